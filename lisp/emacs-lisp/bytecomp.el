@@ -252,6 +252,16 @@ This option is enabled by default because it reduces Emacs memory usage."
   :type 'boolean)
 ;;;###autoload(put 'byte-compile-dynamic-docstrings 'safe-local-variable 'booleanp)
 
+(defcustom byte-compile-fast-load nil
+  "If non-nil, write a fast-load file along with each compiled file.
+When `byte-compile-file' writes FOO.elc, it then also writes FOO.elb,
+which `load' reads faster than FOO.elc; see `load-use-fast-load-files'.
+No fast-load file is written for files holding objects that fast-load
+files cannot represent."
+  :group 'bytecomp
+  :type 'boolean
+  :version "24.4")
+
 (defconst byte-compile-log-buffer "*Compile-Log*"
   "Name of the byte-compiler's log buffer.")
 
@@ -1826,7 +1836,10 @@ The value is non-nil if there were no errors, nil if errors."
 		;; recompiled).  Previously this was accomplished by
 		;; deleting target-file before writing it.
 		(rename-file tempfile target-file t)
-		(message "Wrote %s" target-file))
+		(message "Wrote %s" target-file)
+		(when (and byte-compile-fast-load
+			   (string-match "\\.elc\\'" target-file))
+		  (byte-compile-write-fast-load-file target-file)))
 	    ;; This is just to give a better error message than write-region
 	    (signal 'file-error
 		    (list "Opening output file"
@@ -1845,6 +1858,28 @@ The value is non-nil if there were no errors, nil if errors."
 	    (load target-file))
 	t))))
 
+(defun byte-compile-write-fast-load-file (file)
+  "Write the fast-load file of the compiled file FILE.
+FILE should end in \".elc\"; its fast-load file ends in \".elb\".
+If FILE holds objects that fast-load files cannot represent, just
+say so."
+  (let ((target (concat (file-name-sans-extension file) ".elb"))
+	(contents (condition-case err
+		      (fast-load-file-contents file)
+		    (error
+		     (message "Cannot write fast-load file for %s: %s"
+			      file (error-message-string err))
+		     nil))))
+    (when contents
+      ;; Write to a tempfile for the same reason as the compiled file.
+      (let ((coding-system-for-write 'no-conversion)
+	    (tempfile (make-temp-name target)))
+	(with-temp-buffer
+	  (set-buffer-multibyte nil)
+	  (insert contents)
+	  (write-region nil nil tempfile nil 'silent))
+	(rename-file tempfile target t)))))
+
 ;;; compiling a single function
 ;;;###autoload
 (defun compile-defun (&optional arg)
@@ -47,14 +47,32 @@ The value in the hash table is the cons cell (DIR FILE CALLBACK).")
 ;;;###autoload
 (defun file-notify-handle-event (event)
   "Handle file system monitoring event.
-If EVENT is a filewatch event, call its callback.
+If EVENT is a filewatch event, call its callback.  If it is a
+batch of filewatch events, call the callback of each of them.
 Otherwise, signal a `file-notify-error'."
   (interactive "e")
-  (if (and (eq (car event) 'file-notify)
-	   (>= (length event) 3))
-      (funcall (nth 2 event) (nth 1 event))
+  (cond
+   ((and (eq (car event) 'file-notify)
+	 (>= (length event) 3))
+    (funcall (nth 2 event) (nth 1 event)))
+   ;; `inotify' passes the events it gathers as one event
+   ;; (file-notify ((EVENT CALLBACK) ...)).
+   ((and (eq (car event) 'file-notify)
+	 (= (length event) 2)
+	 (consp (nth 1 event)))
+    ;; An error in one callback must not lose the other events; it
+    ;; is signaled once they have all been handled, as it would be
+    ;; for a single event.
+    (let (first-error)
+      (dolist (ev (nth 1 event))
+	(condition-case err
+	    (funcall (nth 1 ev) (car ev))
+	  (error (unless first-error (setq first-error err)))))
+      (when first-error
+	(signal (car first-error) (cdr first-error)))))
+   (t
     (signal 'file-notify-error
-	    (cons "Not a valid file-notify event" event))))
+	    (cons "Not a valid file-notify event" event)))))
 
 (defvar file-notify--pending-events nil
   "List of pending file notification events for a future `renamed' action.
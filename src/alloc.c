@@ -39,6 +39,7 @@ along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
 #include "puresize.h"
 #include "character.h"
 #include "buffer.h"
+#include "region-cache.h"
 #include "window.h"
 #include "keyboard.h"
 #include "frame.h"
@@ -3105,10 +3106,36 @@ usage: (vector &rest OBJECTS)  */)
   return val;
 }
 
+/* Return a new byte-code object with SIZE slots, all nil.  After its
+   slots, it has COMPILED_CACHE_WORDS words that Lisp does not see,
+   where the byte-code interpreter caches an optimized form of its byte
+   code; they are nil too.  */
+
+Lisp_Object
+make_byte_code_object (ptrdiff_t size)
+{
+  Lisp_Object val;
+  struct Lisp_Vector *p;
+  ptrdiff_t i;
+
+  if (PSEUDOVECTOR_SIZE_MASK < size)
+    error ("Too many elements for a byte-code object");
+  p = allocate_vectorlike (size + COMPILED_CACHE_WORDS);
+  for (i = 0; i < size + COMPILED_CACHE_WORDS; i++)
+    p->contents[i] = Qnil;
+  XSETPVECTYPESIZE (p, PVEC_COMPILED, size, COMPILED_CACHE_WORDS);
+  XSETCOMPILED (val, p);
+  return val;
+}
+
+/* Finish the byte-code object V, made by make_byte_code_object, once
+   its slots are filled.  */
+
 void
 make_byte_code (struct Lisp_Vector *v)
 {
-  if (v->header.size > 1 && STRINGP (v->contents[1])
+  if ((v->header.size & PSEUDOVECTOR_SIZE_MASK) > 1
+      && STRINGP (v->contents[1])
       && STRING_MULTIBYTE (v->contents[1]))
     /* BYTECODE-STRING must have been produced by Emacs 20.2 or the
        earlier because they produced a raw 8-bit string for byte-code
@@ -3116,7 +3143,6 @@ make_byte_code (struct Lisp_Vector *v)
        raw 8-bit characters converted to multibyte form.  Thus, now we
        must convert them back to the original unibyte form.  */
     v->contents[1] = Fstring_as_unibyte (v->contents[1]);
-  XSETPVECTYPE (v, PVEC_COMPILED);
 }
 
 DEFUN ("make-byte-code", Fmake_byte_code, Smake_byte_code, 4, MANY, 0,
@@ -3138,7 +3164,7 @@ usage: (make-byte-code ARGLIST BYTE-CODE CONSTANTS DEPTH &optional DOCSTRING INT
   (ptrdiff_t nargs, Lisp_Object *args)
 {
   ptrdiff_t i;
-  register Lisp_Object val = make_uninit_vector (nargs);
+  register Lisp_Object val = make_byte_code_object (nargs);
   register struct Lisp_Vector *p = XVECTOR (val);
 
   /* We used to purecopy everything here, if purify-flag was set.  This worked
@@ -3152,7 +3178,6 @@ usage: (make-byte-code ARGLIST BYTE-CODE CONSTANTS DEPTH &optional DOCSTRING INT
   for (i = 0; i < nargs; i++)
     p->contents[i] = args[i];
   make_byte_code (p);
-  XSETCOMPILED (val, p);
   return val;
 }
 
@@ -3249,6 +3274,7 @@ Its value is void, and its function definition and property list are nil.  */)
   p->interned = SYMBOL_UNINTERNED;
   p->constant = 0;
   p->declared_special = 0;
+  p->hash = 0;
   consing_since_gc += sizeof (struct Lisp_Symbol);
   symbols_consed++;
   total_free_symbols--;
@@ -3480,6 +3506,7 @@ DEFUN ("make-marker", Fmake_marker, Smake_marker, 0, 0, 0,
   p->next = NULL;
   p->insertion_type = 0;
   p->need_adjustment = 0;
+  p->overlay_indexed = 0;
   return val;
 }
 
@@ -3505,6 +3532,7 @@ build_marker (struct buffer *buf, ptrdiff_t charpos, ptrdiff_t bytepos)
   m->bytepos = bytepos;
   m->insertion_type = 0;
   m->need_adjustment = 0;
+  m->overlay_indexed = 0;
   m->next = BUF_MARKERS (buf);
   BUF_MARKERS (buf) = m;
   return obj;
@@ -5126,17 +5154,22 @@ Does not copy symbols.  Copies strings without text properties.  */)
     {
       register struct Lisp_Vector *vec;
       register ptrdiff_t i;
-      ptrdiff_t size;
+      ptrdiff_t size, words;
 
       size = ASIZE (obj);
       if (size & PSEUDOVECTOR_FLAG)
 	size &= PSEUDOVECTOR_SIZE_MASK;
-      vec = XVECTOR (make_pure_vector (size));
+      words = COMPILEDP (obj) ? COMPILED_CACHE_WORDS : 0;
+      vec = XVECTOR (make_pure_vector (size + words));
       for (i = 0; i < size; i++)
 	vec->contents[i] = Fpurecopy (AREF (obj, i));
       if (COMPILEDP (obj))
 	{
-	  XSETPVECTYPE (vec, PVEC_COMPILED);
+	  /* GC does not mark pure objects, so bytecode.c must keep
+	     alive whatever it caches in these words.  */
+	  for (; i < size + words; i++)
+	    vec->contents[i] = Qnil;
+	  XSETPVECTYPESIZE (vec, PVEC_COMPILED, size, words);
 	  XSETCOMPILED (obj, vec);
 	}
       else
@@ -5674,6 +5707,8 @@ mark_overlay (struct Lisp_Overlay *ptr)
 static void
 mark_buffer (struct buffer *buffer)
 {
+  struct lisp_region_cache *cache;
+
   /* This is handled much like other pseudovectors...  */
   mark_vectorlike ((struct Lisp_Vector *) buffer);
 
@@ -5688,6 +5723,9 @@ mark_buffer (struct buffer *buffer)
   mark_overlay (buffer->overlays_before);
   mark_overlay (buffer->overlays_after);
 
+  for (cache = buffer->lisp_region_caches; cache; cache = cache->next)
+    mark_object (cache->name);
+
   /* If this is an indirect buffer, mark its base buffer.  */
   if (buffer->base_buffer && !VECTOR_MARKED_P (buffer->base_buffer))
     mark_buffer (buffer->base_buffer);
@@ -5841,10 +5879,14 @@ mark_object (Lisp_Object arg)
 		 to save the COMPILED_CONSTANTS element for last and avoid
 		 recursion there.  */
 	      int size = ptr->header.size & PSEUDOVECTOR_SIZE_MASK;
+	      int words = ((ptr->header.size & PSEUDOVECTOR_REST_MASK)
+			   >> PSEUDOVECTOR_SIZE_BITS);
 	      int i;
 
 	      VECTOR_MARK (ptr);
-	      for (i = 0; i < size; i++)
+	      /* The words after the slots, if any, hold the cache of
+		 bytecode.c, and are Lisp objects too.  */
+	      for (i = 0; i < size + words; i++)
 		if (i != COMPILED_CONSTANTS)
 		  mark_object (ptr->contents[i]);
 	      if (size > COMPILED_CONSTANTS)
@@ -152,6 +152,7 @@ static void alloc_buffer_text (struct buffer *, ptrdiff_t);
 static void free_buffer_text (struct buffer *b);
 static struct Lisp_Overlay * copy_overlays (struct buffer *, struct Lisp_Overlay *);
 static void modify_overlay (struct buffer *, ptrdiff_t, ptrdiff_t);
+static void invalidate_overlay_index (struct buffer *);
 static Lisp_Object buffer_lisp_local_variables (struct buffer *, bool);
 
 static void
@@ -546,6 +547,8 @@ even if it is dead.  The return value is never nil.  */)
   /* An ordinary buffer uses its own struct buffer_text.  */
   b->text = &b->own_text;
   b->base_buffer = NULL;
+  b->overlay_index = NULL;
+  memset (&b->undo_log, 0, sizeof b->undo_log);
   /* No one shares the text with us now.  */
   b->indirections = 0;
   /* No one shows us now.  */
@@ -578,6 +581,12 @@ even if it is dead.  The return value is never nil.  */)
   BUF_SAVE_MODIFF (b) = 1;
   BUF_COMPACT (b) = 1;
   set_buffer_intervals (b, NULL);
+  b->text->charpos_cache = NULL;
+  b->text->line_index = NULL;
+  b->text->gap_extra = 0;
+  b->text->gap_moves = 0;
+  b->text->gap_bytes_moved = 0;
+  b->text->gap_reallocs = 0;
   BUF_UNCHANGED_MODIFIED (b) = 1;
   BUF_OVERLAY_UNCHANGED_MODIFIED (b) = 1;
   BUF_END_UNCHANGED (b) = 0;
@@ -588,6 +597,7 @@ even if it is dead.  The return value is never nil.  */)
   b->newline_cache = 0;
   b->width_run_cache = 0;
   b->bidi_paragraph_cache = 0;
+  b->lisp_region_caches = NULL;
   bset_width_table (b, Qnil);
   b->prevent_redisplay_optimizations_p = 1;
 
@@ -703,6 +713,7 @@ clone_per_buffer_values (struct buffer *from, struct buffer *to)
 
   set_buffer_overlays_before (to, copy_overlays (to, from->overlays_before));
   set_buffer_overlays_after (to, copy_overlays (to, from->overlays_after));
+  invalidate_overlay_index (to);
 
   /* Get (a copy of) the alist of Lisp-level local variables of FROM
      and install that in TO.  */
@@ -795,6 +806,8 @@ CLONE nil means the indirect buffer's state is reset to default values.  */)
 
   /* Use the base buffer's text object.  */
   b->text = b->base_buffer->text;
+  b->overlay_index = NULL;
+  memset (&b->undo_log, 0, sizeof b->undo_log);
   /* We have no own text.  */
   b->indirections = -1;
   /* Notify base buffer that we share the text now.  */
@@ -812,6 +825,7 @@ CLONE nil means the indirect buffer's state is reset to default values.  */)
   b->newline_cache = 0;
   b->width_run_cache = 0;
   b->bidi_paragraph_cache = 0;
+  b->lisp_region_caches = NULL;
   bset_width_table (b, Qnil);
 
   name = Fcopy_sequence (name);
@@ -904,6 +918,8 @@ delete_all_overlays (struct buffer *b)
 {
   struct Lisp_Overlay *ov, *next;
 
+  invalidate_overlay_index (b);
+
   /* FIXME: Since each drop_overlay will scan BUF_MARKERS to unlink its
      markers, we have an unneeded O(N^2) behavior here.  */
   for (ov = b->overlays_before; ov; ov = next)
@@ -951,6 +967,7 @@ reset_buffer (register struct buffer *b)
   bset_read_only (b, Qnil);
   set_buffer_overlays_before (b, NULL);
   set_buffer_overlays_after (b, NULL);
+  invalidate_overlay_index (b);
   b->overlay_center = BEG;
   bset_mark_active (b, Qnil);
   bset_point_before_scroll (b, Qnil);
@@ -1479,6 +1496,35 @@ buffer as BUFFER.  */)
   return make_number (BUF_CHARS_MODIFF (buf));
 }
 
+DEFUN ("buffer-gap-statistics", Fbuffer_gap_statistics,
+       Sbuffer_gap_statistics, 0, 1, 0,
+       doc: /* Return statistics about the gap of BUFFER's text.
+The value is a list (MOVES BYTES-MOVED REALLOCATIONS), where MOVES is
+the number of times the gap was moved to another position of the text,
+BYTES-MOVED is the number of bytes of text that were copied to move
+the gap or change its size, including the whole text each time that
+reallocating it moved it elsewhere in memory, and REALLOCATIONS is the
+number of times the text was reallocated to change the size of the
+gap.  These counters only increase; comparing them before and after
+some editing shows how much work the gap caused.  Indirect buffers
+share the counters of their base buffer.  No argument or nil as
+argument means use current buffer as BUFFER.  */)
+  (register Lisp_Object buffer)
+{
+  struct buffer_text *text;
+  if (NILP (buffer))
+    text = current_buffer->text;
+  else
+    {
+      CHECK_BUFFER (buffer);
+      text = XBUFFER (buffer)->text;
+    }
+
+  return list3 (make_fixnum_or_float (text->gap_moves),
+		make_fixnum_or_float (text->gap_bytes_moved),
+		make_fixnum_or_float (text->gap_reallocs));
+}
+
 DEFUN ("rename-buffer", Frename_buffer, Srename_buffer, 1, 2,
        "(list (read-string \"Rename buffer (to new name): \" \
 	      nil 'buffer-name-history (buffer-name (current-buffer))) \
@@ -1675,17 +1721,30 @@ compact_buffer (struct buffer *buffer)
       if (!EQ (buffer->INTERNAL_FIELD (undo_list), Qt))
 	truncate_undo_list (buffer);
 
+      /* Free the space of packed undo records when there are none.  */
+      if (buffer->undo_log.used == 0 && buffer->undo_log.records)
+	{
+	  xfree (buffer->undo_log.records);
+	  buffer->undo_log.records = NULL;
+	  buffer->undo_log.allocated = 0;
+	}
+
       /* Shrink buffer gaps.  */
       if (!buffer->text->inhibit_shrinking)
 	{
 	  /* If a buffer's gap size is more than 10% of the buffer
-	     size, or larger than GAP_BYTES_DFL bytes, then shrink it
-	     accordingly.  Keep a minimum size of GAP_BYTES_MIN bytes.  */
+	     size, or larger than GAP_BYTES_DFL bytes and than the
+	     space reserved by its last enlargement, then shrink it
+	     accordingly.  Keep a minimum size of GAP_BYTES_MIN bytes.
+	     Then reserve less space next time, unless the gap fills
+	     up again soon.  */
 	  ptrdiff_t size = clip_to_bounds (GAP_BYTES_MIN,
 					   BUF_Z_BYTE (buffer) / 10,
-					   GAP_BYTES_DFL);
+					   max (GAP_BYTES_DFL,
+						buffer->text->gap_extra));
 	  if (BUF_GAP_SIZE (buffer) > size)
 	    make_gap_1 (buffer, -(BUF_GAP_SIZE (buffer) - size));
+	  buffer->text->gap_extra /= 2;
 	}
       BUF_COMPACT (buffer) = BUF_MODIFF (buffer);
     }
@@ -1854,6 +1913,9 @@ cleaning up all windows currently displaying the buffer to be killed. */)
   frames_discard_buffer (buffer);
 
   clear_charpos_cache (b);
+  /* This must be done while the markers of the overlays are still in
+     the buffer.  */
+  invalidate_overlay_index (b);
 
   tem = Vinhibit_quit;
   Vinhibit_quit = Qt;
@@ -1961,9 +2023,13 @@ cleaning up all windows currently displaying the buffer to be killed. */)
       free_region_cache (b->bidi_paragraph_cache);
       b->bidi_paragraph_cache = 0;
     }
+  free_lisp_region_caches (b);
   bset_width_table (b, Qnil);
   unblock_input ();
   bset_undo_list (b, Qnil);
+  xfree (b->undo_log.records);
+  b->undo_log.records = NULL;
+  b->undo_log.allocated = 0;
 
   /* Run buffer-list-update-hook.  */
   if (!NILP (Vrun_hooks))
@@ -2132,7 +2198,10 @@ set_buffer_internal_1 (register struct buffer *b)
       /* Put the undo list back in the base buffer, so that it appears
 	 that an indirect buffer shares the undo list of its base.  */
       if (old_buf->base_buffer)
-	bset_undo_list (old_buf->base_buffer, BVAR (old_buf, undo_list));
+	{
+	  unpack_undo_log (old_buf);
+	  bset_undo_list (old_buf->base_buffer, BVAR (old_buf, undo_list));
+	}
 
       /* If the old current buffer has markers to record PT, BEGV and ZV
 	 when it is not current, update them now.  */
@@ -2142,7 +2211,10 @@ set_buffer_internal_1 (register struct buffer *b)
   /* Get the undo list from the base buffer, so that it appears
      that an indirect buffer shares the undo list of its base.  */
   if (b->base_buffer)
-    bset_undo_list (b, BVAR (b->base_buffer, undo_list));
+    {
+      unpack_undo_log (b->base_buffer);
+      bset_undo_list (b, BVAR (b->base_buffer, undo_list));
+    }
 
   /* If the new current buffer has markers to record PT, BEGV and ZV
      when it is not current, fetch them now.  */
@@ -2372,12 +2444,16 @@ DEFUN ("buffer-swap-text", Fbuffer_swap_text, Sbuffer_swap_text,
   swapfield (newline_cache, struct region_cache *);
   swapfield (width_run_cache, struct region_cache *);
   swapfield (bidi_paragraph_cache, struct region_cache *);
+  swapfield (lisp_region_caches, struct lisp_region_cache *);
   current_buffer->prevent_redisplay_optimizations_p = 1;
   other_buffer->prevent_redisplay_optimizations_p = 1;
   swapfield (overlays_before, struct Lisp_Overlay *);
   swapfield (overlays_after, struct Lisp_Overlay *);
   swapfield (overlay_center, ptrdiff_t);
+  invalidate_overlay_index (current_buffer);
+  invalidate_overlay_index (other_buffer);
   swapfield_ (undo_list, Lisp_Object);
+  swapfield (undo_log, struct undo_log);
   swapfield_ (mark, Lisp_Object);
   swapfield_ (enable_multibyte_characters, Lisp_Object);
   swapfield_ (bidi_display_reordering, Lisp_Object);
@@ -2471,12 +2547,15 @@ current buffer is cleared.  */)
   ptrdiff_t begv, zv;
   bool narrowed = (BEG != BEGV || Z != ZV);
   bool modified_p = !NILP (Fbuffer_modified_p (Qnil));
-  Lisp_Object old_undo = BVAR (current_buffer, undo_list);
+  Lisp_Object old_undo;
   struct gcpro gcpro1;
 
   if (current_buffer->base_buffer)
     error ("Cannot do `set-buffer-multibyte' on an indirect buffer");
 
+  unpack_undo_log (current_buffer);
+  old_undo = BVAR (current_buffer, undo_list);
+
   /* Do nothing if nothing actually changes.  */
   if (NILP (flag) == NILP (BVAR (current_buffer, enable_multibyte_characters)))
     return flag;
@@ -2489,6 +2568,7 @@ current buffer is cleared.  */)
 
   /* If the cached position is for this buffer, clear it out.  */
   clear_charpos_cache (current_buffer);
+  clear_line_index (current_buffer);
 
   if (NILP (flag))
     begv = BEGV_BYTE, zv = ZV_BYTE;
@@ -2700,6 +2780,11 @@ current buffer is cleared.  */)
       set_intervals_multibyte (1);
     }
 
+  /* Positions remembered while converting are no longer valid.  */
+  clear_charpos_cache (current_buffer);
+  clear_line_index (current_buffer);
+  note_overlay_positions_changed (current_buffer);
+
   if (!EQ (old_undo, Qt))
     {
       /* Represent all the above changes by a special undo entry.  */
@@ -2807,6 +2892,593 @@ swap_out_buffer_local_variables (struct buffer *b)
     }
 }
 
+/* Overlay index.
+
+   For buffers with many overlays, walking the overlay lists in
+   overlays_at and overlays_in is too slow, even with the lists
+   centered near the position of interest.  Such buffers get an
+   auxiliary index: two treaps holding the overlays, one ordered by
+   start position and the other by end position, with ties broken by
+   address.  Each node of the first tree also records the overlay of
+   its subtree that ends last, so that looking for the overlays that
+   contain a position can skip the subtrees that end before it.
+
+   The trees are ordered by the positions of the overlay markers
+   themselves, so editing the text moves all the overlays in them at
+   once, and their order stays the same except for the overlays with a
+   boundary inside the text being deleted or replaced, or at the place
+   of an insertion if that boundary advances.  Before relocating the
+   markers, insdel.c calls unindex_overlays to take these out of the
+   trees, and they are put back at their new positions the next time
+   the index is used.  Creating, moving and deleting overlays updates
+   the trees directly, so all of this costs O(log N) per overlay
+   concerned.
+
+   The markers of the overlays in the trees have their overlay_indexed
+   flag set.  If such a marker is moved in some other way, as undo
+   does to restore the boundary of an overlay, the index is discarded,
+   to be built again when next needed.  */
+
+/* Don't bother with an index for fewer overlays than this.  */
+enum { OVERLAY_INDEX_THRESHOLD = 64 };
+
+struct overlay_node
+{
+  struct overlay_node *left, *right;
+  struct Lisp_Overlay *overlay;
+
+  /* In the tree ordered by start position, the overlay of this
+     subtree that ends last.  */
+  struct Lisp_Overlay *last_end;
+
+  /* Each tree is a heap with respect to this random number, which
+     keeps it balanced on average.  */
+  EMACS_INT priority;
+};
+
+struct overlay_index
+{
+  /* The overlays ordered by start position and by end position.  */
+  struct overlay_node *by_start, *by_end;
+
+  /* Overlays of the buffer taken out of the trees by
+     unindex_overlays, to be put back when the index is next used,
+     their number and the allocated size of the vector.  */
+  struct Lisp_Overlay **pending;
+  ptrdiff_t npending, pending_size;
+};
+
+static ptrdiff_t
+overlay_start_pos (struct Lisp_Overlay *ov)
+{
+  return XMARKER (ov->start)->charpos;
+}
+
+static ptrdiff_t
+overlay_end_pos (struct Lisp_Overlay *ov)
+{
+  return XMARKER (ov->end)->charpos;
+}
+
+/* Return the position by which the tree BY_END, or the tree by start
+   if !BY_END, orders node N.  */
+
+static ptrdiff_t
+node_pos (struct overlay_node *n, bool by_end)
+{
+  return by_end ? overlay_end_pos (n->overlay) : overlay_start_pos (n->overlay);
+}
+
+/* Return true if overlay OV1 at position POS1 comes before overlay OV2
+   at position POS2.  */
+
+static bool
+overlay_key_less (ptrdiff_t pos1, struct Lisp_Overlay *ov1,
+		  ptrdiff_t pos2, struct Lisp_Overlay *ov2)
+{
+  return pos1 < pos2 || (pos1 == pos2 && (uintptr_t) ov1 < (uintptr_t) ov2);
+}
+
+/* Recompute the information N keeps about its subtree in the tree
+   BY_END, and return N.  */
+
+static struct overlay_node *
+fix_overlay_node (struct overlay_node *n, bool by_end)
+{
+  if (!by_end)
+    {
+      struct Lisp_Overlay *last = n->overlay;
+
+      if (n->left
+	  && overlay_end_pos (n->left->last_end) > overlay_end_pos (last))
+	last = n->left->last_end;
+      if (n->right
+	  && overlay_end_pos (n->right->last_end) > overlay_end_pos (last))
+	last = n->right->last_end;
+      n->last_end = last;
+    }
+  return n;
+}
+
+/* Split the tree T, which is ordered by end if BY_END, into the nodes
+   that come before overlay OV at position POS, stored in *LEFT, and
+   the others, stored in *RIGHT.  */
+
+static void
+split_overlay_tree (struct overlay_node *t, ptrdiff_t pos,
+		    struct Lisp_Overlay *ov, bool by_end,
+		    struct overlay_node **left, struct overlay_node **right)
+{
+  if (!t)
+    *left = *right = NULL;
+  else if (overlay_key_less (node_pos (t, by_end), t->overlay, pos, ov))
+    {
+      split_overlay_tree (t->right, pos, ov, by_end, &t->right, right);
+      *left = fix_overlay_node (t, by_end);
+    }
+  else
+    {
+      split_overlay_tree (t->left, pos, ov, by_end, left, &t->left);
+      *right = fix_overlay_node (t, by_end);
+    }
+}
+
+/* Return the union of the trees LEFT and RIGHT, ordered by end if
+   BY_END, all of whose nodes come before those of RIGHT.  */
+
+static struct overlay_node *
+merge_overlay_trees (struct overlay_node *left, struct overlay_node *right,
+		     bool by_end)
+{
+  if (!left)
+    return right;
+  if (!right)
+    return left;
+  if (left->priority > right->priority)
+    {
+      left->right = merge_overlay_trees (left->right, right, by_end);
+      return fix_overlay_node (left, by_end);
+    }
+  right->left = merge_overlay_trees (left, right->left, by_end);
+  return fix_overlay_node (right, by_end);
+}
+
+/* Insert the node N into the tree T, ordered by end if BY_END, and
+   return the new tree.  */
+
+static struct overlay_node *
+insert_overlay_node (struct overlay_node *t, struct overlay_node *n,
+		     bool by_end)
+{
+  ptrdiff_t pos = node_pos (n, by_end);
+
+  if (!t || n->priority > t->priority)
+    {
+      split_overlay_tree (t, pos, n->overlay, by_end, &n->left, &n->right);
+      return fix_overlay_node (n, by_end);
+    }
+  if (overlay_key_less (pos, n->overlay, node_pos (t, by_end), t->overlay))
+    t->left = insert_overlay_node (t->left, n, by_end);
+  else
+    t->right = insert_overlay_node (t->right, n, by_end);
+  return fix_overlay_node (t, by_end);
+}
+
+/* Delete the node of overlay OV, which is at position POS, from the
+   tree T, ordered by end if BY_END, and return the new tree.  */
+
+static struct overlay_node *
+delete_overlay_node (struct overlay_node *t, ptrdiff_t pos,
+		     struct Lisp_Overlay *ov, bool by_end)
+{
+  eassert (t);
+  if (t->overlay == ov)
+    {
+      struct overlay_node *rest
+	= merge_overlay_trees (t->left, t->right, by_end);
+      xfree (t);
+      return rest;
+    }
+  if (overlay_key_less (pos, ov, node_pos (t, by_end), t->overlay))
+    t->left = delete_overlay_node (t->left, pos, ov, by_end);
+  else
+    t->right = delete_overlay_node (t->right, pos, ov, by_end);
+  return fix_overlay_node (t, by_end);
+}
+
+/* Free the nodes of tree T, and clear the flags of the markers of
+   their overlays.  */
+
+static void
+free_overlay_tree (struct overlay_node *t)
+{
+  while (t)
+    {
+      struct overlay_node *right = t->right;
+
+      free_overlay_tree (t->left);
+      XMARKER (t->overlay->start)->overlay_indexed = 0;
+      XMARKER (t->overlay->end)->overlay_indexed = 0;
+      xfree (t);
+      t = right;
+    }
+}
+
+/* Add overlay OV to the index OI.  */
+
+static void
+index_overlay (struct overlay_index *oi, struct Lisp_Overlay *ov)
+{
+  struct overlay_node *s = xmalloc (sizeof *s);
+  struct overlay_node *e = xmalloc (sizeof *e);
+
+  s->overlay = s->last_end = e->overlay = e->last_end = ov;
+  s->priority = get_random ();
+  e->priority = get_random ();
+  oi->by_start = insert_overlay_node (oi->by_start, s, 0);
+  oi->by_end = insert_overlay_node (oi->by_end, e, 1);
+  XMARKER (ov->start)->overlay_indexed = 1;
+  XMARKER (ov->end)->overlay_indexed = 1;
+}
+
+/* Remove overlay OV, whose markers have not moved since it was put in
+   the trees of OI, from those trees.  */
+
+static void
+remove_overlay_nodes (struct overlay_index *oi, struct Lisp_Overlay *ov)
+{
+  oi->by_start = delete_overlay_node (oi->by_start, overlay_start_pos (ov),
+				      ov, 0);
+  oi->by_end = delete_overlay_node (oi->by_end, overlay_end_pos (ov), ov, 1);
+}
+
+/* Put the overlays taken out of OI back into its trees.  */
+
+static void
+reindex_pending_overlays (struct overlay_index *oi)
+{
+  ptrdiff_t i;
+
+  for (i = 0; i < oi->npending; i++)
+    index_overlay (oi, oi->pending[i]);
+  oi->npending = 0;
+}
+
+/* Discard the overlay index of B, if any.  */
+
+static void
+invalidate_overlay_index (struct buffer *b)
+{
+  struct overlay_index *oi = b->overlay_index;
+
+  if (oi)
+    {
+      free_overlay_tree (oi->by_start);
+      free_overlay_tree (oi->by_end);
+      xfree (oi->pending);
+      xfree (oi);
+      b->overlay_index = NULL;
+    }
+}
+
+/* Discard the overlay indexes of B and of the other buffers sharing
+   its text, because markers in that text were moved other than by
+   editing it.  */
+
+void
+note_overlay_positions_changed (struct buffer *b)
+{
+  struct buffer *other;
+
+  if (!b->base_buffer && b->indirections == 0)
+    invalidate_overlay_index (b);
+  else
+    FOR_EACH_BUFFER (other)
+      if (other->text == b->text)
+	invalidate_overlay_index (other);
+}
+
+/* Take out of the trees of OI, and put in its pending overlays, the
+   overlays in the subtree T of the tree BY_END that start (or end, if
+   BY_END) between FROM and TO inclusive, and that are still in the
+   trees.  If ADVANCING, take only those whose marker there advances
+   at insertions.  */
+
+static void
+collect_moving_overlays (struct overlay_index *oi, struct overlay_node *t,
+			 bool by_end, ptrdiff_t from, ptrdiff_t to,
+			 bool advancing)
+{
+  while (t)
+    {
+      ptrdiff_t pos = node_pos (t, by_end);
+
+      if (from <= pos)
+	collect_moving_overlays (oi, t->left, by_end, from, to, advancing);
+      if (to < pos)
+	break;
+      if (from <= pos)
+	{
+	  struct Lisp_Overlay *ov = t->overlay;
+	  struct Lisp_Marker *m = XMARKER (by_end ? ov->end : ov->start);
+
+	  if (m->overlay_indexed && (!advancing || m->insertion_type))
+	    {
+	      if (oi->npending == oi->pending_size)
+		oi->pending = xpalloc (oi->pending, &oi->pending_size, 1, -1,
+				       sizeof *oi->pending);
+	      oi->pending[oi->npending++] = ov;
+	      XMARKER (ov->start)->overlay_indexed = 0;
+	      XMARKER (ov->end)->overlay_indexed = 0;
+	    }
+	}
+      t = t->right;
+    }
+}
+
+static void
+unindex_overlays_1 (struct overlay_index *oi, ptrdiff_t from, ptrdiff_t to,
+		    bool advancing)
+{
+  ptrdiff_t i = oi->npending;
+
+  collect_moving_overlays (oi, oi->by_start, 0, from, to, advancing);
+  collect_moving_overlays (oi, oi->by_end, 1, from, to, advancing);
+  for (; i < oi->npending; i++)
+    remove_overlay_nodes (oi, oi->pending[i]);
+}
+
+/* Take out of the overlay indexes of the buffers sharing the text of
+   the current buffer the overlays that start or end between FROM and
+   TO inclusive, or if ADVANCING, only those whose marker there
+   advances at insertions.  This is called before relocating the
+   markers in a way that may change the order of those there.  */
+
+void
+unindex_overlays (ptrdiff_t from, ptrdiff_t to, bool advancing)
+{
+  struct buffer *b = current_buffer;
+
+  if (!b->base_buffer && b->indirections == 0)
+    {
+      if (b->overlay_index)
+	unindex_overlays_1 (b->overlay_index, from, to, advancing);
+    }
+  else
+    FOR_EACH_BUFFER (b)
+      if (b->text == current_buffer->text && b->overlay_index)
+	unindex_overlays_1 (b->overlay_index, from, to, advancing);
+}
+
+/* Remove the overlay OV of buffer B from its overlay index.  */
+
+static void
+unindex_overlay (struct buffer *b, struct Lisp_Overlay *ov)
+{
+  struct overlay_index *oi = b->overlay_index;
+
+  if (oi)
+    {
+      reindex_pending_overlays (oi);
+      if (XMARKER (ov->start)->overlay_indexed)
+	{
+	  remove_overlay_nodes (oi, ov);
+	  XMARKER (ov->start)->overlay_indexed = 0;
+	  XMARKER (ov->end)->overlay_indexed = 0;
+	}
+    }
+}
+
+/* Return an up-to-date overlay index for the current buffer, or NULL
+   if it has too few overlays for an index to be worthwhile.  */
+
+static struct overlay_index *
+current_overlay_index (void)
+{
+  struct buffer *b = current_buffer;
+  struct overlay_index *oi = b->overlay_index;
+  struct Lisp_Overlay *tail;
+
+  if (oi)
+    reindex_pending_overlays (oi);
+  else
+    {
+      int n = 0;
+
+      for (tail = b->overlays_before;
+	   tail && n < OVERLAY_INDEX_THRESHOLD; tail = tail->next)
+	n++;
+      for (tail = b->overlays_after;
+	   tail && n < OVERLAY_INDEX_THRESHOLD; tail = tail->next)
+	n++;
+      if (n < OVERLAY_INDEX_THRESHOLD)
+	return NULL;
+
+      oi = b->overlay_index = xzalloc (sizeof *oi);
+      for (tail = b->overlays_before; tail; tail = tail->next)
+	index_overlay (oi, tail);
+      for (tail = b->overlays_after; tail; tail = tail->next)
+	index_overlay (oi, tail);
+    }
+
+  return oi;
+}
+
+/* Store OVERLAY as the IDX'th element of *VEC_PTR, whose allocated
+   size is *LEN_PTR, enlarging it first if needed and EXTEND.  If the
+   vector is full, just count OVERLAY.  Return the new count.  */
+
+static ptrdiff_t
+store_overlay (Lisp_Object overlay, ptrdiff_t idx, bool extend,
+	       Lisp_Object **vec_ptr, ptrdiff_t *len_ptr)
+{
+  if (idx == *len_ptr && extend)
+    *vec_ptr = xpalloc (*vec_ptr, len_ptr, 1, OVERLAY_COUNT_MAX,
+			sizeof **vec_ptr);
+  if (idx < *len_ptr)
+    (*vec_ptr)[idx] = overlay;
+  return idx + 1;
+}
+
+/* Store the overlays of the subtree T of a tree by start that start
+   before BEFORE and end after AFTER.  IDX, EXTEND, VEC_PTR and
+   LEN_PTR are as for store_overlay; return the new count.  */
+
+static ptrdiff_t
+collect_overlays (struct overlay_node *t, ptrdiff_t before, ptrdiff_t after,
+		  ptrdiff_t idx, bool extend,
+		  Lisp_Object **vec_ptr, ptrdiff_t *len_ptr)
+{
+  while (t && overlay_end_pos (t->last_end) > after)
+    {
+      idx = collect_overlays (t->left, before, after, idx, extend,
+			      vec_ptr, len_ptr);
+      if (overlay_start_pos (t->overlay) >= before)
+	break;
+      if (overlay_end_pos (t->overlay) > after)
+	{
+	  Lisp_Object overlay;
+	  XSETMISC (overlay, t->overlay);
+	  idx = store_overlay (overlay, idx, extend, vec_ptr, len_ptr);
+	}
+      t = t->right;
+    }
+  return idx;
+}
+
+/* Likewise, for the empty overlays at POS.  */
+
+static ptrdiff_t
+collect_empty_overlays (struct overlay_node *t, ptrdiff_t pos,
+			ptrdiff_t idx, bool extend,
+			Lisp_Object **vec_ptr, ptrdiff_t *len_ptr)
+{
+  while (t && overlay_end_pos (t->last_end) >= pos)
+    {
+      ptrdiff_t start = overlay_start_pos (t->overlay);
+
+      if (start > pos)
+	t = t->left;
+      else if (start < pos)
+	t = t->right;
+      else
+	{
+	  idx = collect_empty_overlays (t->left, pos, idx, extend,
+					vec_ptr, len_ptr);
+	  if (overlay_end_pos (t->overlay) == pos)
+	    {
+	      Lisp_Object overlay;
+	      XSETMISC (overlay, t->overlay);
+	      idx = store_overlay (overlay, idx, extend, vec_ptr, len_ptr);
+	    }
+	  t = t->right;
+	}
+    }
+  return idx;
+}
+
+/* Return the last start before POS of an overlay in the subtree T of
+   a tree by start that doesn't end before POS, or PTRDIFF_MIN if
+   there is none.  */
+
+static ptrdiff_t
+last_start_before (struct overlay_node *t, ptrdiff_t pos)
+{
+  ptrdiff_t found;
+
+  if (!t || overlay_end_pos (t->last_end) < pos)
+    return PTRDIFF_MIN;
+  if (overlay_start_pos (t->overlay) >= pos)
+    return last_start_before (t->left, pos);
+  found = last_start_before (t->right, pos);
+  if (found == PTRDIFF_MIN && overlay_end_pos (t->overlay) >= pos)
+    found = overlay_start_pos (t->overlay);
+  if (found == PTRDIFF_MIN)
+    found = last_start_before (t->left, pos);
+  return found;
+}
+
+/* overlays_at, using the overlay index OI.  */
+
+static ptrdiff_t
+overlays_at_indexed (struct overlay_index *oi, EMACS_INT pos, bool extend,
+		     Lisp_Object **vec_ptr, ptrdiff_t *len_ptr,
+		     ptrdiff_t *next_ptr, ptrdiff_t *prev_ptr,
+		     bool change_req)
+{
+  ptrdiff_t idx = collect_overlays (oi->by_start, pos + 1, pos, 0, extend,
+				    vec_ptr, len_ptr);
+  struct overlay_node *t;
+
+  if (next_ptr)
+    {
+      /* The first start after POS.  */
+      ptrdiff_t next = ZV;
+
+      for (t = oi->by_start; t; )
+	if (overlay_start_pos (t->overlay) > pos)
+	  {
+	    next = min (next, overlay_start_pos (t->overlay));
+	    t = t->left;
+	  }
+	else
+	  t = t->right;
+      *next_ptr = next;
+    }
+
+  if (prev_ptr)
+    {
+      /* The last start before POS of an overlay that doesn't end
+	 before POS...  */
+      ptrdiff_t prev = max (BEGV, last_start_before (oi->by_start, pos));
+
+      /* ... the last end before POS ...  */
+      for (t = oi->by_end; t; )
+	if (overlay_end_pos (t->overlay) < pos)
+	  {
+	    prev = max (prev, overlay_end_pos (t->overlay));
+	    t = t->right;
+	  }
+	else
+	  t = t->left;
+
+      /* ... or POS itself, if an empty overlay is there.  */
+      if (!change_req)
+	{
+	  Lisp_Object *none = NULL;
+	  ptrdiff_t zero = 0;
+	  if (collect_empty_overlays (oi->by_start, pos, 0, 0, &none, &zero))
+	    prev = pos;
+	}
+
+      *prev_ptr = prev;
+    }
+
+  return idx;
+}
+
+/* overlays_in, using the overlay index OI.  */
+
+static ptrdiff_t
+overlays_in_indexed (struct overlay_index *oi, EMACS_INT beg, EMACS_INT end,
+		     bool extend, Lisp_Object **vec_ptr, ptrdiff_t *len_ptr)
+{
+  /* Overlays that overlap the range...  */
+  ptrdiff_t idx = collect_overlays (oi->by_start, end, beg, 0, extend,
+				    vec_ptr, len_ptr);
+
+  /* ... empty overlays at BEG ...  */
+  idx = collect_empty_overlays (oi->by_start, beg, idx, extend,
+				vec_ptr, len_ptr);
+
+  /* ... and empty overlays at the end of the buffer.  */
+  if (end == Z && end != beg)
+    idx = collect_empty_overlays (oi->by_start, end, idx, extend,
+				  vec_ptr, len_ptr);
+
+  return idx;
+}
+
 /* Find all the overlays in the current buffer that contain position POS.
    Return the number found, and store them in a vector in *VEC_PTR.
    Store in *LEN_PTR the size allocated for the vector.
@@ -2842,6 +3514,11 @@ overlays_at (EMACS_INT pos, bool extend, Lisp_Object **vec_ptr,
   ptrdiff_t next = ZV;
   ptrdiff_t prev = BEGV;
   bool inhibit_storing = 0;
+  struct overlay_index *oi = current_overlay_index ();
+
+  if (oi)
+    return overlays_at_indexed (oi, pos, extend, vec_ptr, len_ptr,
+				next_ptr, prev_ptr, change_req);
 
   for (tail = current_buffer->overlays_before; tail; tail = tail->next)
     {
@@ -2949,11 +3626,6 @@ overlays_at (EMACS_INT pos, bool extend, Lisp_Object **vec_ptr,
 
    Return the number found, and store them in a vector in *VEC_PTR.
    Store in *LEN_PTR the size allocated for the vector.
-   Store in *NEXT_PTR the next position after POS where an overlay starts,
-     or ZV if there are no more overlays.
-   Store in *PREV_PTR the previous position before POS where an overlay ends,
-     or BEGV if there are no previous overlays.
-   NEXT_PTR and/or PREV_PTR may be 0, meaning don't store that info.
 
    *VEC_PTR and *LEN_PTR should contain a valid vector and size
    when this function is called.
@@ -2965,18 +3637,19 @@ overlays_at (EMACS_INT pos, bool extend, Lisp_Object **vec_ptr,
 
 static ptrdiff_t
 overlays_in (EMACS_INT beg, EMACS_INT end, bool extend,
-	     Lisp_Object **vec_ptr, ptrdiff_t *len_ptr,
-	     ptrdiff_t *next_ptr, ptrdiff_t *prev_ptr)
+	     Lisp_Object **vec_ptr, ptrdiff_t *len_ptr)
 {
   Lisp_Object overlay, ostart, oend;
   struct Lisp_Overlay *tail;
   ptrdiff_t idx = 0;
   ptrdiff_t len = *len_ptr;
   Lisp_Object *vec = *vec_ptr;
-  ptrdiff_t next = ZV;
-  ptrdiff_t prev = BEGV;
   bool inhibit_storing = 0;
   bool end_is_Z = end == Z;
+  struct overlay_index *oi = current_overlay_index ();
+
+  if (oi)
+    return overlays_in_indexed (oi, beg, end, extend, vec_ptr, len_ptr);
 
   for (tail = current_buffer->overlays_before; tail; tail = tail->next)
     {
@@ -2988,11 +3661,7 @@ overlays_in (EMACS_INT beg, EMACS_INT end, bool extend,
       oend = OVERLAY_END (overlay);
       endpos = OVERLAY_POSITION (oend);
       if (endpos < beg)
-	{
-	  if (prev < endpos)
-	    prev = endpos;
-	  break;
-	}
+	break;
       startpos = OVERLAY_POSITION (ostart);
       /* Count an interval if it overlaps the range, is empty at the
 	 start of the range, or is empty at END provided END denotes the
@@ -3021,8 +3690,6 @@ overlays_in (EMACS_INT beg, EMACS_INT end, bool extend,
 	  /* Keep counting overlays even if we can't return them all.  */
 	  idx++;
 	}
-      else if (startpos < next)
-	next = startpos;
     }
 
   for (tail = current_buffer->overlays_after; tail; tail = tail->next)
@@ -3035,11 +3702,7 @@ overlays_in (EMACS_INT beg, EMACS_INT end, bool extend,
       oend = OVERLAY_END (overlay);
       startpos = OVERLAY_POSITION (ostart);
       if (end < startpos)
-	{
-	  if (startpos < next)
-	    next = startpos;
-	  break;
-	}
+	break;
       endpos = OVERLAY_POSITION (oend);
       /* Count an interval if it overlaps the range, is empty at the
 	 start of the range, or is empty at END provided END denotes the
@@ -3065,14 +3728,8 @@ overlays_in (EMACS_INT beg, EMACS_INT end, bool extend,
 	    vec[idx] = overlay;
 	  idx++;
 	}
-      else if (endpos < beg && endpos > prev)
-	prev = endpos;
     }
 
-  if (next_ptr)
-    *next_ptr = next;
-  if (prev_ptr)
-    *prev_ptr = prev;
   return idx;
 }
 
@@ -3090,11 +3747,11 @@ mouse_face_overlay_overlaps (Lisp_Object overlay)
 
   size = 10;
   v = alloca (size * sizeof *v);
-  n = overlays_in (start, end, 0, &v, &size, NULL, NULL);
+  n = overlays_in (start, end, 0, &v, &size);
   if (n > size)
     {
       v = alloca (n * sizeof *v);
-      overlays_in (start, end, 0, &v, &n, NULL, NULL);
+      overlays_in (start, end, 0, &v, &n);
     }
 
   for (i = 0; i < n; ++i)
@@ -3896,6 +4553,8 @@ for the rear of the overlay advance when text is inserted there
     }
   /* This puts it in the right list, and in the right order.  */
   recenter_overlay_lists (b, b->overlay_center);
+  if (b->overlay_index)
+    index_overlay (b->overlay_index, XOVERLAY (overlay));
 
   /* We don't need to redisplay the region covered by the overlay, because
      the overlay has no properties at the moment.  */
@@ -3959,6 +4618,7 @@ unchain_both (struct buffer *b, Lisp_Object overlay)
   set_buffer_overlays_before (b, unchain_overlay (b->overlays_before, ov));
   set_buffer_overlays_after (b, unchain_overlay (b->overlays_after, ov));
   eassert (XOVERLAY (overlay)->next == NULL);
+  unindex_overlay (b, ov);
 }
 
 DEFUN ("move-overlay", Fmove_overlay, Smove_overlay, 3, 4, 0,
@@ -4060,6 +4720,8 @@ buffer.  */)
 
   /* This puts it in the right list, and in the right order.  */
   recenter_overlay_lists (b, b->overlay_center);
+  if (b->overlay_index)
+    index_overlay (b->overlay_index, XOVERLAY (overlay));
 
   return unbind_to (count, overlay);
 }
@@ -4211,8 +4873,7 @@ end of the buffer.  */)
 
   /* Put all the overlays we want in a vector in overlay_vec.
      Store the length in len.  */
-  noverlays = overlays_in (XINT (beg), XINT (end), 1, &overlay_vec, &len,
-			   NULL, NULL);
+  noverlays = overlays_in (XINT (beg), XINT (end), 1, &overlay_vec, &len);
 
   /* Make a list of them all.  */
   result = Flist (noverlays, overlay_vec);
@@ -5081,8 +5742,10 @@ void
 enlarge_buffer_text (struct buffer *b, ptrdiff_t delta)
 {
   void *p;
-  ptrdiff_t nbytes = (BUF_Z_BYTE (b) - BUF_BEG_BYTE (b) + BUF_GAP_SIZE (b) + 1
-		      + delta);
+  unsigned char *old_beg = b->text->beg;
+  ptrdiff_t old_nbytes = (BUF_Z_BYTE (b) - BUF_BEG_BYTE (b)
+			  + BUF_GAP_SIZE (b) + 1);
+  ptrdiff_t nbytes = old_nbytes + delta;
   block_input ();
 #if defined USE_MMAP_FOR_BUFFERS
   p = mmap_realloc ((void **) &b->text->beg, nbytes);
@@ -5099,6 +5762,11 @@ enlarge_buffer_text (struct buffer *b, ptrdiff_t delta)
     }
 
   BUF_BEG_ADDR (b) = p;
+  b->text->gap_reallocs++;
+  /* Text that could not grow in place was copied elsewhere.  There
+     is nothing to copy when mapping the text of a dumped buffer.  */
+  if (old_beg && p != old_beg)
+    b->text->gap_bytes_moved += min (old_nbytes, nbytes);
   unblock_input ();
 }
 
@@ -5108,6 +5776,9 @@ enlarge_buffer_text (struct buffer *b, ptrdiff_t delta)
 static void
 free_buffer_text (struct buffer *b)
 {
+  clear_charpos_cache (b);
+  clear_line_index (b);
+
   block_input ();
 
 #if defined USE_MMAP_FOR_BUFFERS
@@ -6166,6 +6837,11 @@ become slightly slower (because of the overhead of consulting the
 cache), and the caches will use memory roughly proportional to the
 number of newlines and characters whose screen width varies.
 
+In large buffers, `cache-long-scans' also makes Emacs remember how
+many lines precede some positions, so that moving over many lines with
+`forward-line', or counting them with `count-lines' or
+`line-number-at-pos', takes about the same time however far it goes.
+
 Bidirectional editing also requires buffer scans to find paragraph
 separators.  If you have large paragraphs or no paragraph separators
 at all, these scans may be slow.  If `cache-long-scans' is non-nil,
@@ -6317,6 +6993,7 @@ and `bury-buffer-internal'.  */);
   defsubr (&Sset_buffer_modified_p);
   defsubr (&Sbuffer_modified_tick);
   defsubr (&Sbuffer_chars_modified_tick);
+  defsubr (&Sbuffer_gap_statistics);
   defsubr (&Srename_buffer);
   defsubr (&Sother_buffer);
   defsubr (&Sbuffer_enable_undo);
@@ -314,11 +314,31 @@ extern void enlarge_buffer_text (struct buffer *, ptrdiff_t);
 #define BUF_BYTES_MAX \
   (ptrdiff_t) min (MOST_POSITIVE_FIXNUM - 1, min (SIZE_MAX, PTRDIFF_MAX))
 
-/* Maximum gap size after compact_buffer, in bytes.  Also
-   used in make_gap_larger to get some extra reserved space.  */
+/* Extra space that make_gap_larger reserves when it first enlarges
+   the gap of a buffer, in bytes.  Also the maximum gap size after
+   compact_buffer for buffers whose gap has not grown much lately.  */
 
 #define GAP_BYTES_DFL 2000
 
+/* make_gap_larger doubles the extra space it reserves each time it
+   enlarges the gap again, up to GAP_BYTES_GROWTH_MAX bytes, so that
+   text that arrives in many chunks, such as process output, does not
+   reallocate the buffer text for each chunk.  compact_buffer halves
+   it again.  */
+
+#define GAP_BYTES_GROWTH_MAX (64 * 1024)
+
+/* In a buffer of more than GAP_BYTES_GROWTH_MAX * GAP_FRACTION bytes,
+   make_gap_larger reserves at least 1 / GAP_FRACTION of the text size,
+   from the first time it enlarges the gap.  Enlarging the gap moves
+   all the text after it, so in a huge buffer a series of insertions
+   would otherwise cost many times the size of the buffer in memory
+   traffic.  compact_buffer still shrinks the gap to the space reserved
+   last, and halves that, when the buffer has changed since the last
+   garbage collection.  */
+
+#define GAP_FRACTION 64
+
 /* Minimum gap size after compact_buffer, in bytes.  Also
    used in make_gap_smaller to avoid too small gap size.  */
 
@@ -475,12 +495,52 @@ struct buffer_text
        to move a marker within a buffer.  */
     struct Lisp_Marker *markers;
 
+    /* Known correspondences between character and byte positions,
+       used to speed up conversions between them; see marker.c.  */
+    struct charpos_cache *charpos_cache;
+
+    /* Known numbers of newlines before some byte positions, used to
+       count lines quickly in large buffers; see search.c.  */
+    struct line_index *line_index;
+
+    /* Extra space reserved by the last enlargement of the gap; see
+       GAP_BYTES_GROWTH_MAX.  */
+    ptrdiff_t gap_extra;
+
+    /* Statistics for `buffer-gap-statistics'.  */
+    EMACS_INT gap_moves;	/* Number of times the gap was moved.  */
+    EMACS_INT gap_bytes_moved;	/* Bytes of text moved to move or
+				   resize the gap.  */
+    EMACS_INT gap_reallocs;	/* Number of reallocations of the
+				   text.  */
+
     /* Usually 0.  Temporarily set to 1 in decode_coding_gap to
        prevent Fgarbage_collect from shrinking the gap and losing
        not-yet-decoded bytes.  */
     bool inhibit_shrinking;
   };
 
+/* The most recent undo records of a buffer, kept in packed form
+   instead of as conses on its undo_list when `undo-packed-records' is
+   non-nil.  They are put on undo_list, in front of the older records,
+   as soon as something else looks at the list; see undo.c.  */
+
+struct undo_log
+  {
+    /* The records, one after another, oldest first.  */
+    char *records;
+
+    /* Number of bytes used and allocated in RECORDS.  */
+    ptrdiff_t used, allocated;
+
+    /* Offset in RECORDS of the most recent record.  */
+    ptrdiff_t last;
+
+    /* How many bytes the records would take on undo_list, as counted
+       by truncate_undo_list.  */
+    EMACS_INT lisp_size;
+  };
+
 /* Most code should use this macro to access Lisp fields in struct buffer.  */
 
 #define BVAR(buf, field) ((buf)->INTERNAL_FIELD (field))
@@ -847,6 +907,10 @@ struct buffer
   struct region_cache *width_run_cache;
   struct region_cache *bidi_paragraph_cache;
 
+  /* Region caches made from Lisp; see region-cache.c.  Always NULL in
+     indirect buffers, which use those of their base buffer.  */
+  struct lisp_region_cache *lisp_region_caches;
+
   /* Non-zero means don't use redisplay optimizations for
      displaying this buffer.  */
   unsigned prevent_redisplay_optimizations_p : 1;
@@ -865,6 +929,12 @@ struct buffer
   /* Position where the overlay lists are centered.  */
   ptrdiff_t overlay_center;
 
+  /* Index of the overlays, for buffers that have many; see buffer.c.  */
+  struct overlay_index *overlay_index;
+
+  /* Undo records not yet put on undo_list.  */
+  struct undo_log undo_log;
+
   /* Changes in the buffer are recorded here for undo, and t means
      don't record anything.  This information belongs to the base
      buffer of an indirect buffer.  But we can't store it in the
@@ -959,6 +1029,8 @@ BUFFER_INLINE void
 bset_undo_list (struct buffer *b, Lisp_Object val)
 {
   b->INTERNAL_FIELD (undo_list) = val;
+  b->undo_log.used = 0;
+  b->undo_log.lisp_size = 0;
 }
 BUFFER_INLINE void
 bset_upcase_table (struct buffer *b, Lisp_Object val)
@@ -1076,6 +1148,8 @@ extern void set_buffer_temp (struct buffer *);
 extern Lisp_Object buffer_local_value_1 (Lisp_Object, Lisp_Object);
 extern void record_buffer (Lisp_Object);
 extern void fix_overlays_before (struct buffer *, ptrdiff_t, ptrdiff_t);
+extern void note_overlay_positions_changed (struct buffer *);
+extern void unindex_overlays (ptrdiff_t, ptrdiff_t, bool);
 extern void mmap_set_vars (bool);
 extern void restore_buffer (Lisp_Object);
 extern void set_buffer_if_live (Lisp_Object);
@@ -1319,17 +1393,26 @@ set_per_buffer_default (int offset, Lisp_Object value)
 }
 
 /* Functions to get and set buffer-local value of the per-buffer
-   variable at offset OFFSET in the buffer structure.  */
+   variable at offset OFFSET in the buffer structure.  Getting
+   undo_list first puts the packed undo records on it, and setting it
+   discards them.  */
 
 BUFFER_INLINE Lisp_Object
 per_buffer_value (struct buffer *b, int offset)
 {
+  if (offset == PER_BUFFER_VAR_OFFSET (undo_list))
+    unpack_undo_log (b);
   return *(Lisp_Object *)(offset + (char *) b);
 }
 
 BUFFER_INLINE void
 set_per_buffer_value (struct buffer *b, int offset, Lisp_Object value)
 {
+  if (offset == PER_BUFFER_VAR_OFFSET (undo_list))
+    {
+      b->undo_log.used = 0;
+      b->undo_log.lisp_size = 0;
+    }
   *(Lisp_Object *)(offset + (char *) b) = value;
 }
 
@@ -278,12 +278,45 @@ DEFINE (BdiscardN,   0266)						\
 									\
 DEFINE (Bconstant, 0300)
 
+/* Superinstructions, each of which does what a pair of the
+   instructions above does.  The compiler never emits them; they only
+   appear in the optimized byte code made by optimize_byte_code, so
+   they use opcodes that are free above.  Each is followed by the
+   operand of its first instruction, if any, then that of its second,
+   each in one byte, except that a jump target takes two bytes.  */
+
+#define BYTE_CODE_PAIRS							\
+PAIR (Bstack_ref_car, 060, Bstack_ref, Bcar)				\
+PAIR (Bstack_ref_cdr, 061, Bstack_ref, Bcdr)				\
+PAIR (Bvarref_car, 062, Bvarref, Bcar)					\
+PAIR (Bvarref_cdr, 063, Bvarref, Bcdr)					\
+PAIR (Bcdr_car, 064, Bcdr, Bcar)					\
+PAIR (Bstack_ref_stack_ref, 065, Bstack_ref, Bstack_ref)		\
+PAIR (Bconstant_call, 066, Bconstant, Bcall)				\
+PAIR (Bconstant_eq, 067, Bconstant, Beq)				\
+									\
+PAIR (Bcar_stack_set, 0200, Bcar, Bstack_set)				\
+PAIR (Bcdr_stack_set, 0251, Bcdr, Bstack_set)				\
+PAIR (Badd1_stack_set, 0264, Badd1, Bstack_set)				\
+PAIR (Bstack_set_goto, 0265, Bstack_set, Bgoto)				\
+									\
+PAIR (Bstack_ref_gotoifnil, 0267, Bstack_ref, Bgotoifnil)		\
+PAIR (Bvarref_gotoifnil, 0270, Bvarref, Bgotoifnil)			\
+PAIR (Bdup_gotoifnil, 0271, Bdup, Bgotoifnil)				\
+PAIR (Beq_gotoifnil, 0272, Beq, Bgotoifnil)				\
+PAIR (Beq_gotoifnonnil, 0273, Beq, Bgotoifnonnil)			\
+PAIR (Blss_gotoifnil, 0274, Blss, Bgotoifnil)
+
 enum byte_code_op
 {
 #define DEFINE(name, value) name = value,
     BYTE_CODES
 #undef DEFINE
 
+#define PAIR(name, value, first, second) name = value,
+    BYTE_CODE_PAIRS
+#undef PAIR
+
 #ifdef BYTE_CODE_SAFE
     Bscan_buffer = 0153, /* No longer generated as of v18.  */
     Bset_mark = 0163, /* this loser is no longer generated as of v18 */
@@ -364,6 +397,94 @@ mark_byte_stack (void)
 }
 #endif
 
+/* Inline caches for calls.
+
+   Each call instruction that calls a symbol has an entry in
+   call_cache, found from the address of the instruction, that
+   records the symbol and its definition, with any aliases followed.
+   An entry is made only when the definition can be called by
+   funcall_known with the number of arguments of the call, so a hit
+   skips looking up the definition and checking it in Ffuncall.
+
+   Entries are valid only as long as call_cache_epoch keeps the value
+   it had when they were made.  `fset', `defalias' and `fmakunbound'
+   change it, since they may change the definition of any symbol that
+   leads to the one they set, and so does GC, which does not mark the
+   definitions recorded and may move or free byte-code strings.  */
+
+struct call_cache
+{
+  /* The byte after the call instruction.  */
+  const unsigned char *pc;
+
+  /* Value of call_cache_epoch when this entry was made.  */
+  EMACS_UINT epoch;
+
+  /* The symbol called, and its definition.  */
+  Lisp_Object symbol, function;
+};
+
+#define CALL_CACHE_SIZE 1024
+
+static struct call_cache call_cache[CALL_CACHE_SIZE];
+
+/* Start at 1, so that the entries of call_cache are invalid.  */
+
+static EMACS_UINT call_cache_epoch = 1;
+
+/* Make all entries of call_cache invalid.  */
+
+void
+invalidate_call_caches (void)
+{
+  call_cache_epoch++;
+}
+
+/* Return the definition of the symbol or function FUN called with
+   NARGS arguments by the call instruction before PC, or nil if
+   funcall_known cannot call it.  */
+
+static Lisp_Object
+call_cache_lookup (const unsigned char *pc, Lisp_Object fun, ptrdiff_t nargs)
+{
+  struct call_cache *entry = &call_cache[(uintptr_t) pc % CALL_CACHE_SIZE];
+  Lisp_Object symbol = fun;
+
+  if (entry->pc == pc && entry->epoch == call_cache_epoch
+      && EQ (entry->symbol, symbol))
+    return entry->function;
+
+  if (SYMBOLP (fun))
+    {
+      if (NILP (fun))
+	return Qnil;
+      fun = XSYMBOL (fun)->function;
+      if (SYMBOLP (fun))
+	fun = indirect_function (fun);
+    }
+
+  if (SUBRP (fun))
+    {
+      if (nargs < XSUBR (fun)->min_args
+	  || XSUBR (fun)->max_args == UNEVALLED
+	  || (XSUBR (fun)->max_args >= 0 && XSUBR (fun)->max_args < nargs))
+	return Qnil;
+    }
+  else if (! (COMPILEDP (fun)
+	      && INTEGERP (AREF (fun, COMPILED_ARGLIST))
+	      && STRINGP (AREF (fun, COMPILED_BYTECODE))))
+    return Qnil;
+
+  if (SYMBOLP (symbol))
+    {
+      entry->pc = pc;
+      entry->epoch = call_cache_epoch;
+      entry->symbol = symbol;
+      entry->function = fun;
+    }
+  return fun;
+}
+
 /* Unmark objects in the stacks on byte_stack_list.  Relocate program
    counters.  Called when GC has completed.  */
 
@@ -381,8 +502,348 @@ unmark_byte_stack (void)
 	  stack->pc = stack->byte_string_start + offset;
 	}
     }
+
+  invalidate_call_caches ();
 }
 
+
+/* Optimized byte code.
+
+   When `byte-code-optimize' is non-nil, the first call of a byte-code
+   function translates its byte code into a form the interpreter runs
+   in fewer dispatches, and later calls run that instead.  The
+   translation replaces the pairs of instructions in BYTE_CODE_PAIRS
+   with single superinstructions, and runs of discards with one
+   BdiscardN, then rewrites jump targets to match.  It leaves a pair
+   alone if a jump lands on its second instruction.  The byte-code
+   slot of the function is not changed, so `disassemble' and the
+   debugger still see what the compiler produced.
+
+   The result is cached in the words after the slots of the function
+   (see COMPILED_CACHE_WORDS): the first holds the byte-code string
+   translated, so that a function whose byte code changes is
+   translated again, and the second the translation, or t if it is
+   not worth running.  The results are also kept in
+   byte_code_optimized, a weak table keyed by the byte-code string,
+   so that the closures made from one lambda share a translation, and
+   so that the translations of pure functions, which GC does not mark,
+   stay alive.  */
+
+static Lisp_Object byte_code_optimized;
+
+static Lisp_Object Qbyte_code_function_p;
+
+/* Return the number of bytes of operand that follow opcode OP, as
+   decoded by decode_byte_code, in a superinstruction.  */
+
+static int
+pair_operand_length (int op)
+{
+  switch (op)
+    {
+    case Bstack_ref: case Bvarref: case Bconstant:
+    case Bcall: case Bstack_set:
+      return 1;
+    case Bgoto: case Bgotoifnil: case Bgotoifnonnil:
+      return 2;
+    default:
+      return 0;
+    }
+}
+
+/* Return true if OP is a jump with an absolute target.  */
+
+static bool
+byte_code_jump_p (int op)
+{
+  return Bgoto <= op && op <= Bgotoifnonnilelsepop;
+}
+
+/* Return true if CODE is the opcode of an instruction in BYTE_CODES.  */
+
+static bool
+byte_code_known_p (int code)
+{
+  switch (code)
+    {
+#define DEFINE(name, value) case name:
+      BYTE_CODES
+#undef DEFINE
+      return 1;
+
+    default:
+      return 0;
+    }
+}
+
+/* Decode the instruction at PC, where END is the end of the byte
+   code.  Store in *OP its opcode, with any operand folded into it
+   taken out, and in *ARG its operand, or 0 if it has none.  Return
+   its length, or 0 if it is not one that optimize_byte_code knows how
+   to translate.  */
+
+static int
+decode_byte_code (const unsigned char *pc, const unsigned char *end,
+		  int *op, int *arg)
+{
+  int code = pc[0];
+  int length = 1;
+
+  *op = code;
+  *arg = 0;
+  if (code >= Bconstant)
+    {
+      *op = Bconstant;
+      *arg = code - Bconstant;
+    }
+  else if (code < Bnth)
+    {
+      /* An instruction with its operand in its low three bits, or in
+	 the one or two bytes after it.  */
+      if (code >= Bunbind + 8 || code == Bstack_ref)
+	return 0;
+      *op = code & ~7;
+      *arg = code & 7;
+      if (*arg == 6)
+	length = 2;
+      else if (*arg == 7)
+	length = 3;
+    }
+  else
+    switch (code)
+      {
+      case Bconstant2:
+	*op = Bconstant;
+	length = 3;
+	break;
+
+      case Bgoto: case Bgotoifnil: case Bgotoifnonnil:
+      case Bgotoifnilelsepop: case Bgotoifnonnilelsepop:
+	length = 3;
+	break;
+
+      case Bstack_set2:
+	*op = Bstack_set;
+	length = 3;
+	break;
+
+      case BlistN: case BconcatN: case BinsertN:
+      case Bstack_set: case BdiscardN:
+	length = 2;
+	break;
+
+      case BRgoto: case BRgotoifnil: case BRgotoifnonnil:
+      case BRgotoifnilelsepop: case BRgotoifnonnilelsepop:
+	/* The compiler never emits relative jumps.  */
+	return 0;
+
+      default:
+	if (!byte_code_known_p (code))
+	  return 0;
+      }
+
+  if (end - pc < length)
+    return 0;
+  if (length == 2)
+    *arg = pc[1];
+  else if (length == 3)
+    *arg = pc[1] + (pc[2] << 8);
+  return length;
+}
+
+/* Return the translation of the byte-code string BYTESTR into
+   optimized byte code, or t if it has nothing to gain from one or
+   cannot be translated.  */
+
+static Lisp_Object
+optimize_byte_code (Lisp_Object bytestr)
+{
+  static const unsigned char pairs[][3] =
+    {
+#define PAIR(name, value, first, second) { first, second, name },
+      BYTE_CODE_PAIRS
+#undef PAIR
+    };
+  const unsigned char *code = SDATA (bytestr);
+  ptrdiff_t length = SBYTES (bytestr);
+  const unsigned char *end = code + length;
+  ptrdiff_t i, j, k, out, fused = 0;
+  int op, arg, op2, arg2, n, p;
+  /* For each offset in BYTESTR, 1 if an instruction starts there, 2
+     if a jump lands there, 3 for both.  */
+  unsigned char *starts;
+  /* For each offset where an instruction starts, its offset in the
+     translation.  */
+  ptrdiff_t *offsets;
+  /* Where the targets of the jumps in the translation are, and where
+     they should go in BYTESTR.  */
+  ptrdiff_t *jumps, *targets, njumps = 0;
+  unsigned char *result;
+  Lisp_Object val = Qt;
+  USE_SAFE_ALLOCA;
+
+  if (STRING_MULTIBYTE (bytestr) || length == 0)
+    return Qt;
+
+  SAFE_NALLOCA (starts, 1, length + 1);
+  SAFE_NALLOCA (offsets, 1, length + 1);
+  SAFE_NALLOCA (jumps, 2, length / 3 + 1);
+  targets = jumps + length / 3 + 1;
+  /* A superinstruction may be a byte longer than its pair.  */
+  SAFE_NALLOCA (result, 2, length);
+  memset (starts, 0, length + 1);
+
+  /* Check that every instruction can be decoded, and find where jumps
+     land.  */
+  for (i = 0; i < length; i += n)
+    {
+      n = decode_byte_code (code + i, end, &op, &arg);
+      if (n == 0)
+	goto done;
+      starts[i] |= 1;
+      if (byte_code_jump_p (op))
+	{
+	  if (arg >= length)
+	    goto done;
+	  starts[arg] |= 2;
+	}
+    }
+  for (i = 0; i < length; i++)
+    if (starts[i] == 2)
+      goto done;
+
+  /* Translate, recording the jumps to fix up below.  */
+  for (i = out = 0; i < length; i = j)
+    {
+      n = decode_byte_code (code + i, end, &op, &arg);
+      j = i + n;
+      offsets[i] = out;
+
+      if (op == Bdiscard || (op == BdiscardN && arg < 0x80))
+	{
+	  /* Fold a run of discards that no jump lands in.  */
+	  int count = op == Bdiscard ? 1 : arg;
+
+	  for (k = j; k < length && starts[k] == 1; k += n)
+	    {
+	      n = decode_byte_code (code + k, end, &op2, &arg2);
+	      if (op2 == Bdiscard)
+		arg2 = 1;
+	      else if (! (op2 == BdiscardN && arg2 < 0x80))
+		break;
+	      if (count + arg2 >= 0x80)
+		break;
+	      count += arg2;
+	    }
+	  if (k > j)
+	    {
+	      for (; j < k; j += n)
+		{
+		  offsets[j] = out;
+		  n = decode_byte_code (code + j, end, &op2, &arg2);
+		}
+	      result[out++] = BdiscardN;
+	      result[out++] = count;
+	      fused++;
+	      continue;
+	    }
+	}
+      else if (j < length && starts[j] == 1)
+	{
+	  /* Look for a pair that starts here.  */
+	  n = decode_byte_code (code + j, end, &op2, &arg2);
+	  for (p = 0; p < sizeof pairs / sizeof *pairs; p++)
+	    if (pairs[p][0] == op && pairs[p][1] == op2
+		&& (pair_operand_length (op) != 1 || arg <= 0xFF)
+		&& (pair_operand_length (op2) != 1 || arg2 <= 0xFF))
+	      break;
+	  if (p < sizeof pairs / sizeof *pairs)
+	    {
+	      result[out++] = pairs[p][2];
+	      if (pair_operand_length (op) == 1)
+		result[out++] = arg;
+	      if (pair_operand_length (op2) == 1)
+		result[out++] = arg2;
+	      else if (pair_operand_length (op2) == 2)
+		{
+		  jumps[njumps] = out;
+		  targets[njumps++] = arg2;
+		  out += 2;
+		}
+	      offsets[j] = out;
+	      fused++;
+	      j += n;
+	      continue;
+	    }
+	}
+
+      memcpy (result + out, code + i, j - i);
+      if (byte_code_jump_p (op))
+	{
+	  jumps[njumps] = out + 1;
+	  targets[njumps++] = arg;
+	}
+      out += j - i;
+    }
+
+  if (fused == 0 || out > 0xFFFF)
+    goto done;
+
+  for (i = 0; i < njumps; i++)
+    {
+      result[jumps[i]] = offsets[targets[i]] & 0xFF;
+      result[jumps[i] + 1] = offsets[targets[i]] >> 8;
+    }
+  val = make_unibyte_string ((char *) result, out);
+
+ done:
+  SAFE_FREE ();
+  return val;
+}
+
+/* Return the optimized byte code of the byte-code function FUN, whose
+   byte-code string is BYTESTR, or nil if FUN should run BYTESTR.  */
+
+static Lisp_Object
+optimized_byte_code (Lisp_Object fun, Lisp_Object bytestr)
+{
+  ptrdiff_t size = ASIZE (fun);
+  Lisp_Object *cache;
+
+  if (!byte_code_optimize
+      || (((size & PSEUDOVECTOR_REST_MASK) >> PSEUDOVECTOR_SIZE_BITS)
+	  < COMPILED_CACHE_WORDS))
+    return Qnil;
+
+  cache = XVECTOR (fun)->contents + (size & PSEUDOVECTOR_SIZE_MASK);
+  if (!EQ (cache[0], bytestr))
+    {
+      struct Lisp_Hash_Table *h = XHASH_TABLE (byte_code_optimized);
+      EMACS_UINT hash;
+      ptrdiff_t i;
+      Lisp_Object val;
+
+      /* Functions made while dumping are copied to pure space without
+	 their cache, so don't bother with them yet.  */
+      if (!STRINGP (bytestr) || !NILP (Vpurify_flag))
+	return Qnil;
+
+      i = hash_lookup (h, bytestr, &hash);
+      if (i >= 0)
+	val = HASH_VALUE (h, i);
+      else
+	{
+	  val = optimize_byte_code (bytestr);
+	  hash_put (h, bytestr, val, hash);
+	}
+      cache[0] = bytestr;
+      cache[1] = val;
+    }
+
+  return STRINGP (cache[1]) ? cache[1] : Qnil;
+}
+
+
 
 /* Fetch the next byte from the bytecode stream.  */
 
@@ -434,6 +895,37 @@ unmark_byte_stack (void)
    AFTER_POTENTIAL_GC ();	\
  } while (0)
 
+/* Push the value of the variable SYM.  */
+
+#define PUSH_VARIABLE(sym)						\
+  do {									\
+    Lisp_Object v1_ = (sym), v2_;					\
+    if (! (SYMBOLP (v1_)						\
+	   && XSYMBOL (v1_)->redirect == SYMBOL_PLAINVAL		\
+	   && (v2_ = SYMBOL_VAL (XSYMBOL (v1_)), !EQ (v2_, Qunbound))))	\
+      {									\
+	BEFORE_POTENTIAL_GC ();						\
+	v2_ = Fsymbol_value (v1_);					\
+	AFTER_POTENTIAL_GC ();						\
+      }									\
+    PUSH (v2_);								\
+  } while (0)
+
+/* Replace the top of the stack with its car or cdr, according to
+   whether ACCESSOR is XCAR or XCDR.  */
+
+#define TOP_CAR_OR_CDR(accessor)		\
+  do {						\
+    Lisp_Object v1_ = TOP;			\
+    if (CONSP (v1_))				\
+      TOP = accessor (v1_);			\
+    else if (!NILP (v1_))			\
+      {						\
+	BEFORE_POTENTIAL_GC ();			\
+	wrong_type_argument (Qlistp, v1_);	\
+      }						\
+  } while (0)
+
 /* Check for jumping out of range.  */
 
 #ifdef BYTE_CODE_SAFE
@@ -484,11 +976,13 @@ If the third argument is incorrect, Emacs may crash.  */)
    argument list (including &rest, &optional, etc.), and ARGS, of size
    NARGS, should be a vector of the actual arguments.  The arguments in
    ARGS are pushed on the stack according to ARGS_TEMPLATE before
-   executing BYTESTR.  */
+   executing BYTESTR.  OPTIMIZED says whether BYTESTR was made by
+   optimize_byte_code, and may contain superinstructions.  */
 
-Lisp_Object
-exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
-		Lisp_Object args_template, ptrdiff_t nargs, Lisp_Object *args)
+static Lisp_Object
+exec_byte_code_1 (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
+		  Lisp_Object args_template, ptrdiff_t nargs, Lisp_Object *args,
+		  bool optimized)
 {
   ptrdiff_t count = SPECPDL_INDEX ();
 #ifdef BYTE_CODE_METER
@@ -634,7 +1128,7 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
       /* NEXT is invoked at the end of an instruction to go to the
 	 next instruction.  It is either a computed goto, or a
 	 plain break.  */
-#define NEXT goto *(targets[op = FETCH])
+#define NEXT goto *(dispatch[op = FETCH])
       /* FIRST is like NEXT, but is only used at the start of the
 	 interpreter body.  In the switch-based interpreter it is the
 	 switch, so the threaded definition must include a semicolon.  */
@@ -681,6 +1175,23 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 #undef DEFINE
 	};
 
+      /* This one is for optimized byte code, and knows the
+	 superinstructions as well.  */
+      static const void *const optimized_targets[256] =
+	{
+	  [0 ... (Bconstant - 1)] = &&insn_default,
+	  [Bconstant ... 255] = &&insn_Bconstant,
+
+#define DEFINE(name, value) LABEL (name) ,
+	  BYTE_CODES
+#undef DEFINE
+#define PAIR(name, value, first, second) LABEL (name) ,
+	  BYTE_CODE_PAIRS
+#undef PAIR
+	};
+
+      const void *const *dispatch = optimized ? optimized_targets : targets;
+
 #if 4 < __GNUC__ + (6 <= __GNUC_MINOR__) || defined __clang__
 # pragma GCC diagnostic pop
 #endif
@@ -708,32 +1219,11 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 	CASE (Bvarref6):
 	  op = FETCH;
 	varref:
-	  {
-	    Lisp_Object v1, v2;
-
-	    v1 = vectorp[op];
-	    if (SYMBOLP (v1))
-	      {
-		if (XSYMBOL (v1)->redirect != SYMBOL_PLAINVAL
-		    || (v2 = SYMBOL_VAL (XSYMBOL (v1)),
-			EQ (v2, Qunbound)))
-		  {
-		    BEFORE_POTENTIAL_GC ();
-		    v2 = Fsymbol_value (v1);
-		    AFTER_POTENTIAL_GC ();
-		  }
-	      }
-	    else
-	      {
-		BEFORE_POTENTIAL_GC ();
-		v2 = Fsymbol_value (v1);
-		AFTER_POTENTIAL_GC ();
-	      }
-	    PUSH (v2);
-	    NEXT;
-	  }
+	  PUSH_VARIABLE (vectorp[op]);
+	  NEXT;
 
 	CASE (Bgotoifnil):
+	dogotoifnil:
 	  {
 	    Lisp_Object v1;
 	    MAYBE_GC ();
@@ -749,22 +1239,12 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 	  }
 
 	CASE (Bcar):
-	  {
-	    Lisp_Object v1;
-	    v1 = TOP;
-	    if (CONSP (v1))
-	      TOP = XCAR (v1);
-	    else if (NILP (v1))
-	      TOP = Qnil;
-	    else
-	      {
-		BEFORE_POTENTIAL_GC ();
-		wrong_type_argument (Qlistp, v1);
-	      }
-	    NEXT;
-	  }
+	docar:
+	  TOP_CAR_OR_CDR (XCAR);
+	  NEXT;
 
 	CASE (Beq):
+	doeq:
 	  {
 	    Lisp_Object v1;
 	    v1 = POP;
@@ -783,20 +1263,9 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 	  }
 
 	CASE (Bcdr):
-	  {
-	    Lisp_Object v1;
-	    v1 = TOP;
-	    if (CONSP (v1))
-	      TOP = XCDR (v1);
-	    else if (NILP (v1))
-	      TOP = Qnil;
-	    else
-	      {
-		BEFORE_POTENTIAL_GC ();
-		wrong_type_argument (Qlistp, v1);
-	      }
-	    NEXT;
-	  }
+	docdr:
+	  TOP_CAR_OR_CDR (XCDR);
+	  NEXT;
 
 	CASE (Bvarset):
 	CASE (Bvarset1):
@@ -885,6 +1354,7 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 	  op -= Bcall;
 	docall:
 	  {
+	    Lisp_Object fun;
 	    BEFORE_POTENTIAL_GC ();
 	    DISCARD (op);
 #ifdef BYTE_CODE_METER
@@ -902,7 +1372,11 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 		  }
 	      }
 #endif
-	    TOP = Ffuncall (op + 1, &TOP);
+	    fun = call_cache_lookup (stack.pc, TOP, op);
+	    if (NILP (fun))
+	      TOP = Ffuncall (op + 1, &TOP);
+	    else
+	      TOP = funcall_known (fun, op + 1, &TOP);
 	    AFTER_POTENTIAL_GC ();
 	    NEXT;
 	  }
@@ -937,6 +1411,7 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 	  NEXT;
 
 	CASE (Bgoto):
+	dogoto:
 	  MAYBE_GC ();
 	  BYTE_CODE_QUIT;
 	  op = FETCH2;    /* pc = FETCH2 loses since FETCH2 contains pc++ */
@@ -945,6 +1420,7 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 	  NEXT;
 
 	CASE (Bgotoifnonnil):
+	dogotoifnonnil:
 	  {
 	    Lisp_Object v1;
 	    MAYBE_GC ();
@@ -1898,6 +2374,7 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 	    NEXT;
 	  }
 	CASE (Bstack_ref6):
+	dostack_ref:
 	  {
 	    Lisp_Object *ptr = top - (FETCH);
 	    PUSH (*ptr);
@@ -1911,6 +2388,7 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 	  }
 	CASE (Bstack_set):
 	  /* stack-set-0 = discard; stack-set-1 = discard-1-preserve-tos.  */
+	dostack_set:
 	  {
 	    Lisp_Object *ptr = top - (FETCH);
 	    *ptr = POP;
@@ -1932,6 +2410,116 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 	  DISCARD (op);
 	  NEXT;
 
+	  /* Superinstructions.  Each does what the first instruction of
+	     its pair does, then goes to the code of the second.  */
+	CASE (Bstack_ref_car):
+	  {
+	    Lisp_Object *ptr = top - (FETCH);
+	    PUSH (*ptr);
+	    goto docar;
+	  }
+	CASE (Bstack_ref_cdr):
+	  {
+	    Lisp_Object *ptr = top - (FETCH);
+	    PUSH (*ptr);
+	    goto docdr;
+	  }
+	CASE (Bstack_ref_stack_ref):
+	  {
+	    Lisp_Object *ptr = top - (FETCH);
+	    PUSH (*ptr);
+	    goto dostack_ref;
+	  }
+	CASE (Bstack_ref_gotoifnil):
+	  {
+	    Lisp_Object *ptr = top - (FETCH);
+	    PUSH (*ptr);
+	    goto dogotoifnil;
+	  }
+
+	CASE (Bvarref_car):
+	  PUSH_VARIABLE (vectorp[FETCH]);
+	  goto docar;
+	CASE (Bvarref_cdr):
+	  PUSH_VARIABLE (vectorp[FETCH]);
+	  goto docdr;
+	CASE (Bvarref_gotoifnil):
+	  PUSH_VARIABLE (vectorp[FETCH]);
+	  goto dogotoifnil;
+
+	CASE (Bcdr_car):
+	  TOP_CAR_OR_CDR (XCDR);
+	  goto docar;
+	CASE (Bcar_stack_set):
+	  TOP_CAR_OR_CDR (XCAR);
+	  goto dostack_set;
+	CASE (Bcdr_stack_set):
+	  TOP_CAR_OR_CDR (XCDR);
+	  goto dostack_set;
+
+	CASE (Bconstant_call):
+	  PUSH (vectorp[FETCH]);
+	  op = FETCH;
+	  goto docall;
+	CASE (Bconstant_eq):
+	  PUSH (vectorp[FETCH]);
+	  goto doeq;
+
+	CASE (Badd1_stack_set):
+	  {
+	    Lisp_Object v1;
+	    v1 = TOP;
+	    if (INTEGERP (v1))
+	      {
+		XSETINT (v1, XINT (v1) + 1);
+		TOP = v1;
+	      }
+	    else
+	      {
+		BEFORE_POTENTIAL_GC ();
+		TOP = Fadd1 (v1);
+		AFTER_POTENTIAL_GC ();
+	      }
+	    goto dostack_set;
+	  }
+	CASE (Bstack_set_goto):
+	  {
+	    Lisp_Object *ptr = top - (FETCH);
+	    *ptr = POP;
+	    goto dogoto;
+	  }
+
+	CASE (Bdup_gotoifnil):
+	  {
+	    Lisp_Object v1;
+	    v1 = TOP;
+	    PUSH (v1);
+	    goto dogotoifnil;
+	  }
+	CASE (Beq_gotoifnil):
+	  {
+	    Lisp_Object v1;
+	    v1 = POP;
+	    TOP = EQ (v1, TOP) ? Qt : Qnil;
+	    goto dogotoifnil;
+	  }
+	CASE (Beq_gotoifnonnil):
+	  {
+	    Lisp_Object v1;
+	    v1 = POP;
+	    TOP = EQ (v1, TOP) ? Qt : Qnil;
+	    goto dogotoifnonnil;
+	  }
+	CASE (Blss_gotoifnil):
+	  {
+	    Lisp_Object v1;
+	    BEFORE_POTENTIAL_GC ();
+	    v1 = POP;
+	    TOP = arithcompare (TOP, v1, ARITH_LESS);
+	    AFTER_POTENTIAL_GC ();
+	    goto dogotoifnil;
+	  }
+
 	CASE_DEFAULT
 	CASE (Bconstant):
 #ifdef BYTE_CODE_SAFE
@@ -1966,10 +2554,68 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
   return result;
 }
 
+Lisp_Object
+exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
+		Lisp_Object args_template, ptrdiff_t nargs, Lisp_Object *args)
+{
+  return exec_byte_code_1 (bytestr, vector, maxdepth, args_template,
+			   nargs, args, 0);
+}
+
+/* Execute the byte-code function FUN, whose byte code must be loaded,
+   with ARGS_TEMPLATE, NARGS and ARGS as for exec_byte_code.  Run its
+   optimized byte code if it has some.  */
+
+Lisp_Object
+exec_compiled_function (Lisp_Object fun, Lisp_Object args_template,
+			ptrdiff_t nargs, Lisp_Object *args)
+{
+  Lisp_Object bytestr = AREF (fun, COMPILED_BYTECODE);
+  Lisp_Object optimized = optimized_byte_code (fun, bytestr);
+
+  return exec_byte_code_1 (NILP (optimized) ? bytestr : optimized,
+			   AREF (fun, COMPILED_CONSTANTS),
+			   AREF (fun, COMPILED_STACK_DEPTH),
+			   args_template, nargs, args, !NILP (optimized));
+}
+
+DEFUN ("internal-byte-code-optimized", Finternal_byte_code_optimized,
+       Sinternal_byte_code_optimized, 1, 1, 0,
+       doc: /* Return the optimized byte code that FUNCTION runs, or nil.
+FUNCTION must be a byte-code function.  The value is nil if FUNCTION
+runs the byte code the compiler produced, for instance because
+`byte-code-optimize' is nil.  This is meant for testing.  */)
+  (Lisp_Object function)
+{
+  CHECK_TYPE (COMPILEDP (function), Qbyte_code_function_p, function);
+  return optimized_byte_code (function, AREF (function, COMPILED_BYTECODE));
+}
+
 void
 syms_of_bytecode (void)
 {
   defsubr (&Sbyte_code);
+  defsubr (&Sinternal_byte_code_optimized);
+
+  DEFSYM (Qbyte_code_function_p, "byte-code-function-p");
+
+  DEFVAR_BOOL ("byte-code-optimize", byte_code_optimize,
+	       doc: /* Non-nil means run byte-code functions in an optimized form.
+The first call of a byte-code function then translates its byte code
+into a form that the byte-code interpreter runs faster, which later
+calls use.  The function itself is not changed, so `disassemble' shows
+the byte code the compiler produced.  */);
+  byte_code_optimize = 1;
+
+  {
+    Lisp_Object args[4];
+    args[0] = QCtest;
+    args[1] = Qeq;
+    args[2] = QCweakness;
+    args[3] = intern_c_string ("key");
+    byte_code_optimized = Fmake_hash_table (4, args);
+    staticpro (&byte_code_optimized);
+  }
 
 #ifdef BYTE_CODE_METER
 
@@ -29,6 +29,16 @@ along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
 
 #include "lisp.h"
 
+/* Define USABLE_POSIX_SPAWN if posix_spawn can set up a child the way
+   child_setup does: in a new session and in a given directory.  */
+#if (defined HAVE_SPAWN_H && defined HAVE_POSIX_SPAWN \
+     && defined HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCHDIR_NP)
+#include <spawn.h>
+#ifdef POSIX_SPAWN_SETSID
+#define USABLE_POSIX_SPAWN
+#endif
+#endif
+
 #ifdef WINDOWSNT
 #define NOMINMAX
 #include <sys/socket.h>	/* for fcntl */
@@ -53,6 +63,7 @@ along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
 #include "syssignal.h"
 #include "systty.h"
 #include "syswait.h"
+#include "systime.h"
 #include "blockinput.h"
 #include "frame.h"
 #include "termhooks.h"
@@ -236,7 +247,9 @@ The program's input comes from file INFILE (nil means `/dev/null').
 Insert output in DESTINATION before point; t means current buffer; nil for DESTINATION
  means discard it; 0 means discard and don't wait; and `(:file FILE)', where
  FILE is a file name string, means that it should be written to that file
- \(if the file already exists it is overwritten).
+ \(if the file already exists it is overwritten).  `(:filter FUNCTION)' means
+ call FUNCTION with each piece of output, decoded, as a string, instead
+ of inserting it.
 DESTINATION can also have the form (REAL-BUFFER STDERR-FILE); in that case,
 REAL-BUFFER says what to do with standard output, as above,
 while STDERR-FILE says what to do with standard error in the child.
@@ -308,6 +321,8 @@ call_process (ptrdiff_t nargs, Lisp_Object *args, int filefd,
      t means use same as standard output.  */
   Lisp_Object error_file;
   Lisp_Object output_file = Qnil;
+  /* Function to give the output to instead of inserting it.  */
+  Lisp_Object output_filter = Qnil;
 #ifdef MSDOS	/* Demacs 1.1.1 91/10/16 HIRANO Satoshi */
   char *tempfile = NULL;
   int pid;
@@ -387,9 +402,10 @@ call_process (ptrdiff_t nargs, Lisp_Object *args, int filefd,
       buffer = args[2];
 
       /* If BUFFER is a list, its meaning is (BUFFER-FOR-STDOUT
-	 FILE-FOR-STDERR), unless the first element is :file, in which case see
-	 the next paragraph. */
-      if (CONSP (buffer) && !EQ (XCAR (buffer), QCfile))
+	 FILE-FOR-STDERR), unless the first element is :file or :filter,
+	 in which case see the next paragraphs. */
+      if (CONSP (buffer) && !EQ (XCAR (buffer), QCfile)
+	  && !EQ (XCAR (buffer), QCfilter))
 	{
 	  if (CONSP (XCDR (buffer)))
 	    {
@@ -414,6 +430,14 @@ call_process (ptrdiff_t nargs, Lisp_Object *args, int filefd,
 	  buffer = Qnil;
 	}
 
+      /* A (:filter FUNCTION) spec reads the output as t does, but
+	 gives it to FUNCTION.  */
+      if (CONSP (buffer) && EQ (XCAR (buffer), QCfilter))
+	{
+	  output_filter = XCAR (XCDR (buffer));
+	  buffer = Qt;
+	}
+
       if (! (NILP (buffer) || EQ (buffer, Qt) || INTEGERP (buffer)))
 	{
 	  Lisp_Object spec_buffer;
@@ -633,39 +657,44 @@ call_process (ptrdiff_t nargs, Lisp_Object *args, int filefd,
   pid = child_setup (filefd, fd_output, fd_error, new_argv, 0, current_dir);
 #else  /* not WINDOWSNT */
 
+  pid = spawn_child (filefd, fd_output, fd_error, new_argv, 0, current_dir);
+
   /* vfork, and prevent local vars from being clobbered by the vfork.  */
-  {
-    Lisp_Object volatile buffer_volatile = buffer;
-    Lisp_Object volatile coding_systems_volatile = coding_systems;
-    Lisp_Object volatile current_dir_volatile = current_dir;
-    bool volatile display_p_volatile = display_p;
-    bool volatile sa_must_free_volatile = sa_must_free;
-    int volatile fd_error_volatile = fd_error;
-    int volatile filefd_volatile = filefd;
-    ptrdiff_t volatile count_volatile = count;
-    ptrdiff_t volatile sa_count_volatile = sa_count;
-    char **volatile new_argv_volatile = new_argv;
-    int volatile callproc_fd_volatile[CALLPROC_FDS];
-    for (i = 0; i < CALLPROC_FDS; i++)
-      callproc_fd_volatile[i] = callproc_fd[i];
-
-    pid = vfork ();
-
-    buffer = buffer_volatile;
-    coding_systems = coding_systems_volatile;
-    current_dir = current_dir_volatile;
-    display_p = display_p_volatile;
-    sa_must_free = sa_must_free_volatile;
-    fd_error = fd_error_volatile;
-    filefd = filefd_volatile;
-    count = count_volatile;
-    sa_count = sa_count_volatile;
-    new_argv = new_argv_volatile;
-
-    for (i = 0; i < CALLPROC_FDS; i++)
-      callproc_fd[i] = callproc_fd_volatile[i];
-    fd_output = callproc_fd[CALLPROC_STDOUT];
-  }
+  if (pid < 0)
+    {
+      Lisp_Object volatile buffer_volatile = buffer;
+      Lisp_Object volatile coding_systems_volatile = coding_systems;
+      Lisp_Object volatile current_dir_volatile = current_dir;
+      Lisp_Object volatile output_filter_volatile = output_filter;
+      bool volatile display_p_volatile = display_p;
+      bool volatile sa_must_free_volatile = sa_must_free;
+      int volatile fd_error_volatile = fd_error;
+      int volatile filefd_volatile = filefd;
+      ptrdiff_t volatile count_volatile = count;
+      ptrdiff_t volatile sa_count_volatile = sa_count;
+      char **volatile new_argv_volatile = new_argv;
+      int volatile callproc_fd_volatile[CALLPROC_FDS];
+      for (i = 0; i < CALLPROC_FDS; i++)
+	callproc_fd_volatile[i] = callproc_fd[i];
+
+      pid = vfork ();
+
+      buffer = buffer_volatile;
+      coding_systems = coding_systems_volatile;
+      current_dir = current_dir_volatile;
+      output_filter = output_filter_volatile;
+      display_p = display_p_volatile;
+      sa_must_free = sa_must_free_volatile;
+      fd_error = fd_error_volatile;
+      filefd = filefd_volatile;
+      count = count_volatile;
+      sa_count = sa_count_volatile;
+      new_argv = new_argv_volatile;
+
+      for (i = 0; i < CALLPROC_FDS; i++)
+	callproc_fd[i] = callproc_fd_volatile[i];
+      fd_output = callproc_fd[CALLPROC_STDOUT];
+    }
 
   if (pid == 0)
     {
@@ -773,8 +802,10 @@ call_process (ptrdiff_t nargs, Lisp_Object *args, int filefd,
   if (0 <= fd0)
     {
       enum { CALLPROC_BUFFER_SIZE_MIN = 16 * 1024 };
-      enum { CALLPROC_BUFFER_SIZE_MAX = 4 * CALLPROC_BUFFER_SIZE_MIN };
-      char buf[CALLPROC_BUFFER_SIZE_MAX];
+      enum { CALLPROC_BUFFER_SIZE_MAX = 64 * CALLPROC_BUFFER_SIZE_MIN };
+      /* Redisplay at most this often, in nanoseconds.  */
+      enum { CALLPROC_REDISPLAY_INTERVAL = 50 * 1000 * 1000 };
+      char *buf = SAFE_ALLOCA (CALLPROC_BUFFER_SIZE_MAX);
       int bufsize = CALLPROC_BUFFER_SIZE_MIN;
       int nread;
       bool first = 1;
@@ -782,16 +813,42 @@ call_process (ptrdiff_t nargs, Lisp_Object *args, int filefd,
       int carryover = 0;
       bool display_on_the_fly = display_p;
       struct coding_system saved_coding = process_coding;
+      struct timespec next_redisplay = make_timespec (0, 0);
+      /* Whether to read into the gap; cleared when some text read
+	 there needed decoding after all, as the rest probably will.  */
+      bool gap_ok = NILP (output_filter);
 
       while (1)
 	{
+	  /* Read straight into the gap when the output may be inserted
+	     as it is, as decode_coding_unchanged checks.  */
+	  bool into_gap = (gap_ok
+			   && decode_coding_unchanged_p (&process_coding));
+	  bool inserted = 0;
+	  char *dest = buf;
+
+	  if (into_gap)
+	    {
+	      /* insert_1_both would run the before-change hooks for
+		 text that needs no decoding; do that before reading.  */
+	      if (NILP (BVAR (current_buffer, enable_multibyte_characters))
+		  && ! CODING_MAY_REQUIRE_DECODING (&process_coding))
+		prepare_to_modify_buffer (PT, PT, NULL);
+	      if (PT != GPT)
+		move_gap_both (PT, PT_BYTE);
+	      if (GAP_SIZE < bufsize)
+		make_gap (bufsize - GAP_SIZE);
+	      dest = (char *) GPT_ADDR;
+	      memcpy (dest, buf, carryover);
+	    }
+
 	  /* Repeatedly read until we've filled as much as possible
 	     of the buffer size we have.  But don't read
 	     less than 1024--save that for the next bufferful.  */
 	  nread = carryover;
 	  while (nread < bufsize - 1024)
 	    {
-	      int this_read = emacs_read (fd0, buf + nread,
+	      int this_read = emacs_read (fd0, dest + nread,
 					  bufsize - nread);
 
 	      if (this_read < 0)
@@ -813,8 +870,52 @@ call_process (ptrdiff_t nargs, Lisp_Object *args, int filefd,
 	  /* Now NREAD is the total amount of data in the buffer.  */
 	  immediate_quit = 0;
 
-	  if (NILP (BVAR (current_buffer, enable_multibyte_characters))
-	      && ! CODING_MAY_REQUIRE_DECODING (&process_coding))
+	  if (into_gap)
+	    {
+	      /* Keep an incomplete character at the end for the next
+		 read, unless this is the last one; then, as when the
+		 text needs decoding, copy it all to BUF and decode it
+		 below.  */
+	      int rest;
+	      ptrdiff_t nchars
+		= decode_coding_unchanged (&process_coding,
+					   (unsigned char *) dest, nread,
+					   &rest);
+
+	      if (nchars >= 0
+		  && ! (rest && process_coding.mode & CODING_MODE_LAST_BLOCK))
+		{
+		  memcpy (buf, dest + nread - rest, rest);
+		  if (nread > rest)
+		    insert_1_from_gap (nchars, nread - rest, 0, 0);
+		  carryover = rest;
+		  inserted = 1;
+		}
+	      else
+		{
+		  memcpy (buf, dest, nread);
+		  gap_ok = 0;
+		}
+	    }
+
+	  if (inserted)
+	    ;
+	  else if (!NILP (output_filter))
+	    {
+	      Lisp_Object text;
+
+	      decode_coding_c_string (&process_coding,
+				      (unsigned char *) buf, nread, Qt);
+	      text = process_coding.dst_object;
+	      carryover = process_coding.carryover_bytes;
+	      if (carryover > 0)
+		memcpy (buf, process_coding.carryover,
+			process_coding.carryover_bytes);
+	      if (SCHARS (text) > 0)
+		call1 (output_filter, text);
+	    }
+	  else if (NILP (BVAR (current_buffer, enable_multibyte_characters))
+		   && ! CODING_MAY_REQUIRE_DECODING (&process_coding))
 	    insert_1_both (buf, nread, nread, 0, 1, 0);
 	  else
 	    {			/* We have to decode the input.  */
@@ -866,18 +967,23 @@ call_process (ptrdiff_t nargs, Lisp_Object *args, int filefd,
 	  if (process_coding.mode & CODING_MODE_LAST_BLOCK)
 	    break;
 
-	  /* Make the buffer bigger as we continue to read more data,
-	     but not past CALLPROC_BUFFER_SIZE_MAX.  */
-	  if (bufsize < CALLPROC_BUFFER_SIZE_MAX && total_read > 32 * bufsize)
-	    if ((bufsize *= 2) > CALLPROC_BUFFER_SIZE_MAX)
-	      bufsize = CALLPROC_BUFFER_SIZE_MAX;
+	  /* Make the buffer bigger as long as the reads fill it, but
+	     not past CALLPROC_BUFFER_SIZE_MAX.  */
+	  if (bufsize < CALLPROC_BUFFER_SIZE_MAX && nread >= bufsize - 1024)
+	    bufsize *= 2;
 
 	  if (display_p)
 	    {
 	      if (first)
 		prepare_menu_bars ();
 	      first = 0;
-	      redisplay_preserve_echo_area (1);
+	      if (timespec_cmp (next_redisplay, current_timespec ()) <= 0)
+		{
+		  redisplay_preserve_echo_area (1);
+		  next_redisplay
+		    = timespec_add (current_timespec (),
+				    make_timespec (0, CALLPROC_REDISPLAY_INTERVAL));
+		}
 	      /* This variable might have been set to 0 for code
 		 detection.  In that case, set it back to 1 because
 		 we should have already detected a coding system.  */
@@ -891,7 +997,7 @@ call_process (ptrdiff_t nargs, Lisp_Object *args, int filefd,
       Vlast_coding_system_used = CODING_ID_NAME (process_coding.id);
       /* If the caller required, let the buffer inherit the
 	 coding-system used to decode the process output.  */
-      if (inherit_process_coding_system)
+      if (inherit_process_coding_system && NILP (output_filter))
 	call1 (intern ("after-insert-file-set-buffer-file-coding-system"),
 	       make_number (total_read));
     }
@@ -900,6 +1006,7 @@ call_process (ptrdiff_t nargs, Lisp_Object *args, int filefd,
   /* Wait for it to terminate, unless it already has.  */
   wait_for_termination (pid, &status, fd0 < 0);
 #endif
+  file_status_outdated = 1;
 
   immediate_quit = 0;
 
@@ -1158,6 +1265,177 @@ add_env (char **env, char **new_env, char *string)
   return new_env;
 }
 
+/* Return the number of strings in the environment of a child process,
+   not counting PWD.  Set *DISPLAY to the value of DISPLAY to add to
+   `process-environment', or to nil if there is none to add.  */
+
+static ptrdiff_t
+child_environment_length (Lisp_Object *display)
+{
+  Lisp_Object tem;
+  ptrdiff_t new_length = 0;
+
+  *display = Qnil;
+  for (tem = Vprocess_environment;
+       CONSP (tem) && STRINGP (XCAR (tem));
+       tem = XCDR (tem))
+    {
+      if (strncmp (SSDATA (XCAR (tem)), "DISPLAY", 7) == 0
+	  && (SDATA (XCAR (tem)) [7] == '\0'
+	      || SDATA (XCAR (tem)) [7] == '='))
+	/* DISPLAY is specified in process-environment.  */
+	*display = Qt;
+      new_length++;
+    }
+
+  /* If not provided yet, use the frame's DISPLAY.  */
+  if (NILP (*display))
+    {
+      Lisp_Object tmp = Fframe_parameter (selected_frame, Qdisplay);
+      if (!STRINGP (tmp) && CONSP (Vinitial_environment))
+	/* If still not found, Look for DISPLAY in Vinitial_environment.  */
+	tmp = Fgetenv_internal (build_string ("DISPLAY"),
+				Vinitial_environment);
+      if (STRINGP (tmp))
+	new_length++;
+      *display = tmp;
+    }
+  else
+    *display = Qnil;
+
+  return new_length;
+}
+
+/* Store the environment of a child process into ENV, which must have
+   room for the number of strings child_environment_length returns
+   plus two.  PWD_VAR is the PWD=DIR string to pass down if Emacs has
+   a PWD, and DISPLAY_VAR the DISPLAY=VALUE string to add, or NULL.  */
+
+static void
+make_child_environment (char **env, char *pwd_var, char *display_var)
+{
+  Lisp_Object tem;
+  char **new_env = env;
+  char **p, **q;
+
+  /* If we have a PWD envvar, pass one down,
+     but with corrected value.  */
+  if (egetenv ("PWD"))
+    *new_env++ = pwd_var;
+
+  new_env = add_env (env, new_env, display_var);
+
+  /* Overrides.  */
+  for (tem = Vprocess_environment;
+       CONSP (tem) && STRINGP (XCAR (tem));
+       tem = XCDR (tem))
+    new_env = add_env (env, new_env, SSDATA (XCAR (tem)));
+
+  *new_env = 0;
+
+  /* Remove variable names without values.  */
+  p = q = env;
+  while (*p != 0)
+    {
+      while (*q != 0 && strchr (*q, '=') == NULL)
+	q++;
+      *p = *q++;
+      if (*p != 0)
+	p++;
+    }
+}
+
+#ifndef WINDOWSNT
+/* Start a child the way a vfork followed by child_setup would, but
+   with posix_spawn, which does not run any of Emacs's code in the
+   child.  The child gets a session of its own, and if INTERRUPTIBLE,
+   the default actions of SIGINT and SIGQUIT as well as of SIGPIPE.
+   IN, OUT, ERR, NEW_ARGV and CURRENT_DIR are as for child_setup.
+
+   Return the child's pid, or -1 if it was not started this way, either
+   because posix_spawn is not usable or because it failed.  The caller
+   should then fall back on vfork and child_setup, whose child reports
+   any error the usual way.  */
+
+pid_t
+spawn_child (int in, int out, int err, char **new_argv, bool interruptible,
+	     Lisp_Object current_dir)
+{
+#ifdef USABLE_POSIX_SPAWN
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t attr;
+  sigset_t sigdefault;
+  Lisp_Object display;
+  char *pwd_var, *display_var = NULL;
+  char **env;
+  ptrdiff_t i, new_length;
+  pid_t pid;
+  int spawn_errno;
+  USE_SAFE_ALLOCA;
+
+  /* Descriptors 0, 1 and 2 would need the shuffling that child_setup
+     does with relocate_fd.  */
+  if (!process_use_posix_spawn || in < 3 || out < 3 || err < 3)
+    return -1;
+
+  i = SBYTES (current_dir);
+  pwd_var = SAFE_ALLOCA (i + 5);
+  memcpy (pwd_var, "PWD=", 4);
+  strcpy (pwd_var + 4, SSDATA (current_dir));
+  /* Strip trailing slashes for PWD, but leave "/" and "//" alone.  */
+  while (i > 2 && IS_DIRECTORY_SEP (pwd_var[4 + i - 1]))
+    pwd_var[4 + --i] = 0;
+
+  new_length = child_environment_length (&display);
+  if (STRINGP (display))
+    {
+      display_var = SAFE_ALLOCA (sizeof "DISPLAY=" + SBYTES (display));
+      strcpy (display_var, "DISPLAY=");
+      strcat (display_var, SSDATA (display));
+    }
+  SAFE_NALLOCA (env, 1, new_length + 2);
+  make_child_environment (env, pwd_var, display_var);
+
+  sigemptyset (&sigdefault);
+  sigaddset (&sigdefault, SIGPIPE);
+  if (interruptible)
+    {
+      sigaddset (&sigdefault, SIGINT);
+      sigaddset (&sigdefault, SIGQUIT);
+    }
+
+  posix_spawn_file_actions_init (&actions);
+  posix_spawnattr_init (&attr);
+  spawn_errno
+    = posix_spawn_file_actions_addchdir_np (&actions, SSDATA (current_dir));
+  if (!spawn_errno)
+    spawn_errno = posix_spawn_file_actions_adddup2 (&actions, in, 0);
+  if (!spawn_errno)
+    spawn_errno = posix_spawn_file_actions_adddup2 (&actions, out, 1);
+  if (!spawn_errno)
+    spawn_errno = posix_spawn_file_actions_adddup2 (&actions, err, 2);
+  if (!spawn_errno)
+    spawn_errno = posix_spawnattr_setflags (&attr, (POSIX_SPAWN_SETSID
+						    | POSIX_SPAWN_SETSIGDEF
+						    | POSIX_SPAWN_SETSIGMASK));
+  if (!spawn_errno)
+    spawn_errno = posix_spawnattr_setsigdefault (&attr, &sigdefault);
+  if (!spawn_errno)
+    spawn_errno = posix_spawnattr_setsigmask (&attr, &empty_mask);
+  if (!spawn_errno)
+    spawn_errno = posix_spawn (&pid, new_argv[0], &actions, &attr,
+			       new_argv, env);
+  posix_spawnattr_destroy (&attr);
+  posix_spawn_file_actions_destroy (&actions);
+  SAFE_FREE ();
+
+  return spawn_errno ? -1 : pid;
+#else
+  return -1;
+#endif
+}
+#endif /* not WINDOWSNT */
+
 /* This is the last thing run in a newly forked inferior
    either synchronous or asynchronous.
    Copy descriptors IN, OUT and ERR as descriptors 0, 1 and 2.
@@ -1233,74 +1511,20 @@ child_setup (int in, int out, int err, char **new_argv, bool set_pgrp,
 
   /* Set `env' to a vector of the strings in the environment.  */
   {
-    register Lisp_Object tem;
-    register char **new_env;
-    char **p, **q;
-    register int new_length;
-    Lisp_Object display = Qnil;
-
-    new_length = 0;
-
-    for (tem = Vprocess_environment;
-	 CONSP (tem) && STRINGP (XCAR (tem));
-	 tem = XCDR (tem))
-      {
-	if (strncmp (SSDATA (XCAR (tem)), "DISPLAY", 7) == 0
-	    && (SDATA (XCAR (tem)) [7] == '\0'
-		|| SDATA (XCAR (tem)) [7] == '='))
-	  /* DISPLAY is specified in process-environment.  */
-	  display = Qt;
-	new_length++;
-      }
-
-    /* If not provided yet, use the frame's DISPLAY.  */
-    if (NILP (display))
-      {
-	Lisp_Object tmp = Fframe_parameter (selected_frame, Qdisplay);
-	if (!STRINGP (tmp) && CONSP (Vinitial_environment))
-	  /* If still not found, Look for DISPLAY in Vinitial_environment.  */
-	  tmp = Fgetenv_internal (build_string ("DISPLAY"),
-				  Vinitial_environment);
-	if (STRINGP (tmp))
-	  {
-	    display = tmp;
-	    new_length++;
-	  }
-      }
-
-    /* new_length + 2 to include PWD and terminating 0.  */
-    env = new_env = alloca ((new_length + 2) * sizeof *env);
-    /* If we have a PWD envvar, pass one down,
-       but with corrected value.  */
-    if (egetenv ("PWD"))
-      *new_env++ = pwd_var;
+    Lisp_Object display;
+    char *display_var = NULL;
+    ptrdiff_t new_length = child_environment_length (&display);
 
     if (STRINGP (display))
       {
-	char *vdata = alloca (sizeof "DISPLAY=" + SBYTES (display));
-	strcpy (vdata, "DISPLAY=");
-	strcat (vdata, SSDATA (display));
-	new_env = add_env (env, new_env, vdata);
+	display_var = alloca (sizeof "DISPLAY=" + SBYTES (display));
+	strcpy (display_var, "DISPLAY=");
+	strcat (display_var, SSDATA (display));
       }
 
-    /* Overrides.  */
-    for (tem = Vprocess_environment;
-	 CONSP (tem) && STRINGP (XCAR (tem));
-	 tem = XCDR (tem))
-      new_env = add_env (env, new_env, SSDATA (XCAR (tem)));
-
-    *new_env = 0;
-
-    /* Remove variable names without values.  */
-    p = q = env;
-    while (*p != 0)
-      {
-	while (*q != 0 && strchr (*q, '=') == NULL)
-	  q++;
-	*p = *q++;
-	if (*p != 0)
-	  p++;
-      }
+    /* new_length + 2 to include PWD and terminating 0.  */
+    env = alloca ((new_length + 2) * sizeof *env);
+    make_child_environment (env, pwd_var, display_var);
   }
 
 
@@ -1730,6 +1954,23 @@ Each element should be a string of the form ENVVARNAME=VALUE.
 The elements must normally be decoded (using `locale-coding-system') for use.  */);
   Vinitial_environment = Qnil;
 
+  DEFVAR_BOOL ("process-use-posix-spawn", process_use_posix_spawn,
+	       doc: /* Non-nil means start subprocesses with `posix_spawn' where possible.
+This applies to the subprocesses of `call-process' and to those of
+`start-process' that communicate through pipes rather than a pty, on
+systems whose `posix_spawn' can start a process in a new session and
+in a given directory.  When it is nil, or `posix_spawn' cannot be
+used, Emacs starts subprocesses with `vfork', or `fork' where
+`vfork' is not available.
+
+The default is nil where `vfork' is available, as `vfork' does not copy
+Emacs's memory either and is then slightly faster.  */);
+#ifdef HAVE_WORKING_VFORK
+  process_use_posix_spawn = 0;
+#else
+  process_use_posix_spawn = 1;
+#endif
+
   DEFVAR_LISP ("process-environment", Vprocess_environment,
 	       doc: /* List of overridden environment variables for subprocesses to inherit.
 Each element should be a string of the form ENVVARNAME=VALUE.
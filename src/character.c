@@ -513,6 +513,45 @@ usage: (string-width STRING)  */)
   return val;
 }
 
+/* The functions below scan text a word at a time where they can,
+   which is much faster than a byte at a time for long texts.  */
+
+static uint64_t const ones_word = 0x0101010101010101;
+static uint64_t const high_bits_word = 0x8080808080808080;
+
+/* Return the word of text at P, which need not be aligned.  */
+
+static uint64_t
+load_text_word (const unsigned char *p)
+{
+  uint64_t w;
+  memcpy (&w, p, sizeof w);
+  return w;
+}
+
+/* Return the number of bytes of the word W whose high bit is set.  */
+
+static int
+count_high_bits (uint64_t w)
+{
+  return ((w & high_bits_word) >> 7) * ones_word >> 56;
+}
+
+/* Return the number of ASCII bytes at the start of the LEN bytes at P.  */
+
+static ptrdiff_t
+ascii_prefix_length (const unsigned char *p, ptrdiff_t len)
+{
+  const unsigned char *start = p, *endp = p + len;
+
+  while (endp - p >= sizeof (uint64_t)
+	 && ! (load_text_word (p) & high_bits_word))
+    p += sizeof (uint64_t);
+  while (p < endp && ASCII_BYTE_P (*p))
+    p++;
+  return p - start;
+}
+
 /* Return the number of characters in the NBYTES bytes at PTR.
    This works by looking at the contents and checking for multibyte
    sequences while assuming that there's no invalid sequence.
@@ -539,19 +578,21 @@ ptrdiff_t
 multibyte_chars_in_text (const unsigned char *ptr, ptrdiff_t nbytes)
 {
   const unsigned char *endp = ptr + nbytes;
-  ptrdiff_t chars = 0;
+  ptrdiff_t trailing = 0;
 
-  while (ptr < endp)
+  /* Each character of a valid multibyte text has exactly one byte
+     that is not a trailing byte 10xxxxxx, so count the trailing
+     bytes.  Shifting a word left by one bit brings the second
+     highest bit of each byte to the highest bit.  */
+  for (; endp - ptr >= sizeof (uint64_t); ptr += sizeof (uint64_t))
     {
-      int len = MULTIBYTE_LENGTH (ptr, endp);
-
-      if (len == 0)
-	emacs_abort ();
-      ptr += len;
-      chars++;
+      uint64_t w = load_text_word (ptr);
+      trailing += count_high_bits (w & ~(w << 1));
     }
+  for (; ptr < endp; ptr++)
+    trailing += ! CHAR_HEAD_P (*ptr);
 
-  return chars;
+  return nbytes - trailing;
 }
 
 /* Parse unibyte text at STR of LEN bytes as a multibyte text, count
@@ -565,7 +606,7 @@ parse_str_as_multibyte (const unsigned char *str, ptrdiff_t len,
 			ptrdiff_t *nchars, ptrdiff_t *nbytes)
 {
   const unsigned char *endp = str + len;
-  int n;
+  ptrdiff_t n;
   ptrdiff_t chars = 0, bytes = 0;
 
   if (len >= MAX_MULTIBYTE_LENGTH)
@@ -573,6 +614,12 @@ parse_str_as_multibyte (const unsigned char *str, ptrdiff_t len,
       const unsigned char *adjusted_endp = endp - MAX_MULTIBYTE_LENGTH;
       while (str < adjusted_endp)
 	{
+	  if (ASCII_BYTE_P (*str))
+	    {
+	      n = ascii_prefix_length (str, adjusted_endp - str);
+	      str += n, bytes += n, chars += n;
+	      continue;
+	    }
 	  if (! CHAR_BYTE8_HEAD_P (*str)
 	      && (n = MULTIBYTE_LENGTH_NO_CHECK (str)) > 0)
 	    str += n, bytes += n;
@@ -611,15 +658,24 @@ str_as_multibyte (unsigned char *str, ptrdiff_t len, ptrdiff_t nbytes,
   unsigned char *p = str, *endp = str + nbytes;
   unsigned char *to;
   ptrdiff_t chars = 0;
-  int n;
+  ptrdiff_t n;
 
   if (nbytes >= MAX_MULTIBYTE_LENGTH)
     {
       unsigned char *adjusted_endp = endp - MAX_MULTIBYTE_LENGTH;
-      while (p < adjusted_endp
-	     && ! CHAR_BYTE8_HEAD_P (*p)
-	     && (n = MULTIBYTE_LENGTH_NO_CHECK (p)) > 0)
-	p += n, chars++;
+      while (p < adjusted_endp)
+	{
+	  if (ASCII_BYTE_P (*p))
+	    {
+	      n = ascii_prefix_length (p, adjusted_endp - p);
+	      p += n, chars += n;
+	    }
+	  else if (! CHAR_BYTE8_HEAD_P (*p)
+		   && (n = MULTIBYTE_LENGTH_NO_CHECK (p)) > 0)
+	    p += n, chars++;
+	  else
+	    break;
+	}
     }
   while (p < endp
 	 && ! CHAR_BYTE8_HEAD_P (*p)
@@ -641,6 +697,13 @@ str_as_multibyte (unsigned char *str, ptrdiff_t len, ptrdiff_t nbytes,
       unsigned char *adjusted_endp = endp - MAX_MULTIBYTE_LENGTH;
       while (p < adjusted_endp)
 	{
+	  if (ASCII_BYTE_P (*p))
+	    {
+	      n = ascii_prefix_length (p, adjusted_endp - p);
+	      memmove (to, p, n);
+	      to += n, p += n, chars += n;
+	      continue;
+	    }
 	  if (! CHAR_BYTE8_HEAD_P (*p)
 	      && (n = MULTIBYTE_LENGTH_NO_CHECK (p)) > 0)
 	    {
@@ -653,8 +716,8 @@ str_as_multibyte (unsigned char *str, ptrdiff_t len, ptrdiff_t nbytes,
 	      c = BYTE8_TO_CHAR (c);
 	      to += CHAR_STRING (c, to);
 	    }
+	  chars++;
 	}
-      chars++;
     }
   while (p < endp)
     {
@@ -685,16 +748,16 @@ ptrdiff_t
 count_size_as_multibyte (const unsigned char *str, ptrdiff_t len)
 {
   const unsigned char *endp = str + len;
-  ptrdiff_t bytes;
-
-  for (bytes = 0; str < endp; str++)
-    {
-      int n = *str < 0x80 ? 1 : 2;
-      if (INT_ADD_OVERFLOW (bytes, n))
-        string_overflow ();
-      bytes += n;
-    }
-  return bytes;
+  ptrdiff_t nonascii = 0;
+
+  /* Each 8-bit byte takes two bytes, every other byte one.  */
+  for (; endp - str >= sizeof (uint64_t); str += sizeof (uint64_t))
+    nonascii += count_high_bits (load_text_word (str));
+  for (; str < endp; str++)
+    nonascii += ! ASCII_BYTE_P (*str);
+  if (INT_ADD_OVERFLOW (len, nonascii))
+    string_overflow ();
+  return len + nonascii;
 }
 
 
@@ -710,7 +773,7 @@ str_to_multibyte (unsigned char *str, ptrdiff_t len, ptrdiff_t bytes)
   unsigned char *p = str, *endp = str + bytes;
   unsigned char *to;
 
-  while (p < endp && *p < 0x80) p++;
+  p += ascii_prefix_length (p, bytes);
   if (p == endp)
     return bytes;
   to = p;
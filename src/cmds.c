@@ -292,6 +292,7 @@ At the end, it runs `post-self-insert-hook'.  */)
       nonundocount++;
     }
 
+  unpack_undo_log (current_buffer);
   if (remove_boundary
       && CONSP (BVAR (current_buffer, undo_list))
       && NILP (XCAR (BVAR (current_buffer, undo_list)))
@@ -290,6 +290,12 @@ encode_coding_XXX (struct coding_system *coding)
 #include <wchar.h>
 #endif /* HAVE_WCHAR_H */
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
 #include "lisp.h"
 #include "character.h"
 #include "buffer.h"
@@ -764,6 +770,33 @@ CHECK_NATNUM_CDR (Lisp_Object x)
   } while (0)
 
 
+/* Return the number of bytes at SRC, before SRC_END, that are in a
+   run of words consisting only of graphic ASCII characters (0x20
+   through 0x7F).  The scanners below, which only care about control
+   characters and 8-bit bytes, skip such runs a word at a time; this
+   matters for huge files, which they scan as a whole.  */
+
+static ptrdiff_t
+graphic_ascii_words (const unsigned char *src, const unsigned char *src_end)
+{
+  uint64_t const ones = 0x0101010101010101, high_bits = ones * 0x80;
+  const unsigned char *p = src;
+
+  /* Subtracting 0x20 from each byte of X sets the high bit of some
+     byte exactly when some byte of X is below 0x20, and the high bits
+     of X itself catch the bytes of 0x80 and above.  */
+  while (src_end - p >= sizeof (uint64_t))
+    {
+      uint64_t x;
+      memcpy (&x, p, sizeof x);
+      if ((x | (x - ones * 0x20)) & high_bits)
+	break;
+      p += sizeof x;
+    }
+  return p - src;
+}
+
+
 /* Store a byte C in the place pointed by DST and increment DST to the
    next free point, and increment PRODUCED_CHARS.  The caller should
    assure that C is 0..127, and declare and set the variable `dst'
@@ -1073,6 +1106,24 @@ coding_alloc_by_making_gap (struct coding_system *coding,
 	 first make the gap size to zero, then increase the gap
 	 size.  */
       ptrdiff_t add = GAP_SIZE;
+      ptrdiff_t produced = coding->produced + gap_head_used;
+      ptrdiff_t rest = coding->src_bytes - coding->consumed;
+
+      /* The source not yet consumed moves with the buffer text every
+	 time the gap grows.  If the decoded text has been longer than
+	 its source, make room at once for what the rest of the source
+	 is likely to produce at the same ratio, so that a large text
+	 is not moved over and over.  */
+      if (coding->src_pos < 0 && coding->consumed > 0
+	  && produced > coding->consumed)
+	{
+	  double estimate = ((double) rest * produced / coding->consumed
+			     - rest);
+	  ptrdiff_t room = BUF_BYTES_MAX - (Z_BYTE - BEG_BYTE + GAP_SIZE);
+
+	  if (bytes < estimate)
+	    bytes = max (bytes, min (estimate, room));
+	}
 
       GPT += gap_head_used, GPT_BYTE += gap_head_used;
       GAP_SIZE = 0; ZV += add; Z += add; ZV_BYTE += add; Z_BYTE += add;
@@ -1202,7 +1253,7 @@ detect_coding_utf_8 (struct coding_system *coding,
   bool multibytep = coding->src_multibyte;
   ptrdiff_t consumed_chars = 0;
   bool bom_found = 0;
-  int nchars = coding->head_ascii;
+  ptrdiff_t nchars = coding->head_ascii;
   int eol_seen = coding->eol_seen;
 
   detect_info->checked |= CATEGORY_MASK_UTF_8;
@@ -1224,6 +1275,13 @@ detect_coding_utf_8 (struct coding_system *coding,
     {
       int c, c1, c2, c3, c4;
 
+      if (! multibytep)
+	{
+	  ptrdiff_t n = graphic_ascii_words (src, src_end);
+	  src += n;
+	  nchars += n;
+	  consumed_chars += n;
+	}
       src_base = src;
       ONE_MORE_BYTE (c);
       if (c < 0 || UTF_8_1_OCTET_P (c))
@@ -1319,6 +1377,8 @@ decode_coding_utf_8 (struct coding_system *coding)
   bool eol_dos
     = !inhibit_eol_conversion && EQ (CODING_ID_EOL_TYPE (coding->id), Qdos);
   int byte_after_cr = -1;
+  /* Where BYTE_AFTER_CR was read from, if it is not -1.  */
+  const unsigned char *src_after_cr = NULL;
 
   if (bom != utf_without_bom)
     {
@@ -1355,15 +1415,12 @@ decode_coding_utf_8 (struct coding_system *coding)
     {
       int c, c1, c2, c3, c4, c5;
 
-      src_base = src;
-      consumed_chars_base = consumed_chars;
+      /* A byte read ahead after a CR belongs to this character.  */
+      src_base = byte_after_cr >= 0 ? src_after_cr : src;
+      consumed_chars_base = consumed_chars - (byte_after_cr >= 0);
 
       if (charbuf >= charbuf_end)
-	{
-	  if (byte_after_cr >= 0)
-	    src_base--;
-	  break;
-	}
+	break;
 
       /* In the simple case, rapidly handle ordinary characters */
       if (multibytep && ! eol_dos
@@ -1415,7 +1472,10 @@ decode_coding_utf_8 (struct coding_system *coding)
       else if (UTF_8_1_OCTET_P (c1))
 	{
 	  if (eol_dos && c1 == '\r')
-	    ONE_MORE_BYTE (byte_after_cr);
+	    {
+	      src_after_cr = src;
+	      ONE_MORE_BYTE (byte_after_cr);
+	    }
 	  c = c1;
 	}
       else
@@ -6210,7 +6270,7 @@ static Lisp_Object adjust_coding_eol_type (struct coding_system *coding,
    EOL_SEEN_LF, EOL_SEEN_CR, and EOL_SEEN_CRLF, but the value is
    reliable only when all the source bytes are ASCII.  */
 
-static int
+static ptrdiff_t
 check_ascii (struct coding_system *coding)
 {
   const unsigned char *src, *end;
@@ -6225,8 +6285,11 @@ check_ascii (struct coding_system *coding)
       || SYMBOLP (eol_type))
     {
       /* We don't have to check EOL format.  */
-      while (src < end && !( *src & 0x80))
+      while (src < end)
 	{
+	  src += graphic_ascii_words (src, end);
+	  if (src == end || *src & 0x80)
+	    break;
 	  if (*src++ == '\n')
 	    eol_seen |= EOL_SEEN_LF;
 	}
@@ -6236,8 +6299,12 @@ check_ascii (struct coding_system *coding)
       end--;		    /* We look ahead one byte for "CR LF".  */
       while (src < end)
 	{
-	  int c = *src;
+	  int c;
 
+	  src += graphic_ascii_words (src, end);
+	  if (src == end)
+	    break;
+	  c = *src;
 	  if (c & 0x80)
 	    break;
 	  src++;
@@ -6275,104 +6342,329 @@ check_ascii (struct coding_system *coding)
 }
 
 
-/* Return the number of characters at the source if all the bytes are
-   valid UTF-8 (of Unicode range).  Otherwise, return -1.  By side
-   effects, update coding->eol_seen.  The value of coding->eol_seen is
-   "logical or" of EOL_SEEN_LF, EOL_SEEN_CR, and EOL_SEEN_CRLF, but
-   the value is reliable only when all the source bytes are valid
-   UTF-8.  */
+/* Return the length of the UTF-8 sequence for a non-ASCII character
+   at SRC, before END, or 0 if there is no valid one.  Sequences of 5
+   bytes are never valid here.  If LAX, accept the characters beyond
+   the Unicode range that 4-byte sequences can encode, as
+   decode_coding_utf_8 does.  */
 
 static int
-check_utf_8 (struct coding_system *coding)
+utf_8_sequence_length (const unsigned char *src, const unsigned char *end,
+		       bool lax)
+{
+  int c = *src;
+
+  if (UTF_8_2_OCTET_LEADING_P (c))
+    {
+      if (c < 0xC2		/* overlong sequence */
+	  || end - src < 2
+	  || ! UTF_8_EXTRA_OCTET_P (src[1]))
+	return 0;
+      return 2;
+    }
+  if (UTF_8_3_OCTET_LEADING_P (c))
+    {
+      if (end - src < 3
+	  || ! (UTF_8_EXTRA_OCTET_P (src[1])
+		&& UTF_8_EXTRA_OCTET_P (src[2])))
+	return 0;
+      c = (((c & 0xF) << 12)
+	   | ((src[1] & 0x3F) << 6) | (src[2] & 0x3F));
+      if (c < 0x800			  /* overlong sequence */
+	  || (c >= 0xd800 && c < 0xe000)) /* surrogates (invalid) */
+	return 0;
+      return 3;
+    }
+  if (UTF_8_4_OCTET_LEADING_P (c))
+    {
+      if (end - src < 4
+	  || ! (UTF_8_EXTRA_OCTET_P (src[1])
+		&& UTF_8_EXTRA_OCTET_P (src[2])
+		&& UTF_8_EXTRA_OCTET_P (src[3])))
+	return 0;
+      c = (((c & 0x7) << 18) | ((src[1] & 0x3F) << 12)
+	   | ((src[2] & 0x3F) << 6) | (src[3] & 0x3F));
+      if (c < 0x10000		/* overlong sequence */
+	  || (c >= 0x110000	/* non-Unicode character  */
+	      && ! lax))
+	return 0;
+      return 4;
+    }
+  return 0;
+}
+
+
+/* A piece of text to be scanned by scan_text_piece, and the results
+   of the scan.  */
+
+struct text_scan
 {
   const unsigned char *src, *end;
+
+  /* Whether the text is to be checked as UTF-8.  */
+  bool utf_8;
+
+  /* If UTF_8, whether to accept the bytes that are not part of a
+     valid UTF-8 sequence, as decode_coding_utf_8 does.  */
+  bool lax;
+
+  /* If UTF_8, the number of characters in the text if all the bytes
+     are valid UTF-8 (of Unicode range), or -1 otherwise.  If LAX, the
+     number of characters the text decodes to, each invalid byte
+     counting as one, or -1 if the text has a 5-byte sequence.  Else
+     the number of bytes of 0x80 and above.  */
+  ptrdiff_t count;
+
+  /* If LAX, the number of invalid bytes.  */
+  ptrdiff_t invalid;
+
+  /* "Logical or" of EOL_SEEN_LF, EOL_SEEN_CR, and EOL_SEEN_CRLF.  */
   int eol_seen;
-  int nchars = coding->head_ascii;
+};
+
+static void
+scan_text_piece (struct text_scan *scan)
+{
+  const unsigned char *src = scan->src, *end = scan->end;
+  /* Where to try skipping whole words of graphic ASCII text again.  */
+  const unsigned char *words = src;
+  ptrdiff_t count = 0, invalid = 0;
+  int eol_seen = EOL_SEEN_NONE;
+
+  if (! scan->utf_8)
+    {
+      while (src < end)
+	{
+	  int c = *src++;
+
+	  if (c >= 0x80)
+	    count++;
+	  else if (c >= 0x20)
+	    {
+	      if (src > words)
+		{
+		  ptrdiff_t n = graphic_ascii_words (src, end);
+		  src += n;
+		  if (n == 0)
+		    words = src + sizeof (uint64_t);
+		}
+	    }
+	  else if (c == '\r')
+	    {
+	      if (src < end && *src == '\n')
+		{
+		  eol_seen |= EOL_SEEN_CRLF;
+		  src++;
+		}
+	      else
+		eol_seen |= EOL_SEEN_CR;
+	    }
+	  else if (c == '\n')
+	    eol_seen |= EOL_SEEN_LF;
+	}
+      scan->count = count;
+      scan->eol_seen = eol_seen;
+      return;
+    }
 
-  if (coding->head_ascii < 0)
-    check_ascii (coding);
-  else
-    coding_set_source (coding);
-  src = coding->source + coding->head_ascii;
-  /* We look ahead one byte for CR LF.  */
-  end = coding->source + coding->src_bytes - 1;
-  eol_seen = coding->eol_seen;
   while (src < end)
     {
       int c = *src;
 
-      if (UTF_8_1_OCTET_P (*src))
+      if (UTF_8_1_OCTET_P (c))
 	{
 	  src++;
-	  if (c < 0x20)
+	  if (c >= 0x20)
 	    {
-	      if (c == '\r')
+	      if (src > words)
 		{
-		  if (*src == '\n')
-		    {
-		      eol_seen |= EOL_SEEN_CRLF;
-		      src++;
-		      nchars++;
-		    }
-		  else
-		    eol_seen |= EOL_SEEN_CR;
+		  ptrdiff_t n = graphic_ascii_words (src, end);
+		  src += n;
+		  count += n;
+		  if (n == 0)
+		    words = src + sizeof (uint64_t);
 		}
-	      else if (c == '\n')
-		eol_seen |= EOL_SEEN_LF;
 	    }
+	  else if (c == '\r')
+	    {
+	      if (src < end && *src == '\n')
+		{
+		  eol_seen |= EOL_SEEN_CRLF;
+		  src++;
+		  count++;
+		}
+	      else
+		eol_seen |= EOL_SEEN_CR;
+	    }
+	  else if (c == '\n')
+	    eol_seen |= EOL_SEEN_LF;
 	}
-      else if (UTF_8_2_OCTET_LEADING_P (c))
+      else
 	{
-	  if (c < 0xC2		/* overlong sequence */
-	      || src + 1 >= end
-	      || ! UTF_8_EXTRA_OCTET_P (src[1]))
-	    return -1;
-	  src += 2;
-	}
-      else if (UTF_8_3_OCTET_LEADING_P (c))
-	{
-	  if (src + 2 >= end
-	      || ! (UTF_8_EXTRA_OCTET_P (src[1])
-		    && UTF_8_EXTRA_OCTET_P (src[2])))
-	    return -1;
-	  c = (((c & 0xF) << 12)
-	       | ((src[1] & 0x3F) << 6) | (src[2] & 0x3F));
-	  if (c < 0x800			      /* overlong sequence */
-	      || (c >= 0xd800 && c < 0xe000)) /* surrogates (invalid) */
-	    return -1;
-	  src += 3;
-	}
-      else if (UTF_8_4_OCTET_LEADING_P (c))
-	{
-	  if (src + 3 >= end
-	      || ! (UTF_8_EXTRA_OCTET_P (src[1])
-		    && UTF_8_EXTRA_OCTET_P (src[2])
-		    && UTF_8_EXTRA_OCTET_P (src[3])))
-	    return -1;
-	  c = (((c & 0x7) << 18) | ((src[1] & 0x3F) << 12)
-	       | ((src[2] & 0x3F) << 6) | (src[3] & 0x3F));
-	  if (c < 0x10000	/* overlong sequence */
-	      || c >= 0x110000)	/* non-Unicode character  */
-	    return -1;
-	  src += 4;
+	  int len = utf_8_sequence_length (src, end, scan->lax);
+
+	  if (len > 0)
+	    src += len;
+	  /* Leave 5-byte sequences, which may stand for raw bytes, to
+	     the decoder.  Any other invalid byte decodes to itself
+	     alone.  */
+	  else if (! scan->lax || UTF_8_5_OCTET_LEADING_P (c))
+	    {
+	      count = -1;
+	      break;
+	    }
+	  else
+	    {
+	      src++;
+	      invalid++;
+	    }
 	}
+      count++;
+    }
+
+  scan->count = count;
+  scan->invalid = invalid;
+  scan->eol_seen = eol_seen;
+}
+
+#ifdef HAVE_PTHREAD
+static void *
+scan_text_thread (void *arg)
+{
+  scan_text_piece (arg);
+  return NULL;
+}
+#endif
+
+enum
+  {
+    /* The most threads that scan_text uses.  */
+    SCAN_THREADS_MAX = 16,
+    /* The least number of bytes that scan_text gives to a thread.  */
+    SCAN_BYTES_PER_THREAD = 4 * 1024 * 1024
+  };
+
+/* Return the number of threads that scan_text may use for a text of
+   NBYTES bytes.  */
+
+static int
+scan_text_threads (ptrdiff_t nbytes)
+{
+#ifdef HAVE_PTHREAD
+  static int processors;
+  EMACS_INT threads = decoding_threads;
+
+  if (threads == 0)
+    {
+# ifdef _SC_NPROCESSORS_ONLN
+      if (processors == 0)
+	processors = max (1, min (sysconf (_SC_NPROCESSORS_ONLN), 8));
+# else
+      processors = 1;
+# endif
+      threads = processors;
+    }
+  threads = min (threads, nbytes / SCAN_BYTES_PER_THREAD);
+  return clip_to_bounds (1, threads, SCAN_THREADS_MAX);
+#else
+  return 1;
+#endif
+}
+
+/* Scan the text from SRC to END as scan_text_piece does, and return
+   the resulting count.  Set *EOL_SEEN to the EOL formats seen.  If
+   INVALID is non-null, scan UTF-8 text leniently and set *INVALID to
+   the number of invalid bytes.  A large text is split into pieces
+   that are scanned in parallel; see `decoding-threads'.  */
+
+static ptrdiff_t
+scan_text (const unsigned char *src, const unsigned char *end, bool utf_8,
+	   int *eol_seen, ptrdiff_t *invalid)
+{
+  struct text_scan scans[SCAN_THREADS_MAX];
+  int nscans = scan_text_threads (end - src), started = 1, i;
+  ptrdiff_t count = 0;
+
+  /* Split the text at character boundaries that are not in the middle
+     of a CR LF sequence, so that each piece can be scanned alone.  */
+  for (i = 0; i < nscans; i++)
+    {
+      scans[i].src = i == 0 ? src : scans[i - 1].end;
+      scans[i].end = max (scans[i].src, src + (end - src) / nscans * (i + 1));
+      if (i == nscans - 1)
+	scans[i].end = end;
       else
-	return -1;
-      nchars++;
+	while (scans[i].end < end
+	       && ((utf_8 && UTF_8_EXTRA_OCTET_P (*scans[i].end))
+		   || (*scans[i].end == '\n' && scans[i].end[-1] == '\r')))
+	  scans[i].end++;
+      scans[i].utf_8 = utf_8;
+      scans[i].lax = invalid != NULL;
+    }
+
+#ifdef HAVE_PTHREAD
+  if (nscans > 1)
+    {
+      pthread_t threads[SCAN_THREADS_MAX];
+      sigset_t blocked, oldset;
+
+      /* Leave the signals to the main thread.  */
+      sigfillset (&blocked);
+      pthread_sigmask (SIG_SETMASK, &blocked, &oldset);
+      while (started < nscans
+	     && pthread_create (&threads[started], NULL, scan_text_thread,
+				&scans[started]) == 0)
+	started++;
+      pthread_sigmask (SIG_SETMASK, &oldset, 0);
+
+      /* Scan here what no thread could be created for.  */
+      for (i = started; i < nscans; i++)
+	scan_text_piece (&scans[i]);
+      scan_text_piece (&scans[0]);
+      for (i = 1; i < started; i++)
+	pthread_join (threads[i], NULL);
     }
+  else
+#endif
+    scan_text_piece (&scans[0]);
 
-  if (src == end)
+  *eol_seen = EOL_SEEN_NONE;
+  if (invalid)
+    *invalid = 0;
+  for (i = 0; i < nscans; i++)
     {
-      if (! UTF_8_1_OCTET_P (*src))
+      *eol_seen |= scans[i].eol_seen;
+      if (scans[i].count < 0)
 	return -1;
-      nchars++;
-      if (*src == '\r')
-	eol_seen |= EOL_SEEN_CR;
-      else if (*src  == '\n')
-	eol_seen |= EOL_SEEN_LF;
+      count += scans[i].count;
+      if (invalid)
+	*invalid += scans[i].invalid;
     }
-  coding->eol_seen = eol_seen;
-  return nchars;
+  return count;
+}
+
+
+/* Return the number of characters at the source if all the bytes are
+   valid UTF-8 (of Unicode range).  Otherwise, return -1.  By side
+   effects, update coding->eol_seen.  The value of coding->eol_seen is
+   "logical or" of EOL_SEEN_LF, EOL_SEEN_CR, and EOL_SEEN_CRLF, but
+   the value is reliable only when all the source bytes are valid
+   UTF-8.  */
+
+static ptrdiff_t
+check_utf_8 (struct coding_system *coding)
+{
+  ptrdiff_t nchars;
+  int eol_seen;
+
+  if (coding->head_ascii < 0)
+    check_ascii (coding);
+  else
+    coding_set_source (coding);
+  nchars = scan_text (coding->source + coding->head_ascii,
+		      coding->source + coding->src_bytes, 1, &eol_seen, NULL);
+  coding->eol_seen |= eol_seen;
+  return nchars < 0 ? -1 : coding->head_ascii + nchars;
 }
 
 
@@ -6544,6 +6836,13 @@ detect_coding (struct coding_system *coding)
       detect_info.checked = detect_info.found = detect_info.rejected = 0;
       for (src = coding->source; src < src_end; src++)
 	{
+	  ptrdiff_t n = graphic_ascii_words (src, src_end);
+
+	  src += n;
+	  if (! eight_bit_found)
+	    coding->head_ascii += n;
+	  if (src == src_end)
+	    break;
 	  c = *src;
 	  if (c & 0x80)
 	    {
@@ -7361,6 +7660,7 @@ decode_coding (struct coding_system *coding)
       if (MODIFF <= SAVE_MODIFF)
 	record_first_change ();
 
+      unpack_undo_log (current_buffer);
       undo_list = BVAR (current_buffer, undo_list);
       bset_undo_list (current_buffer, Qt);
     }
@@ -7870,12 +8170,109 @@ code_conversion_save (bool with_work_buf, bool multibyte)
   return workbuf;
 }
 
+/* Return true if ATTRS are the attributes of a coding system that
+   decodes each byte to the character of the same code, like
+   `iso-latin-1'.  */
+
+static bool
+latin_1_coding_p (Lisp_Object attrs)
+{
+  Lisp_Object charset_list = CODING_ATTR_CHARSET_LIST (attrs);
+  struct charset *charset;
+
+  if (! EQ (CODING_ATTR_TYPE (attrs), Qcharset)
+      || ! CONSP (charset_list) || ! NILP (XCDR (charset_list)))
+    return 0;
+  charset = CHARSET_FROM_ID (XINT (XCAR (charset_list)));
+  return (CHARSET_METHOD (charset) == CHARSET_METHOD_OFFSET
+	  && charset->code_linear_p
+	  && ! CHARSET_UNIFIED_P (charset)
+	  && CHARSET_MIN_CODE (charset) == 0
+	  && CHARSET_MAX_CODE (charset) == 255
+	  && CHARSET_CODE_OFFSET (charset) == 0);
+}
+
+/* Return true if decoding text by CODING may leave it as it is, as
+   decode_coding_unchanged checks.  */
+
+bool
+decode_coding_unchanged_p (struct coding_system *coding)
+{
+  Lisp_Object attrs = CODING_ID_ATTRS (coding->id);
+
+  return (! disable_ascii_optimization
+	  && (EQ (CODING_ATTR_TYPE (attrs), Qraw_text)
+	      || (EQ (CODING_ATTR_TYPE (attrs), Qutf_8)
+		  && CODING_UTF_8_BOM (coding) == utf_without_bom))
+	  && NILP (CODING_ATTR_POST_READ (attrs))
+	  && NILP (get_translation_table (attrs, 0, NULL)));
+}
+
+/* If decoding the NBYTES bytes at SRC by CODING for the current
+   buffer would leave them as they are, return the number of
+   characters they make there; otherwise return -1.  This is the case
+   for raw-text in a unibyte buffer or when the text is ASCII, and for
+   valid UTF-8, as long as no CR needs end-of-line conversion.  Trailing
+   bytes that start an incomplete UTF-8 sequence or a CR LF pair are
+   left out, for decoding with the text that follows; set *CARRYOVER
+   to their number in either case.  */
+
+ptrdiff_t
+decode_coding_unchanged (struct coding_system *coding,
+			 const unsigned char *src, ptrdiff_t nbytes,
+			 int *carryover)
+{
+  Lisp_Object attrs = CODING_ID_ATTRS (coding->id);
+  bool multibyte = ! NILP (BVAR (current_buffer, enable_multibyte_characters));
+  bool utf_8 = multibyte && EQ (CODING_ATTR_TYPE (attrs), Qutf_8);
+  ptrdiff_t nchars;
+  int eol_seen, i;
+
+  *carryover = 0;
+  if (! decode_coding_unchanged_p (coding))
+    return -1;
+
+  if (utf_8)
+    for (i = 1; i <= min (nbytes, 3); i++)
+      {
+	int c = src[nbytes - i];
+
+	if (! UTF_8_EXTRA_OCTET_P (c))
+	  {
+	    if ((UTF_8_2_OCTET_LEADING_P (c) && i < 2)
+		|| (UTF_8_3_OCTET_LEADING_P (c) && i < 3)
+		|| (UTF_8_4_OCTET_LEADING_P (c) && i < 4))
+	      {
+		*carryover = i;
+		nbytes -= i;
+	      }
+	    break;
+	  }
+      }
+  if (*carryover == 0 && nbytes > 0 && src[nbytes - 1] == '\r'
+      && ! EQ (CODING_ID_EOL_TYPE (coding->id), Qunix))
+    {
+      *carryover = 1;
+      nbytes--;
+    }
+
+  nchars = scan_text (src, src + nbytes, utf_8, &eol_seen, NULL);
+  if (utf_8 ? nchars < 0 : multibyte && nchars > 0)
+    return -1;
+  if (eol_seen & (EOL_SEEN_CR | EOL_SEEN_CRLF)
+      && ! EQ (CODING_ID_EOL_TYPE (coding->id), Qunix))
+    return -1;
+  return utf_8 ? nchars : nbytes;
+}
+
 void
 decode_coding_gap (struct coding_system *coding,
 		   ptrdiff_t chars, ptrdiff_t bytes)
 {
   ptrdiff_t count = SPECPDL_INDEX ();
   Lisp_Object attrs;
+  ptrdiff_t expansion = 0;
+  bool utf_8 = false;
 
   coding->src_object = Fcurrent_buffer ();
   coding->src_chars = chars;
@@ -7908,11 +8305,37 @@ decode_coding_gap (struct coding_system *coding,
 	  /* There exists a non-ASCII byte.  */
 	  if (EQ (CODING_ATTR_TYPE (attrs), Qutf_8))
 	    {
+	      utf_8 = true;
 	      if (coding->detected_utf8_chars >= 0)
 		chars = coding->detected_utf8_chars;
 	      else
 		chars = check_utf_8 (coding);
-	      if (CODING_UTF_8_BOM (coding) != utf_without_bom
+	      if (chars < 0 && coding->dst_multibyte)
+		{
+		  /* A few invalid bytes, as in a large log file, need
+		     not send the whole text through decode_coding: each
+		     of them just becomes a two-byte raw-byte character
+		     in place.  */
+		  int eol_seen;
+
+		  chars = scan_text (coding->source + coding->head_ascii,
+				     coding->source + coding->src_bytes, 1,
+				     &eol_seen, &expansion);
+		  /* When the EOL format may be CR LF, decode_coding_utf_8
+		     reads ahead the byte after a CR, and drops it if it
+		     is invalid.  Leave bare CRs to it, so that the text
+		     decodes the same as with decode-coding-region.  */
+		  if (eol_seen & EOL_SEEN_CR
+		      && ! EQ (CODING_ID_EOL_TYPE (coding->id), Qunix))
+		    chars = -1;
+		  if (chars >= 0)
+		    {
+		      chars += coding->head_ascii;
+		      coding->eol_seen |= eol_seen;
+		    }
+		}
+	      if (chars >= 0
+		  && CODING_UTF_8_BOM (coding) != utf_without_bom
 		  && coding->head_ascii == 0
 		  && coding->source[0] == UTF_8_BOM_1
 		  && coding->source[1] == UTF_8_BOM_2
@@ -7923,6 +8346,20 @@ decode_coding_gap (struct coding_system *coding,
 		  coding->src_bytes -= 3;
 		}
 	    }
+	  else if (EQ (CODING_ATTR_TYPE (attrs), Qraw_text)
+		   || latin_1_coding_p (attrs))
+	    {
+	      int eol_seen;
+	      ptrdiff_t nonascii
+		= scan_text (coding->source + coding->head_ascii,
+			     coding->source + coding->src_bytes, 0, &eol_seen,
+			     NULL);
+
+	      coding->eol_seen |= eol_seen;
+	      chars = bytes;
+	      if (coding->dst_multibyte)
+		expansion = nonascii;
+	    }
 	  else
 	    chars = -1;
 	}
@@ -7964,6 +8401,49 @@ decode_coding_gap (struct coding_system *coding,
 	      bytes -= diff;
 	      chars -= diff;
 	    }
+	  if (expansion > 0)
+	    {
+	      /* Each byte of 0x80 and above, or for UTF-8 each byte not
+		 in a valid sequence, becomes a two-byte character; the
+		 text grows towards the start of the gap.  */
+	      unsigned char *src, *src_end, *dst;
+	      int lead = (utf_8 || EQ (CODING_ATTR_TYPE (attrs), Qraw_text)
+			  ? 0xC0 : 0xC2);
+
+	      if (GAP_SIZE < bytes + expansion)
+		{
+		  ptrdiff_t old_gap_size = GAP_SIZE;
+
+		  make_gap (bytes + expansion - GAP_SIZE);
+		  memmove (GAP_END_ADDR - bytes,
+			   GPT_ADDR + old_gap_size - bytes, bytes);
+		}
+	      src_end = GAP_END_ADDR;
+	      src = src_end - bytes;
+	      dst = src - expansion;
+	      /* Once the text has caught up, the rest is in place.  */
+	      while (dst < src)
+		{
+		  int c = *src++, len;
+
+		  if (c < 0x80)
+		    *dst++ = c;
+		  else if (utf_8
+			   && (len = utf_8_sequence_length (src - 1, src_end,
+							    1)) > 0)
+		    {
+		      src--;
+		      while (len-- > 0)
+			*dst++ = *src++;
+		    }
+		  else
+		    {
+		      *dst++ = lead + ((c >> 6) & 1);
+		      *dst++ = 0x80 + (c & 0x3F);
+		    }
+		}
+	      bytes += expansion;
+	    }
 	  coding->produced = bytes;
 	  coding->produced_char = chars;
 	  insert_from_gap (chars, bytes, 1);
@@ -8182,6 +8662,7 @@ decode_coding_object (struct coding_system *coding,
 	{
 	  struct Lisp_Marker *tail;
 
+	  unindex_overlays (from, from + coding->produced, 0);
 	  for (tail = BUF_MARKERS (current_buffer); tail; tail = tail->next)
 	    if (tail->need_adjustment)
 	      {
@@ -8383,6 +8864,7 @@ encode_coding_object (struct coding_system *coding,
 	{
 	  struct Lisp_Marker *tail;
 
+	  unindex_overlays (from, from + coding->produced, 0);
 	  for (tail = BUF_MARKERS (current_buffer); tail; tail = tail->next)
 	    if (tail->need_adjustment)
 	      {
@@ -8603,6 +9085,13 @@ detect_coding_system (const unsigned char *src,
       /* Skip all ASCII bytes except for a few ISO2022 controls.  */
       for (; src < src_end; src++)
 	{
+	  ptrdiff_t n = graphic_ascii_words (src, src_end);
+
+	  src += n;
+	  if (! eight_bit_found)
+	    coding.head_ascii += n;
+	  if (src == src_end)
+	    break;
 	  c = *src;
 	  if (c & 0x80)
 	    {
@@ -11205,6 +11694,14 @@ decode text as usual.  */);
 Internal use only.  Removed after the experimental optimizer gets stable. */);
   disable_ascii_optimization = 0;
 
+  DEFVAR_INT ("decoding-threads", decoding_threads,
+	      doc: /* Maximum number of threads that decoding a large text may use.
+Decoding a large UTF-8, Latin-1 or raw-text file into a buffer checks
+or counts the bytes of the text in pieces, in parallel, using up to
+this many threads.  Zero means as many threads as there are
+processors, but no more than 8.  One means not to use threads.  */);
+  decoding_threads = 0;
+
   DEFVAR_LISP ("translation-table-for-input", Vtranslation_table_for_input,
 	       doc: /* Char table for translating self-inserting characters.
 This is applied to the result of input methods, not their input.
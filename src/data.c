@@ -665,6 +665,7 @@ Return SYMBOL.  */)
   if (NILP (symbol) || EQ (symbol, Qt))
     xsignal1 (Qsetting_constant, symbol);
   set_symbol_function (symbol, Qnil);
+  invalidate_call_caches ();
   return symbol;
 }
 
@@ -711,6 +712,7 @@ DEFUN ("fset", Ffset, Sfset, 2, 2, 0,
     Fput (symbol, Qautoload, XCDR (function));
 
   set_symbol_function (symbol, definition);
+  invalidate_call_caches ();
 
   return definition;
 }
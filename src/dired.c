@@ -54,8 +54,30 @@ static Lisp_Object Qfile_name_all_completions;
 static Lisp_Object Qfile_attributes;
 static Lisp_Object Qfile_attributes_lessp;
 
+static Lisp_Object Qdirectory_files_recursively;
+
+/* The names of the elements of a `file-attributes' list, in a vector,
+   or nil where an element has no name.  */
+static Lisp_Object file_attribute_names;
+
+/* The user and group names last looked up for the attributes of the
+   files in a directory; most files there have the same owner.  */
+struct owner_names
+{
+  /* Whether UID and GID have been looked up.  */
+  bool uid_valid, gid_valid;
+  uid_t uid;
+  gid_t gid;
+  /* Their names, or empty strings if they have none.  Names too long
+     for these are looked up every time.  */
+  char uname[64], gname[64];
+};
+
 static ptrdiff_t scmp (const char *, const char *, ptrdiff_t);
-static Lisp_Object file_attributes (int, char const *, Lisp_Object);
+static Lisp_Object file_attributes (int, char const *, Lisp_Object,
+				    struct owner_names *);
+static Lisp_Object stat_attribute (int, int, char const *, struct stat *,
+				   Lisp_Object, struct owner_names *);
 
 /* Return the number of bytes in DP's name.  */
 static ptrdiff_t
@@ -142,6 +164,7 @@ directory_files_internal (Lisp_Object directory, Lisp_Object full,
   ptrdiff_t count = SPECPDL_INDEX ();
   struct gcpro gcpro1, gcpro2, gcpro3, gcpro4, gcpro5;
   struct dirent *dp;
+  struct owner_names names;
 #ifdef WINDOWSNT
   Lisp_Object w32_save = Qnil;
 #endif
@@ -149,6 +172,7 @@ directory_files_internal (Lisp_Object directory, Lisp_Object full,
   /* Because of file name handlers, these functions might call
      Ffuncall, and cause a GC.  */
   list = encoded_directory = dirfilename = Qnil;
+  names.uid_valid = names.gid_valid = 0;
   GCPRO5 (match, directory, list, dirfilename, encoded_directory);
   dirfilename = Fdirectory_file_name (directory);
 
@@ -296,7 +320,7 @@ directory_files_internal (Lisp_Object directory, Lisp_Object full,
 	  if (attrs)
 	    {
 	      Lisp_Object fileattrs
-		= file_attributes (fd, dp->d_name, id_format);
+		= file_attributes (fd, dp->d_name, id_format, &names);
 	      list = Fcons (Fcons (finalname, fileattrs), list);
 	    }
 	  else
@@ -378,6 +402,233 @@ which see.  */)
 }
 
 
+/* Return the index in a `file-attributes' list of the element named
+   ATTR.  */
+
+static int
+file_attribute_index (Lisp_Object attr)
+{
+  ptrdiff_t i;
+
+  CHECK_SYMBOL (attr);
+  for (i = 0; i < ASIZE (file_attribute_names); i++)
+    if (!NILP (attr) && EQ (AREF (file_attribute_names, i), attr))
+      return i;
+  error ("Unknown file attribute: %s", SDATA (SYMBOL_NAME (attr)));
+}
+
+/* Implement Fdirectory_files_recursively, once DIRECTORY is expanded
+   and known to have no file name handler.  */
+
+static Lisp_Object
+directory_files_recursively (Lisp_Object directory, Lisp_Object match,
+			     Lisp_Object include_directories,
+			     Lisp_Object attributes, Lisp_Object id_format)
+{
+  Lisp_Object list, dirs, dir, encoded, tail;
+  bool all_attrs = EQ (attributes, Qt);
+  bool need_stat = all_attrs;
+  bool top = 1;
+  ptrdiff_t nattrs = 0;
+  int *attrs = NULL;
+  struct owner_names names;
+  struct gcpro gcpro1, gcpro2, gcpro3, gcpro4, gcpro5;
+  USE_SAFE_ALLOCA;
+
+  if (!NILP (match))
+    CHECK_STRING (match);
+  if (!all_attrs && !NILP (attributes))
+    {
+      CHECK_LIST (attributes);
+      SAFE_NALLOCA (attrs, 1, XFASTINT (Flength (attributes)));
+      for (tail = attributes; CONSP (tail); tail = XCDR (tail))
+	{
+	  attrs[nattrs] = file_attribute_index (XCAR (tail));
+	  /* The type of most files is known without calling stat.  */
+	  if (attrs[nattrs] != 0)
+	    need_stat = 1;
+	  nattrs++;
+	}
+    }
+  names.uid_valid = names.gid_valid = 0;
+
+  list = encoded = dir = Qnil;
+  dirs = list1 (directory);
+  GCPRO5 (match, list, dirs, dir, encoded);
+
+  /* DIRS is a stack of the directories left to read.  */
+  while (CONSP (dirs))
+    {
+      DIR *d;
+      int fd;
+      struct dirent *dp;
+      struct re_pattern_buffer *bufp = NULL;
+      ptrdiff_t count = SPECPDL_INDEX ();
+
+      dir = Ffile_name_as_directory (XCAR (dirs));
+      dirs = XCDR (dirs);
+      encoded = ENCODE_FILE (dir);
+
+      d = open_directory (SSDATA (encoded), &fd);
+      if (d == NULL)
+	{
+	  /* Skip the subdirectories that cannot be read.  */
+	  if (top)
+	    report_file_error ("Opening directory", directory);
+	  continue;
+	}
+      top = 0;
+      record_unwind_protect_ptr (directory_files_internal_unwind, d);
+
+      /* ENCODE_FILE can run Lisp, so compile MATCH again for each
+	 directory; compile_pattern caches it.  */
+      if (!NILP (match))
+#ifdef WINDOWSNT
+	bufp = compile_pattern (match, 0,
+				BVAR (&buffer_defaults, case_canon_table),
+				0, 1);
+#else
+	bufp = compile_pattern (match, 0, Qnil, 0, 1);
+#endif
+      re_match_object = Qt;
+
+      for (;;)
+	{
+	  ptrdiff_t len;
+	  bool have_stat = 0, is_dir, is_link, wanted;
+	  struct stat st;
+	  Lisp_Object name, fullname;
+	  struct gcpro gcpro1, gcpro2;
+
+	  errno = 0;
+	  dp = readdir (d);
+	  if (!dp)
+	    {
+	      if (errno == EAGAIN || errno == EINTR)
+		{
+		  QUIT;
+		  continue;
+		}
+	      break;
+	    }
+
+	  len = dirent_namelen (dp);
+	  if (dp->d_name[0] == '.'
+	      && (len == 1 || (len == 2 && dp->d_name[1] == '.')))
+	    continue;
+
+#ifdef HAVE_STRUCT_DIRENT_D_TYPE
+	  if (dp->d_type != DT_UNKNOWN)
+	    {
+	      is_dir = dp->d_type == DT_DIR;
+	      is_link = dp->d_type == DT_LNK;
+	    }
+	  else
+#endif
+	    {
+	      have_stat = fstatat (fd, dp->d_name, &st,
+				   AT_SYMLINK_NOFOLLOW) == 0;
+	      if (!have_stat)
+		continue;
+	      is_dir = S_ISDIR (st.st_mode);
+	      is_link = S_ISLNK (st.st_mode);
+	    }
+
+	  name = fullname = Qnil;
+	  GCPRO2 (name, fullname);
+	  name = DECODE_FILE (make_unibyte_string (dp->d_name, len));
+	  fullname = concat2 (dir, name);
+	  if (is_dir)
+	    dirs = Fcons (fullname, dirs);
+
+	  immediate_quit = 1;
+	  QUIT;
+	  wanted = (NILP (match)
+		    || re_search (bufp, SSDATA (name), SBYTES (name),
+				  0, SBYTES (name), 0) >= 0);
+	  immediate_quit = 0;
+
+	  if (wanted && (!is_dir || !NILP (include_directories)))
+	    {
+	      if (NILP (attributes))
+		list = Fcons (fullname, list);
+	      else
+		{
+		  Lisp_Object fileattrs = Qnil;
+		  ptrdiff_t i;
+
+		  if (all_attrs)
+		    fileattrs = file_attributes (fd, dp->d_name, id_format,
+						 &names);
+		  else
+		    {
+		      if (need_stat && !have_stat)
+			have_stat = fstatat (fd, dp->d_name, &st,
+					     AT_SYMLINK_NOFOLLOW) == 0;
+		      if (have_stat || !need_stat)
+			for (i = nattrs - 1; i >= 0; i--)
+			  fileattrs
+			    = Fcons ((have_stat
+				      ? stat_attribute (attrs[i], fd, dp->d_name,
+							&st, id_format, &names)
+				      : is_link
+				      ? emacs_readlinkat (fd, dp->d_name)
+				      : is_dir ? Qt : Qnil),
+				     fileattrs);
+		    }
+		  list = Fcons (Fcons (fullname, fileattrs), list);
+		}
+	    }
+
+	  UNGCPRO;
+	}
+
+      unbind_to (count, Qnil);
+    }
+
+  UNGCPRO;
+  SAFE_FREE ();
+  return Fnreverse (list);
+}
+
+DEFUN ("directory-files-recursively", Fdirectory_files_recursively,
+       Sdirectory_files_recursively, 1, 5, 0,
+       doc: /* Return a list of the files in DIRECTORY and its subdirectories.
+The file names are absolute.  Symbolic links to directories are listed
+like other files, but not followed.  The list is not sorted.
+There are four optional arguments:
+If MATCH is non-nil, mention only files whose names, without their
+ directory, match the regexp MATCH.  Subdirectories are searched
+ whether their names match or not.
+If INCLUDE-DIRECTORIES is non-nil, mention subdirectories too.
+If ATTRIBUTES is non-nil, each element is of the form (FILE . ATTRS).
+ If ATTRIBUTES is t, ATTRS is the list that `file-attributes' returns.
+ Otherwise ATTRIBUTES is a list of some of the symbols `type', `links',
+ `uid', `gid', `atime', `mtime', `ctime', `size', `modes', `inode' and
+ `device', which name the elements of that list in order, and ATTRS
+ is the list of the elements named.  Asking only for `type' usually
+ saves calling `stat' for each file.  ATTRS is nil for a file that was
+ removed while DIRECTORY was read.
+ID-FORMAT specifies the preferred format of attributes uid and gid, see
+`file-attributes' for further documentation.  */)
+  (Lisp_Object directory, Lisp_Object match, Lisp_Object include_directories,
+   Lisp_Object attributes, Lisp_Object id_format)
+{
+  Lisp_Object handler;
+  directory = Fexpand_file_name (directory, Qnil);
+
+  /* If the file name has special constructs in it,
+     call the corresponding file handler.  */
+  handler = Ffind_file_name_handler (directory, Qdirectory_files_recursively);
+  if (!NILP (handler))
+    return call6 (handler, Qdirectory_files_recursively, directory,
+		  match, include_directories, attributes, id_format);
+
+  return directory_files_recursively (directory, match, include_directories,
+				      attributes, id_format);
+}
+
+
 static Lisp_Object file_name_completion (Lisp_Object, Lisp_Object, bool,
 					 Lisp_Object);
 
@@ -913,21 +1164,133 @@ so last access time will always be midnight of that day.  */)
     }
 
   encoded = ENCODE_FILE (filename);
-  return file_attributes (AT_FDCWD, SSDATA (encoded), id_format);
+  return file_attributes (AT_FDCWD, SSDATA (encoded), id_format, NULL);
 }
 
+/* Return the name of the owner of the file whose status is ST, or its
+   uid if it has none.  Use and update NAMES if it is not null.  */
+
 static Lisp_Object
-file_attributes (int fd, char const *name, Lisp_Object id_format)
+file_owner_name (struct stat *st, struct owner_names *names)
+{
+  char *uname;
+
+  if (names && names->uid_valid && names->uid == st->st_uid)
+    uname = names->uname[0] ? names->uname : NULL;
+  else
+    {
+      block_input ();
+      uname = stat_uname (st);
+      if (names && (!uname || strlen (uname) < sizeof names->uname))
+	{
+	  names->uid_valid = 1;
+	  names->uid = st->st_uid;
+	  strcpy (names->uname, uname ? uname : "");
+	}
+      unblock_input ();
+    }
+
+  if (uname)
+    return DECODE_SYSTEM (build_string (uname));
+  else
+    return make_fixnum_or_float (st->st_uid);
+}
+
+/* Likewise for the group of the file.  */
+
+static Lisp_Object
+file_group_name (struct stat *st, struct owner_names *names)
+{
+  char *gname;
+
+  if (names && names->gid_valid && names->gid == st->st_gid)
+    gname = names->gname[0] ? names->gname : NULL;
+  else
+    {
+      block_input ();
+      gname = stat_gname (st);
+      if (names && (!gname || strlen (gname) < sizeof names->gname))
+	{
+	  names->gid_valid = 1;
+	  names->gid = st->st_gid;
+	  strcpy (names->gname, gname ? gname : "");
+	}
+      unblock_input ();
+    }
+
+  if (gname)
+    return DECODE_SYSTEM (build_string (gname));
+  else
+    return make_fixnum_or_float (st->st_gid);
+}
+
+/* Return element I of the `file-attributes' list for file NAME
+   relative to directory FD, whose status is S.  ID_FORMAT is as for
+   `file-attributes'; NAMES, if not null, caches the names of owners.  */
+
+static Lisp_Object
+stat_attribute (int i, int fd, char const *name, struct stat *s,
+		Lisp_Object id_format, struct owner_names *names)
+{
+  bool want_names = !(NILP (id_format) || EQ (id_format, Qinteger));
+
+  switch (i)
+    {
+    case 0:
+      if (S_ISLNK (s->st_mode))
+	return (fd == AT_FDCWD ? file_status_readlink (name)
+		: emacs_readlinkat (fd, name));
+      return S_ISDIR (s->st_mode) ? Qt : Qnil;
+    case 1:
+      return make_number (s->st_nlink);
+    case 2:
+      return (want_names ? file_owner_name (s, names)
+	      : make_fixnum_or_float (s->st_uid));
+    case 3:
+      return (want_names ? file_group_name (s, names)
+	      : make_fixnum_or_float (s->st_gid));
+    case 4:
+      return make_lisp_time (get_stat_atime (s));
+    case 5:
+      return make_lisp_time (get_stat_mtime (s));
+    case 6:
+      return make_lisp_time (get_stat_ctime (s));
+    case 7:
+      /* If the file size is a 4-byte type, assume that files of sizes in
+	 the 2-4 GiB range wrap around to negative values, as this is a
+	 common bug on older 32-bit platforms.  */
+      if (sizeof (s->st_size) == 4)
+	return make_fixnum_or_float (s->st_size & 0xffffffffu);
+      else
+	return make_fixnum_or_float (s->st_size);
+    case 8:
+      {
+	/* An array to hold the mode string generated by filemodestring,
+	   including its terminating space and null byte.  */
+	char modes[sizeof "-rwxr-xr-x "];
+
+	filemodestring (s, modes);
+	return make_string (modes, 10);
+      }
+    case 9:
+      return Qt;
+    case 10:
+      return INTEGER_TO_CONS (s->st_ino);
+    case 11:
+      return INTEGER_TO_CONS (s->st_dev);
+    default:
+      emacs_abort ();
+    }
+}
+
+static Lisp_Object
+file_attributes (int fd, char const *name, Lisp_Object id_format,
+		 struct owner_names *names)
 {
   Lisp_Object values[12];
   struct stat s;
   int lstat_result;
-
-  /* An array to hold the mode string generated by filemodestring,
-     including its terminating space and null byte.  */
-  char modes[sizeof "-rwxr-xr-x "];
-
-  char *uname = NULL, *gname = NULL;
+  int i;
 
 #ifdef WINDOWSNT
   /* We usually don't request accurate owner and group info, because
@@ -937,7 +1300,8 @@ file_attributes (int fd, char const *name, Lisp_Object id_format)
   w32_stat_get_owner_group = 1;
 #endif
 
-  lstat_result = fstatat (fd, name, &s, AT_SYMLINK_NOFOLLOW);
+  lstat_result = (fd == AT_FDCWD ? file_status (name, &s, 0)
+		  : fstatat (fd, name, &s, AT_SYMLINK_NOFOLLOW));
 
 #ifdef WINDOWSNT
   w32_stat_get_owner_group = 0;
@@ -946,43 +1310,8 @@ file_attributes (int fd, char const *name, Lisp_Object id_format)
   if (lstat_result < 0)
     return Qnil;
 
-  values[0] = (S_ISLNK (s.st_mode) ? emacs_readlinkat (fd, name)
-	       : S_ISDIR (s.st_mode) ? Qt : Qnil);
-  values[1] = make_number (s.st_nlink);
-
-  if (!(NILP (id_format) || EQ (id_format, Qinteger)))
-    {
-      block_input ();
-      uname = stat_uname (&s);
-      gname = stat_gname (&s);
-      unblock_input ();
-    }
-  if (uname)
-    values[2] = DECODE_SYSTEM (build_string (uname));
-  else
-    values[2] = make_fixnum_or_float (s.st_uid);
-  if (gname)
-    values[3] = DECODE_SYSTEM (build_string (gname));
-  else
-    values[3] = make_fixnum_or_float (s.st_gid);
-
-  values[4] = make_lisp_time (get_stat_atime (&s));
-  values[5] = make_lisp_time (get_stat_mtime (&s));
-  values[6] = make_lisp_time (get_stat_ctime (&s));
-
-  /* If the file size is a 4-byte type, assume that files of sizes in
-     the 2-4 GiB range wrap around to negative values, as this is a
-     common bug on older 32-bit platforms.  */
-  if (sizeof (s.st_size) == 4)
-    values[7] = make_fixnum_or_float (s.st_size & 0xffffffffu);
-  else
-    values[7] = make_fixnum_or_float (s.st_size);
-
-  filemodestring (&s, modes);
-  values[8] = make_string (modes, 10);
-  values[9] = Qt;
-  values[10] = INTEGER_TO_CONS (s.st_ino);
-  values[11] = INTEGER_TO_CONS (s.st_dev);
+  for (i = 0; i < sizeof (values) / sizeof (values[0]); i++)
+    values[i] = stat_attribute (i, fd, name, &s, id_format, names);
 
   return Flist (sizeof (values) / sizeof (values[0]), values);
 }
@@ -1043,10 +1372,12 @@ syms_of_dired (void)
   DEFSYM (Qfile_name_all_completions, "file-name-all-completions");
   DEFSYM (Qfile_attributes, "file-attributes");
   DEFSYM (Qfile_attributes_lessp, "file-attributes-lessp");
+  DEFSYM (Qdirectory_files_recursively, "directory-files-recursively");
   DEFSYM (Qdefault_directory, "default-directory");
 
   defsubr (&Sdirectory_files);
   defsubr (&Sdirectory_files_and_attributes);
+  defsubr (&Sdirectory_files_recursively);
   defsubr (&Sfile_name_completion);
   defsubr (&Sfile_name_all_completions);
   defsubr (&Sfile_attributes);
@@ -1054,6 +1385,20 @@ syms_of_dired (void)
   defsubr (&Ssystem_users);
   defsubr (&Ssystem_groups);
 
+  file_attribute_names = Fmake_vector (make_number (12), Qnil);
+  ASET (file_attribute_names, 0, intern_c_string ("type"));
+  ASET (file_attribute_names, 1, intern_c_string ("links"));
+  ASET (file_attribute_names, 2, intern_c_string ("uid"));
+  ASET (file_attribute_names, 3, intern_c_string ("gid"));
+  ASET (file_attribute_names, 4, intern_c_string ("atime"));
+  ASET (file_attribute_names, 5, intern_c_string ("mtime"));
+  ASET (file_attribute_names, 6, intern_c_string ("ctime"));
+  ASET (file_attribute_names, 7, intern_c_string ("size"));
+  ASET (file_attribute_names, 8, intern_c_string ("modes"));
+  ASET (file_attribute_names, 10, intern_c_string ("inode"));
+  ASET (file_attribute_names, 11, intern_c_string ("device"));
+  staticpro (&file_attribute_names);
+
   DEFVAR_LISP ("completion-ignored-extensions", Vcompletion_ignored_extensions,
 	       doc: /* Completion ignores file names ending in any string in this list.
 It does not ignore them if all possible completions end in one of
@@ -2879,6 +2879,7 @@ Both characters must have the same length of multi-byte form.  */)
      Also inhibit locking the file.  */
   if (!changed && !NILP (noundo))
     {
+      unpack_undo_log (current_buffer);
       record_unwind_protect (subst_char_in_region_unwind,
 			     BVAR (current_buffer, undo_list));
       bset_undo_list (current_buffer, Qt);
@@ -2948,6 +2949,7 @@ Both characters must have the same length of multi-byte form.  */)
 
 	      struct gcpro gcpro1;
 
+	      unpack_undo_log (current_buffer);
 	      tem = BVAR (current_buffer, undo_list);
 	      GCPRO1 (tem);
 
@@ -4571,6 +4573,11 @@ Transposing beyond buffer boundaries is an error.  */)
   len1_byte = CHAR_TO_BYTE (end1) - start1_byte;
   len2_byte = end2_byte - start2_byte;
 
+  /* The text is moved below without going through insdel.c, so forget
+     the byte positions it remembers, whether or not the markers are
+     updated.  */
+  clear_charpos_cache (current_buffer);
+
 #ifdef BYTE_COMBINING_DEBUG
   if (end1 == start2)
     {
@@ -4763,11 +4770,16 @@ Transposing beyond buffer boundaries is an error.  */)
       update_compositions (end2 - len1, end2, CHECK_BORDER);
     }
 
+  /* Positions remembered while moving the text, and before PT was
+     updated, are no longer valid.  */
+  clear_charpos_cache (current_buffer);
+
   /* When doing multiple transpositions, it might be nice
      to optimize this.  Perhaps the markers in any one buffer
      should be organized in some sorted data tree.  */
   if (NILP (leave_markers))
     {
+      unindex_overlays (start1, end2 - 1, 0);
       transpose_markers (start1, end1, start2, end2,
 			 start1_byte, start1_byte + len1_byte,
 			 start2_byte, start2_byte + len2_byte);
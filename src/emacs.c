@@ -1368,6 +1368,7 @@ Using an Emacs configured with --with-x-toolkit=lucid does not have this problem
       syms_of_marker ();
       syms_of_minibuf ();
       syms_of_process ();
+      syms_of_region_cache ();
       syms_of_search ();
       syms_of_frame ();
       syms_of_syntax ();
@@ -2775,21 +2775,12 @@ DEFUN ("functionp", Ffunctionp, Sfunctionp, 1, 1, 0,
   return Qnil;
 }
 
-DEFUN ("funcall", Ffuncall, Sfuncall, 1, MANY, 0,
-       doc: /* Call first argument as a function, passing remaining arguments to it.
-Return the value that function returns.
-Thus, (funcall 'cons 'x 'y) returns (x . y).
-usage: (funcall FUNCTION &rest ARGUMENTS)  */)
-  (ptrdiff_t nargs, Lisp_Object *args)
-{
-  Lisp_Object fun, original_fun;
-  Lisp_Object funcar;
-  ptrdiff_t numargs = nargs - 1;
-  Lisp_Object lisp_numargs;
-  Lisp_Object val;
-  register Lisp_Object *internal_args;
-  ptrdiff_t i;
+/* Do what Ffuncall does before calling ARGS[0] with the NARGS - 1
+   arguments that follow it.  */
 
+static void
+begin_funcall (ptrdiff_t nargs, Lisp_Object *args)
+{
   QUIT;
 
   if (++lisp_eval_depth > max_lisp_eval_depth)
@@ -2808,6 +2799,100 @@ usage: (funcall FUNCTION &rest ARGUMENTS)  */)
 
   if (debug_on_next_call)
     do_debug_on_call (Qlambda);
+}
+
+/* Do what Ffuncall does after a call that returned VAL, and return
+   the value of the call.  */
+
+static Lisp_Object
+end_funcall (Lisp_Object val)
+{
+  lisp_eval_depth--;
+  if (backtrace_debug_on_exit (specpdl_ptr - 1))
+    val = call_debugger (list2 (Qexit, val));
+  specpdl_ptr--;
+  return val;
+}
+
+/* Call SUBR with the NUMARGS arguments in ARGS.  The caller has
+   checked that SUBR accepts that many arguments and is not a special
+   form.  */
+
+static Lisp_Object
+funcall_subr (struct Lisp_Subr *subr, ptrdiff_t numargs, Lisp_Object *args)
+{
+  Lisp_Object *internal_args;
+  ptrdiff_t i;
+
+  if (subr->max_args == MANY)
+    return (subr->function.aMANY) (numargs, args);
+
+  if (subr->max_args > numargs)
+    {
+      internal_args = alloca (subr->max_args * sizeof *internal_args);
+      memcpy (internal_args, args, numargs * word_size);
+      for (i = numargs; i < subr->max_args; i++)
+	internal_args[i] = Qnil;
+    }
+  else
+    internal_args = args;
+  switch (subr->max_args)
+    {
+    case 0:
+      return (subr->function.a0 ());
+    case 1:
+      return (subr->function.a1 (internal_args[0]));
+    case 2:
+      return (subr->function.a2 (internal_args[0], internal_args[1]));
+    case 3:
+      return (subr->function.a3
+	      (internal_args[0], internal_args[1], internal_args[2]));
+    case 4:
+      return (subr->function.a4
+	      (internal_args[0], internal_args[1], internal_args[2],
+	       internal_args[3]));
+    case 5:
+      return (subr->function.a5
+	      (internal_args[0], internal_args[1], internal_args[2],
+	       internal_args[3], internal_args[4]));
+    case 6:
+      return (subr->function.a6
+	      (internal_args[0], internal_args[1], internal_args[2],
+	       internal_args[3], internal_args[4], internal_args[5]));
+    case 7:
+      return (subr->function.a7
+	      (internal_args[0], internal_args[1], internal_args[2],
+	       internal_args[3], internal_args[4], internal_args[5],
+	       internal_args[6]));
+    case 8:
+      return (subr->function.a8
+	      (internal_args[0], internal_args[1], internal_args[2],
+	       internal_args[3], internal_args[4], internal_args[5],
+	       internal_args[6], internal_args[7]));
+
+    default:
+
+      /* If a subr takes more than 8 arguments without using MANY
+	 or UNEVALLED, we need to extend this function to support it.
+	 Until this is done, there is no way to call the function.  */
+      emacs_abort ();
+    }
+}
+
+DEFUN ("funcall", Ffuncall, Sfuncall, 1, MANY, 0,
+       doc: /* Call first argument as a function, passing remaining arguments to it.
+Return the value that function returns.
+Thus, (funcall 'cons 'x 'y) returns (x . y).
+usage: (funcall FUNCTION &rest ARGUMENTS)  */)
+  (ptrdiff_t nargs, Lisp_Object *args)
+{
+  Lisp_Object fun, original_fun;
+  Lisp_Object funcar;
+  ptrdiff_t numargs = nargs - 1;
+  Lisp_Object lisp_numargs;
+  Lisp_Object val;
+
+  begin_funcall (nargs, args);
 
   check_cons_list ();
 
@@ -2833,73 +2918,8 @@ usage: (funcall FUNCTION &rest ARGUMENTS)  */)
       else if (XSUBR (fun)->max_args == UNEVALLED)
 	xsignal1 (Qinvalid_function, original_fun);
 
-      else if (XSUBR (fun)->max_args == MANY)
-	val = (XSUBR (fun)->function.aMANY) (numargs, args + 1);
       else
-	{
-	  if (XSUBR (fun)->max_args > numargs)
-	    {
-	      internal_args = alloca (XSUBR (fun)->max_args
-				      * sizeof *internal_args);
-	      memcpy (internal_args, args + 1, numargs * word_size);
-	      for (i = numargs; i < XSUBR (fun)->max_args; i++)
-		internal_args[i] = Qnil;
-	    }
-	  else
-	    internal_args = args + 1;
-	  switch (XSUBR (fun)->max_args)
-	    {
-	    case 0:
-	      val = (XSUBR (fun)->function.a0 ());
-	      break;
-	    case 1:
-	      val = (XSUBR (fun)->function.a1 (internal_args[0]));
-	      break;
-	    case 2:
-	      val = (XSUBR (fun)->function.a2
-		     (internal_args[0], internal_args[1]));
-	      break;
-	    case 3:
-	      val = (XSUBR (fun)->function.a3
-		     (internal_args[0], internal_args[1], internal_args[2]));
-	      break;
-	    case 4:
-	      val = (XSUBR (fun)->function.a4
-		     (internal_args[0], internal_args[1], internal_args[2],
-		     internal_args[3]));
-	      break;
-	    case 5:
-	      val = (XSUBR (fun)->function.a5
-		     (internal_args[0], internal_args[1], internal_args[2],
-		      internal_args[3], internal_args[4]));
-	      break;
-	    case 6:
-	      val = (XSUBR (fun)->function.a6
-		     (internal_args[0], internal_args[1], internal_args[2],
-		      internal_args[3], internal_args[4], internal_args[5]));
-	      break;
-	    case 7:
-	      val = (XSUBR (fun)->function.a7
-		     (internal_args[0], internal_args[1], internal_args[2],
-		      internal_args[3], internal_args[4], internal_args[5],
-		      internal_args[6]));
-	      break;
-
-	    case 8:
-	      val = (XSUBR (fun)->function.a8
-		     (internal_args[0], internal_args[1], internal_args[2],
-		      internal_args[3], internal_args[4], internal_args[5],
-		      internal_args[6], internal_args[7]));
-	      break;
-
-	    default:
-
-	      /* If a subr takes more than 8 arguments without using MANY
-		 or UNEVALLED, we need to extend this function to support it.
-		 Until this is done, there is no way to call the function.  */
-	      emacs_abort ();
-	    }
-	}
+	val = funcall_subr (XSUBR (fun), numargs, args + 1);
     }
   else if (COMPILEDP (fun))
     val = funcall_lambda (fun, numargs, args + 1);
@@ -2925,13 +2945,30 @@ usage: (funcall FUNCTION &rest ARGUMENTS)  */)
 	xsignal1 (Qinvalid_function, original_fun);
     }
   check_cons_list ();
-  lisp_eval_depth--;
-  if (backtrace_debug_on_exit (specpdl_ptr - 1))
-    val = call_debugger (list2 (Qexit, val));
-  specpdl_ptr--;
-  return val;
+  return end_funcall (val);
 }
-
+
+/* Call ARGS[0] with the NARGS - 1 arguments that follow it, like
+   Ffuncall, when the caller has already found its definition FUN.
+   FUN must be a subroutine that accepts that many arguments and is
+   not a special form, or a byte-code function with an integer
+   argument template and its byte-code string loaded.  The byte-code
+   interpreter uses this for calls it has cached.  */
+
+Lisp_Object
+funcall_known (Lisp_Object fun, ptrdiff_t nargs, Lisp_Object *args)
+{
+  Lisp_Object val;
+
+  begin_funcall (nargs, args);
+  if (SUBRP (fun))
+    val = funcall_subr (XSUBR (fun), nargs - 1, args + 1);
+  else
+    val = exec_compiled_function (fun, AREF (fun, COMPILED_ARGLIST),
+				  nargs - 1, args + 1);
+  return end_funcall (val);
+}
+
 static Lisp_Object
 apply_lambda (Lisp_Object fun, Lisp_Object args)
 {
@@ -3021,11 +3058,7 @@ funcall_lambda (Lisp_Object fun, ptrdiff_t nargs,
 	     and constants vector yet, fetch them from the file.  */
 	  if (CONSP (AREF (fun, COMPILED_BYTECODE)))
 	    Ffetch_bytecode (fun);
-	  return exec_byte_code (AREF (fun, COMPILED_BYTECODE),
-				 AREF (fun, COMPILED_CONSTANTS),
-				 AREF (fun, COMPILED_STACK_DEPTH),
-				 syms_left,
-				 nargs, arg_vector);
+	  return exec_compiled_function (fun, syms_left, nargs, arg_vector);
 	}
       lexenv = Qnil;
     }
@@ -3087,10 +3120,7 @@ funcall_lambda (Lisp_Object fun, ptrdiff_t nargs,
 	 and constants vector yet, fetch them from the file.  */
       if (CONSP (AREF (fun, COMPILED_BYTECODE)))
 	Ffetch_bytecode (fun);
-      val = exec_byte_code (AREF (fun, COMPILED_BYTECODE),
-			    AREF (fun, COMPILED_CONSTANTS),
-			    AREF (fun, COMPILED_STACK_DEPTH),
-			    Qnil, 0, 0);
+      val = exec_compiled_function (fun, Qnil, 0, 0);
     }
 
   return unbind_to (count, val);
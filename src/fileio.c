@@ -91,6 +91,10 @@ along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
 
 #include "commands.h"
 
+#ifdef HAVE_INOTIFY
+#include <sys/inotify.h>
+#endif
+
 /* True during writing of auto-save files.  */
 static bool auto_saving;
 
@@ -2189,6 +2193,7 @@ entries (depending on how Emacs was built).  */)
     report_file_error ("Write error", newname);
 
   emacs_close (ifd);
+  forget_file_status (SSDATA (encoded_newname));
 
 #ifdef MSDOS
   /* In DJGPP v2.0 and later, fstat usually returns true file mode bits,
@@ -2226,6 +2231,7 @@ DEFUN ("make-directory-internal", Fmake_directory_internal,
   encoded_dir = ENCODE_FILE (directory);
 
   dir = SSDATA (encoded_dir);
+  forget_file_status (dir);
 
 #ifdef WINDOWSNT
   if (mkdir (dir) != 0)
@@ -2249,6 +2255,7 @@ DEFUN ("delete-directory-internal", Fdelete_directory_internal,
   directory = Fdirectory_file_name (Fexpand_file_name (directory, Qnil));
   encoded_dir = ENCODE_FILE (directory);
   dir = SSDATA (encoded_dir);
+  forget_file_status (dir);
 
   if (rmdir (dir) != 0)
     report_file_error ("Removing directory", directory);
@@ -2292,6 +2299,7 @@ With a prefix argument, TRASH is nil.  */)
     return call1 (Qmove_file_to_trash, filename);
 
   encoded_file = ENCODE_FILE (filename);
+  forget_file_status (SSDATA (encoded_file));
 
   if (unlink (SSDATA (encoded_file)) < 0)
     report_file_error ("Removing old name", filename);
@@ -2374,6 +2382,8 @@ This is what happens in interactive use with M-x.  */)
       || INTEGERP (ok_if_already_exists))
     barf_or_query_if_file_exists (newname, "rename to it",
 				  INTEGERP (ok_if_already_exists), 0, 0);
+  forget_file_status (SSDATA (encoded_file));
+  forget_file_status (SSDATA (encoded_newname));
   if (rename (SSDATA (encoded_file), SSDATA (encoded_newname)) < 0)
     {
       int rename_errno = errno;
@@ -2455,6 +2465,8 @@ This is what happens in interactive use with M-x.  */)
     barf_or_query_if_file_exists (newname, "make it a new name",
 				  INTEGERP (ok_if_already_exists), 0, 0);
 
+  forget_file_status (SSDATA (encoded_file));
+  forget_file_status (SSDATA (encoded_newname));
   unlink (SSDATA (newname));
   if (link (SSDATA (encoded_file), SSDATA (encoded_newname)) < 0)
     {
@@ -2516,6 +2528,7 @@ This happens for interactive use with M-x.  */)
       || INTEGERP (ok_if_already_exists))
     barf_or_query_if_file_exists (linkname, "make it a link",
 				  INTEGERP (ok_if_already_exists), 0, 0);
+  forget_file_status (SSDATA (encoded_linkname));
   if (symlink (SSDATA (encoded_filename), SSDATA (encoded_linkname)) < 0)
     {
       /* If we didn't complain already, silently delete existing file.  */
@@ -2560,6 +2573,9 @@ On Unix, this is a name starting with a `/' or a `~'.  */)
 bool
 check_existing (const char *filename)
 {
+  struct stat st;
+  if (!NILP (Vfile_attribute_cache))
+    return file_status (filename, &st, 1) == 0;
   return faccessat (AT_FDCWD, filename, F_OK, AT_EACCESS) == 0;
 }
 
@@ -2743,6 +2759,17 @@ If there is no error, returns nil.  */)
   return Qnil;
 }
 
+/* Return the symbolic link value BUF, as read from the file system,
+   as a Lisp file name.  */
+static Lisp_Object
+decode_link_target (char const *buf)
+{
+  Lisp_Object val = build_string (buf);
+  if (buf[0] == '/' && strchr (buf, ':'))
+    val = concat2 (build_string ("/:"), val);
+  return DECODE_FILE (val);
+}
+
 /* Relative to directory FD, return the symbolic link value of FILENAME.
    On failure, return nil.  */
 Lisp_Object
@@ -2757,15 +2784,657 @@ emacs_readlinkat (int fd, char const *filename)
   if (!buf)
     return Qnil;
 
-  val = build_string (buf);
-  if (buf[0] == '/' && strchr (buf, ':'))
-    val = concat2 (build_string ("/:"), val);
+  val = decode_link_target (buf);
   if (buf != readlink_buf)
     xfree (buf);
-  val = DECODE_FILE (val);
   return val;
 }
 
+/* Caching the status of files.
+
+   When `file-attribute-cache' is non-nil, the functions that only
+   look at the status of files get it through file_status, which
+   remembers it in file_status_cache, keyed by the encoded absolute
+   file name.  On GNU/Linux, the directory of each file cached and
+   the directories above it are watched with inotify.  The pending
+   inotify events are read before a lookup whenever Emacs has waited
+   for subprocesses since the last one, and at least every
+   STATUS_EVENTS_INTERVAL otherwise; so a lookup may miss what other
+   programs changed during the last STATUS_EVENTS_INTERVAL, while Emacs
+   was not waiting for them.  Files whose directory cannot be watched
+   are cached for `file-attribute-cache-ttl' seconds.  Emacs drops the
+   files that it changes itself from the cache either way.
+
+   Each value in the cache is a vector [STATUS LINK EXPIRY].  STATUS
+   is the struct stat that lstat returned, as a unibyte string, or the
+   errno it failed with.  LINK is the raw target of a symbolic link,
+   t if not read yet, or nil for other files.  EXPIRY is the time at
+   which the entry expires as a float, or nil if it is watched.
+
+   file_status_children maps the name of each directory that has files
+   in the cache, or directories leading to them, to a hash table whose
+   keys are the names of those files and directories.  This way,
+   dropping a directory and the files under it from the cache takes
+   time in proportion to the number of those files, not to the size of
+   the cache.  Every watched directory other than "/" is in there too,
+   so the directories to stop watching are found the same way.  */
+
+static Lisp_Object file_status_cache, file_status_children;
+
+/* The number of lookups answered from the cache, and of the others.  */
+static EMACS_INT file_status_hits, file_status_misses;
+
+/* Clear the cache when it grows beyond this many entries.  */
+enum { FILE_STATUS_CACHE_MAX = 1 << 17 };
+
+/* Follow at most this many symbolic links in a row.  */
+enum { FILE_STATUS_MAX_LINKS = 40 };
+
+/* True if programs may have changed files since the inotify events
+   were last read, as when Emacs has waited for a subprocess.  */
+bool file_status_outdated;
+
+#ifdef HAVE_INOTIFY
+/* The inotify instance that watches the directories of cached files;
+   -1 if not created yet, -2 if it cannot be.  */
+static int status_inotify_fd = -1;
+
+/* Read the pending inotify events when file_status_outdated is set,
+   and otherwise only once this time has come, so that each lookup
+   needs no system call.  */
+static struct timespec status_events_deadline;
+
+/* The nanoseconds between these reads.  */
+enum { STATUS_EVENTS_INTERVAL = 20000000 };
+
+/* Hash tables mapping the encoded names of the watched directories to
+   their watch descriptors, and each descriptor to the list of the
+   names under which its directory is watched.  */
+static Lisp_Object watched_directories, watch_directory_names;
+
+# define STATUS_WATCH_MASK						\
+  (IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_DELETE_SELF	\
+   | IN_MODIFY | IN_MOVE_SELF | IN_MOVED_FROM | IN_MOVED_TO		\
+   | IN_DONT_FOLLOW | IN_ONLYDIR)
+#endif
+
+static Lisp_Object
+make_status_table (struct hash_table_test test)
+{
+  return make_hash_table (test, make_number (DEFAULT_HASH_SIZE),
+			  make_float (DEFAULT_REHASH_SIZE),
+			  make_float (DEFAULT_REHASH_THRESHOLD),
+			  Qnil);
+}
+
+/* Return true if NAME, of NBYTES bytes, can be a key of the cache: an
+   absolute name without empty, "." or ".." components, so that it is
+   the only name for the file through its directories.  */
+
+static bool
+cacheable_file_name (char const *name, ptrdiff_t nbytes)
+{
+  ptrdiff_t i;
+
+  if (nbytes == 0 || name[0] != '/')
+    return 0;
+  if (nbytes == 1)
+    return 1;
+  if (name[nbytes - 1] == '/')
+    return 0;
+  for (i = 0; i < nbytes; i++)
+    if (name[i] == '/')
+      {
+	char const *p = name + i + 1;
+	ptrdiff_t left = nbytes - i - 1;
+
+	if (p[0] == '/'
+	    || (p[0] == '.' && (left == 1 || p[1] == '/'))
+	    || (p[0] == '.' && p[1] == '.' && (left == 2 || p[2] == '/')))
+	  return 0;
+      }
+  return 1;
+}
+
+/* Return the number of bytes of the name of the directory of NAME, a
+   cacheable file name of NBYTES bytes other than "/".  */
+
+static ptrdiff_t
+file_status_parent (char const *name, ptrdiff_t nbytes)
+{
+  while (name[nbytes - 1] != '/')
+    nbytes--;
+  return nbytes == 1 ? 1 : nbytes - 1;
+}
+
+/* Record in file_status_children that KEY, a cache key other than
+   "/", is in its directory, and so on up to the first directory that
+   was already there.  */
+
+static void
+link_file_status (Lisp_Object key)
+{
+  for (;;)
+    {
+      ptrdiff_t dirbytes = file_status_parent (SSDATA (key), SBYTES (key));
+      Lisp_Object dir = make_unibyte_string (SSDATA (key), dirbytes);
+      Lisp_Object children = Fgethash (dir, file_status_children, Qnil);
+      bool new_dir = NILP (children);
+
+      if (new_dir)
+	{
+	  children = make_hash_table (hashtest_equal, make_number (8),
+				      make_float (DEFAULT_REHASH_SIZE),
+				      make_float (DEFAULT_REHASH_THRESHOLD),
+				      Qnil);
+	  Fputhash (dir, children, file_status_children);
+	}
+      Fputhash (key, Qt, children);
+      if (!new_dir || dirbytes == 1)
+	return;
+      key = dir;
+    }
+}
+
+#ifdef HAVE_INOTIFY
+/* Stop watching directory KEY.  */
+
+static void
+unwatch_directory (Lisp_Object key)
+{
+  Lisp_Object wd = Fgethash (key, watched_directories, Qnil);
+  Lisp_Object names;
+
+  if (NILP (wd))
+    return;
+  Fremhash (key, watched_directories);
+  names = Fdelete (key, Fgethash (wd, watch_directory_names, Qnil));
+  if (CONSP (names))
+    Fputhash (wd, names, watch_directory_names);
+  else
+    {
+      Fremhash (wd, watch_directory_names);
+      inotify_rm_watch (status_inotify_fd, XINT (wd));
+    }
+}
+#endif
+
+/* Empty the cache, and stop watching directories for it.  */
+
+static void
+clear_file_status (void)
+{
+  Fclrhash (file_status_cache);
+  Fclrhash (file_status_children);
+#ifdef HAVE_INOTIFY
+  if (HASH_TABLE_P (watch_directory_names))
+    {
+      struct Lisp_Hash_Table *h = XHASH_TABLE (watch_directory_names);
+      ptrdiff_t i;
+
+      for (i = 0; i < HASH_TABLE_SIZE (h); i++)
+	if (!NILP (HASH_HASH (h, i)))
+	  inotify_rm_watch (status_inotify_fd, XINT (HASH_KEY (h, i)));
+      Fclrhash (watch_directory_names);
+      Fclrhash (watched_directories);
+    }
+#endif
+}
+
+/* Drop KEY and the files under it from the cache and from
+   file_status_children, and stop watching the directories among
+   them.  */
+
+static void
+forget_file_status_tree (Lisp_Object key)
+{
+  Lisp_Object children = Fgethash (key, file_status_children, Qnil);
+
+  Fremhash (key, file_status_cache);
+#ifdef HAVE_INOTIFY
+  /* The directories under KEY may not be there any more, or other
+     directories may have taken their names.  */
+  if (HASH_TABLE_P (watched_directories))
+    unwatch_directory (key);
+#endif
+  if (HASH_TABLE_P (children))
+    {
+      struct Lisp_Hash_Table *h = XHASH_TABLE (children);
+      ptrdiff_t i;
+
+      Fremhash (key, file_status_children);
+      for (i = 0; i < HASH_TABLE_SIZE (h); i++)
+	if (!NILP (HASH_HASH (h, i)))
+	  forget_file_status_tree (HASH_KEY (h, i));
+    }
+}
+
+/* Drop the status of NAME, of NBYTES bytes, from the cache, and if
+   TREE, those of the files under it too.  */
+
+static void
+forget_file_status_1 (char const *name, ptrdiff_t nbytes, bool tree)
+{
+  Lisp_Object key = make_unibyte_string (name, nbytes);
+  Lisp_Object siblings;
+
+  if (!tree)
+    {
+      Fremhash (key, file_status_cache);
+      return;
+    }
+  if (nbytes == 1)
+    {
+      clear_file_status ();
+      return;
+    }
+
+  siblings = Fgethash (make_unibyte_string (name,
+					    file_status_parent (name, nbytes)),
+		       file_status_children, Qnil);
+  if (HASH_TABLE_P (siblings))
+    Fremhash (key, siblings);
+  forget_file_status_tree (key);
+}
+
+/* Drop the status of the file named NAME, an encoded absolute name,
+   and of the files under it, from the cache.  Emacs calls this after
+   changing the file.  */
+
+void
+forget_file_status (char const *name)
+{
+  ptrdiff_t nbytes = strlen (name);
+
+  if (NILP (file_status_cache)
+      || XHASH_TABLE (file_status_cache)->count == 0)
+    return;
+
+  if (!cacheable_file_name (name, nbytes))
+    {
+      clear_file_status ();
+      return;
+    }
+
+  forget_file_status_1 (name, nbytes, 1);
+  /* Creating and deleting files changes their directory too.  */
+  if (nbytes > 1)
+    forget_file_status_1 (name, file_status_parent (name, nbytes), 0);
+}
+
+#ifdef HAVE_INOTIFY
+/* Update the cache according to the inotify event EV.  */
+
+static void
+handle_status_event (struct inotify_event const *ev)
+{
+  Lisp_Object wd = make_number (ev->wd);
+  Lisp_Object names
+    = Fcopy_sequence (Fgethash (wd, watch_directory_names, Qnil));
+  bool changed_names = (ev->mask & (IN_CREATE | IN_DELETE
+				    | IN_MOVED_FROM | IN_MOVED_TO)) != 0;
+
+  if (ev->mask & IN_Q_OVERFLOW)
+    {
+      clear_file_status ();
+      return;
+    }
+
+  for (; CONSP (names); names = XCDR (names))
+    {
+      Lisp_Object dir = XCAR (names);
+
+      if (ev->len > 0 && ev->name[0])
+	{
+	  /* An event about the file NAME in the directory DIR.  */
+	  ptrdiff_t dirbytes = SBYTES (dir) == 1 ? 0 : SBYTES (dir);
+	  ptrdiff_t namebytes = strlen (ev->name);
+	  USE_SAFE_ALLOCA;
+	  char *file = SAFE_ALLOCA (dirbytes + 1 + namebytes);
+
+	  memcpy (file, SDATA (dir), dirbytes);
+	  file[dirbytes] = '/';
+	  memcpy (file + dirbytes + 1, ev->name, namebytes);
+	  forget_file_status_1 (file, dirbytes + 1 + namebytes, changed_names);
+	  SAFE_FREE ();
+	  if (changed_names)
+	    forget_file_status_1 (SSDATA (dir), SBYTES (dir), 0);
+	}
+      else if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF
+			   | IN_IGNORED | IN_UNMOUNT))
+	forget_file_status_1 (SSDATA (dir), SBYTES (dir), 1);
+      else
+	forget_file_status_1 (SSDATA (dir), SBYTES (dir), 0);
+    }
+
+  if (ev->mask & IN_IGNORED)
+    {
+      /* The directory is not watched any more.  */
+      for (names = Fgethash (wd, watch_directory_names, Qnil);
+	   CONSP (names); names = XCDR (names))
+	Fremhash (XCAR (names), watched_directories);
+      Fremhash (wd, watch_directory_names);
+    }
+}
+
+/* Update the cache according to the pending inotify events.  */
+
+static void
+read_status_events (void)
+{
+  union
+  {
+    struct inotify_event ev;
+    char buf[16 * (sizeof (struct inotify_event) + NAME_MAX + 1)];
+  } u;
+
+  for (;;)
+    {
+      ssize_t n = read (status_inotify_fd, u.buf, sizeof u.buf);
+      ssize_t i;
+
+      if (n < 0 && errno == EINTR)
+	continue;
+      if (n <= 0)
+	break;
+      for (i = 0; i < n; )
+	{
+	  struct inotify_event const *ev
+	    = (struct inotify_event const *) (u.buf + i);
+
+	  handle_status_event (ev);
+	  i += sizeof *ev + ev->len;
+	}
+    }
+}
+
+static Lisp_Object file_status_entry (Lisp_Object);
+
+/* Make sure that the directory NAME, of NBYTES bytes, is watched, and
+   the directories above it.  Return true if it is.  */
+
+static bool
+watch_directory (char const *name, ptrdiff_t nbytes)
+{
+  Lisp_Object key = make_unibyte_string (name, nbytes);
+  int wd;
+
+  if (!NILP (Fgethash (key, watched_directories, Qnil)))
+    return 1;
+
+  if (nbytes > 1)
+    {
+      Lisp_Object status;
+
+      if (!watch_directory (name, file_status_parent (name, nbytes)))
+	return 0;
+      /* Now that its directory is watched, make sure that NAME is a
+	 directory and not a symbolic link to one, which could change
+	 without notice.  */
+      status = AREF (file_status_entry (key), 0);
+      if (!STRINGP (status)
+	  || !S_ISDIR (((struct stat *) SDATA (status))->st_mode))
+	return 0;
+    }
+
+  wd = inotify_add_watch (status_inotify_fd, SSDATA (key),
+			  STATUS_WATCH_MASK);
+  if (wd < 0)
+    return 0;
+  Fputhash (key, make_number (wd), watched_directories);
+  Fputhash (make_number (wd),
+	    Fcons (key, Fgethash (make_number (wd), watch_directory_names,
+				  Qnil)),
+	    watch_directory_names);
+  return 1;
+}
+#endif /* HAVE_INOTIFY */
+
+/* Return the cache entry for KEY, a cacheable encoded file name,
+   adding it to the cache if needed.  */
+
+static Lisp_Object
+file_status_entry (Lisp_Object key)
+{
+  struct Lisp_Hash_Table *h = XHASH_TABLE (file_status_cache);
+  EMACS_UINT hash;
+  ptrdiff_t i = hash_lookup (h, key, &hash);
+  bool watched = 0;
+  struct stat st;
+  Lisp_Object entry, expiry;
+
+  if (i >= 0)
+    {
+      entry = HASH_VALUE (h, i);
+      expiry = AREF (entry, 2);
+      if (NILP (expiry)
+	  || timespectod (current_timespec ()) < XFLOAT_DATA (expiry))
+	{
+	  file_status_hits++;
+	  return entry;
+	}
+      Fremhash (key, file_status_cache);
+    }
+  file_status_misses++;
+
+  /* Make room before watching the directory, which may add entries
+     for the directories above it.  */
+  if (h->count >= FILE_STATUS_CACHE_MAX)
+    clear_file_status ();
+
+#ifdef HAVE_INOTIFY
+  /* Watch the directory before looking at the file, so that no change
+     goes unnoticed.  */
+  if (status_inotify_fd >= 0)
+    watched = watch_directory (SSDATA (key),
+			       (SBYTES (key) == 1 ? 1
+				: file_status_parent (SSDATA (key),
+						      SBYTES (key))));
+#endif
+
+  if (watched)
+    expiry = Qnil;
+  else if (NUMBERP (Vfile_attribute_cache_ttl))
+    expiry = make_float (timespectod (current_timespec ())
+			 + XFLOATINT (Vfile_attribute_cache_ttl));
+  else
+    expiry = make_float (0);
+
+  entry = Fmake_vector (make_number (3), Qnil);
+  if (lstat (SSDATA (key), &st) == 0)
+    {
+      ASET (entry, 0, make_unibyte_string ((char *) &st, sizeof st));
+      ASET (entry, 1, S_ISLNK (st.st_mode) ? Qt : Qnil);
+    }
+  else
+    ASET (entry, 0, make_number (errno));
+  ASET (entry, 2, expiry);
+
+  /* Watching the directory may have added to the table.  */
+  if (hash_lookup (h, key, &hash) < 0)
+    {
+      hash_put (h, key, entry, hash);
+      if (SBYTES (key) > 1)
+	link_file_status (key);
+    }
+  return entry;
+}
+
+/* Return the raw target of the symbolic link KEY, whose cache entry
+   is ENTRY, or nil if it cannot be read.  */
+
+static Lisp_Object
+file_status_link (Lisp_Object key, Lisp_Object entry)
+{
+  if (EQ (AREF (entry, 1), Qt))
+    {
+      static struct allocator const emacs_norealloc_allocator =
+	{ xmalloc, NULL, xfree, memory_full };
+      char readlink_buf[1024];
+      char *buf = careadlinkat (AT_FDCWD, SSDATA (key), readlink_buf,
+				sizeof readlink_buf,
+				&emacs_norealloc_allocator, readlinkat);
+
+      ASET (entry, 1, buf ? build_unibyte_string (buf) : Qnil);
+      if (buf && buf != readlink_buf)
+	xfree (buf);
+    }
+  return AREF (entry, 1);
+}
+
+/* Return the cache key for NAME, an encoded file name, after making
+   the cache ready for a lookup, or nil if NAME is not to be cached.  */
+
+static Lisp_Object
+file_status_key (char const *name)
+{
+  ptrdiff_t nbytes = strlen (name);
+
+  if (NILP (Vfile_attribute_cache) || !cacheable_file_name (name, nbytes))
+    return Qnil;
+
+  if (NILP (file_status_cache))
+    {
+      file_status_cache = make_status_table (hashtest_equal);
+      file_status_children = make_status_table (hashtest_equal);
+    }
+#ifdef HAVE_INOTIFY
+  if (status_inotify_fd == -1)
+    {
+      status_inotify_fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+      if (status_inotify_fd < 0)
+	status_inotify_fd = -2;
+      watched_directories = make_status_table (hashtest_equal);
+      watch_directory_names = make_status_table (hashtest_eql);
+    }
+  if (status_inotify_fd >= 0)
+    {
+      struct timespec now = current_timespec ();
+
+      if (file_status_outdated
+	  || timespec_cmp (status_events_deadline, now) <= 0)
+	{
+	  read_status_events ();
+	  file_status_outdated = 0;
+	  status_events_deadline
+	    = timespec_add (now, make_timespec (0, STATUS_EVENTS_INTERVAL));
+	}
+    }
+#endif
+
+  return make_unibyte_string (name, nbytes);
+}
+
+/* Store in *ST the status of the file named NAME, an encoded absolute
+   name, as stat does, or as lstat does if not FOLLOW.  Use the cache
+   if `file-attribute-cache' is non-nil.  Return 0 on success, and -1
+   with errno set on failure.  */
+
+int
+file_status (char const *name, struct stat *st, bool follow)
+{
+  Lisp_Object key = file_status_key (name);
+  int links;
+
+  if (NILP (key))
+    return follow ? stat (name, st) : lstat (name, st);
+
+  for (links = 0; ; links++)
+    {
+      Lisp_Object entry = file_status_entry (key);
+      Lisp_Object status = AREF (entry, 0), target;
+
+      if (INTEGERP (status))
+	{
+	  errno = XINT (status);
+	  return -1;
+	}
+      memcpy (st, SDATA (status), sizeof *st);
+      if (!follow || !S_ISLNK (st->st_mode))
+	return 0;
+
+      if (links == FILE_STATUS_MAX_LINKS)
+	{
+	  errno = ELOOP;
+	  return -1;
+	}
+      target = file_status_link (key, entry);
+      if (NILP (target))
+	return stat (name, st);
+      if (SREF (target, 0) != '/')
+	{
+	  ptrdiff_t dirbytes = file_status_parent (SSDATA (key),
+						   SBYTES (key));
+	  target = concat3 (make_unibyte_string (SSDATA (key),
+						 dirbytes == 1 ? 0 : dirbytes),
+			    build_unibyte_string ("/"), target);
+	}
+      if (!cacheable_file_name (SSDATA (target), SBYTES (target)))
+	return stat (name, st);
+      key = target;
+    }
+}
+
+/* Return the target of the symbolic link NAME, an encoded absolute
+   name, like emacs_readlinkat, using the cache as file_status does.  */
+
+Lisp_Object
+file_status_readlink (char const *name)
+{
+  Lisp_Object key = file_status_key (name);
+  Lisp_Object entry;
+
+  if (NILP (key))
+    return emacs_readlinkat (AT_FDCWD, name);
+
+  entry = file_status_entry (key);
+  if (!STRINGP (AREF (entry, 0))
+      || !S_ISLNK (((struct stat *) SDATA (AREF (entry, 0)))->st_mode))
+    return Qnil;
+  entry = file_status_link (key, entry);
+  return NILP (entry) ? Qnil : decode_link_target (SSDATA (entry));
+}
+
+DEFUN ("file-attribute-cache-statistics", Ffile_attribute_cache_statistics,
+       Sfile_attribute_cache_statistics, 0, 0, 0,
+       doc: /* Return statistics about the cache of file attributes.
+The value is a list (HITS MISSES FILES DIRECTORIES): the number of
+lookups answered from the cache and of those that were not since the
+cache was last cleared, the number of files in the cache, and the
+number of directories watched for changes to them.
+See `file-attribute-cache'.  */)
+  (void)
+{
+  EMACS_INT files = 0, directories = 0;
+
+  if (!NILP (file_status_cache))
+    files = XHASH_TABLE (file_status_cache)->count;
+#ifdef HAVE_INOTIFY
+  if (HASH_TABLE_P (watched_directories))
+    directories = XHASH_TABLE (watched_directories)->count;
+#endif
+  return list4 (make_number (file_status_hits),
+		make_number (file_status_misses),
+		make_number (files), make_number (directories));
+}
+
+DEFUN ("clear-file-attribute-cache", Fclear_file_attribute_cache,
+       Sclear_file_attribute_cache, 0, 0, 0,
+       doc: /* Empty the cache of file attributes and reset its statistics.
+See `file-attribute-cache'.  */)
+  (void)
+{
+  file_status_cache = file_status_children = Qnil;
+  file_status_hits = file_status_misses = 0;
+#ifdef HAVE_INOTIFY
+  if (status_inotify_fd >= 0)
+    emacs_close (status_inotify_fd);
+  status_inotify_fd = -1;
+  watched_directories = watch_directory_names = Qnil;
+#endif
+  return Qnil;
+}
+
 DEFUN ("file-symlink-p", Ffile_symlink_p, Sfile_symlink_p, 1, 1, 0,
        doc: /* Return non-nil if file FILENAME is the name of a symbolic link.
 The value is the link target, as a string.
@@ -2788,7 +3457,7 @@ points to a nonexistent file.  */)
 
   filename = ENCODE_FILE (filename);
 
-  return emacs_readlinkat (AT_FDCWD, SSDATA (filename));
+  return file_status_readlink (SSDATA (filename));
 }
 
 DEFUN ("file-directory-p", Ffile_directory_p, Sfile_directory_p, 1, 1, 0,
@@ -2822,7 +3491,7 @@ file_directory_p (char const *file)
   return faccessat (AT_FDCWD, file, D_OK, AT_EACCESS) == 0;
 #else
   struct stat st;
-  return stat (file, &st) == 0 && S_ISDIR (st.st_mode);
+  return file_status (file, &st, 1) == 0 && S_ISDIR (st.st_mode);
 #endif
 }
 
@@ -2938,7 +3607,7 @@ See `file-symlink-p' to distinguish symlinks.  */)
     return S_ISREG (st.st_mode) ? Qt : Qnil;
   }
 #else
-  if (stat (SSDATA (absname), &st) < 0)
+  if (file_status (SSDATA (absname), &st, 1) < 0)
     return Qnil;
   return S_ISREG (st.st_mode) ? Qt : Qnil;
 #endif
@@ -3209,7 +3878,7 @@ Return nil, if file does not exist or is not accessible.  */)
 
   absname = ENCODE_FILE (absname);
 
-  if (stat (SSDATA (absname), &st) < 0)
+  if (file_status (SSDATA (absname), &st, 1) < 0)
     return Qnil;
 
   return make_number (st.st_mode & 07777);
@@ -3238,6 +3907,7 @@ symbolic notation, like the `chmod' command from GNU Coreutils.  */)
     return call3 (handler, Qset_file_modes, absname, mode);
 
   encoded_absname = ENCODE_FILE (absname);
+  forget_file_status (SSDATA (encoded_absname));
 
   if (chmod (SSDATA (encoded_absname), XINT (mode) & 07777) < 0)
     report_file_error ("Doing chmod", absname);
@@ -3297,6 +3967,7 @@ Use the current time if TIMESTAMP is nil.  TIMESTAMP is in the format of
     return call3 (handler, Qset_file_times, absname, timestamp);
 
   encoded_absname = ENCODE_FILE (absname);
+  forget_file_status (SSDATA (encoded_absname));
 
   {
     if (set_file_times (-1, SSDATA (encoded_absname), t, t))
@@ -3357,10 +4028,10 @@ otherwise, if FILE2 does not exist, the answer is t.  */)
   absname2 = ENCODE_FILE (absname2);
   UNGCPRO;
 
-  if (stat (SSDATA (absname1), &st1) < 0)
+  if (file_status (SSDATA (absname1), &st1, 1) < 0)
     return Qnil;
 
-  if (stat (SSDATA (absname2), &st2) < 0)
+  if (file_status (SSDATA (absname2), &st2, 1) < 0)
     return Qt;
 
   return (timespec_cmp (get_stat_mtime (&st2), get_stat_mtime (&st1)) < 0
@@ -3524,7 +4195,7 @@ by calling `format-decode', which see.  */)
      keeping it.  It's typically when we first fill a file-buffer.  */
   bool empty_undo_list_p
     = (!NILP (visit) && NILP (BVAR (current_buffer, undo_list))
-       && BEG == Z);
+       && current_buffer->undo_log.used == 0 && BEG == Z);
   Lisp_Object old_Vdeactivate_mark = Vdeactivate_mark;
   bool we_locked_file = 0;
   ptrdiff_t fd_index;
@@ -4313,6 +4984,7 @@ by calling `format-decode', which see.  */)
 	  Lisp_Object unwind_data;
 	  ptrdiff_t count1 = SPECPDL_INDEX ();
 
+	  unpack_undo_log (current_buffer);
 	  unwind_data = Fcons (BVAR (current_buffer, enable_multibyte_characters),
 			       Fcons (BVAR (current_buffer, undo_list),
 				      Fcurrent_buffer ()));
@@ -4453,6 +5125,7 @@ by calling `format-decode', which see.  */)
       specbind (Qinhibit_modification_hooks, Qt);
 
       /* Save old undo list and don't record undo for decoding.  */
+      unpack_undo_log (current_buffer);
       old_undo = BVAR (current_buffer, undo_list);
       bset_undo_list (current_buffer, Qt);
 
@@ -4904,6 +5577,7 @@ write_region (Lisp_Object start, Lisp_Object end, Lisp_Object filename,
 
   if (open_and_close_file)
     {
+      forget_file_status (fn);
       desc = emacs_open (fn, open_flags, mode);
       if (desc < 0)
 	{
@@ -4994,6 +5668,7 @@ write_region (Lisp_Object start, Lisp_Object end, Lisp_Object filename,
       /* NFS can report a write failure now.  */
       if (emacs_close (desc) < 0)
 	ok = 0, save_errno = errno;
+      forget_file_status (SSDATA (encoded_filename));
 
       /* Discard the unwind protect for close_file_unwind.  */
       specpdl_ptr = specpdl + count1;
@@ -6083,6 +6758,42 @@ This includes interactive calls to `delete-file' and
   DEFSYM (Qcopy_directory, "copy-directory");
   DEFSYM (Qdelete_directory, "delete-directory");
 
+  DEFVAR_LISP ("file-attribute-cache", Vfile_attribute_cache,
+	       doc: /* Non-nil means cache the attributes of files.
+When this is non-nil, the status of files that `file-exists-p',
+`file-attributes', `file-directory-p' and similar functions look up is
+remembered for later calls, which makes calling them again for the
+same files much faster.  Emacs forgets the status of the files that it
+changes itself.  On systems that support it, it watches the directories
+of the files in the cache so as to notice changes made by other
+programs, too, although changes made in the last 20 milliseconds or so
+may not be noticed yet while Emacs is not waiting for subprocesses;
+otherwise, the status of a file is remembered for
+`file-attribute-cache-ttl' seconds.  Changes made on another machine
+to files on a network file system may go unnoticed all the same, so
+only bind this around code that looks at files over and over.
+
+The cache is only used for absolute file names without `.' or `..'
+components, that no file name handler applies to.
+See also `file-attribute-cache-statistics'.  */);
+  Vfile_attribute_cache = Qnil;
+
+  DEFVAR_LISP ("file-attribute-cache-ttl", Vfile_attribute_cache_ttl,
+	       doc: /* Seconds during which a file status in the cache stays valid.
+This applies to the files whose changes Emacs cannot be notified of.
+A value of nil means not to cache them at all.
+See `file-attribute-cache'.  */);
+  Vfile_attribute_cache_ttl = make_number (2);
+
+  file_status_cache = file_status_children = Qnil;
+  staticpro (&file_status_cache);
+  staticpro (&file_status_children);
+#ifdef HAVE_INOTIFY
+  watched_directories = watch_directory_names = Qnil;
+  staticpro (&watched_directories);
+  staticpro (&watch_directory_names);
+#endif
+
   defsubr (&Sfind_file_name_handler);
   defsubr (&Sfile_name_directory);
   defsubr (&Sfile_name_nondirectory);
@@ -6119,6 +6830,8 @@ This includes interactive calls to `delete-file' and
   defsubr (&Sset_default_file_modes);
   defsubr (&Sdefault_file_modes);
   defsubr (&Sfile_newer_than_file_p);
+  defsubr (&Sfile_attribute_cache_statistics);
+  defsubr (&Sclear_file_attribute_cache);
   defsubr (&Sinsert_file_contents);
   defsubr (&Schoose_write_coding_system);
   defsubr (&Swrite_region);
@@ -742,14 +742,181 @@ concat (ptrdiff_t nargs, Lisp_Object *args,
   return val;
 }
 
-static Lisp_Object string_char_byte_cache_string;
-static ptrdiff_t string_char_byte_cache_charpos;
-static ptrdiff_t string_char_byte_cache_bytepos;
+/* Cache of character/byte position correspondences in multibyte
+   strings.  Each entry remembers the last position looked up in one
+   string, plus a table of "anchors": the byte position of every
+   INTERVAL'th character, filled in lazily as scans pass over them.
+   Several strings are cached at once, so that code alternating
+   between a few strings (comparing a key with a value, say) does not
+   discard the anchors of one string when it looks at another.  The
+   least recently used entry is reused when a new string is seen.  */
+
+enum
+  {
+    /* Number of strings cached at once.  */
+    STRING_CHAR_BYTE_CACHE_SIZE = 8,
+    /* Minimum number of characters between two anchors.  */
+    STRING_CHAR_BYTE_ANCHOR_INTERVAL = 128,
+    /* Maximum number of anchors kept for one string.  For longer
+       strings, the anchors are spread further apart.  */
+    STRING_CHAR_BYTE_ANCHORS_MAX = 1024
+  };
+
+struct string_char_byte_cache
+{
+  /* The string this entry describes, or nil if the entry is unused.  */
+  Lisp_Object string;
+
+  /* SCHARS and SBYTES of STRING when the entry was set up.  If they
+     change, the entry is stale.  */
+  ptrdiff_t nchars, nbytes;
+
+  /* The last position looked up in STRING.  */
+  ptrdiff_t charpos, bytepos;
+
+  /* ANCHORS[K] is the byte position of character K * INTERVAL.
+     Only the first NANCHORS elements are valid; ANCHORS[0] is always
+     0.  ANCHORS_SIZE is the allocated size of ANCHORS.  */
+  ptrdiff_t interval;
+  ptrdiff_t *anchors;
+  ptrdiff_t nanchors, anchors_size;
+
+  /* Value of string_char_byte_cache_clock when this entry was last
+     used.  */
+  EMACS_UINT last_use;
+};
+
+static struct string_char_byte_cache
+  string_char_byte_cache[STRING_CHAR_BYTE_CACHE_SIZE];
+
+/* Incremented on every cache lookup.  */
+static EMACS_UINT string_char_byte_cache_clock;
+
+/* The entry found by the last lookup; checked first.  */
+static struct string_char_byte_cache *string_char_byte_cache_last
+  = string_char_byte_cache;
 
 void
 clear_string_char_byte_cache (void)
 {
-  string_char_byte_cache_string = Qnil;
+  int i;
+
+  for (i = 0; i < STRING_CHAR_BYTE_CACHE_SIZE; i++)
+    string_char_byte_cache[i].string = Qnil;
+}
+
+/* Return the cache entry for multibyte STRING, setting up a new one
+   (in place of the least recently used entry) if STRING is not
+   cached yet or if its entry is stale.  */
+
+static struct string_char_byte_cache *
+string_char_byte_cache_lookup (Lisp_Object string)
+{
+  struct string_char_byte_cache *e = string_char_byte_cache_last;
+  ptrdiff_t nchars = SCHARS (string), nbytes = SBYTES (string);
+  ptrdiff_t nanchors;
+  int i;
+
+  if (! EQ (e->string, string))
+    {
+      struct string_char_byte_cache *oldest = string_char_byte_cache;
+
+      for (i = 0, e = string_char_byte_cache;
+	   i < STRING_CHAR_BYTE_CACHE_SIZE; i++, e++)
+	{
+	  if (EQ (e->string, string))
+	    break;
+	  if (e->last_use < oldest->last_use)
+	    oldest = e;
+	}
+      if (i == STRING_CHAR_BYTE_CACHE_SIZE)
+	{
+	  e = oldest;
+	  e->string = Qnil;
+	}
+      string_char_byte_cache_last = e;
+    }
+
+  e->last_use = ++string_char_byte_cache_clock;
+  if (EQ (e->string, string) && e->nchars == nchars && e->nbytes == nbytes)
+    return e;
+
+  /* Set up a fresh entry for STRING.  */
+  e->string = string;
+  e->nchars = nchars;
+  e->nbytes = nbytes;
+  e->charpos = e->bytepos = 0;
+  e->interval = max (STRING_CHAR_BYTE_ANCHOR_INTERVAL,
+		     nchars / (STRING_CHAR_BYTE_ANCHORS_MAX - 1) + 1);
+  nanchors = nchars / e->interval + 1;
+  if (e->anchors_size < nanchors)
+    {
+      xfree (e->anchors);
+      e->anchors = xnmalloc (nanchors, sizeof *e->anchors);
+      e->anchors_size = nanchors;
+    }
+  e->anchors[0] = 0;
+  e->nanchors = 1;
+  return e;
+}
+
+/* Scan STRING forward from character CHARPOS at byte BYTEPOS until
+   reaching either character TO_CHAR or byte TO_BYTE, whichever comes
+   first, recording in cache entry E any anchors passed on the way.
+   Store the position reached in E->charpos and E->bytepos.  */
+
+static void
+string_char_byte_scan_forward (struct string_char_byte_cache *e,
+			       ptrdiff_t charpos, ptrdiff_t bytepos,
+			       ptrdiff_t to_char, ptrdiff_t to_byte)
+{
+  unsigned char *beg = SDATA (e->string);
+  unsigned char *p = beg + bytepos, *pend = beg + to_byte;
+  ptrdiff_t next_anchor = e->nanchors * e->interval;
+
+  /* Anchors are recorded contiguously, so only bother when the scan
+     starts at or before the first missing one.  */
+  if (charpos > next_anchor)
+    next_anchor = PTRDIFF_MAX;
+
+  while (charpos < to_char && p < pend)
+    {
+      if (charpos == next_anchor)
+	{
+	  e->anchors[e->nanchors++] = p - beg;
+	  next_anchor += e->interval;
+	}
+      p += BYTES_BY_CHAR_HEAD (*p);
+      charpos++;
+    }
+  if (charpos == next_anchor && e->nanchors < e->anchors_size)
+    e->anchors[e->nanchors++] = p - beg;
+
+  e->charpos = charpos;
+  e->bytepos = p - beg;
+}
+
+/* Scan STRING backward from character CHARPOS at byte BYTEPOS until
+   reaching either character TO_CHAR or byte TO_BYTE, whichever comes
+   first.  Store the position reached in E->charpos and E->bytepos.  */
+
+static void
+string_char_byte_scan_backward (struct string_char_byte_cache *e,
+				ptrdiff_t charpos, ptrdiff_t bytepos,
+				ptrdiff_t to_char, ptrdiff_t to_byte)
+{
+  unsigned char *beg = SDATA (e->string);
+  unsigned char *p = beg + bytepos, *pbeg = beg + to_byte;
+
+  while (charpos > to_char && p > pbeg)
+    {
+      p--;
+      while (!CHAR_HEAD_P (*p)) p--;
+      charpos--;
+    }
+
+  e->charpos = charpos;
+  e->bytepos = p - beg;
 }
 
 /* Return the byte index corresponding to CHAR_INDEX in STRING.  */
@@ -757,125 +924,112 @@ clear_string_char_byte_cache (void)
 ptrdiff_t
 string_char_to_byte (Lisp_Object string, ptrdiff_t char_index)
 {
-  ptrdiff_t i_byte;
+  struct string_char_byte_cache *e;
   ptrdiff_t best_below, best_below_byte;
   ptrdiff_t best_above, best_above_byte;
+  ptrdiff_t k;
 
-  best_below = best_below_byte = 0;
   best_above = SCHARS (string);
   best_above_byte = SBYTES (string);
   if (best_above == best_above_byte)
     return char_index;
 
-  if (EQ (string, string_char_byte_cache_string))
+  e = string_char_byte_cache_lookup (string);
+
+  /* The nearest known anchors around CHAR_INDEX.  */
+  k = min (char_index / e->interval, e->nanchors - 1);
+  best_below = k * e->interval;
+  best_below_byte = e->anchors[k];
+  if (k + 1 < e->nanchors)
     {
-      if (string_char_byte_cache_charpos < char_index)
-	{
-	  best_below = string_char_byte_cache_charpos;
-	  best_below_byte = string_char_byte_cache_bytepos;
-	}
-      else
-	{
-	  best_above = string_char_byte_cache_charpos;
-	  best_above_byte = string_char_byte_cache_bytepos;
-	}
+      best_above = (k + 1) * e->interval;
+      best_above_byte = e->anchors[k + 1];
     }
 
-  if (char_index - best_below < best_above - char_index)
+  /* The last position looked up may be closer still.  */
+  if (best_below < e->charpos && e->charpos < best_above)
     {
-      unsigned char *p = SDATA (string) + best_below_byte;
-
-      while (best_below < char_index)
+      if (e->charpos <= char_index)
 	{
-	  p += BYTES_BY_CHAR_HEAD (*p);
-	  best_below++;
+	  best_below = e->charpos;
+	  best_below_byte = e->bytepos;
 	}
-      i_byte = p - SDATA (string);
-    }
-  else
-    {
-      unsigned char *p = SDATA (string) + best_above_byte;
-
-      while (best_above > char_index)
+      else
 	{
-	  p--;
-	  while (!CHAR_HEAD_P (*p)) p--;
-	  best_above--;
+	  best_above = e->charpos;
+	  best_above_byte = e->bytepos;
 	}
-      i_byte = p - SDATA (string);
     }
 
-  string_char_byte_cache_bytepos = i_byte;
-  string_char_byte_cache_charpos = char_index;
-  string_char_byte_cache_string = string;
+  if (char_index - best_below < best_above - char_index)
+    string_char_byte_scan_forward (e, best_below, best_below_byte,
+				   char_index, e->nbytes);
+  else
+    string_char_byte_scan_backward (e, best_above, best_above_byte,
+				    char_index, 0);
 
-  return i_byte;
+  return e->bytepos;
 }
-
+
 /* Return the character index corresponding to BYTE_INDEX in STRING.  */
 
 ptrdiff_t
 string_byte_to_char (Lisp_Object string, ptrdiff_t byte_index)
 {
-  ptrdiff_t i, i_byte;
+  struct string_char_byte_cache *e;
   ptrdiff_t best_below, best_below_byte;
   ptrdiff_t best_above, best_above_byte;
+  ptrdiff_t lo, hi;
 
-  best_below = best_below_byte = 0;
   best_above = SCHARS (string);
   best_above_byte = SBYTES (string);
   if (best_above == best_above_byte)
     return byte_index;
 
-  if (EQ (string, string_char_byte_cache_string))
+  e = string_char_byte_cache_lookup (string);
+
+  /* Binary search for the last anchor at or before BYTE_INDEX.  */
+  lo = 0, hi = e->nanchors;
+  while (hi - lo > 1)
     {
-      if (string_char_byte_cache_bytepos < byte_index)
-	{
-	  best_below = string_char_byte_cache_charpos;
-	  best_below_byte = string_char_byte_cache_bytepos;
-	}
+      ptrdiff_t mid = lo + (hi - lo) / 2;
+      if (e->anchors[mid] <= byte_index)
+	lo = mid;
       else
-	{
-	  best_above = string_char_byte_cache_charpos;
-	  best_above_byte = string_char_byte_cache_bytepos;
-	}
+	hi = mid;
     }
-
-  if (byte_index - best_below_byte < best_above_byte - byte_index)
+  best_below = lo * e->interval;
+  best_below_byte = e->anchors[lo];
+  if (hi < e->nanchors)
     {
-      unsigned char *p = SDATA (string) + best_below_byte;
-      unsigned char *pend = SDATA (string) + byte_index;
+      best_above = hi * e->interval;
+      best_above_byte = e->anchors[hi];
+    }
 
-      while (p < pend)
+  if (best_below_byte < e->bytepos && e->bytepos < best_above_byte)
+    {
+      if (e->bytepos <= byte_index)
 	{
-	  p += BYTES_BY_CHAR_HEAD (*p);
-	  best_below++;
+	  best_below = e->charpos;
+	  best_below_byte = e->bytepos;
 	}
-      i = best_below;
-      i_byte = p - SDATA (string);
-    }
-  else
-    {
-      unsigned char *p = SDATA (string) + best_above_byte;
-      unsigned char *pbeg = SDATA (string) + byte_index;
-
-      while (p > pbeg)
+      else
 	{
-	  p--;
-	  while (!CHAR_HEAD_P (*p)) p--;
-	  best_above--;
+	  best_above = e->charpos;
+	  best_above_byte = e->bytepos;
 	}
-      i = best_above;
-      i_byte = p - SDATA (string);
     }
 
-  string_char_byte_cache_bytepos = i_byte;
-  string_char_byte_cache_charpos = i;
-  string_char_byte_cache_string = string;
+  if (byte_index - best_below_byte < best_above_byte - byte_index)
+    string_char_byte_scan_forward (e, best_below, best_below_byte,
+				   e->nchars, byte_index);
+  else
+    string_char_byte_scan_backward (e, best_above, best_above_byte,
+				    0, byte_index);
 
-  return i;
+  return e->charpos;
 }
-
+
 /* Convert STRING to a multibyte string.  */
 
 static Lisp_Object
@@ -4852,6 +5006,8 @@ If BINARY is non-nil, returns a string in binary form.  */)
 void
 syms_of_fns (void)
 {
+  int i;
+
   DEFSYM (Qmd5,    "md5");
   DEFSYM (Qsha1,   "sha1");
   DEFSYM (Qsha224, "sha224");
@@ -4899,8 +5055,11 @@ syms_of_fns (void)
   DEFSYM (Qcursor_in_echo_area, "cursor-in-echo-area");
   DEFSYM (Qwidget_type, "widget-type");
 
-  staticpro (&string_char_byte_cache_string);
-  string_char_byte_cache_string = Qnil;
+  for (i = 0; i < STRING_CHAR_BYTE_CACHE_SIZE; i++)
+    {
+      string_char_byte_cache[i].string = Qnil;
+      staticpro (&string_char_byte_cache[i].string);
+    }
 
   require_nesting_list = Qnil;
   staticpro (&require_nesting_list);
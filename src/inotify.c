@@ -28,6 +28,7 @@ along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
 #include "character.h"
 #include "frame.h" /* Required for termhooks.h.  */
 #include "termhooks.h"
+#include "systime.h"
 
 static Lisp_Object Qaccess;        /* IN_ACCESS */
 static Lisp_Object Qattrib;        /* IN_ATTRIB */
@@ -125,10 +126,59 @@ mask_to_aspects (uint32_t mask) {
   return aspects;
 }
 
+/* The events that only report that a file was accessed or changed in
+   place.  Successive events of these kinds for the same file are
+   merged into one.  */
+#define COALESCED_EVENTS						\
+  (IN_ACCESS | IN_ATTRIB | IN_CLOSE_WRITE | IN_CLOSE_NOWRITE | IN_MODIFY	\
+   | IN_OPEN)
+
+/* The events read but not delivered yet, newest first.  Each element
+   is a vector [WD MASK NAME COOKIE CALLBACK].  */
+static Lisp_Object pending_events;
+
+/* Hash table mapping (WD . NAME) to the element of pending_events
+   that the next event of the COALESCED_EVENTS kinds about NAME in the
+   watch WD can be merged into, if any.  */
+static Lisp_Object coalescable_events;
+
+/* When to deliver the pending events, if there are any.  */
+static struct timespec delivery_time;
+
+/* The number of events read from inotify, of events delivered, and of
+   deliveries.  */
+static EMACS_INT raw_event_count, delivered_event_count, batch_count;
+
+/* Return the event to pass to the callback of the pending event E.  */
+
 static Lisp_Object
-inotifyevent_to_event (Lisp_Object watch_object, struct inotify_event const *ev)
+pending_to_event (Lisp_Object e)
+{
+  return list2 (list4 (make_watch_descriptor (XINT (AREF (e, 0))),
+		       mask_to_aspects (XINT (AREF (e, 1))),
+		       AREF (e, 2),
+		       AREF (e, 3)),
+		AREF (e, 4));
+}
+
+/* Add the inotify event EV to the pending events, merging it with
+   the previous event about the same file if both only report changes
+   in place.  */
+
+static void
+queue_event (struct inotify_event const *ev)
 {
-  Lisp_Object name = Qnil;
+  Lisp_Object watch_object, name = Qnil, key, e;
+
+  raw_event_count++;
+  watch_object = Fassoc (make_watch_descriptor (ev->wd), watch_list);
+  if (NILP (watch_object))
+    return;
+
+  /* If event was removed automatically: Drop it from watch list.  */
+  if (ev->mask & IN_IGNORED)
+    watch_list = Fdelete (watch_object, watch_list);
+
   if (ev->len > 0)
     {
       size_t const len = strlen (ev->name);
@@ -136,20 +186,38 @@ inotifyevent_to_event (Lisp_Object watch_object, struct inotify_event const *ev)
       name = DECODE_FILE (name);
     }
 
-  return list2 (list4 (make_watch_descriptor (ev->wd),
-                       mask_to_aspects (ev->mask),
-                       name,
-                       make_number (ev->cookie)),
-                XCDR (watch_object));
+  key = Fcons (make_number (ev->wd), name);
+  if (! (ev->mask & ~COALESCED_EVENTS) && ev->cookie == 0)
+    {
+      e = Fgethash (key, coalescable_events, Qnil);
+      if (!NILP (e) && EQ (AREF (e, 4), XCDR (watch_object)))
+	{
+	  ASET (e, 1, make_number (XINT (AREF (e, 1)) | ev->mask));
+	  return;
+	}
+    }
+
+  e = Fmake_vector (make_number (5), Qnil);
+  ASET (e, 0, make_number (ev->wd));
+  ASET (e, 1, make_number (ev->mask));
+  ASET (e, 2, name);
+  ASET (e, 3, make_number (ev->cookie));
+  ASET (e, 4, XCDR (watch_object));
+  pending_events = Fcons (e, pending_events);
+
+  /* Later changes in place must not be merged into an event that
+     precedes this one.  */
+  if (! (ev->mask & ~COALESCED_EVENTS) && ev->cookie == 0)
+    Fputhash (key, e, coalescable_events);
+  else
+    Fremhash (key, coalescable_events);
 }
 
-/* This callback is called when the FD is available for read.  The inotify
-   events are read from FD and converted into input_events.  */
+/* Read the available inotify events from FD into the pending events.  */
+
 static void
-inotify_callback (int fd, void *_)
+read_events (int fd)
 {
-  struct input_event event;
-  Lisp_Object watch_object;
   int to_read;
   char *buffer;
   ssize_t n;
@@ -160,6 +228,8 @@ inotify_callback (int fd, void *_)
     xsignal1
       (Qfile_notify_error,
        build_string ("Error while trying to retrieve file system events"));
+  if (to_read == 0)
+    return;
   buffer = xmalloc (to_read);
   n = read (fd, buffer, to_read);
   if (n < 0)
@@ -170,31 +240,80 @@ inotify_callback (int fd, void *_)
        build_string ("Error while trying to read file system events"));
     }
 
-  EVENT_INIT (event);
-  event.kind = FILE_NOTIFY_EVENT;
-
   i = 0;
   while (i < (size_t)n)
     {
       struct inotify_event *ev = (struct inotify_event*)&buffer[i];
+      queue_event (ev);
+      i += sizeof (*ev) + ev->len;
+    }
 
-      watch_object = Fassoc (make_watch_descriptor (ev->wd), watch_list);
-      if (!NILP (watch_object))
-        {
-          event.arg = inotifyevent_to_event (watch_object, ev);
+  xfree (buffer);
+}
 
-          /* If event was removed automatically: Drop it from watch list.  */
-          if (ev->mask & IN_IGNORED)
-            watch_list = Fdelete (watch_object, watch_list);
+/* Store the pending events as a single input_event: the event for
+   their callback if there is only one, and a batch of them otherwise.  */
 
-	  if (!NILP (event.arg))
-	    kbd_buffer_store_event (&event);
-        }
+static void
+deliver_events (void)
+{
+  struct input_event event;
+  Lisp_Object tail, batch = Qnil;
+  EMACS_INT n = 0;
 
-      i += sizeof (*ev) + ev->len;
-    }
+  /* The pending events are newest first.  */
+  for (tail = pending_events; CONSP (tail); tail = XCDR (tail), n++)
+    batch = Fcons (pending_to_event (XCAR (tail)), batch);
+  pending_events = Qnil;
+  Fclrhash (coalescable_events);
+  if (n == 0)
+    return;
 
-  xfree (buffer);
+  EVENT_INIT (event);
+  event.kind = FILE_NOTIFY_EVENT;
+  event.arg = n == 1 ? XCAR (batch) : list1 (batch);
+  kbd_buffer_store_event (&event);
+  delivered_event_count += n;
+  batch_count++;
+}
+
+/* This callback is called when the FD is available for read.  The inotify
+   events are read from FD and added to the pending events.  They are
+   converted into input_events `inotify-coalesce-delay' seconds after
+   the first of them arrived, by inotify_deliver_pending.  */
+static void
+inotify_callback (int fd, void *_)
+{
+  bool was_pending = !NILP (pending_events);
+
+  read_events (fd);
+
+  if (! (NUMBERP (Vinotify_coalesce_delay)
+	 && XFLOATINT (Vinotify_coalesce_delay) > 0))
+    deliver_events ();
+  else if (!was_pending)
+    delivery_time
+      = timespec_add (current_timespec (),
+		      dtotimespec (min (XFLOATINT (Vinotify_coalesce_delay),
+					1)));
+}
+
+/* Convert the pending events into an input_event if their time has
+   come.  Return how long until it does, or an invalid timespec if
+   there is nothing left to wait for.  This is called by
+   wait_reading_process_output each time around its loop.  */
+struct timespec
+inotify_deliver_pending (void)
+{
+  struct timespec now;
+
+  if (NILP (pending_events))
+    return invalid_timespec ();
+  now = current_timespec ();
+  if (timespec_cmp (now, delivery_time) < 0)
+    return timespec_sub (delivery_time, now);
+  deliver_events ();
+  return invalid_timespec ();
 }
 
 static uint32_t
@@ -395,6 +514,20 @@ See inotify_rm_watch(2) for more information.
   return Qt;
 }
 
+DEFUN ("inotify-event-statistics", Finotify_event_statistics,
+       Sinotify_event_statistics, 0, 0, 0,
+       doc: /* Return statistics about the events read from inotify.
+The value is a list (RAW DELIVERED BATCHES): the number of events
+read from inotify, the number of events passed on to callbacks after
+merging them, and the number of input events they were passed in.
+See `inotify-coalesce-delay'.  */)
+     (void)
+{
+  return list3 (make_number (raw_event_count),
+		make_number (delivered_event_count),
+		make_number (batch_count));
+}
+
 void
 syms_of_inotify (void)
 {
@@ -426,10 +559,30 @@ syms_of_inotify (void)
   DEFSYM (Qq_overflow, "q-overflow");
   DEFSYM (Qunmount, "unmount");
 
+  DEFVAR_LISP ("inotify-coalesce-delay", Vinotify_coalesce_delay,
+	       doc: /* Seconds during which to gather file events before handling them.
+When inotify reports changes to watched files, Emacs keeps reading
+events for that long, up to a second, before passing them on.  Events
+that only report that the same file was accessed or changed in place
+are merged into a single event whose aspects are all of theirs, and
+the events gathered are handled as one input event.  A value of nil
+or 0 means to pass on the events available at once without waiting.
+See also `inotify-event-statistics'.  */);
+  Vinotify_coalesce_delay = make_float (0.02);
+
   defsubr (&Sinotify_add_watch);
   defsubr (&Sinotify_rm_watch);
+  defsubr (&Sinotify_event_statistics);
 
   staticpro (&watch_list);
+  pending_events = Qnil;
+  staticpro (&pending_events);
+  coalescable_events = make_hash_table (hashtest_equal,
+					make_number (DEFAULT_HASH_SIZE),
+					make_float (DEFAULT_REHASH_SIZE),
+					make_float (DEFAULT_REHASH_THRESHOLD),
+					Qnil);
+  staticpro (&coalescable_events);
 
   Fprovide (intern_c_string ("inotify"), Qnil);
 }
@@ -92,6 +92,8 @@ move_gap_both (ptrdiff_t charpos, ptrdiff_t bytepos)
 {
   eassert (charpos == BYTE_TO_CHAR (bytepos)
 	   && bytepos == CHAR_TO_BYTE (charpos));
+  if (bytepos != GPT_BYTE)
+    current_buffer->text->gap_moves++;
   if (bytepos < GPT_BYTE)
     gap_left (charpos, bytepos, 0);
   else if (bytepos > GPT_BYTE)
@@ -141,6 +143,7 @@ gap_left (ptrdiff_t charpos, ptrdiff_t bytepos, bool newgap)
       new_s1 -= i;
       from -= i, to -= i;
       memmove (to, from, i);
+      current_buffer->text->gap_bytes_moved += i;
     }
 
   /* Adjust buffer data structure, to put the gap at BYTEPOS.
@@ -194,6 +197,7 @@ gap_right (ptrdiff_t charpos, ptrdiff_t bytepos)
       new_s1 += i;
       memmove (to, from, i);
       from += i, to += i;
+      current_buffer->text->gap_bytes_moved += i;
     }
 
   GPT = charpos;
@@ -218,6 +222,11 @@ adjust_markers_for_delete (ptrdiff_t from, ptrdiff_t from_byte,
   register struct Lisp_Marker *m;
   register ptrdiff_t charpos;
 
+  adjust_charpos_cache (from, from_byte, to - from, to_byte - from_byte, 0, 0);
+  adjust_line_index (from_byte, to_byte - from_byte, 0, 0);
+  if (from < to)
+    unindex_overlays (from + 1, to, 0);
+
   for (m = BUF_MARKERS (current_buffer); m; m = m->next)
     {
       charpos = m->charpos;
@@ -282,6 +291,12 @@ adjust_markers_for_insert (ptrdiff_t from, ptrdiff_t from_byte,
   ptrdiff_t nchars = to - from;
   ptrdiff_t nbytes = to_byte - from_byte;
 
+  adjust_charpos_cache (from, from_byte, 0, 0, nchars, nbytes);
+  adjust_line_index (from_byte, 0, nbytes, 1);
+  /* Markers at FROM that advance leave the others behind.  */
+  if (!before_markers)
+    unindex_overlays (from, from, 1);
+
   for (m = BUF_MARKERS (current_buffer); m; m = m->next)
     {
       eassert (m->bytepos >= m->charpos
@@ -347,6 +362,11 @@ adjust_markers_for_replace (ptrdiff_t from, ptrdiff_t from_byte,
   ptrdiff_t diff_chars = new_chars - old_chars;
   ptrdiff_t diff_bytes = new_bytes - old_bytes;
 
+  adjust_charpos_cache (from, from_byte, old_chars, old_bytes,
+			new_chars, new_bytes);
+  adjust_line_index (from_byte, old_bytes, new_bytes, 1);
+  unindex_overlays (from + 1, from + old_chars, 0);
+
   for (m = BUF_MARKERS (current_buffer); m; m = m->next)
     {
       if (m->bytepos >= prev_to_byte)
@@ -381,14 +401,20 @@ make_gap_larger (ptrdiff_t nbytes_added)
   ptrdiff_t real_gap_loc_byte;
   ptrdiff_t old_gap_size;
   ptrdiff_t current_size = Z_BYTE - BEG_BYTE + GAP_SIZE;
+  ptrdiff_t extra;
 
   if (BUF_BYTES_MAX - current_size < nbytes_added)
     buffer_overflow ();
 
-  /* If we have to get more space, get enough to last a while;
-     but do not exceed the maximum buffer size.  */
-  nbytes_added = min (nbytes_added + GAP_BYTES_DFL,
-		      BUF_BYTES_MAX - current_size);
+  /* If we have to get more space, get enough to last a while: twice
+     as much as last time, which compact_buffer halves, up to
+     GAP_BYTES_GROWTH_MAX, and at least 1 / GAP_FRACTION of the text in
+     a huge buffer.  But do not exceed the maximum buffer size.  */
+  extra = clip_to_bounds (GAP_BYTES_DFL, 2 * current_buffer->text->gap_extra,
+			  GAP_BYTES_GROWTH_MAX);
+  extra = max (extra, current_size / GAP_FRACTION);
+  current_buffer->text->gap_extra = extra;
+  nbytes_added = min (nbytes_added + extra, BUF_BYTES_MAX - current_size);
 
   enlarge_buffer_text (current_buffer, nbytes_added);
 
@@ -807,6 +833,25 @@ insert_1_both (const char *string,
     emacs_abort ();
 #endif
 
+  memcpy (GPT_ADDR, string, nbytes);
+  insert_1_from_gap (nchars, nbytes, inherit, before_markers);
+}
+
+/* Insert at point the NCHARS chars, NBYTES bytes, that the caller
+   stored at the start of the gap after moving it to point and making
+   it large enough.  INHERIT and BEFORE_MARKERS are as for
+   insert_1_both, and like insert_1_both without PREPARE, this does
+   not call prepare_to_modify_buffer.  */
+
+void
+insert_1_from_gap (ptrdiff_t nchars, ptrdiff_t nbytes,
+		   bool inherit, bool before_markers)
+{
+  eassert (PT == GPT && nbytes <= GAP_SIZE);
+
+  if (NILP (BVAR (current_buffer, enable_multibyte_characters)))
+    nchars = nbytes;
+
   /* Record deletion of the surrounding text that combines with
      the insertion.  This, together with recording the insertion,
      will add up to the right stuff in the undo list.  */
@@ -814,8 +859,6 @@ insert_1_both (const char *string,
   MODIFF++;
   CHARS_MODIFF = MODIFF;
 
-  memcpy (GPT_ADDR, string, nbytes);
-
   GAP_SIZE -= nbytes;
   GPT += nchars;
   ZV += nchars;
@@ -1260,59 +1303,30 @@ adjust_after_insert (ptrdiff_t from, ptrdiff_t from_byte,
   adjust_after_replace (from, from_byte, Qnil, newlen, len_byte);
 }
 
-/* Replace the text from character positions FROM to TO with NEW,
-   If PREPARE, call prepare_to_modify_buffer.
-   If INHERIT, the newly inserted text should inherit text properties
-   from the surrounding non-deleted text.  */
-
-/* Note that this does not yet handle markers quite right.
-   Also it needs to record a single undo-entry that does a replacement
-   rather than a separate delete and insert.
-   That way, undo will also handle markers properly.
-
-   But if MARKERS is 0, don't relocate markers.  */
-
-void
-replace_range (ptrdiff_t from, ptrdiff_t to, Lisp_Object new,
-	       bool prepare, bool inherit, bool markers)
+/* Replace the text from FROM to TO, whose byte positions are FROM_BYTE
+   and TO_BYTE, with NEW.  Record it for undo and adjust point and
+   intervals, and markers and the overlay center too if MARKERS;
+   otherwise the caller must relocate those itself.  If INHERIT, the
+   newly inserted text should inherit text properties from the
+   surrounding non-deleted text.  Return the number of bytes inserted.
+
+   Unlike replace_range, never convert other positions, call
+   prepare_to_modify_buffer or signal_after_change, or increment
+   MODIFF; replace_regions relies on that.  */
+
+static ptrdiff_t
+replace_text (ptrdiff_t from, ptrdiff_t from_byte,
+	      ptrdiff_t to, ptrdiff_t to_byte,
+	      Lisp_Object new, bool inherit, bool markers)
 {
   ptrdiff_t inschars = SCHARS (new);
   ptrdiff_t insbytes = SBYTES (new);
-  ptrdiff_t from_byte, to_byte;
-  ptrdiff_t nbytes_del, nchars_del;
+  ptrdiff_t nchars_del = to - from;
+  ptrdiff_t nbytes_del = to_byte - from_byte;
   struct gcpro gcpro1;
   INTERVAL intervals;
   ptrdiff_t outgoing_insbytes = insbytes;
-  Lisp_Object deletion;
-
-  check_markers ();
-
-  GCPRO1 (new);
-  deletion = Qnil;
-
-  if (prepare)
-    {
-      ptrdiff_t range_length = to - from;
-      prepare_to_modify_buffer (from, to, &from);
-      to = from + range_length;
-    }
-
-  UNGCPRO;
-
-  /* Make args be valid.  */
-  if (from < BEGV)
-    from = BEGV;
-  if (to > ZV)
-    to = ZV;
-
-  from_byte = CHAR_TO_BYTE (from);
-  to_byte = CHAR_TO_BYTE (to);
-
-  nchars_del = to - from;
-  nbytes_del = to_byte - from_byte;
-
-  if (nbytes_del <= 0 && insbytes == 0)
-    return;
+  Lisp_Object deletion = Qnil;
 
   /* Make OUTGOING_INSBYTES describe the text
      as it will be inserted in this buffer.  */
@@ -1398,11 +1412,20 @@ replace_range (ptrdiff_t from, ptrdiff_t to, Lisp_Object new,
   if (markers)
     adjust_markers_for_replace (from, from_byte, nchars_del, nbytes_del,
 				inschars, outgoing_insbytes);
+  else
+    {
+      adjust_charpos_cache (from, from_byte, nchars_del, nbytes_del,
+			    inschars, outgoing_insbytes);
+      adjust_line_index (from_byte, nbytes_del, outgoing_insbytes, 1);
+    }
 
   /* Adjust the overlay center as needed.  This must be done after
      adjusting the markers that bound the overlays.  */
-  adjust_overlays_for_delete (from, nchars_del);
-  adjust_overlays_for_insert (from, inschars);
+  if (markers)
+    {
+      adjust_overlays_for_delete (from, nchars_del);
+      adjust_overlays_for_insert (from, inschars);
+    }
 
   offset_intervals (current_buffer, from, inschars - nchars_del);
 
@@ -1419,6 +1442,60 @@ replace_range (ptrdiff_t from, ptrdiff_t to, Lisp_Object new,
 		  (from_byte + outgoing_insbytes
 		   - (PT_BYTE < to_byte ? PT_BYTE : to_byte)));
 
+  UNGCPRO;
+  return outgoing_insbytes;
+}
+
+/* Replace the text from character positions FROM to TO with NEW,
+   If PREPARE, call prepare_to_modify_buffer.
+   If INHERIT, the newly inserted text should inherit text properties
+   from the surrounding non-deleted text.  */
+
+/* Note that this does not yet handle markers quite right.
+   Also it needs to record a single undo-entry that does a replacement
+   rather than a separate delete and insert.
+   That way, undo will also handle markers properly.
+
+   But if MARKERS is 0, don't relocate markers.  */
+
+void
+replace_range (ptrdiff_t from, ptrdiff_t to, Lisp_Object new,
+	       bool prepare, bool inherit, bool markers)
+{
+  ptrdiff_t from_byte, to_byte;
+  ptrdiff_t outgoing_insbytes;
+  struct gcpro gcpro1;
+
+  check_markers ();
+
+  GCPRO1 (new);
+
+  if (prepare)
+    {
+      ptrdiff_t range_length = to - from;
+      prepare_to_modify_buffer (from, to, &from);
+      to = from + range_length;
+    }
+
+  UNGCPRO;
+
+  /* Make args be valid.  */
+  if (from < BEGV)
+    from = BEGV;
+  if (to > ZV)
+    to = ZV;
+
+  from_byte = CHAR_TO_BYTE (from);
+  to_byte = CHAR_TO_BYTE (to);
+
+  if (to_byte <= from_byte && SBYTES (new) == 0)
+    return;
+
+  GCPRO1 (new);
+
+  outgoing_insbytes = replace_text (from, from_byte, to, to_byte,
+				    new, inherit, markers);
+
   if (outgoing_insbytes == 0)
     evaporate_overlays (from);
 
@@ -1428,10 +1505,10 @@ replace_range (ptrdiff_t from, ptrdiff_t to, Lisp_Object new,
   CHARS_MODIFF = MODIFF;
   UNGCPRO;
 
-  signal_after_change (from, nchars_del, GPT - from);
+  signal_after_change (from, to - from, GPT - from);
   update_compositions (from, GPT, CHECK_BORDER);
 }
-
+
 /* Replace the text from character positions FROM to TO with
    the text in INS of length INSCHARS.
    Keep the text properties that applied to the old characters
@@ -1515,6 +1592,12 @@ replace_range_2 (ptrdiff_t from, ptrdiff_t from_byte,
       && ! (nchars_del == 1 && inschars == 1 && nbytes_del == insbytes))
     adjust_markers_for_replace (from, from_byte, nchars_del, nbytes_del,
 				inschars, insbytes);
+  else if (nbytes_del != insbytes)
+    {
+      adjust_charpos_cache (from, from_byte, nchars_del, nbytes_del,
+			    inschars, insbytes);
+      adjust_line_index (from_byte, nbytes_del, insbytes, 1);
+    }
 
   /* Adjust the overlay center as needed.  This must be done after
      adjusting the markers that bound the overlays.  */
@@ -1782,16 +1865,16 @@ modify_text (ptrdiff_t start, ptrdiff_t end)
 /* Check that it is okay to modify the buffer between START and END,
    which are char positions.
 
-   Run the before-change-function, if any.  If intervals are in use,
-   verify that the text to be modified is not read-only, and call
-   any modification properties the text may have.
+   Run the before-change-function, if any.  If intervals are in use
+   and VERIFY_INTERVALS, verify that the text to be modified is not
+   read-only, and call any modification properties the text may have.
 
    If PRESERVE_PTR is nonzero, we relocate *PRESERVE_PTR
    by holding its value temporarily in a marker.  */
 
-void
-prepare_to_modify_buffer_1 (ptrdiff_t start, ptrdiff_t end,
-			    ptrdiff_t *preserve_ptr)
+static void
+prepare_to_modify_text (ptrdiff_t start, ptrdiff_t end,
+			ptrdiff_t *preserve_ptr, bool verify_intervals)
 {
   struct buffer *base_buffer;
 
@@ -1804,7 +1887,7 @@ prepare_to_modify_buffer_1 (ptrdiff_t start, ptrdiff_t end,
       && buffer_window_count (current_buffer))
     ++windows_or_buffers_changed;
 
-  if (buffer_intervals (current_buffer))
+  if (verify_intervals && buffer_intervals (current_buffer))
     {
       if (preserve_ptr)
 	{
@@ -1865,15 +1948,19 @@ prepare_to_modify_buffer_1 (ptrdiff_t start, ptrdiff_t end,
   Vdeactivate_mark = Qt;
 }
 
-/* Like above, but called when we know that the buffer text
-   will be modified and region caches should be invalidated.  */
-
 void
-prepare_to_modify_buffer (ptrdiff_t start, ptrdiff_t end,
-			  ptrdiff_t *preserve_ptr)
+prepare_to_modify_buffer_1 (ptrdiff_t start, ptrdiff_t end,
+			    ptrdiff_t *preserve_ptr)
 {
-  prepare_to_modify_buffer_1 (start, end, preserve_ptr);
+  prepare_to_modify_text (start, end, preserve_ptr, 1);
+}
+
+/* Invalidate the caches of the current buffer that cover the text
+   between START and END, which is about to change.  */
 
+static void
+invalidate_buffer_caches (ptrdiff_t start, ptrdiff_t end)
+{
   if (current_buffer->newline_cache)
     invalidate_region_cache (current_buffer,
                              current_buffer->newline_cache,
@@ -1886,6 +1973,27 @@ prepare_to_modify_buffer (ptrdiff_t start, ptrdiff_t end,
     invalidate_region_cache (current_buffer,
                              current_buffer->bidi_paragraph_cache,
                              start - BEG, Z - end);
+  invalidate_lisp_region_caches (current_buffer, start - BEG, Z - end);
+  /* Text may also be changed in place, without going through the
+     functions that adjust markers; tell the line index now.  */
+  if (current_buffer->text->line_index && start < end)
+    {
+      ptrdiff_t start_byte = CHAR_TO_BYTE (start);
+      ptrdiff_t nbytes = CHAR_TO_BYTE (end) - start_byte;
+      adjust_line_index (start_byte, nbytes, nbytes, 0);
+    }
+}
+
+/* Like prepare_to_modify_buffer_1, but called when we know that the
+   buffer text will be modified and region caches should be
+   invalidated.  */
+
+void
+prepare_to_modify_buffer (ptrdiff_t start, ptrdiff_t end,
+			  ptrdiff_t *preserve_ptr)
+{
+  prepare_to_modify_buffer_1 (start, end, preserve_ptr);
+  invalidate_buffer_caches (start, end);
 }
 
 /* These macros work with an argument named `preserve_ptr'
@@ -2184,6 +2292,217 @@ DEFUN ("combine-after-change-execute", Fcombine_after_change_execute,
   return unbind_to (count, Qnil);
 }
 
+/* One of the replacements made by `replace-regions'.  */
+
+struct region_replacement
+{
+  /* The region to replace, before any of the replacements.  */
+  ptrdiff_t from, to, from_byte, to_byte;
+
+  /* How much the replacements before this one have grown the buffer,
+     in characters and in bytes.  */
+  ptrdiff_t shift, shift_byte;
+
+  /* The index of this replacement in the list given by the caller.  */
+  ptrdiff_t index;
+
+  Lisp_Object new;
+};
+
+static int
+compare_region_replacements (const void *a, const void *b)
+{
+  const struct region_replacement *r1 = a, *r2 = b;
+
+  /* Keep replacements at the same position in the order they
+     were given.  */
+  if (r1->from != r2->from)
+    return r1->from < r2->from ? -1 : 1;
+  return r1->index < r2->index ? -1 : r1->index > r2->index;
+}
+
+DEFUN ("replace-regions", Freplace_regions, Sreplace_regions, 1, 1, 0,
+       doc: /* Replace several regions of the current buffer at once.
+EDITS is a list of elements (START END REPLACEMENT), each of which
+says to replace the text between START and END with the string
+REPLACEMENT.  All the positions refer to the text as it was before any
+of the replacements, and the regions must not overlap.  Insertions at
+the same position are made in the order they appear in EDITS.
+
+The text of the regions must not be read-only, and the
+`modification-hooks' text properties of that text are called for each
+region, as when making each replacement in turn.  However,
+`before-change-functions' and `after-change-functions', and the
+modification hooks of overlays, are called only once, for the whole
+text from the start of the first region to the end of the last one,
+including the unchanged text between the regions.  It is an error for
+any of these hooks to change the text of the buffer.
+
+Markers are relocated in a single pass.  A marker inside a replaced
+region moves to the start of its replacement, like it does with
+`replace-match'.  The new text does not inherit text properties from
+the text around it.  */)
+  (Lisp_Object edits)
+{
+  struct region_replacement *r;
+  ptrdiff_t n, i, beg, end, shift, shift_byte;
+  EMACS_INT chars_modiff;
+  Lisp_Object tail, strings;
+  struct Lisp_Marker *m;
+  struct gcpro gcpro1, gcpro2;
+  USE_SAFE_ALLOCA;
+
+  n = XFASTINT (Flength (edits));
+  if (n == 0)
+    return Qnil;
+
+  SAFE_NALLOCA (r, 1, n);
+  strings = make_uninit_vector (n);
+  for (tail = edits, i = 0; i < n; tail = XCDR (tail), i++)
+    {
+      Lisp_Object edit = XCAR (tail);
+      Lisp_Object start = Fcar (edit);
+      Lisp_Object stop = Fcar (Fcdr (edit));
+      Lisp_Object new = Fcar (Fcdr (Fcdr (edit)));
+
+      validate_region (&start, &stop);
+      CHECK_STRING (new);
+      r[i].from = XINT (start);
+      r[i].to = XINT (stop);
+      r[i].index = i;
+      r[i].new = new;
+      ASET (strings, i, new);
+    }
+
+  qsort (r, n, sizeof *r, compare_region_replacements);
+  for (i = 1; i < n; i++)
+    if (r[i].from < r[i - 1].to)
+      error ("Regions to replace overlap");
+
+  beg = r[0].from;
+  end = r[n - 1].to;
+
+  GCPRO2 (edits, strings);
+  /* Only the text being replaced has to be writable, but the change
+     hooks run once for the whole span.  */
+  if (!NILP (BVAR (current_buffer, read_only)))
+    Fbarf_if_buffer_read_only ();
+  chars_modiff = CHARS_MODIFF;
+  if (buffer_intervals (current_buffer))
+    for (i = 0; i < n; i++)
+      verify_interval_modification (current_buffer, r[i].from, r[i].to);
+  prepare_to_modify_text (beg, end, NULL, 0);
+  invalidate_buffer_caches (beg, end);
+  UNGCPRO;
+
+  /* The positions of the regions are no longer right if the hooks
+     changed the text, and no longer valid if they narrowed the
+     buffer.  */
+  if (CHARS_MODIFF != chars_modiff)
+    error ("Change hooks modified the text to replace");
+  if (beg < BEGV || end > ZV)
+    args_out_of_range (make_number (beg), make_number (end));
+
+  for (i = 0; i < n; i++)
+    {
+      r[i].from_byte = CHAR_TO_BYTE (r[i].from);
+      r[i].to_byte = CHAR_TO_BYTE (r[i].to);
+    }
+
+  check_markers ();
+
+  GCPRO1 (strings);
+
+  /* Start with the last region, so that the positions of the regions
+     before it remain valid.  The markers stay where they were until
+     all the text is in place.  */
+  for (i = n - 1; i >= 0; i--)
+    {
+      r[i].shift_byte = SBYTES (r[i].new);
+      if (r[i].to_byte > r[i].from_byte || r[i].shift_byte > 0)
+	r[i].shift_byte = replace_text (r[i].from, r[i].from_byte,
+					r[i].to, r[i].to_byte,
+					r[i].new, 0, 0);
+    }
+
+  /* Turn the number of bytes inserted for each region into the
+     offsets of the regions after the replacements.  */
+  shift = shift_byte = 0;
+  for (i = 0; i < n; i++)
+    {
+      ptrdiff_t insbytes = r[i].shift_byte;
+
+      r[i].shift = shift;
+      r[i].shift_byte = shift_byte;
+      shift += SCHARS (r[i].new) - (r[i].to - r[i].from);
+      shift_byte += insbytes - (r[i].to_byte - r[i].from_byte);
+    }
+
+  for (i = 0; i < n; i++)
+    if (r[i].from < r[i].to)
+      unindex_overlays (r[i].from + 1, r[i].to, 0);
+
+  /* Relocate each marker by the replacements before it.  Look for the
+     first region that ends after it; if the marker is inside that
+     region, it goes to the start of the replacement.  */
+  for (m = BUF_MARKERS (current_buffer); m; m = m->next)
+    {
+      ptrdiff_t lo = 0, hi = n;
+
+      while (lo < hi)
+	{
+	  ptrdiff_t mid = lo + (hi - lo) / 2;
+	  if (r[mid].to <= m->charpos)
+	    lo = mid + 1;
+	  else
+	    hi = mid;
+	}
+
+      if (lo == n)
+	{
+	  m->charpos += shift;
+	  m->bytepos += shift_byte;
+	}
+      else if (r[lo].from < m->charpos)
+	{
+	  m->charpos = r[lo].from + r[lo].shift;
+	  m->bytepos = r[lo].from_byte + r[lo].shift_byte;
+	}
+      else
+	{
+	  m->charpos += r[lo].shift;
+	  m->bytepos += r[lo].shift_byte;
+	}
+    }
+
+  /* The overlay lists are still sorted, since markers kept their
+     order; only the center needs to move along with them.  */
+  for (i = 0; i < n && r[i].to <= current_buffer->overlay_center; i++)
+    ;
+  if (i == n)
+    current_buffer->overlay_center += shift;
+  else if (r[i].from < current_buffer->overlay_center)
+    current_buffer->overlay_center = r[i].from + r[i].shift;
+  else
+    current_buffer->overlay_center += r[i].shift;
+
+  for (i = 0; i < n; i++)
+    if (SCHARS (r[i].new) == 0 && r[i].to > r[i].from)
+      evaporate_overlays (r[i].from + r[i].shift);
+
+  check_markers ();
+
+  MODIFF++;
+  CHARS_MODIFF = MODIFF;
+  UNGCPRO;
+  SAFE_FREE ();
+
+  signal_after_change (beg, end - beg, end - beg + shift);
+  update_compositions (beg, end + shift, CHECK_BORDER);
+
+  return Qnil;
+}
+
 void
 syms_of_insdel (void)
 {
@@ -2204,4 +2523,5 @@ as well as hooks attached to text properties and overlays.  */);
   DEFSYM (Qinhibit_modification_hooks, "inhibit-modification-hooks");
 
   defsubr (&Scombine_after_change_execute);
+  defsubr (&Sreplace_regions);
 }
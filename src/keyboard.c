@@ -3819,7 +3819,8 @@ kbd_buffer_get_event (KBOARD **kbp,
     }
 #endif	/* subprocesses */
 
-#ifndef HAVE_DBUS  /* We want to read D-Bus events in batch mode.  */
+/* We want to read D-Bus and inotify events in batch mode.  */
+#if !defined HAVE_DBUS && !defined HAVE_INOTIFY
   if (noninteractive
       /* In case we are running as a daemon, only do this before
 	 detaching from the terminal.  */
@@ -3830,7 +3831,7 @@ kbd_buffer_get_event (KBOARD **kbp,
       *kbp = current_kboard;
       return obj;
     }
-#endif	/* ! HAVE_DBUS  */
+#endif	/* ! HAVE_DBUS && ! HAVE_INOTIFY */
 
   /* Wait until there is input available.  */
   for (;;)
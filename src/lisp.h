@@ -1429,6 +1429,11 @@ struct Lisp_Symbol
      special (with `defvar' etc), and shouldn't be lexically bound.  */
   unsigned declared_special : 1;
 
+  /* Hash code of the symbol's name, if the symbol is interned.
+     `oblookup' compares it before comparing names, and the initial
+     obarray uses it to rehash its symbols when it grows.  */
+  unsigned int hash;
+
   /* The symbol's name, as a Lisp string.  */
   Lisp_Object name;
 
@@ -1711,7 +1716,10 @@ struct Lisp_Marker
 {
   ENUM_BF (Lisp_Misc_Type) type : 16;		/* = Lisp_Misc_Marker */
   unsigned gcmarkbit : 1;
-  int spacer : 13;
+  int spacer : 12;
+  /* 1 means this is the start or end of an overlay that is in the
+     overlay index of its buffer; see buffer.c.  */
+  unsigned int overlay_indexed : 1;
   /* This flag is temporarily used in the functions
      decode/encode_coding_object to record that the marker position
      must be adjusted after the conversion.  */
@@ -2144,6 +2152,12 @@ enum Lisp_Compiled
     COMPILED_INTERACTIVE = 5
   };
 
+/* Number of words after the slots of a Lisp_Compiled, which Lisp does
+   not see, where the byte-code interpreter caches an optimized form of
+   the byte code.  */
+
+enum { COMPILED_CACHE_WORDS = 2 };
+
 /* Flag bits in a character.  These also get used in termhooks.h.
    Richard Stallman <rms@gnu.ai.mit.edu> thinks that MULE
    (MUlti-Lingual Emacs) might need 22 bits for the character value
@@ -3320,6 +3334,7 @@ extern void insert_and_inherit (const char *, ptrdiff_t);
 extern void insert_1_both (const char *, ptrdiff_t, ptrdiff_t,
 			   bool, bool, bool);
 extern void insert_from_gap (ptrdiff_t, ptrdiff_t, bool text_at_gap_tail);
+extern void insert_1_from_gap (ptrdiff_t, ptrdiff_t, bool, bool);
 extern void insert_from_string (Lisp_Object, ptrdiff_t, ptrdiff_t,
 				ptrdiff_t, ptrdiff_t, bool);
 extern void insert_from_buffer (struct buffer *, ptrdiff_t, ptrdiff_t, bool);
@@ -3502,6 +3517,7 @@ build_string (const char *str)
 }
 
 extern Lisp_Object pure_cons (Lisp_Object, Lisp_Object);
+extern Lisp_Object make_byte_code_object (ptrdiff_t);
 extern void make_byte_code (struct Lisp_Vector *);
 extern Lisp_Object Qautomatic_gc;
 extern Lisp_Object Qchar_table_extra_slots;
@@ -3628,6 +3644,7 @@ extern Lisp_Object Qvariable_documentation, Qstandard_input;
 extern Lisp_Object Qbackquote, Qcomma, Qcomma_at, Qcomma_dot, Qfunction;
 extern Lisp_Object Qlexical_binding;
 extern Lisp_Object check_obarray (Lisp_Object);
+extern void begin_obarray_walk (Lisp_Object);
 extern Lisp_Object intern_1 (const char *, ptrdiff_t);
 extern Lisp_Object intern_c_string_1 (const char *, ptrdiff_t);
 extern Lisp_Object oblookup (Lisp_Object, const char *, ptrdiff_t, ptrdiff_t);
@@ -3691,6 +3708,7 @@ extern _Noreturn void xsignal3 (Lisp_Object, Lisp_Object, Lisp_Object,
 extern _Noreturn void signal_error (const char *, Lisp_Object);
 extern Lisp_Object eval_sub (Lisp_Object form);
 extern Lisp_Object apply1 (Lisp_Object, Lisp_Object);
+extern Lisp_Object funcall_known (Lisp_Object, ptrdiff_t, Lisp_Object *);
 extern Lisp_Object call0 (Lisp_Object);
 extern Lisp_Object call1 (Lisp_Object, Lisp_Object);
 extern Lisp_Object call2 (Lisp_Object, Lisp_Object, Lisp_Object);
@@ -3775,6 +3793,8 @@ extern void keys_of_buffer (void);
 extern ptrdiff_t marker_position (Lisp_Object);
 extern ptrdiff_t marker_byte_position (Lisp_Object);
 extern void clear_charpos_cache (struct buffer *);
+extern void adjust_charpos_cache (ptrdiff_t, ptrdiff_t, ptrdiff_t, ptrdiff_t,
+				  ptrdiff_t, ptrdiff_t);
 extern ptrdiff_t buf_charpos_to_bytepos (struct buffer *, ptrdiff_t);
 extern ptrdiff_t buf_bytepos_to_charpos (struct buffer *, ptrdiff_t);
 extern void unchain_marker (struct Lisp_Marker *marker);
@@ -3805,6 +3825,11 @@ extern _Noreturn void report_file_errno (const char *, Lisp_Object, int);
 extern _Noreturn void report_file_error (const char *, Lisp_Object);
 extern bool internal_delete_file (Lisp_Object);
 extern Lisp_Object emacs_readlinkat (int, const char *);
+extern bool file_status_outdated;
+struct stat;
+extern int file_status (const char *, struct stat *, bool);
+extern Lisp_Object file_status_readlink (const char *);
+extern void forget_file_status (const char *);
 extern bool file_directory_p (const char *);
 extern bool file_accessible_directory_p (const char *);
 extern void init_fileio (void);
@@ -3813,6 +3838,9 @@ extern Lisp_Object make_temp_name (Lisp_Object, bool);
 extern Lisp_Object Qdelete_file;
 extern bool check_existing (const char *);
 
+/* Defined in region-cache.c.  */
+extern void syms_of_region_cache (void);
+
 /* Defined in search.c.  */
 extern void shrink_regexp_cache (void);
 extern void restore_search_regs (void);
@@ -3835,6 +3863,8 @@ extern ptrdiff_t find_newline_no_quit (ptrdiff_t, ptrdiff_t,
 				       ptrdiff_t, ptrdiff_t *);
 extern ptrdiff_t find_before_next_newline (ptrdiff_t, ptrdiff_t,
 					   ptrdiff_t, ptrdiff_t *);
+extern void clear_line_index (struct buffer *);
+extern void adjust_line_index (ptrdiff_t, ptrdiff_t, ptrdiff_t, bool);
 extern void syms_of_search (void);
 extern void clear_regexp_cache (void);
 
@@ -3988,6 +4018,9 @@ extern void setup_process_coding_systems (Lisp_Object);
  _Noreturn
 #endif
 extern int child_setup (int, int, int, char **, bool, Lisp_Object);
+#ifndef WINDOWSNT
+extern pid_t spawn_child (int, int, int, char **, bool, Lisp_Object);
+#endif
 extern void init_callproc_1 (void);
 extern void init_callproc (void);
 extern void set_initial_environment (void);
@@ -4007,8 +4040,11 @@ extern struct byte_stack *byte_stack_list;
 extern void mark_byte_stack (void);
 #endif
 extern void unmark_byte_stack (void);
+extern void invalidate_call_caches (void);
 extern Lisp_Object exec_byte_code (Lisp_Object, Lisp_Object, Lisp_Object,
 				   Lisp_Object, ptrdiff_t, Lisp_Object *);
+extern Lisp_Object exec_compiled_function (Lisp_Object, Lisp_Object,
+					   ptrdiff_t, Lisp_Object *);
 
 /* Defined in macros.c.  */
 extern void init_macros (void);
@@ -4018,6 +4054,7 @@ extern void syms_of_macros (void);
 extern Lisp_Object Qapply;
 extern Lisp_Object Qinhibit_read_only;
 extern void truncate_undo_list (struct buffer *);
+extern void unpack_undo_log (struct buffer *);
 extern void record_marker_adjustment (Lisp_Object, ptrdiff_t);
 extern void record_insert (ptrdiff_t, ptrdiff_t);
 extern void record_delete (ptrdiff_t, Lisp_Object);
@@ -4131,6 +4168,7 @@ extern void syms_of_gfilenotify (void);
 
 /* Defined in inotify.c */
 #ifdef HAVE_INOTIFY
+extern struct timespec inotify_deliver_pending (void);
 extern void syms_of_inotify (void);
 #endif
 
@@ -58,10 +58,8 @@ along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
 
 #ifdef HAVE_FSEEKO
 #define file_offset off_t
-#define file_tell ftello
 #else
 #define file_offset long
-#define file_tell ftell
 #endif
 
 /* Hash table read constants.  */
@@ -95,8 +93,21 @@ static Lisp_Object Qload_in_progress;
    It must be set to nil before all top-level calls to read0.  */
 static Lisp_Object read_objects;
 
+/* The contents of a file being loaded, read into memory at once.
+   START is the beginning of the contents, END their end, and POS the
+   next byte to read.  */
+struct infile
+{
+  unsigned char *start, *pos, *end;
+
+  /* For a fast-load file, a vector of the symbols it uses, and
+     whether it uses lexical binding.  SYMBOLS is nil for other files.  */
+  Lisp_Object symbols;
+  bool lexical;
+};
+
 /* File for get_file_char to read from.  Use by load.  */
-static FILE *instream;
+static struct infile *infile;
 
 /* For use within read-from-string (this reader is non-reentrant!!)  */
 static ptrdiff_t read_from_string_index;
@@ -142,7 +153,7 @@ static Lisp_Object Vloads_in_progress;
 static int read_emacs_mule_char (int, int (*) (int, Lisp_Object),
                                  Lisp_Object);
 
-static void readevalloop (Lisp_Object, FILE *, Lisp_Object, bool,
+static void readevalloop (Lisp_Object, struct infile *, Lisp_Object, bool,
                           Lisp_Object, Lisp_Object,
                           Lisp_Object, Lisp_Object);
 
@@ -184,11 +195,21 @@ readchar (Lisp_Object readcharfun, bool *multibyte)
   int i, len;
   bool emacs_mule_encoding = 0;
 
+  readchar_count++;
+
+  /* ASCII from the file being loaded is by far the commonest case.  */
+  if (EQ (readcharfun, Qget_file_char) && unread_char < 0
+      && infile && infile->pos < infile->end
+      && ASCII_BYTE_P (*infile->pos))
+    {
+      if (multibyte)
+	*multibyte = 1;
+      return *infile->pos++;
+    }
+
   if (multibyte)
     *multibyte = 0;
 
-  readchar_count++;
-
   if (BUFFERP (readcharfun))
     {
       register struct buffer *inbuffer = XBUFFER (readcharfun);
@@ -354,9 +375,8 @@ skip_dyn_bytes (Lisp_Object readcharfun, ptrdiff_t n)
 {
   if (FROM_FILE_P (readcharfun))
     {
-      block_input ();		/* FIXME: Not sure if it's needed.  */
-      fseek (instream, n, SEEK_CUR);
-      unblock_input ();
+      if (infile)
+	infile->pos += min (n, infile->end - infile->pos);
     }
   else
     { /* We're not reading directly from a file.  In that case, it's difficult
@@ -377,9 +397,8 @@ skip_dyn_eof (Lisp_Object readcharfun)
 {
   if (FROM_FILE_P (readcharfun))
     {
-      block_input ();		/* FIXME: Not sure if it's needed.  */
-      fseek (instream, 0, SEEK_END);
-      unblock_input ();
+      if (infile)
+	infile->pos = infile->end;
     }
   else
     while (READCHAR >= 0);
@@ -456,28 +475,12 @@ readbyte_from_file (int c, Lisp_Object readcharfun)
 {
   if (c >= 0)
     {
-      block_input ();
-      ungetc (c, instream);
-      unblock_input ();
+      if (infile && infile->start < infile->pos)
+	*--infile->pos = c;
       return 0;
     }
 
-  block_input ();
-  c = getc (instream);
-
-  /* Interrupted reads have been observed while reading over the network.  */
-  while (c == EOF && ferror (instream) && errno == EINTR)
-    {
-      unblock_input ();
-      QUIT;
-      block_input ();
-      clearerr (instream);
-      c = getc (instream);
-    }
-
-  unblock_input ();
-
-  return (c == EOF ? -1 : c);
+  return (infile && infile->pos < infile->end ? *infile->pos++ : -1);
 }
 
 static int
@@ -775,11 +778,8 @@ DEFUN ("get-file-char", Fget_file_char, Sget_file_char, 0, 0, 0,
        doc: /* Don't use this yourself.  */)
   (void)
 {
-  register Lisp_Object val;
-  block_input ();
-  XSETINT (val, getc (instream));
-  unblock_input ();
-  return val;
+  return make_number (infile && infile->pos < infile->end
+		      ? *infile->pos++ : -1);
 }
 
 
@@ -957,6 +957,894 @@ record_load_unwind (Lisp_Object old)
   Vloads_in_progress = old;
 }
 
+/* Callback for record_unwind_protect_ptr.  Free the contents of the
+   file ARG, a struct infile, and forget the file if it is being read.  */
+
+static void
+infile_unwind (void *arg)
+{
+  struct infile *in = arg;
+
+  if (infile == in)
+    infile = NULL;
+  xfree (in->start);
+}
+
+/* Read all of STREAM into memory and make IN describe its contents.
+   IN->start must be null or point to memory that an unwind-protect
+   frees.  FILE is the file name to use in error messages.  */
+
+static void
+infile_read (struct infile *in, FILE *stream, Lisp_Object file)
+{
+  struct stat st;
+  ptrdiff_t size = 0, alloc = BUFSIZ;
+
+  /* Ask for one byte more than the file holds, so that the read that
+     finds the end of the file needs no more memory.  */
+  if (fstat (fileno (stream), &st) == 0 && S_ISREG (st.st_mode)
+      && 0 <= st.st_size && st.st_size < min (PTRDIFF_MAX, SIZE_MAX) / 2)
+    alloc = st.st_size + 1;
+  in->start = xrealloc (in->start, alloc);
+
+  while (true)
+    {
+      size_t n;
+
+      block_input ();
+      n = fread (in->start + size, 1, alloc - size, stream);
+      unblock_input ();
+      size += n;
+      if (size == alloc)
+	in->start = xpalloc (in->start, &alloc, 1, -1, 1);
+      else if (! ferror (stream))
+	break;
+      else if (errno == EINTR)
+	{
+	  /* Interrupted reads have been observed while reading over
+	     the network.  */
+	  QUIT;
+	  clearerr (stream);
+	}
+      else
+	report_file_error ("Read error", file);
+    }
+
+  in->pos = in->start;
+  in->end = in->start + size;
+}
+
+/* Fast-load files.
+
+   A fast-load file FOO.elb holds the forms of the compiled file
+   FOO.elc in a binary form that `load' turns back into objects without
+   parsing printed Lisp.  It starts with a header made of:
+
+     FAST_LOAD_MAGIC, and the format version FAST_LOAD_VERSION as one byte;
+     the size and modification time of FOO.elc, so that `load' ignores
+     FOO.elb once FOO.elc changes;
+     flags, a combination of enum fast_load_flag;
+     the number of symbols the forms use, then the character count,
+     byte count and bytes of the name of each.
+
+   Then come the forms, each as the number of objects it shares
+   followed by the form itself.  An object is one of enum fast_load_tag
+   as a byte, followed by data that depends on the tag.  All numbers
+   are unsigned LEB128, with signed ones zigzag-encoded first.
+
+   Doc strings and lazily loaded byte code stay in FOO.elc, and the
+   forms refer to them by position just as FOO.elc does.  `load' binds
+   `load-file-name' to FOO.elc when it loads FOO.elb, so that these
+   references still work.  */
+
+#define FAST_LOAD_MAGIC "\177ELB"
+enum { FAST_LOAD_VERSION = 1 };
+
+enum fast_load_flag
+  {
+    /* FOO.elc uses lexical binding.  */
+    FAST_LOAD_LEXICAL = 1
+  };
+
+enum fast_load_tag
+  {
+    /* The symbol with the given index in the symbol table.  */
+    FAST_LOAD_SYMBOL,
+    /* An uninterned symbol, followed by its name as a string.  */
+    FAST_LOAD_UNINTERNED,
+    /* A fixnum.  */
+    FAST_LOAD_INTEGER,
+    /* A float, as the 8 bytes of its IEEE double, least significant
+       first.  */
+    FAST_LOAD_FLOAT,
+    /* A unibyte string: its length, then its bytes.  */
+    FAST_LOAD_UNIBYTE_STRING,
+    /* A multibyte string: its character and byte counts, then its
+       bytes.  */
+    FAST_LOAD_MULTIBYTE_STRING,
+    /* A string with text properties, followed by the string and by a
+       list of START, END and PLIST for each run of properties.  */
+    FAST_LOAD_PROPERTIZED_STRING,
+    /* A list: its number N of conses, their N cars, then the cdr of
+       the last cons.  */
+    FAST_LOAD_LIST,
+    /* Vector-like objects: the number of slots, then the slots.  */
+    FAST_LOAD_VECTOR,
+    FAST_LOAD_BYTE_CODE,
+    FAST_LOAD_CHAR_TABLE,
+    FAST_LOAD_SUB_CHAR_TABLE,
+    /* A bool vector: its number of bits, then its bytes.  */
+    FAST_LOAD_BOOL_VECTOR,
+    /* The value of `load-file-name', which FOO.elc reads as #$.  */
+    FAST_LOAD_FILE_NAME,
+    /* An object that occurs more than once in a form: its index among
+       the shared objects of the form, then the object.  */
+    FAST_LOAD_DEFINE,
+    /* A reference to the shared object with the given index.  */
+    FAST_LOAD_SHARED
+  };
+
+verify (sizeof (double) == sizeof (uint64_t));
+
+/* True if OBJ occurring twice in a form must yield the same object
+   twice when the form is loaded.  */
+#define FAST_LOAD_SHAREABLE_P(obj)				\
+  ((CONSP (obj) || STRINGP (obj) || VECTORLIKEP (obj)		\
+    || (SYMBOLP (obj) && ! SYMBOL_INTERNED_P (obj)))		\
+   && ! EQ (obj, Vload_file_name))
+
+static _Noreturn void
+fast_load_invalid (void)
+{
+  error ("Invalid fast-load file");
+}
+
+/* Read a number from the fast-load file IN.  */
+
+static uintmax_t
+fast_load_uint (struct infile *in)
+{
+  uintmax_t n = 0;
+  int shift = 0;
+  unsigned char c;
+
+  do
+    {
+      if (in->pos == in->end || sizeof n * CHAR_BIT <= shift)
+	fast_load_invalid ();
+      c = *in->pos++;
+      n |= (uintmax_t) (c & 0x7f) << shift;
+      shift += 7;
+    }
+  while (c & 0x80);
+
+  return n;
+}
+
+/* Read a signed number from the fast-load file IN.  */
+
+static intmax_t
+fast_load_int (struct infile *in)
+{
+  uintmax_t n = fast_load_uint (in);
+
+  return (intmax_t) (n >> 1) ^ - (intmax_t) (n & 1);
+}
+
+/* Read from the fast-load file IN an index into VECTOR.  */
+
+static ptrdiff_t
+fast_load_index (struct infile *in, Lisp_Object vector)
+{
+  uintmax_t n = fast_load_uint (in);
+
+  if (ASIZE (vector) <= n)
+    fast_load_invalid ();
+  return n;
+}
+
+/* Read a count of bytes or objects from the fast-load file IN.  Each
+   of them takes at least one byte, so the count cannot exceed the
+   number of bytes left.  */
+
+static ptrdiff_t
+fast_load_count (struct infile *in)
+{
+  uintmax_t n = fast_load_uint (in);
+
+  if ((uintmax_t) (in->end - in->pos) < n)
+    fast_load_invalid ();
+  return n;
+}
+
+/* Make OBJ the shared object with index INDEX in the vector SHARED,
+   unless INDEX is negative.  */
+
+static void
+fast_load_define (Lisp_Object shared, ptrdiff_t index, Lisp_Object obj)
+{
+  if (0 <= index)
+    ASET (shared, index, obj);
+}
+
+/* Read an object from the fast-load file IN.  SHARED is the vector of
+   the shared objects of the current form.  If INDEX is not negative,
+   the object gets that index in SHARED, before the objects it
+   contains are read.  */
+
+static Lisp_Object
+fast_load_object (struct infile *in, Lisp_Object shared, ptrdiff_t index)
+{
+  Lisp_Object obj, tail;
+  ptrdiff_t i, n, nbytes;
+  uintmax_t u;
+  uint64_t bits;
+  double d;
+  int tag;
+
+  if (in->pos == in->end)
+    fast_load_invalid ();
+  tag = *in->pos++;
+
+  switch (tag)
+    {
+    case FAST_LOAD_SYMBOL:
+      return AREF (in->symbols, fast_load_index (in, in->symbols));
+
+    case FAST_LOAD_UNINTERNED:
+      obj = fast_load_object (in, shared, -1);
+      if (! STRINGP (obj))
+	fast_load_invalid ();
+      obj = Fmake_symbol (obj);
+      fast_load_define (shared, index, obj);
+      return obj;
+
+    case FAST_LOAD_INTEGER:
+      {
+	intmax_t v = fast_load_int (in);
+	if (FIXNUM_OVERFLOW_P (v))
+	  fast_load_invalid ();
+	return make_number (v);
+      }
+
+    case FAST_LOAD_FLOAT:
+      if (in->end - in->pos < sizeof bits)
+	fast_load_invalid ();
+      bits = 0;
+      for (i = sizeof bits - 1; 0 <= i; i--)
+	bits = bits << CHAR_BIT | in->pos[i];
+      in->pos += sizeof bits;
+      memcpy (&d, &bits, sizeof d);
+      obj = make_float (d);
+      fast_load_define (shared, index, obj);
+      return obj;
+
+    case FAST_LOAD_UNIBYTE_STRING:
+      nbytes = fast_load_count (in);
+      obj = make_unibyte_string ((char *) in->pos, nbytes);
+      in->pos += nbytes;
+      fast_load_define (shared, index, obj);
+      return obj;
+
+    case FAST_LOAD_MULTIBYTE_STRING:
+      n = fast_load_count (in);
+      nbytes = fast_load_count (in);
+      if (nbytes < n)
+	fast_load_invalid ();
+      obj = make_multibyte_string ((char *) in->pos, n, nbytes);
+      in->pos += nbytes;
+      fast_load_define (shared, index, obj);
+      return obj;
+
+    case FAST_LOAD_PROPERTIZED_STRING:
+      obj = fast_load_object (in, shared, index);
+      if (! STRINGP (obj))
+	fast_load_invalid ();
+      for (tail = fast_load_object (in, shared, -1); CONSP (tail);
+	   tail = XCDR (XCDR (XCDR (tail))))
+	{
+	  if (! (CONSP (XCDR (tail)) && CONSP (XCDR (XCDR (tail)))))
+	    fast_load_invalid ();
+	  Fset_text_properties (XCAR (tail), XCAR (XCDR (tail)),
+				XCAR (XCDR (XCDR (tail))), obj);
+	}
+      return obj;
+
+    case FAST_LOAD_LIST:
+      n = fast_load_count (in);
+      if (n == 0)
+	fast_load_invalid ();
+      obj = tail = Fcons (Qnil, Qnil);
+      fast_load_define (shared, index, obj);
+      XSETCAR (obj, fast_load_object (in, shared, -1));
+      for (i = 1; i < n; i++)
+	{
+	  Lisp_Object elt = fast_load_object (in, shared, -1);
+	  XSETCDR (tail, Fcons (elt, Qnil));
+	  tail = XCDR (tail);
+	}
+      XSETCDR (tail, fast_load_object (in, shared, -1));
+      return obj;
+
+    case FAST_LOAD_VECTOR:
+    case FAST_LOAD_BYTE_CODE:
+    case FAST_LOAD_CHAR_TABLE:
+    case FAST_LOAD_SUB_CHAR_TABLE:
+      n = fast_load_count (in);
+      obj = (tag == FAST_LOAD_BYTE_CODE ? make_byte_code_object (n)
+	     : Fmake_vector (make_number (n), Qnil));
+      fast_load_define (shared, index, obj);
+      for (i = 0; i < n; i++)
+	ASET (obj, i, fast_load_object (in, shared, -1));
+
+      /* Check what read1 checks for the same objects.  */
+      if (tag == FAST_LOAD_BYTE_CODE)
+	{
+	  if (n <= COMPILED_STACK_DEPTH)
+	    fast_load_invalid ();
+	  make_byte_code (XVECTOR (obj));
+	}
+      else if (tag == FAST_LOAD_CHAR_TABLE)
+	{
+	  if (n < CHAR_TABLE_STANDARD_SLOTS)
+	    fast_load_invalid ();
+	  XSETPVECTYPE (XVECTOR (obj), PVEC_CHAR_TABLE);
+	}
+      else if (tag == FAST_LOAD_SUB_CHAR_TABLE)
+	{
+	  if (n == 0 || ! RANGED_INTEGERP (1, AREF (obj, 0), 3)
+	      || chartab_size[XINT (AREF (obj, 0))] != n - 2)
+	    fast_load_invalid ();
+	  XSETPVECTYPE (XVECTOR (obj), PVEC_SUB_CHAR_TABLE);
+	}
+      return obj;
+
+    case FAST_LOAD_BOOL_VECTOR:
+      u = fast_load_uint (in);
+      if (MOST_POSITIVE_FIXNUM < u)
+	fast_load_invalid ();
+      nbytes = ((u + BOOL_VECTOR_BITS_PER_CHAR - 1)
+		/ BOOL_VECTOR_BITS_PER_CHAR);
+      if (in->end - in->pos < nbytes)
+	fast_load_invalid ();
+      obj = Fmake_bool_vector (make_number (u), Qnil);
+      fast_load_define (shared, index, obj);
+      memcpy (XBOOL_VECTOR (obj)->data, in->pos, nbytes);
+      in->pos += nbytes;
+      /* Clear the extraneous bits in the last byte.  */
+      if (u % BOOL_VECTOR_BITS_PER_CHAR)
+	XBOOL_VECTOR (obj)->data[nbytes - 1]
+	  &= (1 << (u % BOOL_VECTOR_BITS_PER_CHAR)) - 1;
+      return obj;
+
+    case FAST_LOAD_FILE_NAME:
+      return Vload_file_name;
+
+    case FAST_LOAD_DEFINE:
+      return fast_load_object (in, shared, fast_load_index (in, shared));
+
+    case FAST_LOAD_SHARED:
+      obj = AREF (shared, fast_load_index (in, shared));
+      if (NILP (obj))
+	fast_load_invalid ();
+      return obj;
+
+    default:
+      fast_load_invalid ();
+    }
+}
+
+/* Read the next form from the fast-load file IN.  */
+
+static Lisp_Object
+fast_load_form (struct infile *in)
+{
+  ptrdiff_t nshared = fast_load_count (in);
+
+  return fast_load_object (in, Fmake_vector (make_number (nshared), Qnil),
+			   -1);
+}
+
+/* If `load' should load the fast-load file of FOUND instead of FOUND,
+   a compiled file open as STREAM, read the fast-load file into IN up
+   to its first form, intern its symbols and return true.  Otherwise
+   return false.  */
+
+static bool
+fast_load_open (struct infile *in, Lisp_Object found, FILE *stream)
+{
+  ptrdiff_t count = SPECPDL_INDEX ();
+  Lisp_Object name, obarray;
+  struct stat st;
+  struct timespec mtime;
+  ptrdiff_t i, nsymbols;
+  FILE *elb;
+  int fd;
+
+  if (! load_use_fast_load_files
+      || ! NILP (Vpurify_flag) || load_force_doc_strings
+      || ! NILP (Vload_read_function)
+      || SBYTES (found) < 4
+      || memcmp (SDATA (found) + SBYTES (found) - 4, ".elc", 4) != 0
+      || fstat (fileno (stream), &st) != 0)
+    return 0;
+
+  name = concat2 (Fsubstring (found, make_number (0), make_number (-1)),
+		  build_string ("b"));
+  name = ENCODE_FILE (name);
+  fd = emacs_open (SSDATA (name), O_RDONLY, 0);
+  if (fd < 0)
+    return 0;
+  record_unwind_protect_int (close_file_unwind, fd);
+  elb = fdopen (fd, "rb");
+  if (! elb)
+    {
+      unbind_to (count, Qnil);
+      return 0;
+    }
+  set_unwind_protect_ptr (count, fclose_unwind, elb);
+  infile_read (in, elb, found);
+  unbind_to (count, Qnil);
+
+  /* Ignore the file if it has another format or FOUND has changed
+     since it was made.  */
+  mtime = get_stat_mtime (&st);
+  if (in->end - in->pos <= sizeof FAST_LOAD_MAGIC
+      || memcmp (in->pos, FAST_LOAD_MAGIC, sizeof FAST_LOAD_MAGIC - 1) != 0
+      || in->pos[sizeof FAST_LOAD_MAGIC - 1] != FAST_LOAD_VERSION)
+    return 0;
+  in->pos += sizeof FAST_LOAD_MAGIC;
+  if (fast_load_uint (in) != st.st_size)
+    return 0;
+  if (fast_load_int (in) != mtime.tv_sec
+      || fast_load_uint (in) != mtime.tv_nsec)
+    return 0;
+
+  in->lexical = (fast_load_uint (in) & FAST_LOAD_LEXICAL) != 0;
+  nsymbols = fast_load_count (in);
+  in->symbols = Fmake_vector (make_number (nsymbols), Qnil);
+  obarray = check_obarray (Vobarray);
+  for (i = 0; i < nsymbols; i++)
+    {
+      ptrdiff_t nchars = fast_load_count (in);
+      ptrdiff_t nbytes = fast_load_count (in);
+      char *p = (char *) in->pos;
+      Lisp_Object sym;
+
+      if (nbytes < nchars)
+	fast_load_invalid ();
+      in->pos += nbytes;
+      sym = oblookup (obarray, p, nchars, nbytes);
+      if (! SYMBOLP (sym))
+	sym = Fintern (make_multibyte_string (p, nchars, nbytes), obarray);
+      ASET (in->symbols, i, sym);
+    }
+  return 1;
+}
+
+/* Memory that a fast-load file is written to.  BUF holds SIZE bytes
+   and has room for ALLOC.  */
+struct fast_load_output
+{
+  unsigned char *buf;
+  ptrdiff_t size, alloc;
+};
+
+/* The state of Ffast_load_file_contents.  */
+struct fast_load_writer
+{
+  /* The header and symbol table, the names of the symbols, and the
+     forms.  */
+  struct fast_load_output header, names, forms;
+
+  /* A hash table mapping the interned symbols written so far to their
+     indexes, and the number of those symbols.  */
+  Lisp_Object symbols;
+  ptrdiff_t nsymbols;
+
+  /* A hash table mapping the objects of the current form that may be
+     shared to the number of times they occur, and, once they are
+     written, to -1 minus their indexes.  NSHARED is the number of
+     objects that occur more than once, NDEFINED the number of those
+     written so far.  */
+  Lisp_Object shared;
+  ptrdiff_t nshared, ndefined;
+};
+
+/* Callback for record_unwind_protect_ptr.  Free the memory of the
+   fast_load_writer ARG.  */
+
+static void
+fast_load_writer_unwind (void *arg)
+{
+  struct fast_load_writer *w = arg;
+
+  xfree (w->header.buf);
+  xfree (w->names.buf);
+  xfree (w->forms.buf);
+}
+
+static void
+fast_load_put_bytes (struct fast_load_output *out, const void *p,
+		     ptrdiff_t n)
+{
+  if (out->alloc - out->size < n)
+    out->buf = xpalloc (out->buf, &out->alloc,
+			n - (out->alloc - out->size), -1, 1);
+  memcpy (out->buf + out->size, p, n);
+  out->size += n;
+}
+
+static void
+fast_load_put_byte (struct fast_load_output *out, int c)
+{
+  unsigned char b = c;
+  fast_load_put_bytes (out, &b, 1);
+}
+
+static void
+fast_load_put_uint (struct fast_load_output *out, uintmax_t n)
+{
+  unsigned char buf[(sizeof n * CHAR_BIT + 6) / 7];
+  int i = 0;
+
+  do
+    {
+      buf[i] = n & 0x7f;
+      n >>= 7;
+      if (n)
+	buf[i] |= 0x80;
+      i++;
+    }
+  while (n);
+
+  fast_load_put_bytes (out, buf, i);
+}
+
+static void
+fast_load_put_int (struct fast_load_output *out, intmax_t n)
+{
+  fast_load_put_uint (out, ((uintmax_t) n << 1) ^ (n < 0 ? UINTMAX_MAX : 0));
+}
+
+/* Return a list of START, END and PLIST for each run of text
+   properties of STRING.  */
+
+static Lisp_Object
+fast_load_string_properties (Lisp_Object string)
+{
+  Lisp_Object props = Qnil;
+  ptrdiff_t start, end;
+
+  for (start = 0; start < SCHARS (string); start = end)
+    {
+      Lisp_Object next = Fnext_property_change (make_number (start),
+						string, Qnil);
+      Lisp_Object plist = Ftext_properties_at (make_number (start), string);
+
+      end = NILP (next) ? SCHARS (string) : XINT (next);
+      if (! NILP (plist))
+	props = Fcons (plist, Fcons (make_number (end),
+				     Fcons (make_number (start), props)));
+    }
+
+  return Fnreverse (props);
+}
+
+/* Count the occurrences of the shareable objects in OBJ, in the
+   writer W.  */
+
+static void
+fast_load_count_shared (struct fast_load_writer *w, Lisp_Object obj)
+{
+  while (FAST_LOAD_SHAREABLE_P (obj))
+    {
+      Lisp_Object n = Fgethash (obj, w->shared, Qnil);
+      ptrdiff_t i, size;
+
+      if (! NILP (n))
+	{
+	  if (XINT (n) == 1)
+	    w->nshared++;
+	  Fputhash (obj, make_number (XINT (n) + 1), w->shared);
+	  return;
+	}
+      Fputhash (obj, make_number (1), w->shared);
+
+      if (CONSP (obj))
+	{
+	  fast_load_count_shared (w, XCAR (obj));
+	  obj = XCDR (obj);
+	}
+      else
+	{
+	  if (STRINGP (obj))
+	    {
+	      Lisp_Object props = fast_load_string_properties (obj);
+	      for (; CONSP (props); props = XCDR (XCDR (XCDR (props))))
+		fast_load_count_shared (w, XCAR (XCDR (XCDR (props))));
+	    }
+	  else if (VECTORP (obj) || COMPILEDP (obj)
+		   || CHAR_TABLE_P (obj) || SUB_CHAR_TABLE_P (obj))
+	    {
+	      size = ASIZE (obj) & PSEUDOVECTOR_SIZE_MASK;
+	      for (i = 0; i < size; i++)
+		fast_load_count_shared (w, AREF (obj, i));
+	    }
+	  return;
+	}
+    }
+}
+
+/* True if OBJ occurs more than once in the current form, in the writer W.  */
+
+static bool
+fast_load_shared_p (struct fast_load_writer *w, Lisp_Object obj)
+{
+  Lisp_Object n;
+
+  if (! FAST_LOAD_SHAREABLE_P (obj))
+    return 0;
+  n = Fgethash (obj, w->shared, Qnil);
+  return INTEGERP (n) && XINT (n) != 1;
+}
+
+static void fast_load_write_object (struct fast_load_writer *,
+				    Lisp_Object);
+
+/* Write the string STRING, without its text properties, in the writer W.  */
+
+static void
+fast_load_write_string (struct fast_load_writer *w, Lisp_Object string)
+{
+  if (STRING_MULTIBYTE (string))
+    {
+      fast_load_put_byte (&w->forms, FAST_LOAD_MULTIBYTE_STRING);
+      fast_load_put_uint (&w->forms, SCHARS (string));
+    }
+  else
+    fast_load_put_byte (&w->forms, FAST_LOAD_UNIBYTE_STRING);
+  fast_load_put_uint (&w->forms, SBYTES (string));
+  fast_load_put_bytes (&w->forms, SDATA (string), SBYTES (string));
+}
+
+/* Write OBJ in the writer W.  */
+
+static void
+fast_load_write_object (struct fast_load_writer *w, Lisp_Object obj)
+{
+  struct fast_load_output *out = &w->forms;
+  ptrdiff_t i, n;
+
+  if (STRINGP (obj) && EQ (obj, Vload_file_name))
+    {
+      fast_load_put_byte (out, FAST_LOAD_FILE_NAME);
+      return;
+    }
+
+  if (fast_load_shared_p (w, obj))
+    {
+      n = XINT (Fgethash (obj, w->shared, Qnil));
+      if (n < 0)
+	{
+	  fast_load_put_byte (out, FAST_LOAD_SHARED);
+	  fast_load_put_uint (out, -1 - n);
+	  return;
+	}
+      Fputhash (obj, make_number (-1 - w->ndefined), w->shared);
+      fast_load_put_byte (out, FAST_LOAD_DEFINE);
+      fast_load_put_uint (out, w->ndefined++);
+    }
+
+  switch (XTYPE (obj))
+    {
+    case Lisp_Symbol:
+      if (SYMBOL_INTERNED_P (obj))
+	{
+	  Lisp_Object name = SYMBOL_NAME (obj);
+	  Lisp_Object index = Fgethash (obj, w->symbols, Qnil);
+
+	  if (NILP (index))
+	    {
+	      index = make_number (w->nsymbols++);
+	      Fputhash (obj, index, w->symbols);
+	      fast_load_put_uint (&w->names, SCHARS (name));
+	      fast_load_put_uint (&w->names, SBYTES (name));
+	      fast_load_put_bytes (&w->names, SDATA (name), SBYTES (name));
+	    }
+	  fast_load_put_byte (out, FAST_LOAD_SYMBOL);
+	  fast_load_put_uint (out, XINT (index));
+	}
+      else
+	{
+	  fast_load_put_byte (out, FAST_LOAD_UNINTERNED);
+	  fast_load_write_string (w, SYMBOL_NAME (obj));
+	}
+      return;
+
+    case_Lisp_Int:
+      fast_load_put_byte (out, FAST_LOAD_INTEGER);
+      fast_load_put_int (out, XINT (obj));
+      return;
+
+    case Lisp_Float:
+      {
+	double d = XFLOAT_DATA (obj);
+	uint64_t bits;
+	unsigned char buf[sizeof bits];
+
+	memcpy (&bits, &d, sizeof bits);
+	for (i = 0; i < sizeof bits; i++)
+	  buf[i] = bits >> (i * CHAR_BIT);
+	fast_load_put_byte (out, FAST_LOAD_FLOAT);
+	fast_load_put_bytes (out, buf, sizeof buf);
+      }
+      return;
+
+    case Lisp_String:
+      if (string_intervals (obj))
+	{
+	  fast_load_put_byte (out, FAST_LOAD_PROPERTIZED_STRING);
+	  fast_load_write_string (w, obj);
+	  fast_load_write_object (w, fast_load_string_properties (obj));
+	}
+      else
+	fast_load_write_string (w, obj);
+      return;
+
+    case Lisp_Cons:
+      {
+	Lisp_Object tail = XCDR (obj);
+
+	for (n = 1; CONSP (tail) && ! fast_load_shared_p (w, tail); n++)
+	  tail = XCDR (tail);
+	fast_load_put_byte (out, FAST_LOAD_LIST);
+	fast_load_put_uint (out, n);
+	for (i = 0; i < n; i++, obj = XCDR (obj))
+	  fast_load_write_object (w, XCAR (obj));
+	fast_load_write_object (w, obj);
+      }
+      return;
+
+    case Lisp_Vectorlike:
+      if (BOOL_VECTOR_P (obj))
+	{
+	  EMACS_INT size = XBOOL_VECTOR (obj)->size;
+	  fast_load_put_byte (out, FAST_LOAD_BOOL_VECTOR);
+	  fast_load_put_uint (out, size);
+	  fast_load_put_bytes (out, XBOOL_VECTOR (obj)->data,
+			       ((size + BOOL_VECTOR_BITS_PER_CHAR - 1)
+				/ BOOL_VECTOR_BITS_PER_CHAR));
+	  return;
+	}
+      if (VECTORP (obj) || COMPILEDP (obj)
+	  || CHAR_TABLE_P (obj) || SUB_CHAR_TABLE_P (obj))
+	{
+	  fast_load_put_byte (out, (VECTORP (obj) ? FAST_LOAD_VECTOR
+				    : COMPILEDP (obj) ? FAST_LOAD_BYTE_CODE
+				    : CHAR_TABLE_P (obj) ? FAST_LOAD_CHAR_TABLE
+				    : FAST_LOAD_SUB_CHAR_TABLE));
+	  n = ASIZE (obj) & PSEUDOVECTOR_SIZE_MASK;
+	  fast_load_put_uint (out, n);
+	  for (i = 0; i < n; i++)
+	    fast_load_write_object (w, AREF (obj, i));
+	  return;
+	}
+      break;
+
+    default:
+      break;
+    }
+
+  xsignal2 (Qerror, build_string ("Cannot write object to a fast-load file"),
+	    obj);
+}
+
+DEFUN ("fast-load-file-contents", Ffast_load_file_contents,
+       Sfast_load_file_contents, 1, 1, 0,
+       doc: /* Return the contents of a fast-load file for FILE, as a unibyte string.
+FILE should be a file compiled by this version of the byte compiler.
+
+If FILE is FOO.elc, the contents should be written to FOO.elb, its
+fast-load file.  `load' loads FOO.elb in place of FOO.elc, as long as
+FOO.elc has not changed since the contents were computed; see
+`load-use-fast-load-files'.
+
+Signal an error if FILE holds an object that fast-load files cannot
+represent, such as a hash table.  */)
+  (Lisp_Object file)
+{
+  ptrdiff_t count = SPECPDL_INDEX ();
+  Lisp_Object readcharfun = Qget_file_char;
+  Lisp_Object efile, form, result;
+  struct fast_load_writer w;
+  struct infile input;
+  struct timespec mtime;
+  struct stat st;
+  struct gcpro gcpro1, gcpro2, gcpro3;
+  FILE *stream;
+  bool lexical;
+  int fd, c;
+
+  file = Fexpand_file_name (file, Qnil);
+  efile = ENCODE_FILE (file);
+  fd = emacs_open (SSDATA (efile), O_RDONLY, 0);
+  if (fd < 0)
+    report_file_error ("Opening input file", file);
+  record_unwind_protect_int (close_file_unwind, fd);
+  if (safe_to_load_version (fd) < 22)
+    error ("File `%s' was not compiled by this Emacs", SDATA (file));
+  if (fstat (fd, &st) != 0)
+    report_file_error ("Getting attributes", file);
+  stream = fdopen (fd, "rb");
+  if (! stream)
+    report_file_error ("Opening stdio stream", file);
+  set_unwind_protect_ptr (count, fclose_unwind, stream);
+
+  input.start = NULL;
+  input.symbols = Qnil;
+  record_unwind_protect_ptr (infile_unwind, &input);
+  infile_read (&input, stream, file);
+
+  memset (&w, 0, sizeof w);
+  w.symbols = w.shared = Qnil;
+  record_unwind_protect_ptr (fast_load_writer_unwind, &w);
+  GCPRO3 (file, w.symbols, w.shared);
+  {
+    Lisp_Object args[2];
+    args[0] = QCtest;
+    args[1] = Qeq;
+    w.symbols = Fmake_hash_table (2, args);
+  }
+
+  /* Read FILE as `load' would, so that #$ reads as FILE.  */
+  specbind (Qload_file_name, file);
+  specbind (Qload_force_doc_strings, Qnil);
+  infile = &input;
+  lexical = lisp_file_lexically_bound_p (readcharfun);
+
+  while ((c = READCHAR) >= 0)
+    {
+      if (c == ';')
+	while ((c = READCHAR) != '\n' && c != -1);
+      else if (! (c == ' ' || c == '\t' || c == '\n' || c == '\f'
+		  || c == '\r'))
+	{
+	  Lisp_Object args[2];
+
+	  UNREAD (c);
+	  form = read_internal_start (readcharfun, Qnil, Qnil);
+
+	  args[0] = QCtest;
+	  args[1] = Qeq;
+	  w.shared = Fmake_hash_table (2, args);
+	  w.nshared = w.ndefined = 0;
+	  fast_load_count_shared (&w, form);
+	  fast_load_put_uint (&w.forms, w.nshared);
+	  fast_load_write_object (&w, form);
+	}
+    }
+
+  mtime = get_stat_mtime (&st);
+  fast_load_put_bytes (&w.header, FAST_LOAD_MAGIC,
+		       sizeof FAST_LOAD_MAGIC - 1);
+  fast_load_put_byte (&w.header, FAST_LOAD_VERSION);
+  fast_load_put_uint (&w.header, st.st_size);
+  fast_load_put_int (&w.header, mtime.tv_sec);
+  fast_load_put_uint (&w.header, mtime.tv_nsec);
+  fast_load_put_uint (&w.header, lexical ? FAST_LOAD_LEXICAL : 0);
+  fast_load_put_uint (&w.header, w.nsymbols);
+
+  result = make_uninit_string (w.header.size + w.names.size + w.forms.size);
+  memcpy (SDATA (result), w.header.buf, w.header.size);
+  memcpy (SDATA (result) + w.header.size, w.names.buf, w.names.size);
+  memcpy (SDATA (result) + w.header.size + w.names.size,
+	  w.forms.buf, w.forms.size);
+
+  UNGCPRO;
+  return unbind_to (count, result);
+}
+
 /* This handler function is used via internal_condition_case_1.  */
 
 static Lisp_Object
@@ -1043,10 +1931,11 @@ Return t if the file exists and loads successfully.  */)
    Lisp_Object nosuffix, Lisp_Object must_suffix)
 {
   FILE *stream;
+  struct infile input;
   int fd;
   int fd_index;
   ptrdiff_t count = SPECPDL_INDEX ();
-  struct gcpro gcpro1, gcpro2, gcpro3;
+  struct gcpro gcpro1, gcpro2, gcpro3, gcpro4;
   Lisp_Object found, efound, hist_file_name;
   /* True means we printed the ".el is newer" message.  */
   bool newer = 0;
@@ -1298,7 +2187,9 @@ Return t if the file exists and loads successfully.  */)
 	}
     }
 
-  GCPRO3 (file, found, hist_file_name);
+  input.start = NULL;
+  input.symbols = Qnil;
+  GCPRO4 (file, found, hist_file_name, input.symbols);
 
   if (fd < 0)
     {
@@ -1323,6 +2214,14 @@ Return t if the file exists and loads successfully.  */)
     report_file_error ("Opening stdio stream", file);
   set_unwind_protect_ptr (fd_index, fclose_unwind, stream);
 
+  /* Read the whole file at once, so that the reader can take its
+     bytes straight from memory.  */
+  record_unwind_protect_ptr (infile_unwind, &input);
+  if (! (compiled && version >= 22 && fast_load_open (&input, found, stream)))
+    infile_read (&input, stream, file);
+  clear_unwind_protect (fd_index);
+  fclose (stream);
+
   if (! NILP (Vpurify_flag))
     Vpreloaded_file_list = Fcons (Fpurecopy (file), Vpreloaded_file_list);
 
@@ -1344,19 +2243,20 @@ Return t if the file exists and loads successfully.  */)
   specbind (Qinhibit_file_name_operation, Qnil);
   specbind (Qload_in_progress, Qt);
 
-  instream = stream;
-  if (lisp_file_lexically_bound_p (Qget_file_char))
+  infile = &input;
+  if (! NILP (input.symbols) ? input.lexical
+      : lisp_file_lexically_bound_p (Qget_file_char))
     Fset (Qlexical_binding, Qt);
 
   if (! version || version >= 22)
-    readevalloop (Qget_file_char, stream, hist_file_name,
+    readevalloop (Qget_file_char, &input, hist_file_name,
 		  0, Qnil, Qnil, Qnil, Qnil);
   else
     {
       /* We can't handle a file which was compiled with
 	 byte-compile-dynamic by older version of Emacs.  */
       specbind (Qload_force_doc_strings, Qt);
-      readevalloop (Qget_emacs_mule_file_char, stream, hist_file_name,
+      readevalloop (Qget_emacs_mule_file_char, &input, hist_file_name,
 		    0, Qnil, Qnil, Qnil, Qnil);
     }
   unbind_to (count, Qnil);
@@ -1705,7 +2605,9 @@ end_of_file_error (void)
   xsignal0 (Qend_of_file);
 }
 
-/* UNIBYTE specifies how to set load_convert_to_unibyte
+/* IN, if non-null, is the file READCHARFUN reads from when it is
+   Qget_file_char or Qget_emacs_mule_file_char.
+   UNIBYTE specifies how to set load_convert_to_unibyte
    for this invocation.
    READFUN, if non-nil, is used instead of `read'.
 
@@ -1714,7 +2616,7 @@ end_of_file_error (void)
 
 static void
 readevalloop (Lisp_Object readcharfun,
-	      FILE *stream,
+	      struct infile *in,
 	      Lisp_Object sourcename,
 	      bool printflag,
 	      Lisp_Object unibyte, Lisp_Object readfun,
@@ -1817,7 +2719,18 @@ readevalloop (Lisp_Object readcharfun,
       if (b && first_sexp)
 	whole_buffer = (PT == BEG && ZV == Z);
 
-      instream = stream;
+      infile = in;
+      if (in && ! NILP (in->symbols))
+	{
+	  /* IN is a fast-load file.  */
+	  if (in->pos == in->end)
+	    {
+	      unbind_to (count1, Qnil);
+	      break;
+	    }
+	  val = fast_load_form (in);
+	  goto form_read;
+	}
     read_next:
       c = READCHAR;
       if (c == ';')
@@ -1864,6 +2777,7 @@ readevalloop (Lisp_Object readcharfun,
 	    val = read_internal_start (readcharfun, Qnil, Qnil);
 	}
 
+    form_read:
       if (!NILP (start) && continue_reading_p)
 	start = Fpoint_marker ();
 
@@ -1888,7 +2802,7 @@ readevalloop (Lisp_Object readcharfun,
     }
 
   build_load_history (sourcename,
-		      stream || whole_buffer);
+		      in || whole_buffer);
 
   UNGCPRO;
 
@@ -2409,6 +3323,60 @@ read_integer (Lisp_Object readcharfun, EMACS_INT radix)
 }
 
 
+/* Copy to P, which has room for ROOM bytes, the run of ASCII
+   characters that READCHARFUN would return next, taking them
+   directly from memory without going through readchar.  The run ends
+   before a backslash or a non-ASCII byte, and also before a double
+   quote if IN_STRING, or else before a character that ends a symbol.
+   Return the number of characters copied, which is zero unless
+   READCHARFUN is the file being loaded or a string.  */
+
+static ptrdiff_t
+read_ascii_run (Lisp_Object readcharfun, char *p, ptrdiff_t room,
+		bool in_string)
+{
+  const unsigned char *from, *lim, *q;
+  ptrdiff_t n;
+
+  if (FROM_FILE_P (readcharfun) && infile && unread_char < 0)
+    {
+      from = infile->pos;
+      lim = infile->end;
+    }
+  else if (STRINGP (readcharfun))
+    {
+      from = SDATA (readcharfun) + read_from_string_index_byte;
+      lim = from + min (SBYTES (readcharfun) - read_from_string_index_byte,
+			read_from_string_limit - read_from_string_index);
+    }
+  else
+    return 0;
+
+  if (room < lim - from)
+    lim = from + room;
+  if (in_string)
+    for (q = from; q < lim && *q < 0200 && *q != '"' && *q != '\\'; q++)
+      continue;
+  else
+    for (q = from;
+	 (q < lim && 040 < *q && *q < 0200
+	  && !strchr ("\"';()[]#`,\\", *q));
+	 q++)
+      continue;
+
+  n = q - from;
+  memcpy (p, from, n);
+  readchar_count += n;
+  if (STRINGP (readcharfun))
+    {
+      read_from_string_index += n;
+      read_from_string_index_byte += n;
+    }
+  else
+    infile->pos += n;
+  return n;
+}
+
 /* If the next token is ')' or ']' or '.', we store that character
    in *PCH and the return value is not interesting.  Else, we store
    zero in *PCH and we read and return one lisp object.
@@ -2665,7 +3633,7 @@ read1 (Lisp_Object readcharfun, int *pch, bool first_in_list)
 	    UNREAD (c);
 
 	  if (load_force_doc_strings
-	      && (FROM_FILE_P (readcharfun)))
+	      && FROM_FILE_P (readcharfun) && infile)
 	    {
 	      /* If we are supposed to force doc strings into core right now,
 		 record the last string that we skipped,
@@ -2701,13 +3669,12 @@ read1 (Lisp_Object readcharfun, int *pch, bool first_in_list)
 		  saved_doc_string_size = nskip + extra;
 		}
 
-	      saved_doc_string_position = file_tell (instream);
+	      saved_doc_string_position = infile->pos - infile->start;
 
 	      /* Copy that many characters into saved_doc_string.  */
-	      block_input ();
-	      for (i = 0; i < nskip && c >= 0; i++)
-		saved_doc_string[i] = c = getc (instream);
-	      unblock_input ();
+	      i = min (nskip, infile->end - infile->pos);
+	      memcpy (saved_doc_string, infile->pos, i);
+	      infile->pos += i;
 
 	      saved_doc_string_length = i;
 	    }
@@ -3020,11 +3987,18 @@ read1 (Lisp_Object readcharfun, int *pch, bool first_in_list)
 	      }
 	    else
 	      {
+		ptrdiff_t n;
+
 		p += CHAR_STRING (ch, (unsigned char *) p);
 		if (CHAR_BYTE8_P (ch))
 		  force_singlebyte = 1;
 		else if (! ASCII_CHAR_P (ch))
 		  force_multibyte = 1;
+
+		/* Take the plain characters that follow in one go.  */
+		n = read_ascii_run (readcharfun, p, end - p, 1);
+		p += n;
+		nchars += n;
 	      }
 	    nchars++;
 	  }
@@ -3109,6 +4083,7 @@ read1 (Lisp_Object readcharfun, int *pch, bool first_in_list)
 		p += CHAR_STRING (c, (unsigned char *) p);
 	      else
 		*p++ = c;
+	      p += read_ascii_run (readcharfun, p, end - p, 0);
 	      c = READCHAR;
 	    }
 	  while (c > 040
@@ -3456,9 +4431,9 @@ read_vector (Lisp_Object readcharfun, bool bytecodeflag)
 
   tem = read_list (1, readcharfun);
   len = Flength (tem);
-  vector = Fmake_vector (len, Qnil);
-
-  size = ASIZE (vector);
+  size = XFASTINT (len);
+  vector = (bytecodeflag ? make_byte_code_object (size)
+	    : Fmake_vector (len, Qnil));
   ptr = XVECTOR (vector)->contents;
   for (i = 0; i < size; i++)
     {
@@ -3678,9 +4653,24 @@ read_list (bool flag, Lisp_Object readcharfun)
 
 static Lisp_Object initial_obarray;
 
-/* `oblookup' stores the bucket number here, for the sake of Funintern.  */
+/* Number of symbols interned in initial_obarray.  When there are
+   more symbols than buckets, grow_obarray replaces initial_obarray
+   with a bigger vector.  */
+
+static ptrdiff_t initial_obarray_count;
+
+/* Number of walks over the buckets of initial_obarray in progress.
+   Growing it would empty the vector being walked and relink the
+   chains of its symbols, so Fintern leaves that to the first intern
+   after the last walk ends.  */
+
+static ptrdiff_t initial_obarray_walks;
+
+/* `oblookup' stores the bucket number here, for the sake of Funintern,
+   and the hash code of the name, for the sake of Fintern.  */
 
 static size_t oblookup_last_bucket_number;
+static unsigned int oblookup_last_hash;
 
 /* Get an error if OBARRAY is not an obarray.
    If it is one, return it.  */
@@ -3688,15 +4678,99 @@ static size_t oblookup_last_bucket_number;
 Lisp_Object
 check_obarray (Lisp_Object obarray)
 {
+  if (EQ (obarray, initial_obarray))
+    return obarray;
   if (!VECTORP (obarray) || ASIZE (obarray) == 0)
     {
       /* If Vobarray is now invalid, force it to be valid.  */
       if (EQ (Vobarray, obarray)) Vobarray = initial_obarray;
       wrong_type_argument (Qvectorp, obarray);
     }
+  /* A vector that the initial obarray outgrew holds its replacement
+     in its first element, and no symbols; see grow_obarray.  Code
+     that kept a reference to it, such as a `let' binding of
+     `obarray', gets the initial obarray instead.  */
+  if (VECTORP (AREF (obarray, 0)))
+    return initial_obarray;
   return obarray;
 }
 
+/* Return the hash code of the symbol name of SIZE_BYTE bytes at PTR.
+   This is the 32-bit FNV-1a hash, which mixes every byte into all
+   bits of the result, so that names differing only in a suffix, like
+   those of generated symbols, spread evenly over the buckets.  */
+
+static unsigned int
+obarray_hash (const char *ptr, ptrdiff_t size_byte)
+{
+  const unsigned char *p = (const unsigned char *) ptr;
+  const unsigned char *end = p + size_byte;
+  unsigned int hash = 2166136261u;
+
+  while (p < end)
+    hash = (hash ^ *p++) * 16777619u;
+  return hash;
+}
+
+/* Replace initial_obarray with a vector about twice as big, moving
+   its symbols there using the hash codes they store.  Leave the old
+   vector with no symbols and the new one in its first element, which
+   check_obarray recognizes.  */
+
+static void
+grow_obarray (void)
+{
+  Lisp_Object old = initial_obarray;
+  ptrdiff_t old_size = ASIZE (old);
+  ptrdiff_t size = 2 * old_size + 1;
+  Lisp_Object new = Fmake_vector (make_number (size), make_number (0));
+  ptrdiff_t i;
+
+  for (i = 0; i < old_size; i++)
+    {
+      Lisp_Object tail = AREF (old, i);
+
+      while (SYMBOLP (tail))
+	{
+	  struct Lisp_Symbol *next = XSYMBOL (tail)->next;
+	  Lisp_Object *ptr = aref_addr (new, XSYMBOL (tail)->hash % size);
+
+	  set_symbol_next (tail, SYMBOLP (*ptr) ? XSYMBOL (*ptr) : NULL);
+	  *ptr = tail;
+	  if (!next)
+	    break;
+	  XSETSYMBOL (tail, next);
+	}
+      ASET (old, i, make_number (0));
+    }
+
+  ASET (old, 0, new);
+  initial_obarray = new;
+  if (EQ (Vobarray, old))
+    Vobarray = new;
+}
+
+static void
+end_obarray_walk (void)
+{
+  initial_obarray_walks--;
+}
+
+/* Note that the buckets of OBARRAY are about to be walked by code that
+   may intern symbols, for instance by calling Lisp.  If OBARRAY is the
+   initial obarray, it does not grow until the walk ends, which is when
+   the current binding context is unwound.  */
+
+void
+begin_obarray_walk (Lisp_Object obarray)
+{
+  if (EQ (obarray, initial_obarray))
+    {
+      initial_obarray_walks++;
+      record_unwind_protect_void (end_obarray_walk);
+    }
+}
+
 /* Intern the C string STR: return a symbol with that name,
    interned in the current obarray.  */
 
@@ -3750,6 +4824,7 @@ it defaults to the value of `obarray'.  */)
   if (!NILP (Vpurify_flag))
     string = Fpurecopy (string);
   sym = Fmake_symbol (string);
+  XSYMBOL (sym)->hash = oblookup_last_hash;
 
   if (EQ (obarray, initial_obarray))
     XSYMBOL (sym)->interned = SYMBOL_INTERNED_IN_INITIAL_OBARRAY;
@@ -3770,6 +4845,11 @@ it defaults to the value of `obarray'.  */)
   else
     set_symbol_next (sym, NULL);
   *ptr = sym;
+
+  if (EQ (obarray, initial_obarray)
+      && ++initial_obarray_count > ASIZE (obarray)
+      && initial_obarray_walks == 0)
+    grow_obarray ();
   return sym;
 }
 
@@ -3871,6 +4951,8 @@ OBARRAY defaults to the value of the variable `obarray'.  */)
 	}
     }
 
+  if (EQ (obarray, initial_obarray))
+    initial_obarray_count--;
   return Qt;
 }
 
@@ -3878,13 +4960,14 @@ OBARRAY defaults to the value of the variable `obarray'.  */)
    of SIZE characters (SIZE_BYTE bytes) at PTR.
    If there is no such symbol in OBARRAY, return nil.
 
-   Also store the bucket number in oblookup_last_bucket_number.  */
+   Also store the bucket number in oblookup_last_bucket_number, and
+   the hash code of the name in oblookup_last_hash.  */
 
 Lisp_Object
 oblookup (Lisp_Object obarray, register const char *ptr, ptrdiff_t size, ptrdiff_t size_byte)
 {
-  size_t hash;
-  size_t obsize;
+  unsigned int hash;
+  size_t obsize, index;
   register Lisp_Object tail;
   Lisp_Object bucket, tem;
 
@@ -3893,9 +4976,11 @@ oblookup (Lisp_Object obarray, register const char *ptr, ptrdiff_t size, ptrdiff
 
   /* This is sometimes needed in the middle of GC.  */
   obsize &= ~ARRAY_MARK_FLAG;
-  hash = hash_string (ptr, size_byte) % obsize;
-  bucket = AREF (obarray, hash);
-  oblookup_last_bucket_number = hash;
+  hash = obarray_hash (ptr, size_byte);
+  index = hash % obsize;
+  bucket = AREF (obarray, index);
+  oblookup_last_bucket_number = index;
+  oblookup_last_hash = hash;
   if (EQ (bucket, make_number (0)))
     ;
   else if (!SYMBOLP (bucket))
@@ -3903,14 +4988,15 @@ oblookup (Lisp_Object obarray, register const char *ptr, ptrdiff_t size, ptrdiff
   else
     for (tail = bucket; ; XSETSYMBOL (tail, XSYMBOL (tail)->next))
       {
-	if (SBYTES (SYMBOL_NAME (tail)) == size_byte
+	if (XSYMBOL (tail)->hash == hash
+	    && SBYTES (SYMBOL_NAME (tail)) == size_byte
 	    && SCHARS (SYMBOL_NAME (tail)) == size
 	    && !memcmp (SDATA (SYMBOL_NAME (tail)), ptr, size_byte))
 	  return tail;
 	else if (XSYMBOL (tail)->next == 0)
 	  break;
       }
-  XSETINT (tem, hash);
+  XSETINT (tem, index);
   return tem;
 }
 
@@ -3918,8 +5004,10 @@ void
 map_obarray (Lisp_Object obarray, void (*fn) (Lisp_Object, Lisp_Object), Lisp_Object arg)
 {
   ptrdiff_t i;
+  ptrdiff_t count = SPECPDL_INDEX ();
   register Lisp_Object tail;
-  CHECK_VECTOR (obarray);
+  obarray = check_obarray (obarray);
+  begin_obarray_walk (obarray);
   for (i = ASIZE (obarray) - 1; i >= 0; i--)
     {
       tail = AREF (obarray, i);
@@ -3932,6 +5020,7 @@ map_obarray (Lisp_Object obarray, void (*fn) (Lisp_Object, Lisp_Object), Lisp_Ob
 	    XSETSYMBOL (tail, XSYMBOL (tail)->next);
 	  }
     }
+  unbind_to (count, Qnil);
 }
 
 static void
@@ -4392,6 +5481,7 @@ syms_of_lread (void)
   defsubr (&Sunintern);
   defsubr (&Sget_load_suffixes);
   defsubr (&Sload);
+  defsubr (&Sfast_load_file_contents);
   defsubr (&Seval_buffer);
   defsubr (&Seval_region);
   defsubr (&Sread_char);
@@ -4405,7 +5495,9 @@ syms_of_lread (void)
 	       doc: /* Symbol table for use by `intern' and `read'.
 It is a vector whose length ought to be prime for best results.
 The vector's contents don't make sense if examined from Lisp programs;
-to find all the symbols in an obarray, use `mapatoms'.  */);
+to find all the symbols in an obarray, use `mapatoms'.
+The initial obarray is replaced with a bigger vector when it fills up;
+a reference to a replaced vector still refers to the initial obarray.  */);
 
   DEFVAR_LISP ("values", Vvalues,
 	       doc: /* List of values of all expressions which were read, evaluated and printed.
@@ -4559,6 +5651,13 @@ and NOERROR and NOMESSAGE are the corresponding arguments passed to
 This is useful when the file being loaded is a temporary copy.  */);
   load_force_doc_strings = 0;
 
+  DEFVAR_BOOL ("load-use-fast-load-files", load_use_fast_load_files,
+	       doc: /* Non-nil means `load' uses fast-load files when it can.
+When `load' loads a compiled file FOO.elc, and FOO.elb is a fast-load
+file made from FOO.elc as it is now, `load' reads FOO.elb instead,
+which is quicker.  See `fast-load-file-contents'.  */);
+  load_use_fast_load_files = 1;
+
   DEFVAR_BOOL ("load-convert-to-unibyte", load_convert_to_unibyte,
 	       doc: /* Non-nil means `read' converts strings to unibyte whenever possible.
 This is normally bound by `load' and `eval-buffer' to control `read',
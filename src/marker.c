@@ -32,6 +32,41 @@ static ptrdiff_t cached_bytepos;
 static struct buffer *cached_buffer;
 static EMACS_INT cached_modiff;
 
+/* In addition, each buffer text keeps a sorted table of positions
+   whose byte position is known, recorded whenever a conversion had
+   to scan far from any other known position.  The table is updated
+   by insdel.c on each change, so it stays valid across edits, and is
+   searched with a binary search.
+
+   Updating the positions after an edit is done lazily: the anchors
+   from index SPLIT onward are stored relative to DELTA_CHARS and
+   DELTA_BYTES, which are only folded into them when an edit happens
+   at a different place.  Thus a series of insertions or deletions at
+   the same spot costs O(log N), like the binary search itself.  */
+
+struct charpos_anchor
+{
+  ptrdiff_t charpos, bytepos;
+};
+
+struct charpos_cache
+{
+  struct charpos_anchor *anchors;
+  ptrdiff_t nanchors, size;
+  ptrdiff_t split;
+  ptrdiff_t delta_chars, delta_bytes;
+};
+
+enum
+  {
+    /* Don't record a new anchor unless the conversion had to scan
+       at least this many characters.  */
+    CHARPOS_CACHE_MIN_DISTANCE = 1000,
+    /* Maximum number of anchors in a buffer.  When the table is
+       full, every other anchor is dropped.  */
+    CHARPOS_CACHE_MAX_ANCHORS = 4096
+  };
+
 /* Juanma Barranquero <lekktu@gmail.com> reported ~3x increased
    bootstrap time when byte_char_debug_check is enabled; so this
    is never turned on by --enable-checking configure option.  */
@@ -72,16 +107,160 @@ byte_char_debug_check (struct buffer *b, ptrdiff_t charpos, ptrdiff_t bytepos)
 void
 clear_charpos_cache (struct buffer *b)
 {
+  struct charpos_cache *c = b->text->charpos_cache;
+
   if (cached_buffer == b)
     cached_buffer = 0;
+
+  if (c)
+    {
+      xfree (c->anchors);
+      xfree (c);
+      b->text->charpos_cache = NULL;
+    }
+}
+
+/* Return the character position of the Ith anchor of C.  */
+
+static ptrdiff_t
+anchor_charpos (struct charpos_cache *c, ptrdiff_t i)
+{
+  return c->anchors[i].charpos + (i < c->split ? 0 : c->delta_chars);
+}
+
+/* Return the byte position of the Ith anchor of C.  */
+
+static ptrdiff_t
+anchor_bytepos (struct charpos_cache *c, ptrdiff_t i)
+{
+  return c->anchors[i].bytepos + (i < c->split ? 0 : c->delta_bytes);
+}
+
+/* Return the number of anchors of C that are at or before POS, which
+   is a byte position if BYTE, a character position otherwise.  */
+
+static ptrdiff_t
+charpos_cache_search (struct charpos_cache *c, ptrdiff_t pos, bool byte)
+{
+  ptrdiff_t lo = 0, hi = c->nanchors;
+
+  while (lo < hi)
+    {
+      ptrdiff_t mid = lo + (hi - lo) / 2;
+      ptrdiff_t this = (byte
+			? anchor_bytepos (c, mid) : anchor_charpos (c, mid));
+      if (this <= pos)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  return lo;
+}
+
+/* Fold the pending delta of C into its anchors.  */
+
+static void
+charpos_cache_flush (struct charpos_cache *c)
+{
+  ptrdiff_t i;
+
+  if (c->delta_chars || c->delta_bytes)
+    for (i = c->split; i < c->nanchors; i++)
+      {
+	c->anchors[i].charpos += c->delta_chars;
+	c->anchors[i].bytepos += c->delta_bytes;
+      }
+  c->split = c->nanchors;
+  c->delta_chars = c->delta_bytes = 0;
+}
+
+/* Record that character position CHARPOS of B is at byte BYTEPOS.  */
+
+static void
+charpos_cache_record (struct buffer *b, ptrdiff_t charpos, ptrdiff_t bytepos)
+{
+  struct charpos_cache *c = b->text->charpos_cache;
+  ptrdiff_t i;
+
+  if (! c)
+    {
+      c = xzalloc (sizeof *c);
+      b->text->charpos_cache = c;
+    }
+
+  if (c->nanchors == c->size)
+    {
+      if (c->size < CHARPOS_CACHE_MAX_ANCHORS)
+	c->anchors = xpalloc (c->anchors, &c->size, 1,
+			      CHARPOS_CACHE_MAX_ANCHORS, sizeof *c->anchors);
+      else
+	{
+	  /* Make room by dropping every other anchor.  */
+	  charpos_cache_flush (c);
+	  for (i = 0; 2 * i < c->nanchors; i++)
+	    c->anchors[i] = c->anchors[2 * i];
+	  c->nanchors = c->split = i;
+	}
+    }
+
+  i = charpos_cache_search (c, charpos, 0);
+  if (i > 0 && anchor_charpos (c, i - 1) == charpos)
+    return;
+
+  memmove (c->anchors + i + 1, c->anchors + i,
+	   (c->nanchors - i) * sizeof *c->anchors);
+  c->nanchors++;
+  if (i < c->split)
+    c->split++;
+  c->anchors[i].charpos = charpos - (i < c->split ? 0 : c->delta_chars);
+  c->anchors[i].bytepos = bytepos - (i < c->split ? 0 : c->delta_bytes);
+}
+
+/* Update the anchors of the current buffer for a replacement of the
+   text at FROM (FROM_BYTE) of length OLD_CHARS (OLD_BYTES) by a new
+   text of length NEW_CHARS (NEW_BYTES).  Insertions and deletions
+   are the special cases where OLD_CHARS or NEW_CHARS is zero.  */
+
+void
+adjust_charpos_cache (ptrdiff_t from, ptrdiff_t from_byte,
+		      ptrdiff_t old_chars, ptrdiff_t old_bytes,
+		      ptrdiff_t new_chars, ptrdiff_t new_bytes)
+{
+  struct charpos_cache *c = current_buffer->text->charpos_cache;
+  ptrdiff_t first, last;
+
+  if (! c || c->nanchors == 0)
+    return;
+
+  /* Anchors strictly inside the replaced text become meaningless;
+     anchors from its end onward move by the change in length.  */
+  first = charpos_cache_search (c, from, 0);
+  last = (old_chars > 0
+	  ? charpos_cache_search (c, from + old_chars - 1, 0) : first);
+
+  if (last > first || (c->split != first
+		       && (c->delta_chars || c->delta_bytes)))
+    charpos_cache_flush (c);
+
+  if (last > first)
+    {
+      memmove (c->anchors + first, c->anchors + last,
+	       (c->nanchors - last) * sizeof *c->anchors);
+      c->nanchors -= last - first;
+    }
+
+  c->split = first;
+  c->delta_chars += new_chars - old_chars;
+  c->delta_bytes += new_bytes - old_bytes;
 }
 
 /* Converting between character positions and byte positions.  */
 
 /* There are several places in the buffer where we know
    the correspondence: BEG, BEGV, PT, GPT, ZV and Z,
-   and everywhere there is a marker.  So we find the one of these places
-   that is closest to the specified position, and scan from there.  */
+   and at each anchor of the buffer's charpos cache.  So we find the
+   one of these places that is closest to the specified position,
+   and scan from there.  */
 
 /* This macro is a subroutine of buf_charpos_to_bytepos.
    Note that it is desirable that BYTEPOS is not evaluated
@@ -138,7 +317,7 @@ CHECK_MARKER (Lisp_Object x)
 ptrdiff_t
 buf_charpos_to_bytepos (struct buffer *b, ptrdiff_t charpos)
 {
-  struct Lisp_Marker *tail;
+  struct charpos_cache *c = b->text->charpos_cache;
   ptrdiff_t best_above, best_above_byte;
   ptrdiff_t best_below, best_below_byte;
 
@@ -173,15 +352,14 @@ buf_charpos_to_bytepos (struct buffer *b, ptrdiff_t charpos)
   if (b == cached_buffer && BUF_MODIFF (b) == cached_modiff)
     CONSIDER (cached_charpos, cached_bytepos);
 
-  for (tail = BUF_MARKERS (b); tail; tail = tail->next)
+  if (c && c->nanchors > 0)
     {
-      CONSIDER (tail->charpos, tail->bytepos);
+      ptrdiff_t i = charpos_cache_search (c, charpos, 0);
 
-      /* If we are down to a range of 50 chars,
-	 don't bother checking any other markers;
-	 scan the intervening chars directly now.  */
-      if (best_above - best_below < 50)
-	break;
+      if (i > 0)
+	CONSIDER (anchor_charpos (c, i - 1), anchor_bytepos (c, i - 1));
+      if (i < c->nanchors)
+	CONSIDER (anchor_charpos (c, i), anchor_bytepos (c, i));
     }
 
   /* We get here if we did not exactly hit one of the known places.
@@ -190,7 +368,7 @@ buf_charpos_to_bytepos (struct buffer *b, ptrdiff_t charpos)
 
   if (charpos - best_below < best_above - charpos)
     {
-      bool record = charpos - best_below > 5000;
+      bool record = charpos - best_below > CHARPOS_CACHE_MIN_DISTANCE;
 
       while (best_below != charpos)
 	{
@@ -199,10 +377,9 @@ buf_charpos_to_bytepos (struct buffer *b, ptrdiff_t charpos)
 	}
 
       /* If this position is quite far from the nearest known position,
-	 cache the correspondence by creating a marker here.
-	 It will last until the next GC.  */
+	 remember the correspondence.  */
       if (record)
-	build_marker (b, best_below, best_below_byte);
+	charpos_cache_record (b, best_below, best_below_byte);
 
       byte_char_debug_check (b, best_below, best_below_byte);
 
@@ -215,7 +392,7 @@ buf_charpos_to_bytepos (struct buffer *b, ptrdiff_t charpos)
     }
   else
     {
-      bool record = best_above - charpos > 5000;
+      bool record = best_above - charpos > CHARPOS_CACHE_MIN_DISTANCE;
 
       while (best_above != charpos)
 	{
@@ -224,10 +401,9 @@ buf_charpos_to_bytepos (struct buffer *b, ptrdiff_t charpos)
 	}
 
       /* If this position is quite far from the nearest known position,
-	 cache the correspondence by creating a marker here.
-	 It will last until the next GC.  */
+	 remember the correspondence.  */
       if (record)
-	build_marker (b, best_above, best_above_byte);
+	charpos_cache_record (b, best_above, best_above_byte);
 
       byte_char_debug_check (b, best_above, best_above_byte);
 
@@ -290,7 +466,7 @@ buf_charpos_to_bytepos (struct buffer *b, ptrdiff_t charpos)
 ptrdiff_t
 buf_bytepos_to_charpos (struct buffer *b, ptrdiff_t bytepos)
 {
-  struct Lisp_Marker *tail;
+  struct charpos_cache *c = b->text->charpos_cache;
   ptrdiff_t best_above, best_above_byte;
   ptrdiff_t best_below, best_below_byte;
 
@@ -316,15 +492,14 @@ buf_bytepos_to_charpos (struct buffer *b, ptrdiff_t bytepos)
   if (b == cached_buffer && BUF_MODIFF (b) == cached_modiff)
     CONSIDER (cached_bytepos, cached_charpos);
 
-  for (tail = BUF_MARKERS (b); tail; tail = tail->next)
+  if (c && c->nanchors > 0)
     {
-      CONSIDER (tail->bytepos, tail->charpos);
+      ptrdiff_t i = charpos_cache_search (c, bytepos, 1);
 
-      /* If we are down to a range of 50 chars,
-	 don't bother checking any other markers;
-	 scan the intervening chars directly now.  */
-      if (best_above - best_below < 50)
-	break;
+      if (i > 0)
+	CONSIDER (anchor_bytepos (c, i - 1), anchor_charpos (c, i - 1));
+      if (i < c->nanchors)
+	CONSIDER (anchor_bytepos (c, i), anchor_charpos (c, i));
     }
 
   /* We get here if we did not exactly hit one of the known places.
@@ -333,7 +508,7 @@ buf_bytepos_to_charpos (struct buffer *b, ptrdiff_t bytepos)
 
   if (bytepos - best_below_byte < best_above_byte - bytepos)
     {
-      bool record = bytepos - best_below_byte > 5000;
+      bool record = bytepos - best_below_byte > CHARPOS_CACHE_MIN_DISTANCE;
 
       while (best_below_byte < bytepos)
 	{
@@ -342,12 +517,9 @@ buf_bytepos_to_charpos (struct buffer *b, ptrdiff_t bytepos)
 	}
 
       /* If this position is quite far from the nearest known position,
-	 cache the correspondence by creating a marker here.
-	 It will last until the next GC.
-	 But don't do it if BUF_MARKERS is nil;
-	 that is a signal from Fset_buffer_multibyte.  */
-      if (record && BUF_MARKERS (b))
-	build_marker (b, best_below, best_below_byte);
+	 remember the correspondence.  */
+      if (record)
+	charpos_cache_record (b, best_below, best_below_byte);
 
       byte_char_debug_check (b, best_below, best_below_byte);
 
@@ -360,7 +532,7 @@ buf_bytepos_to_charpos (struct buffer *b, ptrdiff_t bytepos)
     }
   else
     {
-      bool record = best_above_byte - bytepos > 5000;
+      bool record = best_above_byte - bytepos > CHARPOS_CACHE_MIN_DISTANCE;
 
       while (best_above_byte > bytepos)
 	{
@@ -369,12 +541,9 @@ buf_bytepos_to_charpos (struct buffer *b, ptrdiff_t bytepos)
 	}
 
       /* If this position is quite far from the nearest known position,
-	 cache the correspondence by creating a marker here.
-	 It will last until the next GC.
-	 But don't do it if BUF_MARKERS is nil;
-	 that is a signal from Fset_buffer_multibyte.  */
-      if (record && BUF_MARKERS (b))
-	build_marker (b, best_above, best_above_byte);
+	 remember the correspondence.  */
+      if (record)
+	charpos_cache_record (b, best_above, best_above_byte);
 
       byte_char_debug_check (b, best_above, best_above_byte);
 
@@ -436,6 +605,11 @@ attach_marker (struct Lisp_Marker *m, struct buffer *b,
   else
     eassert (charpos <= bytepos);
 
+  /* The overlay index can't follow an overlay boundary that moves
+     on its own.  */
+  if (m->overlay_indexed)
+    note_overlay_positions_changed (m->buffer);
+
   m->charpos = charpos;
   m->bytepos = bytepos;
 
@@ -613,6 +787,9 @@ unchain_marker (register struct Lisp_Marker *marker)
       /* No dead buffers here.  */
       eassert (BUFFER_LIVE_P (b));
 
+      if (marker->overlay_indexed)
+	note_overlay_positions_changed (b);
+
       marker->buffer = NULL;
       prev = &BUF_MARKERS (b);
 
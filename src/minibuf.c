@@ -1206,6 +1206,7 @@ is used to further constrain the set of candidates.  */)
   ptrdiff_t idx = 0, obsize = 0;
   int matchcount = 0;
   ptrdiff_t bindcount = -1;
+  ptrdiff_t count = SPECPDL_INDEX ();
   Lisp_Object bucket, zero, end, tem;
   struct gcpro gcpro1, gcpro2, gcpro3, gcpro4;
 
@@ -1221,6 +1222,8 @@ is used to further constrain the set of candidates.  */)
   if (type == obarray_table)
     {
       collection = check_obarray (collection);
+      /* The predicate and the regexps can intern symbols.  */
+      begin_obarray_walk (collection);
       obsize = ASIZE (collection);
       bucket = AREF (collection, idx);
     }
@@ -1402,6 +1405,7 @@ is used to further constrain the set of candidates.  */)
     unbind_to (bindcount, Qnil);
     bindcount = -1;
   }
+  unbind_to (count, Qnil);
 
   if (NILP (bestmatch))
     return Qnil;		/* No completions found.  */
@@ -1465,6 +1469,7 @@ with a space are ignored unless STRING itself starts with a space.  */)
 				|| NILP (XCAR (collection))));
   ptrdiff_t idx = 0, obsize = 0;
   ptrdiff_t bindcount = -1;
+  ptrdiff_t count = SPECPDL_INDEX ();
   Lisp_Object bucket, tem, zero;
   struct gcpro gcpro1, gcpro2, gcpro3, gcpro4;
 
@@ -1479,6 +1484,8 @@ with a space are ignored unless STRING itself starts with a space.  */)
   if (type == 2)
     {
       collection = check_obarray (collection);
+      /* The predicate and the regexps can intern symbols.  */
+      begin_obarray_walk (collection);
       obsize = ASIZE (collection);
       bucket = AREF (collection, idx);
     }
@@ -1602,6 +1609,7 @@ with a space are ignored unless STRING itself starts with a space.  */)
     unbind_to (bindcount, Qnil);
     bindcount = -1;
   }
+  unbind_to (count, Qnil);
 
   return Fnreverse (allmatches);
 }
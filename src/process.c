@@ -53,6 +53,9 @@ along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
 #endif
 
 #include <sys/ioctl.h>
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
 #if defined (HAVE_NET_IF_H)
 #include <net/if.h>
 #endif /* HAVE_NET_IF_H */
@@ -90,6 +93,15 @@ along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
 #include <pty.h>
 #endif
 
+/* Define USE_EPOLL to wait for descriptors with epoll instead of
+   pselect.  ns_select is built around pselect; GLib's descriptors are
+   registered with the epoll instance instead of going to xg_select.  */
+#if (defined HAVE_SYS_EPOLL_H && defined HAVE_EPOLL_CREATE1 \
+     && !defined HAVE_NS)
+#define USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #include <c-ctype.h>
 #include <sig2str.h>
 #include <verify.h>
@@ -296,6 +308,14 @@ static void create_pty (Lisp_Object);
 
 static Lisp_Object get_process (register Lisp_Object name);
 static void exec_sentinel (Lisp_Object proc, Lisp_Object reason);
+static void update_send_queue_fd (struct Lisp_Process *);
+static void clear_write_queue (struct Lisp_Process *);
+static void send_queued_input (int, void *);
+static void run_send_callbacks (void);
+
+/* List of (PROCESS . CALLBACK) for the input that has been sent, in
+   reverse order.  run_send_callbacks calls them.  */
+static Lisp_Object pending_send_callbacks;
 
 /* Mask of bits indicating the descriptors that we wait for input on.  */
 
@@ -313,6 +333,12 @@ static fd_set non_process_wait_mask;
 
 static fd_set write_mask;
 
+/* Mask of the descriptors of processes that have input queued for
+   them.  Every wait checks them for write, so that waiting for the
+   output of a process never keeps it from reading its input.  */
+
+static fd_set send_queue_mask;
+
 #ifdef NON_BLOCKING_CONNECT
 /* Mask of bits indicating the descriptors that we wait for connect to
    complete on.  Once they complete, they are removed from this mask
@@ -448,6 +474,11 @@ pset_write_queue (struct Lisp_Process *p, Lisp_Object val)
 {
   p->write_queue = val;
 }
+static void
+pset_write_queue_tail (struct Lisp_Process *p, Lisp_Object val)
+{
+  p->write_queue_tail = val;
+}
 
 
 
@@ -460,6 +491,475 @@ static struct fd_callback_data
   int condition; /* mask of the defines above.  */
 } fd_callback_info[FD_SETSIZE];
 
+#ifdef USE_EPOLL
+
+/* The epoll instance that process_select waits with, or -1 to use
+   pselect.  The descriptors in input_wait_mask and write_mask stay
+   registered with it as long as they are in those masks, so that a
+   wait costs time in proportion to the descriptors that are ready, not
+   to the largest descriptor in use.  */
+static int epoll_fd = -1;
+
+/* What the epoll instance knows about each descriptor, indexed by
+   descriptor.  Descriptors that GLib polls need not be below
+   FD_SETSIZE, so this grows as needed.  */
+static struct epoll_fd_state
+{
+  /* FOR_READ and FOR_WRITE, as the masks want them.  */
+  unsigned char wanted;
+  /* FOR_READ and FOR_WRITE, as GLib last asked for them.  */
+  unsigned char glib;
+  /* The conditions the descriptor is registered for now.  These are
+     those in WANTED and GLIB, unless the descriptor is parked.  */
+  unsigned char armed;
+  /* True if the descriptor is in epoll_parked_fds.  */
+  bool parked;
+  /* True if the descriptor is in epoll_glib_fds.  */
+  bool glib_listed;
+  /* True if the descriptor was parked after it reported a hangup, which
+     only a reader can take care of.  */
+  bool hangup;
+  /* True if epoll refused to watch the descriptor, as for a regular
+     file or /dev/null.  */
+  bool unpollable;
+} *epoll_fd_state;
+static ptrdiff_t epoll_fd_state_size;
+
+/* Descriptors that became ready while nobody was waiting for them.
+   They are disarmed, lest every wait return at once because of them,
+   until someone waits for them again.  */
+static int *epoll_parked_fds;
+static ptrdiff_t epoll_nparked, epoll_parked_size;
+
+/* The largest descriptor that epoll refused to watch; -1 if none.  */
+static int max_unpollable_desc;
+
+/* Return the state of FD, making room for it if need be.  */
+
+static struct epoll_fd_state *
+epoll_state (int fd)
+{
+  if (epoll_fd_state_size <= fd)
+    {
+      ptrdiff_t old_size = epoll_fd_state_size;
+      epoll_fd_state = xpalloc (epoll_fd_state, &epoll_fd_state_size,
+				fd + 1 - old_size, -1,
+				sizeof *epoll_fd_state);
+      memset (epoll_fd_state + old_size, 0,
+	      ((epoll_fd_state_size - old_size)
+	       * sizeof *epoll_fd_state));
+    }
+  return &epoll_fd_state[fd];
+}
+
+/* Give up on epoll and use pselect from now on.  */
+
+static void
+epoll_disable (void)
+{
+  emacs_close (epoll_fd);
+  epoll_fd = -1;
+}
+
+/* Register FD with the epoll instance for EVENTS, a mask of FOR_READ
+   and FOR_WRITE, or remove it from there if EVENTS is zero.  */
+
+static void
+epoll_arm (int fd, int events)
+{
+  struct epoll_fd_state *s = epoll_state (fd);
+  struct epoll_event ev;
+  int op;
+
+  if (events == s->armed)
+    return;
+
+  ev.events = ((events & FOR_READ ? EPOLLIN : 0)
+	       | (events & FOR_WRITE ? EPOLLOUT : 0));
+  ev.data.fd = fd;
+  op = (! events ? EPOLL_CTL_DEL
+	: s->armed ? EPOLL_CTL_MOD : EPOLL_CTL_ADD);
+  if (epoll_ctl (epoll_fd, op, fd, &ev) != 0)
+    {
+      /* The kernel forgets descriptors by itself when they are
+	 closed, and a number might have been reused since.  */
+      if (op == EPOLL_CTL_MOD && errno == ENOENT)
+	op = EPOLL_CTL_ADD;
+      else if (op == EPOLL_CTL_ADD && errno == EEXIST)
+	op = EPOLL_CTL_MOD;
+      else if (op == EPOLL_CTL_DEL)
+	op = -1;
+      if (op < 0 || epoll_ctl (epoll_fd, op, fd, &ev) == 0)
+	;
+      else if (errno == EPERM)
+	{
+	  /* pselect says that such a descriptor is always ready.  */
+	  s->unpollable = 1;
+	  if (fd > max_unpollable_desc)
+	    max_unpollable_desc = fd;
+	  events = 0;
+	}
+      else
+	{
+	  epoll_disable ();
+	  return;
+	}
+    }
+  s->armed = events;
+}
+
+/* Park FD, which is ready for something nobody waits for.  */
+
+static void
+epoll_park (int fd, bool hangup)
+{
+  struct epoll_fd_state *s = &epoll_fd_state[fd];
+
+  /* Keep waiting for what GLib wants, which is not ready yet.  */
+  epoll_arm (fd, s->glib);
+  if (epoll_fd < 0)
+    return;
+  s->hangup = hangup;
+  if (! s->parked)
+    {
+      if (epoll_nparked == epoll_parked_size)
+	epoll_parked_fds = xpalloc (epoll_parked_fds, &epoll_parked_size,
+				    1, -1, sizeof *epoll_parked_fds);
+      s->parked = 1;
+      epoll_parked_fds[epoll_nparked++] = fd;
+    }
+}
+
+#ifdef HAVE_GLIB
+
+/* The descriptors that GLib asked to poll last time, and the records
+   that g_main_context_query fills in.  */
+static int *epoll_glib_fds;
+static ptrdiff_t epoll_nglib, epoll_glib_size;
+static GPollFD *glib_pollfds;
+static ptrdiff_t glib_pollfds_size;
+
+/* Ask GLib which descriptors it wants polled, and register them with
+   the epoll instance along with those of the masks; unregister those
+   GLib no longer wants.  Store GLib's timeout in milliseconds, or -1
+   if it has none, in *MSECS.  Return false if the epoll instance
+   cannot wait for GLib's descriptors, so that xg_select must.  */
+
+static bool
+epoll_watch_glib (GMainContext *context, int *msecs)
+{
+  ptrdiff_t i, nlisted;
+  int n;
+
+  while (glib_pollfds_size
+	 < (n = g_main_context_query (context, G_PRIORITY_LOW, msecs,
+				      glib_pollfds, glib_pollfds_size)))
+    glib_pollfds = xpalloc (glib_pollfds, &glib_pollfds_size,
+			    n - glib_pollfds_size, INT_MAX,
+			    sizeof *glib_pollfds);
+
+  for (i = 0; i < epoll_nglib; i++)
+    epoll_fd_state[epoll_glib_fds[i]].glib = 0;
+  for (i = 0; i < n; i++)
+    {
+      int fd = glib_pollfds[i].fd;
+      gushort events = glib_pollfds[i].events;
+      struct epoll_fd_state *s = epoll_state (fd);
+
+      s->glib |= ((events & G_IO_IN ? FOR_READ : 0)
+		  | (events & G_IO_OUT ? FOR_WRITE : 0));
+    }
+
+  /* Drop from the list the descriptors GLib no longer wants.  */
+  nlisted = 0;
+  for (i = 0; i < epoll_nglib; i++)
+    {
+      int fd = epoll_glib_fds[i];
+      struct epoll_fd_state *s = &epoll_fd_state[fd];
+
+      if (s->glib)
+	epoll_glib_fds[nlisted++] = fd;
+      else
+	{
+	  s->glib_listed = 0;
+	  if (s->unpollable)
+	    s->unpollable = s->wanted != 0;
+	  else
+	    epoll_arm (fd, s->parked ? s->armed & s->wanted : s->wanted);
+	}
+    }
+  epoll_nglib = nlisted;
+
+  for (i = 0; i < n; i++)
+    {
+      int fd = glib_pollfds[i].fd;
+      struct epoll_fd_state *s = &epoll_fd_state[fd];
+
+      if (s->glib && ! s->glib_listed)
+	{
+	  if (epoll_nglib == epoll_glib_size)
+	    epoll_glib_fds = xpalloc (epoll_glib_fds, &epoll_glib_size,
+				      1, -1, sizeof *epoll_glib_fds);
+	  s->glib_listed = 1;
+	  epoll_glib_fds[epoll_nglib++] = fd;
+	}
+    }
+
+  for (i = 0; i < epoll_nglib; i++)
+    {
+      int fd = epoll_glib_fds[i];
+      struct epoll_fd_state *s = &epoll_fd_state[fd];
+
+      if (! s->unpollable)
+	epoll_arm (fd, ((s->parked ? s->armed & s->wanted : s->wanted)
+			| s->glib));
+      if (epoll_fd < 0 || s->unpollable)
+	return 0;
+    }
+  return 1;
+}
+
+#endif /* HAVE_GLIB */
+
+#endif /* USE_EPOLL */
+
+/* Tell the epoll instance, if any, how the masks want FD to be waited
+   for now.  Call this whenever input_wait_mask or write_mask change for
+   FD, and before closing it.  */
+
+static void
+update_wait_fd (int fd)
+{
+#ifdef USE_EPOLL
+  struct epoll_fd_state *s;
+
+  if (epoll_fd < 0)
+    return;
+
+  s = epoll_state (fd);
+  s->wanted = ((FD_ISSET (fd, &input_wait_mask) ? FOR_READ : 0)
+	       | (FD_ISSET (fd, &write_mask) ? FOR_WRITE : 0));
+  s->hangup = 0;
+  if (s->unpollable)
+    {
+      if (! s->wanted && ! s->glib)
+	s->unpollable = 0;
+    }
+  /* process_select arms parked descriptors when they are waited for.  */
+  else if (! s->parked || ! s->wanted)
+    epoll_arm (fd, s->wanted | s->glib);
+#endif
+}
+
+/* Like pselect, but use the epoll instance when there is one.  If GLIB,
+   also wait for the descriptors and timeouts of GLib's main context
+   and dispatch its events, like xg_select.  */
+
+static int
+process_select_1 (int nfds, fd_set *rfds, fd_set *wfds, fd_set *efds,
+		  struct timespec const *timeout, sigset_t const *sigmask,
+		  bool glib)
+{
+#ifdef USE_EPOLL
+  struct epoll_event events[64];
+  fd_set want_rfds, want_wfds;
+  struct timespec end_time;
+  struct timespec const *tmop = timeout;
+  int fd, i, n, nready;
+  bool glib_ready = 0;
+#ifdef HAVE_GLIB
+  bool glib_timed_out = 0;
+  GMainContext *context = NULL;
+  struct timespec glib_tmo;
+#endif
+
+  if (epoll_fd < 0 || efds)
+    goto use_pselect;
+
+  /* Descriptors that epoll cannot watch are always ready, and pselect
+     knows how to report them.  */
+  for (fd = 0; fd <= max_unpollable_desc && fd < nfds; fd++)
+    if (epoll_fd_state[fd].unpollable
+	&& (FD_ISSET (fd, rfds) || (wfds && FD_ISSET (fd, wfds))))
+      goto use_pselect;
+
+#ifdef HAVE_GLIB
+  if (glib)
+    {
+      int glib_msecs;
+
+      context = g_main_context_default ();
+      if (! epoll_watch_glib (context, &glib_msecs))
+	goto use_pselect;
+      if (0 <= glib_msecs)
+	{
+	  glib_tmo = make_timespec (glib_msecs / 1000,
+				    1000 * 1000 * (glib_msecs % 1000));
+	  if (! tmop || timespec_cmp (glib_tmo, *tmop) < 0)
+	    {
+	      tmop = &glib_tmo;
+	      glib_timed_out = 1;
+	    }
+	}
+    }
+#endif
+
+  /* Arm the parked descriptors that are waited for now.  */
+  for (i = 0; i < epoll_nparked; )
+    {
+      struct epoll_fd_state *s;
+      int events;
+
+      fd = epoll_parked_fds[i];
+      s = &epoll_fd_state[fd];
+      events = (fd < nfds
+		? s->wanted & ((FD_ISSET (fd, rfds) ? FOR_READ : 0)
+			       | (wfds && FD_ISSET (fd, wfds) ? FOR_WRITE : 0))
+		: 0);
+      if (s->hangup && ! (events & FOR_READ))
+	events = 0;
+      if (events & ~s->armed)
+	{
+	  epoll_arm (fd, s->armed | events);
+	  if (epoll_fd < 0)
+	    goto use_pselect;
+	  if (events & FOR_READ)
+	    s->hangup = 0;
+	}
+      if (! (s->wanted & ~s->armed) && ! s->unpollable)
+	{
+	  s->parked = 0;
+	  s->hangup = 0;
+	  epoll_parked_fds[i] = epoll_parked_fds[--epoll_nparked];
+	}
+      else
+	i++;
+    }
+
+  want_rfds = *rfds;
+  FD_ZERO (rfds);
+  if (wfds)
+    {
+      want_wfds = *wfds;
+      FD_ZERO (wfds);
+    }
+  if (tmop)
+    end_time = timespec_add (current_timespec (), *tmop);
+
+  do
+    {
+      int msecs = -1;
+
+      if (tmop)
+	{
+	  struct timespec now = current_timespec ();
+	  struct timespec left = (timespec_cmp (end_time, now) <= 0
+				  ? make_timespec (0, 0)
+				  : timespec_sub (end_time, now));
+	  msecs = (left.tv_sec < INT_MAX / 1000 - 1
+		   ? (left.tv_sec * 1000
+		      + (left.tv_nsec + 999999) / 1000000)
+		   : INT_MAX);
+	}
+
+      n = epoll_pwait (epoll_fd, events, sizeof events / sizeof *events,
+		       msecs, sigmask);
+      if (n < 0)
+	return n;
+
+      nready = 0;
+      for (i = 0; i < n; i++)
+	{
+	  uint32_t revents = events[i].events;
+	  int glib_events;
+	  bool readable, writable;
+
+	  fd = events[i].data.fd;
+	  glib_events = epoll_fd_state[fd].glib;
+	  readable = ((revents & (EPOLLIN | EPOLLHUP | EPOLLERR))
+		      && fd < nfds && FD_ISSET (fd, &want_rfds));
+	  writable = (wfds && (revents & (EPOLLOUT | EPOLLERR))
+		      && fd < nfds && FD_ISSET (fd, &want_wfds));
+	  if (readable)
+	    {
+	      FD_SET (fd, rfds);
+	      nready++;
+	    }
+	  if (writable)
+	    {
+	      FD_SET (fd, wfds);
+	      nready++;
+	    }
+	  if (((glib_events & FOR_READ)
+	       && (revents & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+	      || ((glib_events & FOR_WRITE)
+		  && (revents & (EPOLLOUT | EPOLLERR))))
+	    glib_ready = 1;
+	  else if (! readable && ! writable)
+	    {
+	      epoll_park (fd, (revents & (EPOLLHUP | EPOLLERR)) != 0);
+	      if (epoll_fd < 0)
+		break;
+	    }
+	}
+    }
+  /* Wait again if only descriptors nobody waits for were ready, since
+     our callers take zero for the end of the timeout.  */
+  while (nready == 0 && n > 0 && ! glib_ready && epoll_fd >= 0);
+
+#ifdef HAVE_GLIB
+  if (glib && (glib_ready || (n == 0 && glib_timed_out)))
+    {
+      /* If Gtk+ is in use, dispatch only when nothing else is ready;
+	 see xg_select.  */
+#ifdef USE_GTK
+      if (nready == 0)
+#endif
+	while (g_main_context_pending (context))
+	  g_main_context_dispatch (context);
+
+      /* To our callers, it looks like we got interrupted.  */
+      if (nready == 0)
+	{
+	  errno = EINTR;
+	  return -1;
+	}
+    }
+#endif
+
+  if (0 <= epoll_fd || nready)
+    return nready;
+  *rfds = want_rfds;
+  if (wfds)
+    *wfds = want_wfds;
+
+ use_pselect:
+#endif
+#ifdef HAVE_GLIB
+  if (glib)
+    return xg_select (nfds, rfds, wfds, efds, timeout, sigmask);
+#endif
+  return pselect (nfds, rfds, wfds, efds, timeout, sigmask);
+}
+
+static int
+process_select (int nfds, fd_set *rfds, fd_set *wfds, fd_set *efds,
+		struct timespec const *timeout, sigset_t const *sigmask)
+{
+  return process_select_1 (nfds, rfds, wfds, efds, timeout, sigmask, 0);
+}
+
+#ifdef HAVE_GLIB
+/* Like xg_select, but use the epoll instance when there is one.  */
+
+static int
+process_xg_select (int nfds, fd_set *rfds, fd_set *wfds, fd_set *efds,
+		   struct timespec const *timeout, sigset_t const *sigmask)
+{
+  return process_select_1 (nfds, rfds, wfds, efds, timeout, sigmask, 1);
+}
+#endif
+
 
 /* Add a file descriptor FD to be monitored for when read is possible.
    When read is possible, call FUNC with argument DATA.  */
@@ -499,6 +999,7 @@ add_write_fd (int fd, fd_callback func, void *data)
 {
   eassert (fd < FD_SETSIZE);
   FD_SET (fd, &write_mask);
+  update_wait_fd (fd);
   if (fd > max_input_desc)
     max_input_desc = fd;
 
@@ -530,6 +1031,7 @@ delete_write_fd (int fd)
 {
   eassert (fd < FD_SETSIZE);
   FD_CLR (fd, &write_mask);
+  update_wait_fd (fd);
   fd_callback_info[fd].condition &= ~FOR_WRITE;
   if (fd_callback_info[fd].condition == 0)
     {
@@ -1079,6 +1581,7 @@ The string argument is normally a multibyte string, except:
 	{
 	  FD_CLR (p->infd, &input_wait_mask);
 	  FD_CLR (p->infd, &non_keyboard_wait_mask);
+	  update_wait_fd (p->infd);
 	}
       else if (EQ (p->filter, Qt)
 	       /* Network or serial process not stopped:  */
@@ -1086,6 +1589,7 @@ The string argument is normally a multibyte string, except:
 	{
 	  FD_SET (p->infd, &input_wait_mask);
 	  FD_SET (p->infd, &non_keyboard_wait_mask);
+	  update_wait_fd (p->infd);
 	}
     }
 
@@ -1718,6 +2222,7 @@ create_process (Lisp_Object process, char **new_argv, Lisp_Object current_dir)
 
   FD_SET (inchannel, &input_wait_mask);
   FD_SET (inchannel, &non_keyboard_wait_mask);
+  update_wait_fd (inchannel);
   if (inchannel > max_process_desc)
     max_process_desc = inchannel;
 
@@ -1728,26 +2233,30 @@ create_process (Lisp_Object process, char **new_argv, Lisp_Object current_dir)
   block_child_signal ();
 
 #ifndef WINDOWSNT
+  pid = (pty_flag ? -1
+	 : spawn_child (forkin, forkout, forkout, new_argv, 1, current_dir));
+
   /* vfork, and prevent local vars from being clobbered by the vfork.  */
-  {
-    Lisp_Object volatile current_dir_volatile = current_dir;
-    Lisp_Object volatile lisp_pty_name_volatile = lisp_pty_name;
-    char **volatile new_argv_volatile = new_argv;
-    int volatile forkin_volatile = forkin;
-    int volatile forkout_volatile = forkout;
-    struct Lisp_Process *p_volatile = p;
-
-    pid = vfork ();
-
-    current_dir = current_dir_volatile;
-    lisp_pty_name = lisp_pty_name_volatile;
-    new_argv = new_argv_volatile;
-    forkin = forkin_volatile;
-    forkout = forkout_volatile;
-    p = p_volatile;
-
-    pty_flag = p->pty_flag;
-  }
+  if (pid < 0)
+    {
+      Lisp_Object volatile current_dir_volatile = current_dir;
+      Lisp_Object volatile lisp_pty_name_volatile = lisp_pty_name;
+      char **volatile new_argv_volatile = new_argv;
+      int volatile forkin_volatile = forkin;
+      int volatile forkout_volatile = forkout;
+      struct Lisp_Process *p_volatile = p;
+
+      pid = vfork ();
+
+      current_dir = current_dir_volatile;
+      lisp_pty_name = lisp_pty_name_volatile;
+      new_argv = new_argv_volatile;
+      forkin = forkin_volatile;
+      forkout = forkout_volatile;
+      p = p_volatile;
+
+      pty_flag = p->pty_flag;
+    }
 
   if (pid == 0)
 #endif /* not WINDOWSNT */
@@ -1947,6 +2456,7 @@ create_pty (Lisp_Object process)
 
       FD_SET (pty_fd, &input_wait_mask);
       FD_SET (pty_fd, &non_keyboard_wait_mask);
+      update_wait_fd (pty_fd);
       if (pty_fd > max_process_desc)
 	max_process_desc = pty_fd;
 
@@ -2588,6 +3098,7 @@ usage:  (make-serial-process &rest ARGS)  */)
     {
       FD_SET (fd, &input_wait_mask);
       FD_SET (fd, &non_keyboard_wait_mask);
+      update_wait_fd (fd);
     }
 
   if (BUFFERP (buffer))
@@ -3394,6 +3905,7 @@ usage: (make-network-process &rest ARGS)  */)
 	{
 	  FD_SET (inch, &connect_wait_mask);
 	  FD_SET (inch, &write_mask);
+	  update_wait_fd (inch);
 	  num_pending_connects++;
 	}
     }
@@ -3406,6 +3918,7 @@ usage: (make-network-process &rest ARGS)  */)
       {
 	FD_SET (inch, &input_wait_mask);
 	FD_SET (inch, &non_keyboard_wait_mask);
+	update_wait_fd (inch);
       }
 
   if (inch > max_process_desc)
@@ -3831,10 +4344,11 @@ deactivate_process (Lisp_Object proc)
     }
 #endif
 
-  /* Beware SIGCHLD hereabouts. */
+  /* Give up on the input still queued.  */
+  clear_write_queue (p);
+  update_send_queue_fd (p);
 
-  for (i = 0; i < PROCESS_OPEN_FDS; i++)
-    close_process_fd (&p->open_fd[i]);
+  /* Beware SIGCHLD hereabouts. */
 
   inchannel = p->infd;
   if (inchannel >= 0)
@@ -3861,6 +4375,7 @@ deactivate_process (Lisp_Object proc)
 	    emacs_abort ();
 	}
 #endif
+      update_wait_fd (inchannel);
       if (inchannel == max_process_desc)
 	{
 	  /* We just closed the highest-numbered process input descriptor,
@@ -3873,6 +4388,11 @@ deactivate_process (Lisp_Object proc)
 	  max_process_desc = i;
 	}
     }
+
+  /* Close the descriptors only now that they are not waited for,
+     because epoll would go on watching one that a child shares.  */
+  for (i = 0; i < PROCESS_OPEN_FDS; i++)
+    close_process_fd (&p->open_fd[i]);
 }
 
 
@@ -4131,6 +4651,7 @@ server_accept_connection (Lisp_Object server, int channel)
     {
       FD_SET (s, &input_wait_mask);
       FD_SET (s, &non_keyboard_wait_mask);
+      update_wait_fd (s);
     }
 
   if (s > max_process_desc)
@@ -4235,6 +4756,9 @@ wait_reading_process_output (intmax_t time_limit, int nsecs, int read_kbd,
   fd_set Available;
   fd_set Writeok;
   bool check_write;
+  /* Whether to wait until a process with queued input can take more of
+     it, though not checking for write otherwise.  */
+  bool check_send_queue;
   int check_delay;
   bool no_avail;
   int xerrno;
@@ -4372,6 +4896,21 @@ wait_reading_process_output (intmax_t time_limit, int nsecs, int read_kbd,
 	    }
 	}
 
+#ifdef HAVE_INOTIFY
+      /* Pass on the file notification events gathered so far once
+	 they are due, and wake up in time for that.  */
+      {
+	struct timespec inotify_delay = inotify_deliver_pending ();
+
+	if (nsecs >= 0 && timespec_valid_p (inotify_delay)
+	    && timespec_cmp (inotify_delay, timeout) < 0)
+	  {
+	    timeout = inotify_delay;
+	    timeout_reduced_for_timers = 1;
+	  }
+      }
+#endif
+
       /* Cause C-g and alarm signals to take immediate action,
 	 and cause input available signals to zero out timeout.
 
@@ -4397,14 +4936,14 @@ wait_reading_process_output (intmax_t time_limit, int nsecs, int read_kbd,
 	  Ctemp = write_mask;
 
 	  timeout = make_timespec (0, 0);
-	  if ((pselect (max (max_process_desc, max_input_desc) + 1,
-			&Atemp,
+	  if ((process_select (max (max_process_desc, max_input_desc) + 1,
+			       &Atemp,
 #ifdef NON_BLOCKING_CONNECT
-			(num_pending_connects > 0 ? &Ctemp : NULL),
+			       (num_pending_connects > 0 ? &Ctemp : NULL),
 #else
-			NULL,
+			       NULL,
 #endif
-			NULL, &timeout, NULL)
+			       NULL, &timeout, NULL)
 	       <= 0))
 	    {
 	      /* It's okay for us to do this and then continue with
@@ -4453,6 +4992,7 @@ wait_reading_process_output (intmax_t time_limit, int nsecs, int read_kbd,
 
       /* Wait till there is something to do */
 
+      check_send_queue = 0;
       if (wait_proc && just_wait_proc)
 	{
 	  if (wait_proc->infd < 0)  /* Terminated */
@@ -4460,12 +5000,29 @@ wait_reading_process_output (intmax_t time_limit, int nsecs, int read_kbd,
 	  FD_SET (wait_proc->infd, &Available);
 	  check_delay = 0;
           check_write = 0;
+	  /* Keep sending the input queued for WAIT_PROC; it may need
+	     all of it before it answers.  */
+	  FD_ZERO (&Writeok);
+	  if (0 <= wait_proc->outfd
+	      && FD_ISSET (wait_proc->outfd, &send_queue_mask))
+	    {
+#ifdef SELECT_CANT_DO_WRITE_MASK
+	      send_queued_input (wait_proc->outfd, wait_proc);
+#else
+	      FD_SET (wait_proc->outfd, &Writeok);
+	      check_send_queue = 1;
+#endif
+	    }
 	}
       else if (!NILP (wait_for_cell))
 	{
 	  Available = non_process_wait_mask;
 	  check_delay = 0;
 	  check_write = 0;
+#ifndef SELECT_CANT_DO_WRITE_MASK
+	  Writeok = send_queue_mask;
+	  check_send_queue = 1;
+#endif
 	}
       else
 	{
@@ -4546,14 +5103,16 @@ wait_reading_process_output (intmax_t time_limit, int nsecs, int read_kbd,
 
 #if defined (HAVE_NS)
           nfds = ns_select
+#elif defined (HAVE_GLIB) && defined (USE_EPOLL)
+	  nfds = process_xg_select
 #elif defined (HAVE_GLIB)
 	  nfds = xg_select
 #else
-	  nfds = pselect
+	  nfds = process_select
 #endif
             (max (max_process_desc, max_input_desc) + 1,
              &Available,
-             (check_write ? &Writeok : 0),
+             (check_write || check_send_queue ? &Writeok : 0),
              NULL, &timeout, NULL);
 
 #ifdef HAVE_GNUTLS
@@ -4609,6 +5168,9 @@ wait_reading_process_output (intmax_t time_limit, int nsecs, int read_kbd,
       /* Make C-g and alarm signals set flags again */
       clear_waiting_for_input ();
 
+      /* Other programs may have changed files while Emacs waited.  */
+      file_status_outdated = 1;
+
       /*  If we woke up due to SIGWINCH, actually change size now.  */
       do_pending_window_change (0);
 
@@ -4716,7 +5278,8 @@ wait_reading_process_output (intmax_t time_limit, int nsecs, int read_kbd,
 	      && ((d->condition & FOR_READ
 		   && FD_ISSET (channel, &Available))
 		  || (d->condition & FOR_WRITE
-		      && FD_ISSET (channel, &write_mask))))
+		      && FD_ISSET (channel,
+				   check_write ? &Writeok : &write_mask))))
             d->func (channel, d->data);
 	}
 
@@ -4794,6 +5357,7 @@ wait_reading_process_output (intmax_t time_limit, int nsecs, int read_kbd,
 		     signal once.  */
 		  FD_CLR (channel, &input_wait_mask);
 		  FD_CLR (channel, &non_keyboard_wait_mask);
+		  update_wait_fd (channel);
 
 		  if (p->pid == -2)
 		    {
@@ -4829,6 +5393,7 @@ wait_reading_process_output (intmax_t time_limit, int nsecs, int read_kbd,
 
 	      FD_CLR (channel, &connect_wait_mask);
               FD_CLR (channel, &write_mask);
+	      update_wait_fd (channel);
 	      if (--num_pending_connects < 0)
 		emacs_abort ();
 
@@ -4880,11 +5445,16 @@ wait_reading_process_output (intmax_t time_limit, int nsecs, int read_kbd,
 		    {
 		      FD_SET (p->infd, &input_wait_mask);
 		      FD_SET (p->infd, &non_keyboard_wait_mask);
+		      update_wait_fd (p->infd);
 		    }
 		}
 	    }
 #endif /* NON_BLOCKING_CONNECT */
 	}			/* End for each file descriptor.  */
+
+      /* Tell those who sent input with a callback that it is gone.  */
+      if (CONSP (pending_send_callbacks))
+	run_send_callbacks ();
     }				/* End while exit conditions not met.  */
 
   unbind_to (count, Qnil);
@@ -4920,96 +5490,288 @@ read_process_output_error_handler (Lisp_Object error_val)
   return Qt;
 }
 
+struct gap_read;
 static void
 read_and_dispose_of_process_output (struct Lisp_Process *p, char *chars,
 				    ssize_t nbytes,
-				    struct coding_system *coding);
-
-/* Read pending output from the process channel,
-   starting with our buffered-ahead character if we have one.
-   Yield number of decoded characters read.
+				    struct coding_system *coding,
+				    struct gap_read *gap);
+static void process_output_decoded (struct Lisp_Process *,
+				    struct coding_system *);
+static void insert_process_output (struct Lisp_Process *,
+				   void (*) (struct Lisp_Process *, void *),
+				   void *);
 
-   This function reads at most 4096 characters.
-   If you want to read all available subprocess output,
-   you must call it repeatedly until it returns zero.
-
-   The characters read are decoded according to PROC's coding-system
-   for decoding.  */
+#ifdef ADAPTIVE_READ_BUFFERING
+/* Adjust the delay before reading output from process P again, now
+   that NBYTES bytes were read out of the READMAX asked for.  */
 
-static int
-read_process_output (Lisp_Object proc, register int channel)
+static void
+adapt_read_output_delay (struct Lisp_Process *p, ssize_t nbytes,
+			 ptrdiff_t readmax)
 {
-  register ssize_t nbytes;
-  char *chars;
-  register struct Lisp_Process *p = XPROCESS (proc);
-  struct coding_system *coding = proc_decode_coding_system[channel];
-  int carryover = p->decoding_carryover;
-  int readmax = 4096;
-  ptrdiff_t count = SPECPDL_INDEX ();
-  Lisp_Object odeactivate;
-
-  chars = alloca (carryover + readmax);
-  if (carryover)
-    /* See the comment above.  */
-    memcpy (chars, SDATA (p->decoding_buf), carryover);
-
-#ifdef DATAGRAM_SOCKETS
-  /* We have a working select, so proc_buffered_char is always -1.  */
-  if (DATAGRAM_CHAN_P (channel))
-    {
-      socklen_t len = datagram_address[channel].len;
-      nbytes = recvfrom (channel, chars + carryover, readmax,
-			 0, datagram_address[channel].sa, &len);
-    }
-  else
-#endif
+  if (nbytes > 0 && p->adaptive_read_buffering)
     {
-      bool buffered = proc_buffered_char[channel] >= 0;
-      if (buffered)
-	{
-	  chars[carryover] = proc_buffered_char[channel];
-	  proc_buffered_char[channel] = -1;
-	}
-#ifdef HAVE_GNUTLS
-      if (p->gnutls_p)
-	nbytes = emacs_gnutls_read (p, chars + carryover + buffered,
-				    readmax - buffered);
-      else
-#endif
-	nbytes = emacs_read (channel, chars + carryover + buffered,
-			     readmax - buffered);
-#ifdef ADAPTIVE_READ_BUFFERING
-      if (nbytes > 0 && p->adaptive_read_buffering)
+      int delay = p->read_output_delay;
+      if (nbytes < 256)
 	{
-	  int delay = p->read_output_delay;
-	  if (nbytes < 256)
+	  if (delay < READ_OUTPUT_DELAY_MAX_MAX)
 	    {
-	      if (delay < READ_OUTPUT_DELAY_MAX_MAX)
-		{
-		  if (delay == 0)
-		    process_output_delay_count++;
-		  delay += READ_OUTPUT_DELAY_INCREMENT * 2;
-		}
-	    }
-	  else if (delay > 0 && nbytes == readmax - buffered)
-	    {
-	      delay -= READ_OUTPUT_DELAY_INCREMENT;
 	      if (delay == 0)
-		process_output_delay_count--;
-	    }
-	  p->read_output_delay = delay;
-	  if (delay)
-	    {
-	      p->read_output_skip = 1;
-	      process_output_skip = 1;
+		process_output_delay_count++;
+	      delay += READ_OUTPUT_DELAY_INCREMENT * 2;
 	    }
 	}
-#endif
-      nbytes += buffered;
-      nbytes += buffered && nbytes <= 0;
+      else if (delay > 0 && nbytes == readmax)
+	{
+	  delay -= READ_OUTPUT_DELAY_INCREMENT;
+	  if (delay == 0)
+	    process_output_delay_count--;
+	}
+      p->read_output_delay = delay;
+      if (delay)
+	{
+	  p->read_output_skip = 1;
+	  process_output_skip = 1;
+	}
     }
+}
+#endif
 
-  p->decoding_carryover = 0;
+#ifdef USABLE_FIONREAD
+
+/* The most output to read from a process at a time.  */
+#define READ_OUTPUT_MAX (1024 * 1024)
+
+/* Output from a process read into the gap of its buffer.  */
+
+struct gap_read
+{
+  int channel;
+  struct coding_system *coding;
+  /* How many bytes to read at most, and how many were read.  */
+  ptrdiff_t readmax;
+  ssize_t nbytes;
+  /* The errno of the read, if it failed.  */
+  int read_errno;
+  /* Whether the reading was attempted: the before-change hooks can
+     signal an error before.  */
+  bool tried;
+};
+
+/* If the output of process P waiting on CHANNEL can be read straight
+   into the gap of its buffer, return how many bytes to read;
+   otherwise return 0.  This needs the default filter, a coding
+   system that may leave the text unchanged (see
+   decode_coding_unchanged), and some output that is already there,
+   since the before-change hooks run before it is read.  */
+
+static ptrdiff_t
+process_output_gap_size (struct Lisp_Process *p, int channel,
+			 struct coding_system *coding)
+{
+  int nread;
+
+  if (! EQ (p->filter, Qinternal_default_process_filter)
+      || ! BUFFERP (p->buffer) || ! BUFFER_LIVE_P (XBUFFER (p->buffer))
+      || ! decode_coding_unchanged_p (coding)
+      || coding->mode & CODING_MODE_LAST_BLOCK
+      || proc_buffered_char[channel] >= 0
+#ifdef DATAGRAM_SOCKETS
+      || DATAGRAM_CHAN_P (channel)
+#endif
+#ifdef HAVE_GNUTLS
+      || p->gnutls_p
+#endif
+      || ioctl (channel, FIONREAD, &nread) != 0
+      || nread <= 0)
+    return 0;
+
+  /* Ask for more than is there, in case more comes meanwhile.  */
+  return min (max (nread * 2, 4096), READ_OUTPUT_MAX);
+}
+
+/* Read the output of process P as described by ARG, a struct
+   gap_read, into the gap of the current buffer at point, and insert
+   it there without copying it if decoding would not change it.
+   Otherwise decode it in the gap as insert-file-contents does.  */
+
+static void
+read_process_output_into_gap (struct Lisp_Process *p, void *arg)
+{
+  struct gap_read *r = arg;
+  int carryover = p->decoding_carryover;
+  ptrdiff_t opoint = PT;
+
+  prepare_to_modify_buffer (PT, PT, NULL);
+
+  /* Keep room for the bytes of an incomplete character at the end.  */
+  if (SCHARS (p->decoding_buf) < MAX_MULTIBYTE_LENGTH)
+    pset_decoding_buf (p, make_uninit_string (MAX_MULTIBYTE_LENGTH));
+
+  if (PT != GPT)
+    move_gap_both (PT, PT_BYTE);
+  if (GAP_SIZE < carryover + r->readmax)
+    make_gap (carryover + r->readmax - GAP_SIZE);
+  if (carryover)
+    memcpy (GPT_ADDR, SDATA (p->decoding_buf), carryover);
+
+  r->tried = 1;
+  r->nbytes = emacs_read (r->channel, GPT_ADDR + carryover, r->readmax);
+  r->read_errno = errno;
+#ifdef ADAPTIVE_READ_BUFFERING
+  adapt_read_output_delay (p, r->nbytes, r->readmax);
+#endif
+
+  if (r->nbytes > 0)
+    {
+      ptrdiff_t nbytes = carryover + r->nbytes;
+      int rest;
+      ptrdiff_t nchars = decode_coding_unchanged (r->coding, GPT_ADDR,
+						  nbytes, &rest);
+
+      nbytes -= rest;
+      memcpy (SDATA (p->decoding_buf), GPT_ADDR + nbytes, rest);
+      p->decoding_carryover = rest;
+
+      if (nchars >= 0)
+	{
+	  Vlast_coding_system_used = CODING_ID_NAME (r->coding->id);
+	  if (nbytes > 0)
+	    insert_1_from_gap (nchars, nbytes, 0, 1);
+	}
+      else
+	{
+	  /* Decode the text at the end of the gap, where
+	     decode_coding_gap wants it; it inserts the text after
+	     point, so move point and the markers there past it.  */
+	  ptrdiff_t opoint_byte = PT_BYTE, z = Z, z_byte = Z_BYTE;
+	  int mode = r->coding->mode;
+	  struct Lisp_Marker *m;
+
+	  memmove (GAP_END_ADDR - nbytes, GPT_ADDR, nbytes);
+	  decode_coding_gap (r->coding, nbytes, nbytes);
+	  r->coding->mode = mode;
+	  CHARS_MODIFF = MODIFF;
+	  process_output_decoded (p, r->coding);
+
+	  TEMP_SET_PT_BOTH (PT + (Z - z), PT_BYTE + (Z_BYTE - z_byte));
+	  for (m = BUF_MARKERS (current_buffer); m; m = m->next)
+	    if (m->bytepos == opoint_byte)
+	      {
+		m->charpos = PT;
+		m->bytepos = PT_BYTE;
+	      }
+	}
+    }
+
+  signal_after_change (opoint, 0, PT - opoint);
+  update_compositions (opoint, PT, CHECK_BORDER);
+}
+
+/* Insert the output of process PROC as GAP_READ, a saved pointer to
+   a struct gap_read, says.  */
+
+static Lisp_Object
+read_process_output_into_gap_1 (Lisp_Object proc, Lisp_Object gap_read)
+{
+  insert_process_output (XPROCESS (proc), read_process_output_into_gap,
+			 XSAVE_POINTER (gap_read, 0));
+  return Qnil;
+}
+
+#endif /* USABLE_FIONREAD */
+
+/* Read pending output from the process channel,
+   starting with our buffered-ahead character if we have one.
+   Yield number of decoded characters read.
+
+   This function reads at most 4096 characters, or more when the
+   output can go straight into the gap of the process buffer.
+   If you want to read all available subprocess output,
+   you must call it repeatedly until it returns zero.
+
+   The characters read are decoded according to PROC's coding-system
+   for decoding.  */
+
+static int
+read_process_output (Lisp_Object proc, register int channel)
+{
+  register ssize_t nbytes;
+  char *chars;
+  register struct Lisp_Process *p = XPROCESS (proc);
+  struct coding_system *coding = proc_decode_coding_system[channel];
+  int carryover = p->decoding_carryover;
+  int readmax = 4096;
+  ptrdiff_t count = SPECPDL_INDEX ();
+  Lisp_Object odeactivate;
+#ifdef USABLE_FIONREAD
+  struct gap_read gap;
+#endif
+
+#ifdef USABLE_FIONREAD
+  gap.readmax = process_output_gap_size (p, channel, coding);
+  if (gap.readmax > 0)
+    {
+      gap.channel = channel;
+      gap.coding = coding;
+      gap.nbytes = -1;
+      gap.tried = 0;
+      odeactivate = Vdeactivate_mark;
+      record_unwind_current_buffer ();
+      read_and_dispose_of_process_output (p, NULL, 0, coding, &gap);
+      Vdeactivate_mark = odeactivate;
+      unbind_to (count, Qnil);
+      if (gap.tried)
+	{
+	  /* The hooks run after the read may have changed errno.  */
+	  if (gap.nbytes < 0)
+	    errno = gap.read_errno;
+	  return gap.nbytes;
+	}
+      /* Otherwise read the output as usual, so that it does not
+	 stay there to cause the same error again.  */
+    }
+#endif
+
+  chars = alloca (carryover + readmax);
+  if (carryover)
+    /* See the comment above.  */
+    memcpy (chars, SDATA (p->decoding_buf), carryover);
+
+#ifdef DATAGRAM_SOCKETS
+  /* We have a working select, so proc_buffered_char is always -1.  */
+  if (DATAGRAM_CHAN_P (channel))
+    {
+      socklen_t len = datagram_address[channel].len;
+      nbytes = recvfrom (channel, chars + carryover, readmax,
+			 0, datagram_address[channel].sa, &len);
+    }
+  else
+#endif
+    {
+      bool buffered = proc_buffered_char[channel] >= 0;
+      if (buffered)
+	{
+	  chars[carryover] = proc_buffered_char[channel];
+	  proc_buffered_char[channel] = -1;
+	}
+#ifdef HAVE_GNUTLS
+      if (p->gnutls_p)
+	nbytes = emacs_gnutls_read (p, chars + carryover + buffered,
+				    readmax - buffered);
+      else
+#endif
+	nbytes = emacs_read (channel, chars + carryover + buffered,
+			     readmax - buffered);
+#ifdef ADAPTIVE_READ_BUFFERING
+      adapt_read_output_delay (p, nbytes, readmax - buffered);
+#endif
+      nbytes += buffered;
+      nbytes += buffered && nbytes <= 0;
+    }
+
+  p->decoding_carryover = 0;
 
   /* At this point, NBYTES holds number of bytes just received
      (including the one in proc_buffered_char[channel]).  */
@@ -5029,7 +5791,7 @@ read_process_output (Lisp_Object proc, register int channel)
      friends don't expect current-buffer to be changed from under them.  */
   record_unwind_current_buffer ();
 
-  read_and_dispose_of_process_output (p, chars, nbytes, coding);
+  read_and_dispose_of_process_output (p, chars, nbytes, coding, NULL);
 
   /* Handling the process output should not deactivate the mark.  */
   Vdeactivate_mark = odeactivate;
@@ -5038,10 +5800,59 @@ read_process_output (Lisp_Object proc, register int channel)
   return nbytes;
 }
 
+/* Note that output from process P was decoded with CODING: remember
+   the coding system that decoding found, and keep the bytes of an
+   incomplete character at the end for the next time.  */
+
+static void
+process_output_decoded (struct Lisp_Process *p, struct coding_system *coding)
+{
+  Vlast_coding_system_used = CODING_ID_NAME (coding->id);
+  /* A new coding system might be found.  */
+  if (!EQ (p->decode_coding_system, Vlast_coding_system_used))
+    {
+      pset_decode_coding_system (p, Vlast_coding_system_used);
+
+      /* Don't call setup_coding_system for
+	 proc_decode_coding_system[channel] here.  It is done in
+	 detect_coding called via decode_coding above.  */
+
+      /* If a coding system for encoding is not yet decided, we set
+	 it as the same as coding-system for decoding.
+
+	 But, before doing that we must check if
+	 proc_encode_coding_system[p->outfd] surely points to a
+	 valid memory because p->outfd will be changed once EOF is
+	 sent to the process.  */
+      if (NILP (p->encode_coding_system)
+	  && proc_encode_coding_system[p->outfd])
+	{
+	  pset_encode_coding_system
+	    (p, coding_inherit_eol_type (Vlast_coding_system_used, Qnil));
+	  setup_coding_system (p->encode_coding_system,
+			       proc_encode_coding_system[p->outfd]);
+	}
+    }
+
+  if (coding->carryover_bytes > 0)
+    {
+      if (SCHARS (p->decoding_buf) < coding->carryover_bytes)
+	pset_decoding_buf (p, make_uninit_string (coding->carryover_bytes));
+      memcpy (SDATA (p->decoding_buf), coding->carryover,
+	      coding->carryover_bytes);
+      p->decoding_carryover = coding->carryover_bytes;
+    }
+}
+
+/* Decode the NBYTES bytes of output from process P at CHARS and pass
+   the text to its filter.  If GAP is non-null, read the output into
+   the gap of the process buffer as it says instead.  */
+
 static void
 read_and_dispose_of_process_output (struct Lisp_Process *p, char *chars,
 				    ssize_t nbytes,
-				    struct coding_system *coding)
+				    struct coding_system *coding,
+				    struct gap_read *gap)
 {
   Lisp_Object outstream = p->filter;
   Lisp_Object text;
@@ -5079,51 +5890,27 @@ read_and_dispose_of_process_output (struct Lisp_Process *p, char *chars,
      save the match data in a special nonrecursive fashion.  */
   running_asynch_code = 1;
 
-  decode_coding_c_string (coding, (unsigned char *) chars, nbytes, Qt);
-  text = coding->dst_object;
-  Vlast_coding_system_used = CODING_ID_NAME (coding->id);
-  /* A new coding system might be found.  */
-  if (!EQ (p->decode_coding_system, Vlast_coding_system_used))
-    {
-      pset_decode_coding_system (p, Vlast_coding_system_used);
-
-      /* Don't call setup_coding_system for
-	 proc_decode_coding_system[channel] here.  It is done in
-	 detect_coding called via decode_coding above.  */
-
-      /* If a coding system for encoding is not yet decided, we set
-	 it as the same as coding-system for decoding.
-
-	 But, before doing that we must check if
-	 proc_encode_coding_system[p->outfd] surely points to a
-	 valid memory because p->outfd will be changed once EOF is
-	 sent to the process.  */
-      if (NILP (p->encode_coding_system)
-	  && proc_encode_coding_system[p->outfd])
-	{
-	  pset_encode_coding_system
-	    (p, coding_inherit_eol_type (Vlast_coding_system_used, Qnil));
-	  setup_coding_system (p->encode_coding_system,
-			       proc_encode_coding_system[p->outfd]);
-	}
-    }
-
-  if (coding->carryover_bytes > 0)
-    {
-      if (SCHARS (p->decoding_buf) < coding->carryover_bytes)
-	pset_decoding_buf (p, make_uninit_string (coding->carryover_bytes));
-      memcpy (SDATA (p->decoding_buf), coding->carryover,
-	      coding->carryover_bytes);
-      p->decoding_carryover = coding->carryover_bytes;
-    }
-  if (SBYTES (text) > 0)
-    /* FIXME: It's wrong to wrap or not based on debug-on-error, and
-       sometimes it's simply wrong to wrap (e.g. when called from
-       accept-process-output).  */
-    internal_condition_case_1 (read_process_output_call,
-			       list3 (outstream, make_lisp_proc (p), text),
+#ifdef USABLE_FIONREAD
+  if (gap)
+    internal_condition_case_2 (read_process_output_into_gap_1,
+			       make_lisp_proc (p), make_save_ptr_int (gap, 0),
 			       !NILP (Vdebug_on_error) ? Qnil : Qerror,
 			       read_process_output_error_handler);
+  else
+#endif
+    {
+      decode_coding_c_string (coding, (unsigned char *) chars, nbytes, Qt);
+      text = coding->dst_object;
+      process_output_decoded (p, coding);
+      if (SBYTES (text) > 0)
+	/* FIXME: It's wrong to wrap or not based on debug-on-error, and
+	   sometimes it's simply wrong to wrap (e.g. when called from
+	   accept-process-output).  */
+	internal_condition_case_1 (read_process_output_call,
+				   list3 (outstream, make_lisp_proc (p), text),
+				   !NILP (Vdebug_on_error) ? Qnil : Qerror,
+				   read_process_output_error_handler);
+    }
 
   /* If we saved the match data nonrecursively, restore it now.  */
   restore_search_regs ();
@@ -5146,18 +5933,18 @@ read_and_dispose_of_process_output (struct Lisp_Process *p, char *chars,
       record_asynch_buffer_change ();
 }
 
-DEFUN ("internal-default-process-filter", Finternal_default_process_filter,
-       Sinternal_default_process_filter, 2, 2, 0,
-       doc: /* Function used as default process filter.  */)
-  (Lisp_Object proc, Lisp_Object text)
+/* Insert output of process P in its buffer at its output marker, as
+   the default filter does.  INSERT_TEXT, called with P and ARG,
+   inserts the text at point before the markers there; the output
+   marker, point and the restriction of the buffer are then updated.  */
+
+static void
+insert_process_output (struct Lisp_Process *p,
+		       void (*insert_text) (struct Lisp_Process *, void *),
+		       void *arg)
 {
-  struct Lisp_Process *p;
   ptrdiff_t opoint;
 
-  CHECK_PROCESS (proc);
-  p = XPROCESS (proc);
-  CHECK_STRING (text);
-
   if (!NILP (p->buffer) && BUFFER_LIVE_P (XBUFFER (p->buffer)))
     {
       Lisp_Object old_read_only;
@@ -5192,16 +5979,9 @@ DEFUN ("internal-default-process-filter", Finternal_default_process_filter,
       if (! (BEGV <= PT && PT <= ZV))
 	Fwiden ();
 
-      /* Adjust the multibyteness of TEXT to that of the buffer.  */
-      if (NILP (BVAR (current_buffer, enable_multibyte_characters))
-	  != ! STRING_MULTIBYTE (text))
-	text = (STRING_MULTIBYTE (text)
-		? Fstring_as_unibyte (text)
-		: Fstring_to_multibyte (text));
       /* Insert before markers in case we are inserting where
 	 the buffer's mark is, and the user's next command is Meta-y.  */
-      insert_from_string_before_markers (text, 0, 0,
-					 SCHARS (text), SBYTES (text), 0);
+      insert_text (p, arg);
 
       /* Make sure the process marker's position is valid when the
 	 process buffer is changed in the signal_after_change above.
@@ -5239,6 +6019,32 @@ DEFUN ("internal-default-process-filter", Finternal_default_process_filter,
       bset_read_only (current_buffer, old_read_only);
       SET_PT_BOTH (opoint, opoint_byte);
     }
+}
+
+static void
+insert_process_output_string (struct Lisp_Process *p, void *arg)
+{
+  Lisp_Object text = *(Lisp_Object *) arg;
+
+  /* Adjust the multibyteness of TEXT to that of the buffer.  */
+  if (NILP (BVAR (current_buffer, enable_multibyte_characters))
+      != ! STRING_MULTIBYTE (text))
+    text = (STRING_MULTIBYTE (text)
+	    ? Fstring_as_unibyte (text)
+	    : Fstring_to_multibyte (text));
+  insert_from_string_before_markers (text, 0, 0,
+				     SCHARS (text), SBYTES (text), 0);
+}
+
+DEFUN ("internal-default-process-filter", Finternal_default_process_filter,
+       Sinternal_default_process_filter, 2, 2, 0,
+       doc: /* Function used as default process filter.  */)
+  (Lisp_Object proc, Lisp_Object text)
+{
+  CHECK_PROCESS (proc);
+  CHECK_STRING (text);
+  insert_process_output (XPROCESS (proc), insert_process_output_string,
+			 &text);
   return Qnil;
 }
 
@@ -5252,70 +6058,379 @@ DEFUN ("internal-default-process-filter", Finternal_default_process_filter,
    handled by the write_queue element of struct process.  It is a list
    with each entry having the form
 
-   (string . (offset . length))
+   (string offset length . callbacks)
 
    where STRING is a lisp string, OFFSET is the offset into the
-   string's byte sequence from which we should begin to send, and
-   LENGTH is the number of bytes left to send.  */
+   string's byte sequence from which we should begin to send, LENGTH
+   is the number of bytes left to send, and CALLBACKS is a list of
+   functions to call with the process once they have all been sent.
+
+   When process-send-string and process-send-region are given a
+   callback, they leave what the process cannot take at once in the
+   queue, and wait_reading_process_output writes it out through
+   send_queued_input as the process reads its input.  */
 
-/* Create a new entry in write_queue.
+/* The number of queued strings to write at once with writev.  */
+enum { WRITE_QUEUE_IOVECS = 64 };
+
+/* Data smaller than this, sent with a callback, waits in the queue
+   until Emacs next waits for input.  Queued, it is copied to the end
+   of the last entry if that is smaller than this too, to be written
+   together with it.  */
+enum { SEND_COALESCE_BYTES = 4096 };
+
+/* Add an entry at the end of write_queue.
    INPUT_OBJ should be a buffer, string Qt, or Qnil.
    BUF is a pointer to the string sequence of the input_obj or a C
-   string in case of Qt or Qnil.  */
+   string in case of Qt or Qnil.  CALLBACK is the function to call
+   once the entry has been sent, or nil.
+
+   If both BUF and the last entry are small, append BUF to the last
+   entry instead, so that they are written together.  */
 
 static void
 write_queue_push (struct Lisp_Process *p, Lisp_Object input_obj,
-                  const char *buf, ptrdiff_t len, bool front)
+                  const char *buf, ptrdiff_t len, Lisp_Object callback)
 {
-  ptrdiff_t offset;
+  ptrdiff_t offset = STRINGP (input_obj) ? buf - SSDATA (input_obj) : 0;
+  Lisp_Object callbacks = NILP (callback) ? Qnil : list1 (callback);
   Lisp_Object entry, obj;
 
-  if (STRINGP (input_obj))
+  p->write_queue_bytes += len;
+  if (CONSP (p->write_queue) && len < SEND_COALESCE_BYTES)
     {
-      offset = buf - SSDATA (input_obj);
-      obj = input_obj;
+      Lisp_Object last = XCAR (p->write_queue_tail), offset_length;
+      ptrdiff_t last_offset, last_len;
+
+      offset_length = XCDR (last);
+      last_offset = XINT (XCAR (offset_length));
+      last_len = XINT (XCAR (XCDR (offset_length)));
+      if (last_len < SEND_COALESCE_BYTES)
+	{
+	  obj = make_uninit_string (last_len + len);
+	  if (STRINGP (input_obj))
+	    buf = SSDATA (input_obj) + offset;
+	  memcpy (SDATA (obj), SDATA (XCAR (last)) + last_offset, last_len);
+	  memcpy (SDATA (obj) + last_len, buf, len);
+	  XSETCAR (last, obj);
+	  XSETCAR (offset_length, make_number (0));
+	  XSETCAR (XCDR (offset_length), make_number (last_len + len));
+	  XSETCDR (XCDR (offset_length),
+		   nconc2 (XCDR (XCDR (offset_length)), callbacks));
+	  return;
+	}
     }
+
+  obj = (STRINGP (input_obj) ? input_obj
+	 : make_unibyte_string (buf, len));
+  entry = list1 (Fcons (obj, Fcons (make_number (offset),
+				    Fcons (make_number (len), callbacks))));
+  if (CONSP (p->write_queue))
+    XSETCDR (p->write_queue_tail, entry);
   else
+    pset_write_queue (p, entry);
+  pset_write_queue_tail (p, entry);
+}
+
+/* Empty the write_queue of P.  */
+
+static void
+clear_write_queue (struct Lisp_Process *p)
+{
+  pset_write_queue (p, Qnil);
+  pset_write_queue_tail (p, Qnil);
+  p->write_queue_bytes = 0;
+}
+
+/* Write to process P the LEN bytes at BUF, without waiting.  Return
+   the number of bytes written, setting errno if this is less than
+   LEN.  */
+
+static ptrdiff_t
+send_process_bytes (struct Lisp_Process *p, const char *buf, ptrdiff_t len)
+{
+  ptrdiff_t written;
+  int outfd = p->outfd;
+
+#ifdef DATAGRAM_SOCKETS
+  if (DATAGRAM_CHAN_P (outfd))
     {
-      offset = 0;
-      obj = make_unibyte_string (buf, len);
+      ssize_t rv = sendto (outfd, buf, len,
+			   0, datagram_address[outfd].sa,
+			   datagram_address[outfd].len);
+      written = rv < 0 ? 0 : rv;
+    }
+  else
+#endif
+    {
+#ifdef HAVE_GNUTLS
+      if (p->gnutls_p)
+	written = emacs_gnutls_write (p, buf, len);
+      else
+#endif
+	written = emacs_write_sig (outfd, buf, len);
+#ifdef ADAPTIVE_READ_BUFFERING
+      if (p->read_output_delay > 0
+	  && p->adaptive_read_buffering == 1)
+	{
+	  p->read_output_delay = 0;
+	  process_output_delay_count--;
+	  p->read_output_skip = 0;
+	}
+#endif
     }
 
-  entry = Fcons (obj, Fcons (make_number (offset), make_number (len)));
+#ifdef BROKEN_PTY_READ_AFTER_EAGAIN
+  /* A gross hack to work around a bug in FreeBSD.
+     In the following sequence, read(2) returns
+     bogus data:
+
+     write(2)	 1022 bytes
+     write(2)   954 bytes, get EAGAIN
+     read(2)   1024 bytes in process_read_output
+     read(2)     11 bytes in process_read_output
+
+     That is, read(2) returns more bytes than have
+     ever been written successfully.  The 1033 bytes
+     read are the 1022 bytes written successfully
+     after processing (for example with CRs added if
+     the terminal is set up that way which it is
+     here).  The same bytes will be seen again in a
+     later read(2), without the CRs.  */
+
+  if (written < len && errno == EAGAIN)
+    {
+      int flags = FWRITE;
+      ioctl (outfd, TIOCFLUSH, &flags);
+    }
+#endif /* BROKEN_PTY_READ_AFTER_EAGAIN */
 
-  if (front)
-    pset_write_queue (p, Fcons (entry, p->write_queue));
-  else
-    pset_write_queue (p, nconc2 (p->write_queue, list1 (entry)));
+  return written;
 }
 
-/* Remove the first element in the write_queue of process P, put its
-   contents in OBJ, BUF and LEN, and return true.  If the
-   write_queue is empty, return false.  */
+/* Return true if ERR means that a write would have had to wait.  */
 
 static bool
-write_queue_pop (struct Lisp_Process *p, Lisp_Object *obj,
-		 const char **buf, ptrdiff_t *len)
+write_would_block (int err)
 {
-  Lisp_Object entry, offset_length;
-  ptrdiff_t offset;
+#ifdef EWOULDBLOCK
+  if (err == EWOULDBLOCK)
+    return 1;
+#endif
+  return err == EAGAIN;
+}
 
-  if (NILP (p->write_queue))
-    return 0;
+/* Write to process P, whose Lisp object is PROC, as much of its
+   write_queue as it takes without waiting.  Record the callbacks of
+   the entries sent in pending_send_callbacks.  Return 1 if the queue
+   is empty now, 0 if the process cannot take more for now, and -1 with
+   errno set if writing failed.  */
+
+static int
+write_queued_input (struct Lisp_Process *p, Lisp_Object proc)
+{
+  while (CONSP (p->write_queue))
+    {
+      ptrdiff_t requested = 0, written;
+      bool failed;
+      int err;
+
+#ifdef HAVE_SYS_UIO_H
+      /* Send several strings with one writev, but datagrams one by
+	 one, and leave TLS to its own functions.  */
+      if (CONSP (XCDR (p->write_queue))
+	  && ! DATAGRAM_CHAN_P (p->outfd)
+#ifdef HAVE_GNUTLS
+	  && ! p->gnutls_p
+#endif
+	  )
+	{
+	  struct iovec iov[WRITE_QUEUE_IOVECS];
+	  Lisp_Object tail;
+	  int n = 0;
+
+	  for (tail = p->write_queue;
+	       CONSP (tail) && n < WRITE_QUEUE_IOVECS;
+	       tail = XCDR (tail))
+	    {
+	      Lisp_Object entry = XCAR (tail);
+	      Lisp_Object offset_length = XCDR (entry);
+
+	      iov[n].iov_base = (SSDATA (XCAR (entry))
+				 + XINT (XCAR (offset_length)));
+	      iov[n].iov_len = XINT (XCAR (XCDR (offset_length)));
+	      requested += iov[n].iov_len;
+	      n++;
+	    }
 
-  entry = XCAR (p->write_queue);
-  pset_write_queue (p, XCDR (p->write_queue));
+	  while ((written = writev (p->outfd, iov, n)) < 0 && errno == EINTR)
+	    if (pending_signals)
+	      process_pending_signals ();
+	  /* A short count just means that the process took less than
+	     everything; try again to see whether it takes more.  */
+	  failed = written < 0;
+	  if (failed)
+	    written = 0;
+	}
+      else
+#endif
+	{
+	  Lisp_Object entry = XCAR (p->write_queue);
+	  Lisp_Object offset_length = XCDR (entry);
+
+	  requested = XINT (XCAR (XCDR (offset_length)));
+	  written = send_process_bytes (p, (SSDATA (XCAR (entry))
+					    + XINT (XCAR (offset_length))),
+					requested);
+	  failed = written < requested;
+	}
+      err = errno;
 
-  *obj = XCAR (entry);
-  offset_length = XCDR (entry);
+      /* Drop the entries that have been sent, and skip what has been
+	 sent of the next one.  */
+      while (CONSP (p->write_queue))
+	{
+	  Lisp_Object entry = XCAR (p->write_queue);
+	  Lisp_Object offset_length = XCDR (entry);
+	  ptrdiff_t length = XINT (XCAR (XCDR (offset_length)));
+	  Lisp_Object callbacks;
 
-  *len = XINT (XCDR (offset_length));
-  offset = XINT (XCAR (offset_length));
-  *buf = SSDATA (*obj) + offset;
+	  if (written < length)
+	    {
+	      if (written > 0)
+		{
+		  XSETCAR (offset_length,
+			   make_number (XINT (XCAR (offset_length))
+					+ written));
+		  XSETCAR (XCDR (offset_length),
+			   make_number (length - written));
+		  p->write_queue_bytes -= written;
+		}
+	      break;
+	    }
+	  written -= length;
+	  requested -= length;
+	  p->write_queue_bytes -= length;
+	  pset_write_queue (p, XCDR (p->write_queue));
+	  if (NILP (p->write_queue))
+	    pset_write_queue_tail (p, Qnil);
+	  for (callbacks = XCDR (XCDR (offset_length)); CONSP (callbacks);
+	       callbacks = XCDR (callbacks))
+	    pending_send_callbacks
+	      = Fcons (Fcons (proc, XCAR (callbacks)), pending_send_callbacks);
+	}
+
+      if (failed)
+	{
+	  errno = err;
+	  return write_would_block (err) ? 0 : -1;
+	}
+    }
 
   return 1;
 }
 
+/* Make wait_reading_process_output call send_queued_input when P can
+   take more input, if anything is queued for it, or stop it
+   otherwise.  */
+
+static void
+update_send_queue_fd (struct Lisp_Process *p)
+{
+  int fd = p->outfd;
+  bool watched = (0 <= fd
+		  && fd_callback_info[fd].func == send_queued_input
+		  && fd_callback_info[fd].condition & FOR_WRITE);
+
+  if (CONSP (p->write_queue) && 0 <= fd && ! watched)
+    {
+      add_write_fd (fd, send_queued_input, p);
+      FD_SET (fd, &send_queue_mask);
+    }
+  else if (NILP (p->write_queue) && watched)
+    {
+      delete_write_fd (fd);
+      FD_CLR (fd, &send_queue_mask);
+    }
+}
+
+/* Writing to process PROC failed with error ERR.  Give up on sending
+   it input and, if SIGNAL, signal an error.  */
+
+static void
+send_process_failed (Lisp_Object proc, int err, bool signal)
+{
+  struct Lisp_Process *p = XPROCESS (proc);
+
+#ifdef DATAGRAM_SOCKETS
+  if (signal && err == EMSGSIZE && DATAGRAM_CHAN_P (p->outfd))
+    report_file_errno ("Sending datagram", proc, err);
+#endif
+  if (signal && err != EPIPE)
+    /* This is a real error.  */
+    report_file_errno ("Writing to process", proc, err);
+
+  /* There is nobody to report other errors to when the input was
+     queued, so treat them all like a broken pipe.  */
+  clear_write_queue (p);
+  p->raw_status_new = 0;
+  pset_status (p, list2 (Qexit, make_number (256)));
+  p->tick = ++process_tick;
+  deactivate_process (proc);
+  if (signal)
+    error ("process %s no longer connected to pipe; closed it",
+	   SDATA (p->name));
+}
+
+/* Write what is queued for the process whose descriptor FD is ready
+   for it; DATA is the struct Lisp_Process.  */
+
+static void
+send_queued_input (int fd, void *data)
+{
+  struct Lisp_Process *p = data;
+  Lisp_Object proc;
+
+  XSETPROCESS (proc, p);
+  if (write_queued_input (p, proc) < 0)
+    send_process_failed (proc, errno, 0);
+  else
+    update_send_queue_fd (p);
+}
+
+static Lisp_Object
+send_callback_error_handler (Lisp_Object error_val)
+{
+  cmd_error_internal (error_val, "error in process send callback: ");
+  Vinhibit_quit = Qt;
+  update_echo_area ();
+  Fsleep_for (make_number (2), Qnil);
+  return Qt;
+}
+
+static void exec_process_function (Lisp_Object,
+				   Lisp_Object (*) (Lisp_Object));
+
+/* Call the callbacks in pending_send_callbacks, oldest first.  */
+
+static void
+run_send_callbacks (void)
+{
+  while (CONSP (pending_send_callbacks))
+    {
+      Lisp_Object callbacks = Fnreverse (pending_send_callbacks);
+      struct gcpro gcpro1;
+
+      pending_send_callbacks = Qnil;
+      GCPRO1 (callbacks);
+      for (; CONSP (callbacks); callbacks = XCDR (callbacks))
+	exec_process_function (list2 (XCDR (XCAR (callbacks)),
+				      XCAR (XCAR (callbacks))),
+			       send_callback_error_handler);
+      UNGCPRO;
+    }
+}
+
 /* Send some data to process PROC.
    BUF is the beginning of the data; LEN is the number of characters.
    OBJECT is the Lisp object that the data comes from.  If OBJECT is
@@ -5324,14 +6439,17 @@ write_queue_pop (struct Lisp_Process *p, Lisp_Object *obj,
    If OBJECT is not nil, the data is encoded by PROC's coding-system
    for encoding before it is sent.
 
+   If CALLBACK is nil, wait until the data has been written.
+   Otherwise, queue what PROC cannot take now, and call CALLBACK with
+   PROC once all of it is written.
+
    This function can evaluate Lisp code and can garbage collect.  */
 
 static void
 send_process (Lisp_Object proc, const char *buf, ptrdiff_t len,
-	      Lisp_Object object)
+	      Lisp_Object object, Lisp_Object callback)
 {
   struct Lisp_Process *p = XPROCESS (proc);
-  ssize_t rv;
   struct coding_system *coding;
 
   if (p->raw_status_new)
@@ -5378,7 +6496,7 @@ send_process (Lisp_Object proc, const char *buf, ptrdiff_t len,
 	    {
 	      /* But, before changing the coding, we must flush out data.  */
 	      coding->mode |= CODING_MODE_LAST_BLOCK;
-	      send_process (proc, "", 0, Qt);
+	      send_process (proc, "", 0, Qt, Qnil);
 	      coding->mode &= CODING_MODE_LAST_BLOCK;
 	    }
 	  setup_coding_system (raw_text_coding_system
@@ -5427,134 +6545,65 @@ send_process (Lisp_Object proc, const char *buf, ptrdiff_t len,
     }
 
   /* If there is already data in the write_queue, put the new data
-     in the back of queue.  Otherwise, ignore it.  */
-  if (!NILP (p->write_queue))
-    write_queue_push (p, object, buf, len, 0);
-
-  do   /* while !NILP (p->write_queue) */
+     in the back of queue, to be sent in order.  Otherwise, send what
+     can be sent now, unless it is small enough to wait for more.  */
+  if (NILP (p->write_queue) && 0 < len
+      && (NILP (callback) || SEND_COALESCE_BYTES <= len))
     {
-      ptrdiff_t cur_len = -1;
-      const char *cur_buf;
-      Lisp_Object cur_object;
+      ptrdiff_t written = send_process_bytes (p, buf, len);
 
-      /* If write_queue is empty, ignore it.  */
-      if (!write_queue_pop (p, &cur_object, &cur_buf, &cur_len))
-	{
-	  cur_len = len;
-	  cur_buf = buf;
-	  cur_object = object;
-	}
-
-      while (cur_len > 0)
-	{
-	  /* Send this batch, using one or more write calls.  */
-	  ptrdiff_t written = 0;
-	  int outfd = p->outfd;
-#ifdef DATAGRAM_SOCKETS
-	  if (DATAGRAM_CHAN_P (outfd))
-	    {
-	      rv = sendto (outfd, cur_buf, cur_len,
-			   0, datagram_address[outfd].sa,
-			   datagram_address[outfd].len);
-	      if (rv >= 0)
-		written = rv;
-	      else if (errno == EMSGSIZE)
-		report_file_error ("Sending datagram", proc);
-	    }
-	  else
-#endif
-	    {
-#ifdef HAVE_GNUTLS
-	      if (p->gnutls_p)
-		written = emacs_gnutls_write (p, cur_buf, cur_len);
-	      else
-#endif
-		written = emacs_write_sig (outfd, cur_buf, cur_len);
-	      rv = (written ? 0 : -1);
-#ifdef ADAPTIVE_READ_BUFFERING
-	      if (p->read_output_delay > 0
-		  && p->adaptive_read_buffering == 1)
-		{
-		  p->read_output_delay = 0;
-		  process_output_delay_count--;
-		  p->read_output_skip = 0;
-		}
-#endif
-	    }
+      if (written < len && ! write_would_block (errno))
+	send_process_failed (proc, errno, 1);
+      buf += written;
+      len -= written;
+    }
+  if (0 < len || (CONSP (p->write_queue) && ! NILP (callback)))
+    write_queue_push (p, object, buf, len, callback);
+  else if (! NILP (callback))
+    pending_send_callbacks = Fcons (Fcons (proc, callback),
+				    pending_send_callbacks);
+
+  if (NILP (callback))
+    while (CONSP (p->write_queue))
+      {
+	int sent = write_queued_input (p, proc);
 
-	  if (rv < 0)
-	    {
-	      if (errno == EAGAIN
-#ifdef EWOULDBLOCK
-		  || errno == EWOULDBLOCK
-#endif
-		  )
-		/* Buffer is full.  Wait, accepting input;
-		   that may allow the program
-		   to finish doing output and read more.  */
-		{
-#ifdef BROKEN_PTY_READ_AFTER_EAGAIN
-		  /* A gross hack to work around a bug in FreeBSD.
-		     In the following sequence, read(2) returns
-		     bogus data:
-
-		     write(2)	 1022 bytes
-		     write(2)   954 bytes, get EAGAIN
-		     read(2)   1024 bytes in process_read_output
-		     read(2)     11 bytes in process_read_output
-
-		     That is, read(2) returns more bytes than have
-		     ever been written successfully.  The 1033 bytes
-		     read are the 1022 bytes written successfully
-		     after processing (for example with CRs added if
-		     the terminal is set up that way which it is
-		     here).  The same bytes will be seen again in a
-		     later read(2), without the CRs.  */
-
-		  if (errno == EAGAIN)
-		    {
-		      int flags = FWRITE;
-		      ioctl (p->outfd, TIOCFLUSH, &flags);
-		    }
-#endif /* BROKEN_PTY_READ_AFTER_EAGAIN */
+	if (sent < 0)
+	  send_process_failed (proc, errno, 1);
+	else if (sent == 0)
+	  {
+	    /* Buffer is full.  Wait, accepting input;
+	       that may allow the program
+	       to finish doing output and read more.  */
+	    update_send_queue_fd (p);
+	    wait_reading_process_output (0, 20 * 1000 * 1000,
+					 0, 0, Qnil, NULL, 0);
+	    if (p->outfd < 0)
+	      error ("Output file descriptor of %s is closed",
+		     SDATA (p->name));
+	  }
+      }
 
-		  /* Put what we should have written in wait_queue.  */
-		  write_queue_push (p, cur_object, cur_buf, cur_len, 1);
-		  wait_reading_process_output (0, 20 * 1000 * 1000,
-					       0, 0, Qnil, NULL, 0);
-		  /* Reread queue, to see what is left.  */
-		  break;
-		}
-	      else if (errno == EPIPE)
-		{
-		  p->raw_status_new = 0;
-		  pset_status (p, list2 (Qexit, make_number (256)));
-		  p->tick = ++process_tick;
-		  deactivate_process (proc);
-		  error ("process %s no longer connected to pipe; closed it",
-			 SDATA (p->name));
-		}
-	      else
-		/* This is a real error.  */
-		report_file_error ("Writing to process", proc);
-	    }
-	  cur_buf += written;
-	  cur_len -= written;
-	}
-    }
-  while (!NILP (p->write_queue));
+  update_send_queue_fd (p);
+  run_send_callbacks ();
 }
 
 DEFUN ("process-send-region", Fprocess_send_region, Sprocess_send_region,
-       3, 3, 0,
+       3, 4, 0,
        doc: /* Send current contents of region as input to PROCESS.
 PROCESS may be a process, a buffer, the name of a process or buffer, or
 nil, indicating the current buffer's process.
 Called from program, takes three arguments, PROCESS, START and END.
 If the region is more than 500 characters long,
 it is sent in several bunches.  This may happen even for shorter regions.
-Output from processes can arrive in between bunches.  */)
-  (Lisp_Object process, Lisp_Object start, Lisp_Object end)
+Output from processes can arrive in between bunches.
+
+If optional fourth argument CALLBACK is non-nil, do not wait for
+PROCESS to take all of the region, and call CALLBACK as
+`process-send-string' does.  In that case, return the number of bytes
+still queued for PROCESS.  */)
+  (Lisp_Object process, Lisp_Object start, Lisp_Object end,
+   Lisp_Object callback)
 {
   Lisp_Object proc = get_process (process);
   ptrdiff_t start_byte, end_byte;
@@ -5568,29 +6617,52 @@ Output from processes can arrive in between bunches.  */)
     move_gap_both (XINT (start), start_byte);
 
   send_process (proc, (char *) BYTE_POS_ADDR (start_byte),
-		end_byte - start_byte, Fcurrent_buffer ());
+		end_byte - start_byte, Fcurrent_buffer (), callback);
 
-  return Qnil;
+  return NILP (callback) ? Qnil : Fprocess_send_queue_size (proc);
 }
 
 DEFUN ("process-send-string", Fprocess_send_string, Sprocess_send_string,
-       2, 2, 0,
+       2, 3, 0,
        doc: /* Send PROCESS the contents of STRING as input.
 PROCESS may be a process, a buffer, the name of a process or buffer, or
 nil, indicating the current buffer's process.
 If STRING is more than 500 characters long,
 it is sent in several bunches.  This may happen even for shorter strings.
-Output from processes can arrive in between bunches.  */)
-  (Lisp_Object process, Lisp_Object string)
+Output from processes can arrive in between bunches.
+
+If optional third argument CALLBACK is non-nil, do not wait for
+PROCESS to take all of STRING.  Queue what it cannot take now, and
+small strings that can wait to be sent together with what follows
+them; Emacs sends them when it next waits for input, as PROCESS reads
+them.  Once all of STRING has been sent, call CALLBACK with PROCESS as
+its argument; this can happen before this function returns.  In that
+case, return the number of bytes still queued for PROCESS, counting
+those of earlier calls.  Input sent without a callback still waits for
+what is queued before it.  */)
+  (Lisp_Object process, Lisp_Object string, Lisp_Object callback)
 {
   Lisp_Object proc;
   CHECK_STRING (string);
   proc = get_process (process);
   send_process (proc, SSDATA (string),
-		SBYTES (string), string);
-  return Qnil;
+		SBYTES (string), string, callback);
+  return NILP (callback) ? Qnil : Fprocess_send_queue_size (proc);
 }
-
+
+DEFUN ("process-send-queue-size", Fprocess_send_queue_size,
+       Sprocess_send_queue_size, 0, 1, 0,
+       doc: /* Return the number of bytes queued for sending to PROCESS.
+PROCESS may be a process, a buffer, the name of a process or buffer, or
+nil, indicating the current buffer's process.
+These are the bytes that `process-send-string' and
+`process-send-region' queued when called with a callback, and that
+PROCESS has not read yet.  */)
+  (Lisp_Object process)
+{
+  return make_number (XPROCESS (get_process (process))->write_queue_bytes);
+}
+
 /* Return the foreground process group for the tty/pty that
    the process P uses.  */
 static pid_t
@@ -5719,7 +6791,7 @@ process_send_signal (Lisp_Object process, int signo, Lisp_Object current_group,
 
       if (sig_char && *sig_char != CDISABLE)
 	{
-	  send_process (proc, (char *) sig_char, 1, Qnil);
+	  send_process (proc, (char *) sig_char, 1, Qnil, Qnil);
 	  return;
 	}
       /* If we can't send the signal with a character,
@@ -5855,6 +6927,7 @@ traffic.  */)
 	{
 	  FD_CLR (p->infd, &input_wait_mask);
 	  FD_CLR (p->infd, &non_keyboard_wait_mask);
+	  update_wait_fd (p->infd);
 	}
       pset_command (p, Qt);
       return process;
@@ -5885,6 +6958,7 @@ traffic.  */)
 	{
 	  FD_SET (p->infd, &input_wait_mask);
 	  FD_SET (p->infd, &non_keyboard_wait_mask);
+	  update_wait_fd (p->infd);
 #ifdef WINDOWSNT
 	  if (fd_info[ p->infd ].flags & FILE_SERIAL)
 	    PurgeComm (fd_info[ p->infd ].hnd, PURGE_RXABORT | PURGE_RXCLEAR);
@@ -6011,14 +7085,16 @@ process has been transmitted to the serial port.  */)
   if (! EQ (XPROCESS (proc)->status, Qrun))
     error ("Process %s not running", SDATA (XPROCESS (proc)->name));
 
+  /* Send what is queued for the process, and what the coding system
+     holds back, before the EOF.  */
   if (CODING_REQUIRE_FLUSHING (coding))
-    {
-      coding->mode |= CODING_MODE_LAST_BLOCK;
-      send_process (proc, "", 0, Qnil);
-    }
+    coding->mode |= CODING_MODE_LAST_BLOCK;
+  if (CODING_REQUIRE_FLUSHING (coding)
+      || CONSP (XPROCESS (proc)->write_queue))
+    send_process (proc, "", 0, Qnil, Qnil);
 
   if (XPROCESS (proc)->pty_flag)
-    send_process (proc, "\004", 1, Qnil);
+    send_process (proc, "\004", 1, Qnil, Qnil);
   else if (EQ (XPROCESS (proc)->type, Qserial))
     {
 #ifndef WINDOWSNT
@@ -6174,7 +7250,9 @@ handle_child_signal (int sig)
 	      if (p->infd >= 0)
 		clear_desc_flag = 1;
 
-	      /* clear_desc_flag avoids a compiler bug in Microsoft C.  */
+	      /* clear_desc_flag avoids a compiler bug in Microsoft C.
+		 Do not call update_wait_fd from a signal handler; if the
+		 descriptor becomes ready, process_select parks it.  */
 	      if (clear_desc_flag)
 		{
 		  FD_CLR (p->infd, &input_wait_mask);
@@ -6209,18 +7287,19 @@ exec_sentinel_error_handler (Lisp_Object error_val)
   return Qt;
 }
 
+/* Call the function that is the car of FUN_AND_ARGS with the rest as
+   arguments, as asynchronous code like a process sentinel.  Call
+   HANDLER with the error data if it signals an error.  */
+
 static void
-exec_sentinel (Lisp_Object proc, Lisp_Object reason)
+exec_process_function (Lisp_Object fun_and_args,
+		       Lisp_Object (*handler) (Lisp_Object))
 {
-  Lisp_Object sentinel, odeactivate;
-  struct Lisp_Process *p = XPROCESS (proc);
+  Lisp_Object odeactivate;
   ptrdiff_t count = SPECPDL_INDEX ();
   bool outer_running_asynch_code = running_asynch_code;
   int waiting = waiting_for_user_input_p;
 
-  if (inhibit_sentinels)
-    return;
-
   /* No need to gcpro these, because all we do with them later
      is test them for EQness, and none of them should be a string.  */
   odeactivate = Vdeactivate_mark;
@@ -6235,8 +7314,6 @@ exec_sentinel (Lisp_Object proc, Lisp_Object reason)
      friends don't expect current-buffer to be changed from under them.  */
   record_unwind_current_buffer ();
 
-  sentinel = p->sentinel;
-
   /* Inhibit quit so that random quits don't screw up a running filter.  */
   specbind (Qinhibit_quit, Qt);
   specbind (Qlast_nonmenu_event, Qt); /* Why? --Stef  */
@@ -6257,10 +7334,9 @@ exec_sentinel (Lisp_Object proc, Lisp_Object reason)
      save the match data in a special nonrecursive fashion.  */
   running_asynch_code = 1;
 
-  internal_condition_case_1 (read_process_output_call,
-			     list3 (sentinel, proc, reason),
+  internal_condition_case_1 (read_process_output_call, fun_and_args,
 			     !NILP (Vdebug_on_error) ? Qnil : Qerror,
-			     exec_sentinel_error_handler);
+			     handler);
 
   /* If we saved the match data nonrecursively, restore it now.  */
   restore_search_regs ();
@@ -6285,6 +7361,16 @@ exec_sentinel (Lisp_Object proc, Lisp_Object reason)
   unbind_to (count, Qnil);
 }
 
+static void
+exec_sentinel (Lisp_Object proc, Lisp_Object reason)
+{
+  if (inhibit_sentinels)
+    return;
+
+  exec_process_function (list3 (XPROCESS (proc)->sentinel, proc, reason),
+			 exec_sentinel_error_handler);
+}
+
 /* Report all recent events of a change in process status
    (either run the sentinel or output a message).
    This is usually done while Emacs is waiting for keyboard input
@@ -6774,6 +7860,7 @@ add_keyboard_wait_descriptor (int desc)
 #ifdef subprocesses /* actually means "not MSDOS" */
   FD_SET (desc, &input_wait_mask);
   FD_SET (desc, &non_process_wait_mask);
+  update_wait_fd (desc);
   if (desc > max_input_desc)
     max_input_desc = desc;
 #endif
@@ -6787,6 +7874,7 @@ delete_keyboard_wait_descriptor (int desc)
 #ifdef subprocesses
   FD_CLR (desc, &input_wait_mask);
   FD_CLR (desc, &non_process_wait_mask);
+  update_wait_fd (desc);
   delete_input_desc (desc);
 #endif
 }
@@ -7045,9 +8133,21 @@ init_process_emacs (void)
   FD_ZERO (&non_keyboard_wait_mask);
   FD_ZERO (&non_process_wait_mask);
   FD_ZERO (&write_mask);
+  FD_ZERO (&send_queue_mask);
   max_process_desc = max_input_desc = -1;
   memset (fd_callback_info, 0, sizeof (fd_callback_info));
 
+#ifdef USE_EPOLL
+  if (epoll_fd_state)
+    memset (epoll_fd_state, 0, epoll_fd_state_size * sizeof *epoll_fd_state);
+  epoll_nparked = 0;
+#ifdef HAVE_GLIB
+  epoll_nglib = 0;
+#endif
+  max_unpollable_desc = -1;
+  epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+#endif
+
 #ifdef NON_BLOCKING_CONNECT
   FD_ZERO (&connect_wait_mask);
   num_pending_connects = 0;
@@ -7194,6 +8294,8 @@ syms_of_process (void)
 
   staticpro (&Vprocess_alist);
   staticpro (&deleted_pid_list);
+  pending_send_callbacks = Qnil;
+  staticpro (&pending_send_callbacks);
 
 #endif	/* subprocesses */
 
@@ -7310,6 +8412,7 @@ The variable takes effect when `start-process' is called.  */);
   defsubr (&Saccept_process_output);
   defsubr (&Sprocess_send_region);
   defsubr (&Sprocess_send_string);
+  defsubr (&Sprocess_send_queue_size);
   defsubr (&Sinterrupt_process);
   defsubr (&Skill_process);
   defsubr (&Squit_process);
@@ -104,6 +104,9 @@ struct Lisp_Process
     /* Queue for storing waiting writes */
     Lisp_Object write_queue;
 
+    /* Last cons of write_queue, or nil if the queue is empty.  */
+    Lisp_Object write_queue_tail;
+
 #ifdef HAVE_GNUTLS
     Lisp_Object gnutls_cred_type;
 #endif
@@ -123,6 +126,8 @@ struct Lisp_Process
     /* Descriptors that were created for this process and that need
        closing.  Unused entries are negative.  */
     int open_fd[PROCESS_OPEN_FDS];
+    /* Number of bytes left to send in write_queue.  */
+    ptrdiff_t write_queue_bytes;
     /* Event-count of last event in which this process changed status.  */
     EMACS_INT tick;
     /* Event-count of last such event reported.  */
@@ -93,6 +93,9 @@ struct region_cache {
      Yes, buffer_beg is always 1.  It's there for symmetry with
      buffer_end and the BEG and BUF_BEG macros.  */
   ptrdiff_t buffer_beg, buffer_end;
+
+  /* The index of the boundary found by the last search.  */
+  ptrdiff_t hint;
 };
 
 /* Return the position of boundary i in cache c.  */
@@ -143,6 +146,7 @@ new_region_cache (void)
   c->end_unchanged = 0;
   c->buffer_beg = BEG;
   c->buffer_end = BEG;
+  c->hint = 0;
 
   /* Insert the boundary for the buffer start.  */
   c->cache_len++;
@@ -168,13 +172,32 @@ free_region_cache (struct region_cache *c)
    In other words, return the boundary that specifies the value for
    the region POS..(POS + 1).
 
-   This operation should be logarithmic in the number of cache
-   entries.  It would be nice if it took advantage of locality of
-   reference, too, by searching entries near the last entry found.  */
+   This operation is logarithmic in the number of cache entries.  It
+   takes advantage of locality of reference, too, by looking at the
+   last entry found and the next one first; scans over the buffer
+   usually find one of them.  */
 static ptrdiff_t
 find_cache_boundary (struct region_cache *c, ptrdiff_t pos)
 {
   ptrdiff_t low = 0, high = c->cache_len;
+  ptrdiff_t hint = c->hint;
+
+  if (hint < high)
+    {
+      if (pos < BOUNDARY_POS (c, hint))
+	high = hint;
+      else
+	{
+	  low = hint;
+	  if (low + 1 < high)
+	    {
+	      if (pos < BOUNDARY_POS (c, low + 1))
+		high = low + 1;
+	      else
+		low++;
+	    }
+	}
+    }
 
   while (low + 1 < high)
     {
@@ -194,6 +217,7 @@ find_cache_boundary (struct region_cache *c, ptrdiff_t pos)
 	     || (low + 1 < c->cache_len
 		 && BOUNDARY_POS (c, low + 1) <= pos)));
 
+  c->hint = low;
   return low;
 }
 
@@ -665,10 +689,19 @@ revalidate_region_cache (struct buffer *buf, struct region_cache *c)
 void
 know_region_cache (struct buffer *buf, struct region_cache *c,
 		   ptrdiff_t start, ptrdiff_t end)
+{
+  set_region_cache (buf, c, start, end, 1);
+}
+
+/* Set the value of the region of BUF between START and END to VALUE,
+   for the purposes of CACHE.  Zero means unknown.  */
+void
+set_region_cache (struct buffer *buf, struct region_cache *c,
+		  ptrdiff_t start, ptrdiff_t end, int value)
 {
   revalidate_region_cache (buf, c);
 
-  set_cache_region (c, start, end, 1);
+  set_cache_region (c, start, end, value);
 }
 
 
@@ -785,3 +818,197 @@ pp_cache (struct region_cache *c)
 }
 
 #endif /* ENABLE_CHECKING */
+
+
+/* Lisp region caches.  */
+
+/* Return the buffer whose Lisp region caches the current buffer uses.  */
+static struct buffer *
+lisp_region_cache_buffer (void)
+{
+  return (current_buffer->base_buffer
+	  ? current_buffer->base_buffer : current_buffer);
+}
+
+/* Return the Lisp region cache named NAME of the current buffer.  If
+   there is none, make one if CREATE, and return NULL otherwise.  */
+static struct region_cache *
+lisp_region_cache (Lisp_Object name, bool create)
+{
+  struct buffer *b = lisp_region_cache_buffer ();
+  struct lisp_region_cache *p;
+
+  CHECK_SYMBOL (name);
+  for (p = b->lisp_region_caches; p; p = p->next)
+    if (EQ (p->name, name))
+      return p->cache;
+
+  if (!create)
+    return NULL;
+  p = xmalloc (sizeof *p);
+  p->name = name;
+  p->cache = new_region_cache ();
+  p->next = b->lisp_region_caches;
+  b->lisp_region_caches = p;
+  return p->cache;
+}
+
+void
+invalidate_lisp_region_caches (struct buffer *buf,
+			       ptrdiff_t head, ptrdiff_t tail)
+{
+  struct lisp_region_cache *p;
+
+  if (buf->base_buffer)
+    buf = buf->base_buffer;
+  for (p = buf->lisp_region_caches; p; p = p->next)
+    invalidate_region_cache (buf, p->cache, head, tail);
+}
+
+void
+free_lisp_region_caches (struct buffer *buf)
+{
+  while (buf->lisp_region_caches)
+    {
+      struct lisp_region_cache *p = buf->lisp_region_caches;
+      buf->lisp_region_caches = p->next;
+      free_region_cache (p->cache);
+      xfree (p);
+    }
+}
+
+/* Check that POS is an accessible position of the current buffer, and
+   return it as an integer.  */
+static ptrdiff_t
+check_region_cache_pos (Lisp_Object pos)
+{
+  CHECK_NUMBER_COERCE_MARKER (pos);
+  if (! (BEGV <= XINT (pos) && XINT (pos) <= ZV))
+    args_out_of_range (pos, Fcurrent_buffer ());
+  return XINT (pos);
+}
+
+DEFUN ("region-cache-put", Fregion_cache_put, Sregion_cache_put, 4, 4, 0,
+       doc: /* Record VALUE for the text between START and END in CACHE.
+CACHE is a symbol naming a region cache of the current buffer; the
+cache is made if it does not exist yet.  VALUE is a positive integer,
+t, which is the same as 1, or nil, which forgets what was recorded
+about that text.
+
+A region cache remembers facts about stretches of text, such as
+whether they were fontified or parsed.  Each change in the buffer
+forgets what was recorded for the text that changed, so there is no
+need to invalidate the cache by hand.  Indirect buffers share the
+region caches of their base buffer.  */)
+  (Lisp_Object cache, Lisp_Object start, Lisp_Object end, Lisp_Object value)
+{
+  struct region_cache *c;
+  int v;
+
+  CHECK_SYMBOL (cache);
+  validate_region (&start, &end);
+  if (NILP (value))
+    v = 0;
+  else if (EQ (value, Qt))
+    v = 1;
+  else
+    {
+      CHECK_RANGED_INTEGER (value, 1, INT_MAX);
+      v = XINT (value);
+    }
+
+  c = lisp_region_cache (cache, v != 0);
+  if (c)
+    set_region_cache (lisp_region_cache_buffer (), c,
+		      XINT (start), XINT (end), v);
+  return Qnil;
+}
+
+DEFUN ("region-cache-get", Fregion_cache_get, Sregion_cache_get, 2, 2, 0,
+       doc: /* Return the value recorded in CACHE for the character after POS.
+Return nil if nothing is recorded for it.  See `region-cache-put'.  */)
+  (Lisp_Object cache, Lisp_Object pos)
+{
+  ptrdiff_t p = check_region_cache_pos (pos);
+  struct region_cache *c = lisp_region_cache (cache, 0);
+  int v;
+
+  if (!c || p == ZV)
+    return Qnil;
+  v = region_cache_forward (lisp_region_cache_buffer (), c, p, NULL);
+  return v ? make_number (v) : Qnil;
+}
+
+DEFUN ("region-cache-next-change", Fregion_cache_next_change,
+       Sregion_cache_next_change, 2, 3, 0,
+       doc: /* Return the next position after POS where the value in CACHE changes.
+Return the end of the accessible part of the buffer, or LIMIT if it is
+non-nil, when the value does not change before it.  See
+`region-cache-put'.  */)
+  (Lisp_Object cache, Lisp_Object pos, Lisp_Object limit)
+{
+  ptrdiff_t p = check_region_cache_pos (pos);
+  ptrdiff_t lim = NILP (limit) ? ZV : check_region_cache_pos (limit);
+  struct region_cache *c = lisp_region_cache (cache, 0);
+  ptrdiff_t next = lim;
+
+  if (c && p < lim)
+    {
+      region_cache_forward (lisp_region_cache_buffer (), c, p, &next);
+      next = min (next, lim);
+    }
+  return make_number (next);
+}
+
+DEFUN ("region-cache-previous-change", Fregion_cache_previous_change,
+       Sregion_cache_previous_change, 2, 3, 0,
+       doc: /* Return the previous position before POS where the value in CACHE changes.
+Return the start of the accessible part of the buffer, or LIMIT if it
+is non-nil, when the value does not change after it.  See
+`region-cache-put'.  */)
+  (Lisp_Object cache, Lisp_Object pos, Lisp_Object limit)
+{
+  ptrdiff_t p = check_region_cache_pos (pos);
+  ptrdiff_t lim = NILP (limit) ? BEGV : check_region_cache_pos (limit);
+  struct region_cache *c = lisp_region_cache (cache, 0);
+  ptrdiff_t prev = lim;
+
+  if (c && lim < p)
+    {
+      region_cache_backward (lisp_region_cache_buffer (), c, p, &prev);
+      prev = max (prev, lim);
+    }
+  return make_number (prev);
+}
+
+DEFUN ("region-cache-forget", Fregion_cache_forget, Sregion_cache_forget,
+       1, 1, 0,
+       doc: /* Delete the region cache CACHE of the current buffer.
+See `region-cache-put'.  */)
+  (Lisp_Object cache)
+{
+  struct buffer *b = lisp_region_cache_buffer ();
+  struct lisp_region_cache **p;
+
+  CHECK_SYMBOL (cache);
+  for (p = &b->lisp_region_caches; *p; p = &(*p)->next)
+    if (EQ ((*p)->name, cache))
+      {
+	struct lisp_region_cache *dead = *p;
+	*p = dead->next;
+	free_region_cache (dead->cache);
+	xfree (dead);
+	break;
+      }
+  return Qnil;
+}
+
+void
+syms_of_region_cache (void)
+{
+  defsubr (&Sregion_cache_put);
+  defsubr (&Sregion_cache_get);
+  defsubr (&Sregion_cache_next_change);
+  defsubr (&Sregion_cache_previous_change);
+  defsubr (&Sregion_cache_forget);
+}
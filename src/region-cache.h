@@ -61,6 +61,16 @@ along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
    property P or not."  */
 
 
+/* A region cache made from Lisp, named by a symbol.  The Lisp region
+   caches of a buffer are chained from its lisp_region_caches member;
+   indirect buffers use those of their base buffer.  */
+struct lisp_region_cache
+{
+  Lisp_Object name;
+  struct region_cache *cache;
+  struct lisp_region_cache *next;
+};
+
 /* Allocate, initialize and return a new, empty region cache.  */
 struct region_cache *new_region_cache (void);
 
@@ -74,6 +84,14 @@ extern void know_region_cache (struct buffer *BUF,
                                struct region_cache *CACHE,
                                ptrdiff_t START, ptrdiff_t END);
 
+/* Set the value of the region of BUF between START and END to VALUE,
+   for the purposes of CACHE.  Zero means unknown; know_region_cache
+   uses 1.  */
+extern void set_region_cache (struct buffer *BUF,
+                              struct region_cache *CACHE,
+                              ptrdiff_t START, ptrdiff_t END,
+                              int VALUE);
+
 /* Indicate that a section of BUF has changed, to invalidate CACHE.
    HEAD is the number of chars unchanged at the beginning of the buffer.
    TAIL is the number of chars unchanged at the end of the buffer.
@@ -86,6 +104,13 @@ extern void invalidate_region_cache (struct buffer *BUF,
                                      struct region_cache *CACHE,
                                      ptrdiff_t HEAD, ptrdiff_t TAIL);
 
+/* Likewise for all the Lisp region caches of BUF.  */
+extern void invalidate_lisp_region_caches (struct buffer *BUF,
+                                           ptrdiff_t HEAD, ptrdiff_t TAIL);
+
+/* Free all the Lisp region caches of BUF.  */
+extern void free_lisp_region_caches (struct buffer *BUF);
+
 /* The scanning functions.
 
    Basically, if you're scanning forward/backward from position POS,
@@ -613,6 +613,7 @@ newline_cache_on_off (struct buffer *buf)
           free_region_cache (buf->newline_cache);
           buf->newline_cache = 0;
         }
+      clear_line_index (buf);
     }
   else
     {
@@ -622,6 +623,364 @@ newline_cache_on_off (struct buffer *buf)
     }
 }
 
+
+/* The line index: remembering how many newlines precede some
+   positions of a large buffer.
+
+   Each buffer text can have a table of anchors, sorted by byte
+   position, each recording the number of newlines between BEG_BYTE
+   and its position.  Counting the lines before a position then costs
+   a binary search plus a scan of at most LINE_INDEX_INTERVAL bytes,
+   and find_newline uses this to go straight to the part of the
+   buffer that holds the newline it looks for.  The anchors are
+   recorded by these scans themselves, so the index covers the parts
+   of the buffer that were looked at.  Like the newline cache, it is
+   used only when `cache-long-scans' is non-nil.
+
+   insdel.c reports each change through adjust_line_index.  As in the
+   charpos cache of marker.c, the anchors from index SPLIT onward are
+   stored relative to a pending byte delta DELTA_BYTES.  In addition,
+   their line counts are only known up to a common offset, which is
+   recovered by counting the newlines between anchors SPLIT - 1 and
+   SPLIT the next time it is needed.  Thus a series of changes at the
+   same spot costs O(log N) and does not look at the text.  */
+
+struct line_anchor
+{
+  ptrdiff_t bytepos, lines;
+};
+
+struct line_index
+{
+  struct line_anchor *anchors;
+  ptrdiff_t nanchors, size;
+  ptrdiff_t split;
+  ptrdiff_t delta_bytes;
+};
+
+enum
+  {
+    /* Distance in bytes between the anchors recorded by a scan.  */
+    LINE_INDEX_INTERVAL = 16 * 1024,
+    /* Consult the index only for scans that may cover at least this
+       many bytes, looking for at least LINE_INDEX_MIN_COUNT
+       newlines; shorter scans are faster without it.  */
+    LINE_INDEX_MIN_DISTANCE = 4 * LINE_INDEX_INTERVAL,
+    LINE_INDEX_MIN_COUNT = 1000
+  };
+
+void
+clear_line_index (struct buffer *b)
+{
+  struct line_index *li = b->text->line_index;
+
+  if (li)
+    {
+      xfree (li->anchors);
+      xfree (li);
+      b->text->line_index = NULL;
+    }
+}
+
+/* Return the byte position of the Ith anchor of LI.  */
+
+static ptrdiff_t
+line_anchor_bytepos (struct line_index *li, ptrdiff_t i)
+{
+  return li->anchors[i].bytepos + (i < li->split ? 0 : li->delta_bytes);
+}
+
+/* Return the number of anchors of LI that are at or before BYTEPOS.  */
+
+static ptrdiff_t
+line_index_search (struct line_index *li, ptrdiff_t bytepos)
+{
+  ptrdiff_t lo = 0, hi = li->nanchors;
+
+  while (lo < hi)
+    {
+      ptrdiff_t mid = lo + (hi - lo) / 2;
+      if (line_anchor_bytepos (li, mid) <= bytepos)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  return lo;
+}
+
+/* Return the number of newlines in the NBYTES bytes at P.  */
+
+static ptrdiff_t
+count_newlines_in_bytes (unsigned char const *p, ptrdiff_t nbytes)
+{
+  uint64_t const ones = 0x0101010101010101, lows = 0x7f7f7f7f7f7f7f7f;
+  uint64_t const newlines = ones * '\n';
+  ptrdiff_t count = 0;
+
+  /* Look at a word at a time.  After XORing with NEWLINES, a byte of
+     X is zero exactly for a newline, and then only that byte of the
+     complemented value below has its high bit set.  */
+  for (; nbytes >= sizeof (uint64_t);
+       p += sizeof (uint64_t), nbytes -= sizeof (uint64_t))
+    {
+      uint64_t x;
+      memcpy (&x, p, sizeof x);
+      x ^= newlines;
+      x = ~(((x & lows) + lows) | x | lows);
+      count += (x >> 7) * ones >> 56;
+    }
+  for (; nbytes > 0; p++, nbytes--)
+    count += *p == '\n';
+  return count;
+}
+
+/* Return the number of newlines between FROM_BYTE and TO_BYTE in the
+   current buffer.  */
+
+static ptrdiff_t
+count_newlines (ptrdiff_t from_byte, ptrdiff_t to_byte)
+{
+  ptrdiff_t count = 0;
+
+  if (from_byte < GPT_BYTE)
+    {
+      ptrdiff_t ceiling = min (to_byte, GPT_BYTE);
+      count = count_newlines_in_bytes (BYTE_POS_ADDR (from_byte),
+				       ceiling - from_byte);
+      from_byte = ceiling;
+    }
+  if (from_byte < to_byte)
+    count += count_newlines_in_bytes (BYTE_POS_ADDR (from_byte),
+				      to_byte - from_byte);
+  return count;
+}
+
+/* Fold the pending changes of LI into its anchors.  The newlines
+   between anchors SPLIT - 1 and SPLIT are counted in the current
+   text; but if that part of the text is at or after SHIFT_FROM, it
+   is taken to have moved by SHIFT bytes, for the benefit of
+   adjust_line_index, which is called after some changes.  */
+
+static void
+line_index_flush (struct line_index *li, ptrdiff_t shift_from,
+		  ptrdiff_t shift)
+{
+  ptrdiff_t i = li->split, lo, hi, delta_lines;
+
+  if (i == li->nanchors)
+    return;
+
+  lo = i > 0 ? li->anchors[i - 1].bytepos : BEG_BYTE;
+  hi = line_anchor_bytepos (li, i);
+  if (lo >= shift_from)
+    lo += shift, hi += shift;
+  delta_lines = ((i > 0 ? li->anchors[i - 1].lines : 0)
+		 + count_newlines (lo, hi) - li->anchors[i].lines);
+
+  for (; i < li->nanchors; i++)
+    {
+      li->anchors[i].bytepos += li->delta_bytes;
+      li->anchors[i].lines += delta_lines;
+    }
+  li->split = li->nanchors;
+  li->delta_bytes = 0;
+}
+
+/* Return the number of newlines between BEG_BYTE and BYTEPOS in the
+   current buffer, whose line index is LI, recording new anchors on
+   the way.  If ALLOW_QUIT, allow quitting.  */
+
+static ptrdiff_t
+line_index_lines_before (struct line_index *li, ptrdiff_t bytepos,
+			 bool allow_quit)
+{
+  bool multibyte = !NILP (BVAR (current_buffer, enable_multibyte_characters));
+  ptrdiff_t i, pos, lines;
+
+  if (li->split < li->nanchors
+      && line_anchor_bytepos (li, li->split) <= bytepos)
+    line_index_flush (li, 0, 0);
+
+  i = line_index_search (li, bytepos);
+  pos = i > 0 ? li->anchors[i - 1].bytepos : BEG_BYTE;
+  lines = i > 0 ? li->anchors[i - 1].lines : 0;
+
+  while (bytepos - pos > LINE_INDEX_INTERVAL)
+    {
+      ptrdiff_t next = pos + LINE_INDEX_INTERVAL;
+
+      /* Keep anchors at character boundaries, so that find_newline
+	 can start scanning from them.  */
+      if (multibyte)
+	while (! CHAR_HEAD_P (FETCH_BYTE (next)))
+	  next++;
+      lines += count_newlines (pos, next);
+      pos = next;
+
+      if (li->nanchors == li->size)
+	li->anchors = xpalloc (li->anchors, &li->size, 1, -1,
+			       sizeof *li->anchors);
+      memmove (li->anchors + i + 1, li->anchors + i,
+	       (li->nanchors - i) * sizeof *li->anchors);
+      li->anchors[i].bytepos = pos;
+      li->anchors[i].lines = lines;
+      li->nanchors++;
+      li->split++;
+      i++;
+
+      if (allow_quit)
+	QUIT;
+    }
+
+  return lines + count_newlines (pos, bytepos);
+}
+
+/* Update the line index of the current buffer for a replacement of
+   the OLD_BYTES bytes of text at FROM_BYTE by NEW_BYTES bytes.
+   Insertions and deletions are the special cases where OLD_BYTES or
+   NEW_BYTES is zero.  TEXT_CHANGED says whether the buffer text
+   already reflects the change.  */
+
+void
+adjust_line_index (ptrdiff_t from_byte, ptrdiff_t old_bytes,
+		   ptrdiff_t new_bytes, bool text_changed)
+{
+  struct line_index *li = current_buffer->text->line_index;
+  ptrdiff_t to_byte = from_byte + old_bytes;
+  ptrdiff_t first, last;
+  bool merge = 0;
+
+  if (! li || li->nanchors == 0)
+    return;
+
+  /* If there are pending changes elsewhere, fold them in first.
+     Otherwise, this change just widens the stretch of text whose
+     newlines are not accounted for yet.  */
+  if (li->split < li->nanchors)
+    {
+      ptrdiff_t lo = (li->split > 0
+		      ? li->anchors[li->split - 1].bytepos : BEG_BYTE);
+      ptrdiff_t hi = line_anchor_bytepos (li, li->split);
+
+      if (to_byte < lo || hi < from_byte)
+	line_index_flush (li, to_byte,
+			  text_changed ? new_bytes - old_bytes : 0);
+      else
+	merge = 1;
+    }
+
+  /* Anchors after FROM_BYTE and before TO_BYTE become meaningless;
+     those after the change move by its length, and lose track of
+     their line count.  When merging, drop all anchors of the merged
+     stretch, so that the ones after it share the same offset.  */
+  first = line_index_search (li, from_byte);
+  last = old_bytes > 0 ? line_index_search (li, to_byte - 1) : first;
+  if (merge)
+    {
+      first = min (first, li->split);
+      last = max (last, li->split);
+    }
+
+  if (last > first)
+    {
+      memmove (li->anchors + first, li->anchors + last,
+	       (li->nanchors - last) * sizeof *li->anchors);
+      li->nanchors -= last - first;
+    }
+
+  li->split = first;
+  if (li->split < li->nanchors)
+    li->delta_bytes += new_bytes - old_bytes;
+  else
+    li->delta_bytes = 0;
+}
+
+/* If the line index of the current buffer can help to find *COUNT
+   newlines between *START_BYTE and END_BYTE (see find_newline), use
+   it to move *START_BYTE closer to the *COUNTth newline and set
+   *COUNT to the number of newlines left to find from there, or to
+   move *START_BYTE to END_BYTE and set *COUNT to the number of
+   newlines that are missing, and return true.  Otherwise, return
+   false.  The caller checks that `cache-long-scans' is non-nil and
+   that *COUNT is large enough.  */
+
+static bool
+find_newline_with_index (ptrdiff_t *start_byte, ptrdiff_t end_byte,
+			 ptrdiff_t *count, bool allow_quit)
+{
+  struct line_index *li = current_buffer->text->line_index;
+  ptrdiff_t start_lines, end_lines, target, lo, hi, limit;
+
+  if (eabs (end_byte - *start_byte) < LINE_INDEX_MIN_DISTANCE)
+    return 0;
+
+  if (! li)
+    {
+      li = xzalloc (sizeof *li);
+      current_buffer->text->line_index = li;
+    }
+
+  start_lines = line_index_lines_before (li, *start_byte, allow_quit);
+  end_lines = line_index_lines_before (li, end_byte, allow_quit);
+
+  /* All anchors up to the larger of the two positions are now up to
+     date.  TARGET is the number of the newline we look for, counting
+     from zero at BEG.  */
+  if (*count > 0)
+    {
+      if (end_lines - start_lines < *count)
+	{
+	  *start_byte = end_byte;
+	  *count -= end_lines - start_lines;
+	  return 1;
+	}
+      target = start_lines + *count - 1;
+
+      /* Find the last anchor before that newline.  */
+      lo = 0, hi = line_index_search (li, end_byte);
+      while (lo < hi)
+	{
+	  ptrdiff_t mid = lo + (hi - lo) / 2;
+	  if (li->anchors[mid].lines <= target)
+	    lo = mid + 1;
+	  else
+	    hi = mid;
+	}
+      if (lo > 0 && li->anchors[lo - 1].bytepos > *start_byte)
+	{
+	  *start_byte = li->anchors[lo - 1].bytepos;
+	  *count = target - li->anchors[lo - 1].lines + 1;
+	}
+    }
+  else
+    {
+      if (start_lines - end_lines < - *count)
+	{
+	  *start_byte = end_byte;
+	  *count += start_lines - end_lines;
+	  return 1;
+	}
+      target = start_lines + *count;
+
+      /* Find the first anchor after that newline.  */
+      lo = 0, hi = limit = line_index_search (li, *start_byte);
+      while (lo < hi)
+	{
+	  ptrdiff_t mid = lo + (hi - lo) / 2;
+	  if (li->anchors[mid].lines <= target)
+	    lo = mid + 1;
+	  else
+	    hi = mid;
+	}
+      if (lo < limit && li->anchors[lo].bytepos < *start_byte)
+	{
+	  *start_byte = li->anchors[lo].bytepos;
+	  *count = target - li->anchors[lo].lines;
+	}
+    }
+  return 1;
+}
+
 
 /* Search for COUNT newlines between START/START_BYTE and END/END_BYTE.
 
@@ -672,6 +1031,28 @@ find_newline (ptrdiff_t start, ptrdiff_t start_byte, ptrdiff_t end,
   newline_cache_on_off (current_buffer);
   newline_cache = current_buffer->newline_cache;
 
+  /* When looking for many newlines, let the line index skip over
+     most of them.  What is left to scan is then short, and not worth
+     recording in the newline cache.  */
+  if (eabs (count) >= LINE_INDEX_MIN_COUNT
+      && !NILP (BVAR (current_buffer, cache_long_scans)))
+    {
+      ptrdiff_t old_start_byte;
+
+      if (start_byte == -1)
+	start_byte = CHAR_TO_BYTE (start);
+      old_start_byte = start_byte;
+      if (find_newline_with_index (&start_byte, end_byte, &count,
+				   allow_quit))
+	{
+	  newline_cache = NULL;
+	  if (start_byte == end_byte)
+	    start = end;
+	  else if (start_byte != old_start_byte)
+	    start = BYTE_TO_CHAR (start_byte);
+	}
+    }
+
   if (shortage != 0)
     *shortage = 0;
 
@@ -47,6 +47,107 @@ Lisp_Object Qapply;
    an undo-boundary.  */
 static Lisp_Object pending_boundary;
 
+/* Kinds of packed undo records, and the list elements they stand for.  */
+enum undo_record_kind
+  {
+    UNDO_POINT,			/* POSITION */
+    UNDO_INSERT,		/* (BEG . END) */
+    UNDO_DELETE			/* (TEXT . POSITION) */
+  };
+
+/* A packed undo record.  The record of a deletion is followed by the
+   bytes of the deleted text, padded to a multiple of the size of
+   ptrdiff_t.  */
+struct undo_record
+{
+  enum undo_record_kind kind;
+
+  /* For UNDO_DELETE, whether the deleted text was multibyte.  */
+  bool multibyte;
+
+  /* The position or beginning of the change.  */
+  ptrdiff_t pos;
+
+  /* For UNDO_INSERT, the end of the insertion.  For UNDO_DELETE, the
+     number of characters deleted.  */
+  ptrdiff_t length;
+
+  /* Number of bytes of text after the record.  */
+  ptrdiff_t nbytes;
+};
+
+/* Return the size of a packed undo record with NBYTES bytes of text.  */
+
+static ptrdiff_t
+undo_record_size (ptrdiff_t nbytes)
+{
+  ptrdiff_t align = sizeof (ptrdiff_t);
+  return sizeof (struct undo_record) + (nbytes + align - 1) / align * align;
+}
+
+/* Append a record of KIND with room for NBYTES bytes of text to the
+   packed undo records of the current buffer, and return it.
+   LISP_SIZE is the size of the list element it stands for.  */
+
+static struct undo_record *
+push_undo_record (enum undo_record_kind kind, ptrdiff_t nbytes,
+		  EMACS_INT lisp_size)
+{
+  struct undo_log *log = &current_buffer->undo_log;
+  ptrdiff_t size = undo_record_size (nbytes);
+  struct undo_record *r;
+
+  if (log->allocated - log->used < size)
+    log->records = xpalloc (log->records, &log->allocated,
+			    size - (log->allocated - log->used), -1, 1);
+  r = (struct undo_record *) (log->records + log->used);
+  r->kind = kind;
+  r->multibyte = 0;
+  r->nbytes = nbytes;
+  log->last = log->used;
+  log->used += size;
+  log->lisp_size += lisp_size;
+  return r;
+}
+
+/* Put the packed undo records of buffer B on its undo list, as the
+   list elements they stand for.  */
+
+void
+unpack_undo_log (struct buffer *b)
+{
+  struct undo_log *log = &b->undo_log;
+  Lisp_Object list, elt;
+  ptrdiff_t i;
+
+  if (log->used == 0)
+    return;
+
+  list = BVAR (b, undo_list);
+  for (i = 0; i < log->used; )
+    {
+      struct undo_record *r = (struct undo_record *) (log->records + i);
+
+      switch (r->kind)
+	{
+	case UNDO_POINT:
+	  elt = make_number (r->pos);
+	  break;
+	case UNDO_INSERT:
+	  elt = Fcons (make_number (r->pos), make_number (r->length));
+	  break;
+	default:
+	  elt = Fcons (make_specified_string ((char *) (r + 1), r->length,
+					      r->nbytes, r->multibyte),
+		       make_number (r->pos));
+	  break;
+	}
+      list = Fcons (elt, list);
+      i += undo_record_size (r->nbytes);
+    }
+  bset_undo_list (b, list);
+}
+
 /* Record point as it was at beginning of this command (if necessary)
    and prepare the undo info for recording a change.
    PT is the position of point that will naturally occur as a result of the
@@ -75,7 +176,10 @@ record_point (ptrdiff_t pt)
     Fundo_boundary ();
   last_undo_buffer = current_buffer;
 
-  if (CONSP (BVAR (current_buffer, undo_list)))
+  /* Packed records are never boundaries or marker adjustments.  */
+  if (current_buffer->undo_log.used)
+    at_boundary = 0;
+  else if (CONSP (BVAR (current_buffer, undo_list)))
     {
       /* Set AT_BOUNDARY to 1 only when we have nothing other than
          marker adjustment before undo boundary.  */
@@ -105,9 +209,15 @@ record_point (ptrdiff_t pt)
   if (at_boundary
       && current_buffer == last_boundary_buffer
       && last_boundary_position != pt)
-    bset_undo_list (current_buffer,
-		    Fcons (make_number (last_boundary_position),
-			   BVAR (current_buffer, undo_list)));
+    {
+      if (undo_packed_records)
+	push_undo_record (UNDO_POINT, 0, sizeof (struct Lisp_Cons))->pos
+	  = last_boundary_position;
+      else
+	bset_undo_list (current_buffer,
+			Fcons (make_number (last_boundary_position),
+			       BVAR (current_buffer, undo_list)));
+    }
 }
 
 /* Record an insertion that just happened or is about to happen,
@@ -119,6 +229,7 @@ void
 record_insert (ptrdiff_t beg, ptrdiff_t length)
 {
   Lisp_Object lbeg, lend;
+  struct undo_log *log = &current_buffer->undo_log;
 
   if (EQ (BVAR (current_buffer, undo_list), Qt))
     return;
@@ -127,7 +238,17 @@ record_insert (ptrdiff_t beg, ptrdiff_t length)
 
   /* If this is following another insertion and consecutive with it
      in the buffer, combine the two.  */
-  if (CONSP (BVAR (current_buffer, undo_list)))
+  if (log->used)
+    {
+      struct undo_record *r = (struct undo_record *) (log->records
+						      + log->last);
+      if (r->kind == UNDO_INSERT && r->length == beg)
+	{
+	  r->length = beg + length;
+	  return;
+	}
+    }
+  else if (CONSP (BVAR (current_buffer, undo_list)))
     {
       Lisp_Object elt;
       elt = XCAR (BVAR (current_buffer, undo_list));
@@ -141,6 +262,16 @@ record_insert (ptrdiff_t beg, ptrdiff_t length)
 	}
     }
 
+  if (undo_packed_records)
+    {
+      struct undo_record *r
+	= push_undo_record (UNDO_INSERT, 0, 2 * sizeof (struct Lisp_Cons));
+      r->pos = beg;
+      r->length = beg + length;
+      return;
+    }
+
+  unpack_undo_log (current_buffer);
   XSETFASTINT (lbeg, beg);
   XSETINT (lend, beg + length);
   bset_undo_list (current_buffer,
@@ -169,6 +300,22 @@ record_delete (ptrdiff_t beg, Lisp_Object string)
       record_point (beg);
     }
 
+  /* Text properties of the deleted text need the Lisp string.  */
+  if (undo_packed_records && ! string_intervals (string))
+    {
+      struct undo_record *r
+	= push_undo_record (UNDO_DELETE, SBYTES (string),
+			    (2 * sizeof (struct Lisp_Cons)
+			     + sizeof (struct Lisp_String) - 1
+			     + SCHARS (string)));
+      r->pos = XINT (sbeg);
+      r->length = SCHARS (string);
+      r->multibyte = STRING_MULTIBYTE (string);
+      memcpy (r + 1, SDATA (string), SBYTES (string));
+      return;
+    }
+
+  unpack_undo_log (current_buffer);
   bset_undo_list
     (current_buffer,
      Fcons (Fcons (string, sbeg), BVAR (current_buffer, undo_list)));
@@ -193,6 +340,7 @@ record_marker_adjustment (Lisp_Object marker, ptrdiff_t adjustment)
     Fundo_boundary ();
   last_undo_buffer = current_buffer;
 
+  unpack_undo_log (current_buffer);
   bset_undo_list
     (current_buffer,
      Fcons (Fcons (marker, make_number (adjustment)),
@@ -229,6 +377,7 @@ record_first_change (void)
   if (base_buffer->base_buffer)
     base_buffer = base_buffer->base_buffer;
 
+  unpack_undo_log (current_buffer);
   bset_undo_list (current_buffer,
 		  Fcons (Fcons (Qt, Fvisited_file_modtime ()),
 			 BVAR (current_buffer, undo_list)));
@@ -269,6 +418,7 @@ record_property_change (ptrdiff_t beg, ptrdiff_t length,
   XSETINT (lbeg, beg);
   XSETINT (lend, beg + length);
   entry = Fcons (Qnil, Fcons (prop, Fcons (value, Fcons (lbeg, lend))));
+  unpack_undo_log (current_buffer);
   bset_undo_list (current_buffer,
 		  Fcons (entry, BVAR (current_buffer, undo_list)));
 
@@ -284,6 +434,7 @@ but another undo command will undo to the previous boundary.  */)
   Lisp_Object tem;
   if (EQ (BVAR (current_buffer, undo_list), Qt))
     return Qnil;
+  unpack_undo_log (current_buffer);
   tem = Fcar (BVAR (current_buffer, undo_list));
   if (!NILP (tem))
     {
@@ -315,7 +466,8 @@ truncate_undo_list (struct buffer *b)
 {
   Lisp_Object list;
   Lisp_Object prev, next, last_boundary;
-  EMACS_INT size_so_far = 0;
+  /* Packed records are the most recent ones, in front of the list.  */
+  EMACS_INT size_so_far = b->undo_log.lisp_size;
 
   /* Make sure that calling undo-outer-limit-function
      won't cause another GC.  */
@@ -334,7 +486,7 @@ truncate_undo_list (struct buffer *b)
   last_boundary = Qnil;
 
   /* If the first element is an undo boundary, skip past it.  */
-  if (CONSP (next) && NILP (XCAR (next)))
+  if (b->undo_log.used == 0 && CONSP (next) && NILP (XCAR (next)))
     {
       /* Add in the space occupied by this element and its chain link.  */
       size_so_far += sizeof (struct Lisp_Cons);
@@ -437,9 +589,10 @@ truncate_undo_list (struct buffer *b)
   /* Truncate at the boundary where we decided to truncate.  */
   else if (!NILP (last_boundary))
     XSETCDR (last_boundary, Qnil);
-  /* There's nothing we decided to keep, so clear it out.  */
+  /* There's nothing we decided to keep, so clear it out, except for
+     the packed records.  */
   else
-    bset_undo_list (b, Qnil);
+    b->INTERNAL_FIELD (undo_list) = Qnil;
 
   unbind_to (count, Qnil);
 }
@@ -512,4 +665,13 @@ so it must make sure not to do a lot of consing.  */);
   DEFVAR_BOOL ("undo-inhibit-record-point", undo_inhibit_record_point,
 	       doc: /* Non-nil means do not record `point' in `buffer-undo-list'.  */);
   undo_inhibit_record_point = 0;
+
+  DEFVAR_BOOL ("undo-packed-records", undo_packed_records,
+	       doc: /* Non-nil means record changes for undo in a packed form.
+Insertions, deletions of text without properties and positions of
+point are then recorded without consing, and put on `buffer-undo-list'
+only when the current command ends or something looks at the list.
+This makes commands that change a buffer in many places cheaper, and
+the garbage collections that happen during them shorter.  */);
+  undo_packed_records = 0;
 }
@@ -0,0 +1,318 @@
+;;; buffer-tests.el --- tests for src/buffer.c
+
+;; Copyright (C) 2013 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; This program is free software: you can redistribute it and/or
+;; modify it under the terms of the GNU General Public License as
+;; published by the Free Software Foundation, either version 3 of the
+;; License, or (at your option) any later version.
+;;
+;; This program is distributed in the hope that it will be useful, but
+;; WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+;; General Public License for more details.
+;;
+;; You should have received a copy of the GNU General Public License
+;; along with this program.  If not, see `http://www.gnu.org/licenses/'.
+
+;;; Commentary:
+
+;;; Code:
+
+(require 'cl-lib)
+
+(defun buffer-tests--sort-overlays (overlays)
+  (sort (copy-sequence overlays)
+	(lambda (o1 o2)
+	  (or (< (overlay-start o1) (overlay-start o2))
+	      (and (= (overlay-start o1) (overlay-start o2))
+		   (< (overlay-end o1) (overlay-end o2)))
+	      (and (= (overlay-start o1) (overlay-start o2))
+		   (= (overlay-end o1) (overlay-end o2))
+		   (< (overlay-get o1 'n) (overlay-get o2 'n)))))))
+
+(defun buffer-tests--check-overlays (overlays pos beg end)
+  "Check the overlay primitives at POS and in BEG..END against OVERLAYS."
+  (let ((all (cl-remove-if-not #'overlay-buffer overlays)))
+    (should (equal (buffer-tests--sort-overlays (overlays-at pos))
+		   (buffer-tests--sort-overlays
+		    (cl-remove-if-not
+		     (lambda (o) (and (<= (overlay-start o) pos)
+				      (< pos (overlay-end o))))
+		     all))))
+    (should (equal (buffer-tests--sort-overlays (overlays-in beg end))
+		   (buffer-tests--sort-overlays
+		    (cl-remove-if-not
+		     (lambda (o)
+		       (let ((s (overlay-start o)) (e (overlay-end o)))
+			 (or (and (< beg e) (< s end))
+			     (and (= s e)
+				  (or (= beg e)
+				      (and (= end (1+ (buffer-size)))
+					   (= e end)))))))
+		     all))))
+    (should (= (next-overlay-change pos)
+	       (apply #'min (point-max)
+		      (delq nil
+			    (mapcar (lambda (o)
+				      (let ((s (overlay-start o))
+					    (e (overlay-end o)))
+					(cond ((< pos s) s)
+					      ((< pos e) e))))
+				    all)))))
+    (unless (= pos (point-min))
+      (should (= (previous-overlay-change pos)
+		 (apply #'max (point-min)
+			(delq nil
+			      (mapcar (lambda (o)
+					(let ((s (overlay-start o))
+					      (e (overlay-end o)))
+					  (cond ((< e pos) e)
+						((< s pos) s))))
+				      all))))))))
+
+(ert-deftest buffer-tests-many-overlays ()
+  "Check overlay lookups in a buffer with enough overlays to be indexed."
+  (with-temp-buffer
+    (insert (make-string 2000 ?x))
+    (let ((overlays
+	   (cl-loop for n below 300
+		    for beg = (1+ (random 2000))
+		    for ov = (make-overlay beg (min (point-max)
+						    (+ beg (random 100)))
+					   nil (zerop (random 2))
+					   (zerop (random 2)))
+		    do (overlay-put ov 'n n)
+		    collect ov)))
+      (dotimes (i 300)
+	(pcase (random 5)
+	  (0 (goto-char (1+ (random (buffer-size))))
+	     (insert (make-string (random 20) ?y)))
+	  (1 (let ((beg (1+ (random (buffer-size)))))
+	       (delete-region beg (min (point-max) (+ beg (random 20))))))
+	  (2 (let ((beg (1+ (random (buffer-size)))))
+	       (move-overlay (nth (random 300) overlays)
+			     beg (min (point-max) (+ beg (random 100))))))
+	  (3 (delete-overlay (nth (random 300) overlays)))
+	  (4 (let ((beg (1+ (random (buffer-size)))))
+	       (push (make-overlay beg beg) overlays)
+	       (overlay-put (car overlays) 'n (+ 300 i)))))
+	(let ((pos (1+ (random (buffer-size))))
+	      (beg (1+ (random (buffer-size)))))
+	  (buffer-tests--check-overlays
+	   overlays pos beg
+	   (if (zerop (random 4)) (point-max)
+	     (min (point-max) (+ beg (random 50))))))))))
+
+;; Edits that move overlay boundaries past each other.
+
+(defun buffer-tests--boundary ()
+  "Return one of the few positions where the test overlays start or end."
+  (1+ (* 10 (random (max 1 (/ (buffer-size) 10))))))
+
+(defun buffer-tests--make-overlays (n)
+  "Make N overlays in the current buffer, most of them starting or
+ending at the same few positions."
+  (cl-loop for i below n
+	   for beg = (buffer-tests--boundary)
+	   for ov = (make-overlay beg (min (point-max)
+					   (+ beg (* 10 (random 3))))
+				  nil (zerop (random 2)) (zerop (random 2)))
+	   do (overlay-put ov 'n i)
+	   collect ov))
+
+(ert-deftest buffer-tests-many-overlays-edits ()
+  "Check overlay lookups after edits at the boundaries of indexed overlays."
+  (with-temp-buffer
+    (buffer-enable-undo)
+    (insert (make-string 500 ?x))
+    (let ((overlays (buffer-tests--make-overlays 200)))
+      (dotimes (i 200)
+	(let ((pos (buffer-tests--boundary)))
+	  (pcase (random 6)
+	    (0 (goto-char pos) (insert "yyyyyyyyyy"))
+	    (1 (goto-char pos) (insert-before-markers "yyyyyyyyyy"))
+	    (2 (delete-region pos (min (point-max) (+ pos 10))))
+	    (3 (let ((end (min (point-max) (+ pos 10))))
+		 (goto-char pos)
+		 (when (re-search-forward "x+" end t)
+		   (replace-match "zzz"))))
+	    (4 (when (< (+ pos 20) (point-max))
+		 (transpose-regions pos (+ pos 10) (+ pos 10) (+ pos 20))))
+	    (5 (undo-boundary)
+	       (delete-region pos (min (point-max) (+ pos 30)))
+	       (undo-boundary)
+	       (primitive-undo 1 buffer-undo-list))))
+	(let ((pos (1+ (random (buffer-size))))
+	      (beg (1+ (random (buffer-size)))))
+	  (buffer-tests--check-overlays
+	   overlays pos beg (min (point-max) (+ beg (random 30)))))))))
+
+(ert-deftest buffer-tests-many-overlays-indirect ()
+  "Check the overlays of an indirect buffer after editing its base."
+  (with-temp-buffer
+    (insert (make-string 500 ?x))
+    (let* ((base (current-buffer))
+	   (indirect (make-indirect-buffer base " *overlays-indirect*"))
+	   overlays)
+      (unwind-protect
+	  (progn
+	    (with-current-buffer indirect
+	      (setq overlays (buffer-tests--make-overlays 200)))
+	    (dotimes (_ 100)
+	      (let ((pos (buffer-tests--boundary)))
+		(if (zerop (random 2))
+		    (progn (goto-char pos) (insert "yyyyyyyyyy"))
+		  (delete-region pos (min (point-max) (+ pos 10)))))
+	      (with-current-buffer indirect
+		(let ((pos (1+ (random (buffer-size)))))
+		  (buffer-tests--check-overlays
+		   overlays pos pos (min (point-max) (+ pos 20)))))))
+	(kill-buffer indirect)))))
+
+(ert-deftest buffer-tests-gap-statistics ()
+  "Check the gap statistics and the growth of the gap."
+  (with-temp-buffer
+    (let ((gc-cons-threshold most-positive-fixnum)
+	  (stats (buffer-gap-statistics))
+	  (chunk (make-string 4000 ?x)))
+      (should (equal stats '(0 0 0)))
+      ;; Inserting text chunk by chunk reallocates the text a
+      ;; logarithmic number of times.
+      (dotimes (_ 100)
+	(insert chunk))
+      (setq stats (buffer-gap-statistics))
+      (should (= (car stats) 0))
+      (should (< 0 (nth 2 stats) 20))
+      (goto-char (point-min))
+      (insert "x")
+      (goto-char (point-max))
+      (insert "x")
+      (should (equal (buffer-gap-statistics (current-buffer))
+		     (buffer-gap-statistics)))
+      (should (= (car (buffer-gap-statistics)) 2))
+      (should (>= (nth 1 (buffer-gap-statistics))
+		  (+ (nth 1 stats) (* 2 400000)))))))
+
+(ert-deftest buffer-tests-gap-fraction ()
+  "Check that the gap of a huge buffer grows with the buffer at once."
+  (with-temp-buffer
+    (let ((gc-cons-threshold most-positive-fixnum)
+	  (chunk (make-string 1000 ?x))
+	  reallocs)
+      (insert (make-string (* 8 1024 1024) ?x))
+      (setq reallocs (nth 2 (buffer-gap-statistics)))
+      ;; 1/64 of the text is more than all these chunks together.
+      (dotimes (_ 100)
+	(insert chunk))
+      (should (<= (- (nth 2 (buffer-gap-statistics)) reallocs) 1)))))
+
+;; Replacing several regions at once.
+
+(defun buffer-tests--random-edits (size)
+  "Return a random list of non-overlapping edits of a buffer of SIZE chars."
+  (let ((pos 1) edits)
+    (while (< pos size)
+      (let* ((start (min size (+ pos (random 20))))
+	     (end (min size (+ start (random 5)))))
+	(push (list start end
+		    (apply #'string
+			   (mapcar (lambda (_) (if (zerop (random 5)) ?é ?y))
+				   (make-list (random 6) nil))))
+	      edits)
+	(setq pos end)))
+    edits))
+
+(ert-deftest buffer-tests-replace-regions ()
+  "Compare `replace-regions' with making the replacements one by one."
+  (random "replace-regions")
+  (dotimes (_ 20)
+    (let* ((text (apply #'string
+			(mapcar (lambda (_) (+ ?a (random 26)))
+				(make-list 300 nil))))
+	   (edits (buffer-tests--random-edits 301))
+	   (positions (mapcar (lambda (_) (1+ (random 301)))
+			      (make-list 30 nil)))
+	   results)
+      (dolist (batch '(nil t))
+	(with-temp-buffer
+	  (buffer-enable-undo)
+	  (insert text)
+	  (setq buffer-undo-list nil)
+	  (let ((markers (mapcar #'copy-marker positions))
+		(overlays (cl-mapcar #'make-overlay positions
+				     (reverse positions))))
+	    (dolist (ov overlays)
+	      (overlay-put ov 'evaporate t))
+	    (if batch
+		(replace-regions (reverse edits))
+	      ;; The edits are in descending order.
+	      (dolist (edit edits)
+		(set-match-data (list (nth 0 edit) (nth 1 edit)))
+		(replace-match (nth 2 edit) t t)))
+	    (push (list (buffer-string) (mapcar #'marker-position markers)
+			(mapcar (lambda (ov)
+				  (list (overlay-start ov) (overlay-end ov)))
+				overlays)
+			(length (overlays-in (point-min) (point-max))))
+		  results)
+	    (primitive-undo (length buffer-undo-list) buffer-undo-list)
+	    (should (equal (buffer-string) text)))))
+      (should (equal (car results) (cadr results))))))
+
+(ert-deftest buffer-tests-replace-regions-hooks ()
+  "Check the change hooks, point and errors of `replace-regions'."
+  (with-temp-buffer
+    (insert "one two three four")
+    (let* ((calls nil)
+	   (before-change-functions
+	    (list (lambda (beg end) (push (list 'before beg end) calls))))
+	   (after-change-functions
+	    (list (lambda (beg end len) (push (list 'after beg end len) calls)))))
+      (goto-char 10)
+      (replace-regions '((15 19 "4") (1 4 "1") (5 8 "")))
+      (should (equal (buffer-string) "1  three 4"))
+      (should (= (point) 5))
+      (should (equal (nreverse calls) '((before 1 19) (after 1 11 18))))
+      (setq calls nil)
+      (should-error (replace-regions '((1 5 "x") (3 7 "y"))))
+      (should-error (replace-regions '((1 50 "x"))))
+      (should-error (replace-regions '((1 2 x))))
+      (should (equal (buffer-string) "1  three 4"))
+      (should-not calls)
+      (replace-regions '((3 3 "a") (3 3 "b")))
+      (should (equal (buffer-string) "1 ab three 4")))))
+
+(ert-deftest buffer-tests-replace-regions-read-only ()
+  "Check that only the replaced text of `replace-regions' must be writable."
+  (with-temp-buffer
+    (insert "one two three")
+    (put-text-property 5 8 'read-only t)
+    (let ((hooks nil))
+      (put-text-property 1 4 'modification-hooks
+			 (list (lambda (beg end) (push (list beg end) hooks))))
+      (replace-regions '((1 4 "1") (9 14 "3")))
+      (should (equal (buffer-string) "1 two 3"))
+      (should (equal hooks '((1 4)))))
+    (should-error (replace-regions '((1 2 "x") (3 5 "y")))
+		  :type 'text-read-only)
+    (should (equal (buffer-string) "1 two 3"))))
+
+(ert-deftest buffer-tests-replace-regions-hook-edits ()
+  "Check that `replace-regions' does not replace stale regions."
+  (with-temp-buffer
+    (insert "one two three")
+    (let ((before-change-functions
+	   (list (lambda (_beg _end)
+		   (save-excursion (goto-char 1) (insert "zero "))))))
+      (should-error (replace-regions '((1 4 "1") (9 14 "3"))))
+      (should (equal (buffer-string) "zero one two three")))
+    ;; Changing only text properties leaves the positions valid.
+    (let ((before-change-functions
+	   (list (lambda (beg end) (put-text-property beg end 'face 'bold)))))
+      (replace-regions '((6 9 "1") (14 19 "3")))
+      (should (equal (buffer-string) "zero 1 two 3")))))
+
+;;; buffer-tests.el ends here
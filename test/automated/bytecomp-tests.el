@@ -275,6 +275,126 @@ bytecompiled code, and their results compared.")
   (dolist (pat byte-opt-testsuite-arith-data)
     (should (bytecomp-check-1 pat))))
 
+(ert-deftest bytecomp-tests-call-cache ()
+  "Test that compiled calls follow changes of the functions they call."
+  (let* ((lexical-binding t)
+	 (caller (byte-compile '(lambda (x) (bytecomp-tests--callee x)))))
+    (unwind-protect
+	(progn
+	  (fset 'bytecomp-tests--callee #'1+)
+	  (should (= (funcall caller 1) 2))
+	  (fset 'bytecomp-tests--callee (byte-compile '(lambda (x) (* x 10))))
+	  (should (= (funcall caller 2) 20))
+	  (defalias 'bytecomp-tests--callee 'bytecomp-tests--alias)
+	  (fset 'bytecomp-tests--alias #'list)
+	  (should (equal (funcall caller 3) '(3)))
+	  (fset 'bytecomp-tests--alias #'1-)
+	  (should (= (funcall caller 3) 2))
+	  (garbage-collect)
+	  (should (= (funcall caller 4) 3))
+	  (fset 'bytecomp-tests--callee #'cons)
+	  (should-error (funcall caller 5) :type 'wrong-number-of-arguments)
+	  (fmakunbound 'bytecomp-tests--callee)
+	  (should-error (funcall caller 6) :type 'void-function))
+      (fmakunbound 'bytecomp-tests--callee)
+      (fmakunbound 'bytecomp-tests--alias))))
+
+(defvar bytecomp-tests--list nil)
+
+(defconst bytecomp-tests-optimized-data
+  '(((lambda (l)
+       (let ((s 0))
+	 (while l
+	   (setq s (+ s (car l)))
+	   (setq l (cdr l)))
+	 s))
+     (1 2 3 4 5))
+    ((lambda (n)
+       (let ((i 0) (c 0))
+	 (while (< i n)
+	   (if (eq (logand i 1) 0) (setq c (1+ c)))
+	   (setq i (1+ i)))
+	 c))
+     99)
+    ((lambda (l)
+       (let (r)
+	 (dolist (x l)
+	   (when (and (consp x) (not (eq (cdr x) 'skip)))
+	     (push (cons (cadr x) (car x)) r)))
+	 (nreverse r)))
+     ((a b) (c . skip) d (e f g)))
+    ((lambda (n)
+       (let ((c 0))
+	 (dotimes (_ n)
+	   (if (car bytecomp-tests--list) (setq c (1+ c)))
+	   (setq bytecomp-tests--list (cdr bytecomp-tests--list)))
+	 (list c bytecomp-tests--list)))
+     3)
+    ((lambda (x)
+       (let ((a (list x x)))
+	 (let ((b (car a)) (c (cdr a)))
+	   (let ((d (cons b c)))
+	     (if (eq x 'b) (list a b c d) (length d))))))
+     b)
+    ((lambda (x)
+       (cond ((eq x 'a) 1)
+	     ((and x (< (length (symbol-name x)) 2)) 2)
+	     ((memq x '(foo bar)) (format "%s" x))
+	     (t (condition-case nil (car x)
+		  (wrong-type-argument 'error)))))
+     foo))
+  "Functions and arguments that exercise the optimized byte code.")
+
+(ert-deftest bytecomp-tests-optimized-byte-code ()
+  "Test that optimized byte code computes what the original does."
+  (let ((lexical-binding t))
+    (dolist (data bytecomp-tests-optimized-data)
+      (let* ((fun (byte-compile (car data)))
+	     (code (aref fun 1))
+	     (arg (cadr data))
+	     (expected (let ((byte-code-optimize nil)
+			     (bytecomp-tests--list '(a nil b c)))
+			 (funcall fun arg))))
+	(dotimes (_ 2)
+	  (let ((byte-code-optimize t)
+		(bytecomp-tests--list '(a nil b c)))
+	    (should (equal (funcall fun arg) expected))))
+	;; The function was translated.
+	(let ((byte-code-optimize t))
+	  (should (stringp (internal-byte-code-optimized fun))))
+	;; The function object keeps its original byte code.
+	(should (eq (aref fun 1) code)))))
+  ;; Jumps in byte code the compiler could make, to check that their
+  ;; targets are moved along with the code.
+  (dolist (data
+	   ;; A jump right after a fused pair: dup, goto-if-nil 6, cdr,
+	   ;; car, return.
+	   '(("\211\203\006\000\101\100\207" [] 2
+	      (nil (1 2)) (nil 2))
+	     ;; A jump to the start of a run of discards, which is
+	     ;; folded into one: dup, goto-if-nil 10, y, j, j, goto 13,
+	     ;; n, j, j, discard, discard, return.
+	     ("\211\203\012\000\300\302\302\202\015\000\301\302\302\210\210\207"
+	      [y n j] 5 (t nil) (y n))
+	     ;; A jump into a run of discards, which is folded only up to
+	     ;; there: dup, goto-if-nil 12, y, j, j, j, discard, discard,
+	     ;; discard, return, n, j, goto 10.
+	     ("\211\203\014\000\300\302\302\302\210\210\210\207\301\302\202\012\000"
+	      [y n j] 5 (t nil) (y n))))
+    (let ((fun (make-byte-code 257 (nth 0 data) (nth 1 data) (nth 2 data)))
+	  (byte-code-optimize t))
+      (should (equal (mapcar fun (nth 3 data)) (nth 4 data)))
+      (should (< (length (internal-byte-code-optimized fun))
+		 (length (nth 0 data))))
+      (let ((byte-code-optimize nil))
+	(should (equal (mapcar fun (nth 3 data)) (nth 4 data))))))
+  ;; Closures made from the same code share a translation.
+  (let* ((lexical-binding t)
+	 (make (byte-compile '(lambda (n) (lambda (l) (+ n (car (cdr l)))))))
+	 (byte-code-optimize t))
+    (should (= (funcall (funcall make 1) '(1 2)) 3))
+    (should (= (funcall (funcall make 10) '(1 2)) 12))))
+
 (defun test-byte-opt-arithmetic (&optional arg)
   "Unit test for byte-opt arithmetic operations.
 Subtests signal errors if something goes wrong."
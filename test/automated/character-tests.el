@@ -0,0 +1,67 @@
+;;; character-tests.el --- tests for src/character.c
+
+;; Copyright (C) 2013 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; This program is free software: you can redistribute it and/or
+;; modify it under the terms of the GNU General Public License as
+;; published by the Free Software Foundation, either version 3 of the
+;; License, or (at your option) any later version.
+;;
+;; This program is distributed in the hope that it will be useful, but
+;; WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+;; General Public License for more details.
+;;
+;; You should have received a copy of the GNU General Public License
+;; along with this program.  If not, see `http://www.gnu.org/licenses/'.
+
+;;; Commentary:
+
+;;; Code:
+
+(require 'cl-lib)
+
+(defun character-tests--random-string (n chars)
+  "Return a string of N characters chosen at random among CHARS.
+Characters come in runs, so that there are long ASCII stretches."
+  (let ((result nil))
+    (while (> n 0)
+      (let ((c (aref chars (random (length chars))))
+	    (run (min n (1+ (random 40)))))
+	(push (make-string run c) result)
+	(setq n (- n run))))
+    (apply #'concat result)))
+
+(defun character-tests--random-bytes (n)
+  "Return a unibyte string of N random bytes, mostly ASCII."
+  (apply #'unibyte-string
+	 (mapcar (lambda (_) (if (zerop (random 4)) (random 256) (random 128)))
+		 (make-list n nil))))
+
+(ert-deftest character-tests-count-chars ()
+  "Character counts of multibyte text are right."
+  (dotimes (_ 200)
+    (let ((s (character-tests--random-string
+	      (random 300) [?a ?b ?é ?λ ?中 #x1F600 #x3FFF80])))
+      (should (= (length (format "%s" s)) (length s)))
+      (should (equal (format "%s" s) s))
+      (should (= (length (string-as-multibyte
+			  (encode-coding-string s 'utf-8-emacs)))
+		 (length s))))))
+
+(ert-deftest character-tests-unibyte-to-multibyte ()
+  "Conversions of unibyte text to multibyte keep all bytes."
+  (dotimes (_ 200)
+    (let* ((u (character-tests--random-bytes (random 300)))
+	   (nonascii (cl-count-if (lambda (b) (>= b 128)) u))
+	   (to (string-to-multibyte u))
+	   (as (string-as-multibyte u)))
+      (should (= (length to) (length u)))
+      (should (= (string-bytes to) (+ (length u) nonascii)))
+      (should (equal (string-to-unibyte to) u))
+      (should (= (length as) (length (append as nil))))
+      (should (equal (string-as-unibyte as) u)))))
+
+;;; character-tests.el ends here
@@ -36,5 +36,185 @@
                          c-e-x)
                    '(1 2)))))
 
+;; `load' reads a file from memory, taking runs of plain characters
+;; directly; check that strings, symbols, escapes and lazily loaded
+;; doc strings still read as they should.
+(ert-deftest core-elisp-tests-load ()
+  (let* ((dir (make-temp-file "core-elisp-tests" t))
+         (file (expand-file-name "c-e-load.el" dir))
+         (text "Ünïcode, \"quotes\", back\\slash and a
+newline"))
+    (unwind-protect
+        (progn
+          (let ((coding-system-for-write 'utf-8-unix))
+            (with-temp-file file
+              (insert ";;; -*- lexical-binding: t -*-\n"
+                      (format "(defvar c-e-load-text %S)\n" text)
+                      "(defvar c-e-load-symbols '(foo\\ bar a\\(b 12 1.5 ?\\C-a))\n"
+                      "(defun c-e-load-fun (x)\n"
+                      "  \"Return X.\nThis doc string is long enough to be lazy.\"\n"
+                      "  (list x \"\\300\\t\\x41\" (lambda () x)))\n"
+                      "(defvar c-e-load-string-end \"ends here\")")))
+          (dolist (load-force-doc-strings '(nil t))
+            (dolist (source '(t nil))
+              (let ((load-source-file-function nil))
+                (makunbound 'c-e-load-text)
+                (makunbound 'c-e-load-symbols)
+                (fmakunbound 'c-e-load-fun)
+                (unless source
+                  (byte-compile-file file))
+                (load (if source file (concat file "c")) nil t t)
+                (should (equal c-e-load-text text))
+                (should (equal c-e-load-symbols
+                               (list (intern "foo bar") (intern "a(b")
+                                     12 1.5 1)))
+                (should (equal (butlast (c-e-load-fun 'y))
+                               (list 'y "\300\tA")))
+                (should (string-prefix-p
+                         (concat "Return X.\nThis doc string is "
+                                 "long enough to be lazy.")
+                         (documentation 'c-e-load-fun t)))
+                (should (equal c-e-load-string-end "ends here"))))))
+      (delete-directory dir t))))
+
+(ert-deftest core-elisp-tests-fast-load ()
+  (let* ((dir (make-temp-file "core-elisp-tests" t))
+         (file (expand-file-name "c-e-fast.el" dir))
+         (elc (concat file "c"))
+         (byte-compile-fast-load t)
+         (print-circle t)
+         (load-values
+          (lambda (fast)
+            (let ((load-use-fast-load-files fast))
+              (load elc nil t t)
+              (prin1-to-string
+               (list c-e-fast-value c-e-fast-circular
+                     (c-e-fast-fun 'x) (documentation 'c-e-fast-fun t)))))))
+    (unwind-protect
+        (progn
+          (let ((coding-system-for-write 'utf-8-unix))
+            (with-temp-file file
+              (insert ";;; -*- lexical-binding: t -*-\n"
+                      "(defconst c-e-fast-value\n"
+                      "  '(\"one\" \"twö\" #(\"three\" 0 2 (face bold))"
+                      " two -3 4.5 [6 7] #&10\"\\377\\3\" "
+                      (format "%d %d))\n" most-positive-fixnum
+                              most-negative-fixnum)
+                      "(defconst c-e-fast-circular '#1=(a b . #1#))\n"
+                      "(defmacro c-e-fast-macro (x)\n"
+                      "  (let ((s (make-symbol \"s\")))\n"
+                      "    `(let ((,s ,x)) (list ,s ,s))))\n"
+                      "(defun c-e-fast-fun (x)\n"
+                      "  \"Return X twice.\"\n"
+                      "  (c-e-fast-macro x))\n")))
+          (byte-compile-file file)
+          (should (file-exists-p (concat file "b")))
+          (should (equal (funcall load-values t) (funcall load-values nil)))
+          (should (equal (c-e-fast-fun 'x) '(x x)))
+          (should (string-prefix-p "Return X twice."
+                                   (documentation 'c-e-fast-fun t)))
+          ;; Change FILE.elc without changing its size or time: `load'
+          ;; still loads FILE.elb.
+          (let ((mtime (nth 5 (file-attributes elc))))
+            (with-temp-buffer
+              (set-buffer-multibyte nil)
+              (insert-file-contents-literally elc)
+              (should (search-forward "\"one\"" nil t))
+              (replace-match "\"ONE\"" t t)
+              (let ((coding-system-for-write 'no-conversion))
+                (write-region nil nil elc nil 'silent)))
+            (set-file-times elc mtime))
+          (let ((load-use-fast-load-files t))
+            (load elc nil t t)
+            (should (equal (car c-e-fast-value) "one")))
+          (let ((load-use-fast-load-files nil))
+            (load elc nil t t)
+            (should (equal (car c-e-fast-value) "ONE")))
+          ;; Once FILE.elc has changed, FILE.elb is ignored.
+          (set-file-times elc (time-add (nth 5 (file-attributes elc))
+                                        (seconds-to-time 1)))
+          (let ((load-use-fast-load-files t))
+            (load elc nil t t)
+            (should (equal (car c-e-fast-value) "ONE"))))
+      (delete-directory dir t))))
+
+;; The initial obarray grows as symbols are interned.
+(ert-deftest core-elisp-tests-obarray ()
+  (let* ((old obarray)
+         (count (lambda (ob)
+                  (let ((n 0))
+                    (mapatoms (lambda (_) (setq n (1+ n))) ob)
+                    n)))
+         (before (funcall count obarray))
+         (n (1+ (length obarray)))
+         (names (mapcar (lambda (i) (format "core-elisp-tests-%d" i))
+                        (number-sequence 1 n)))
+         (symbols (mapcar #'intern names)))
+    (unwind-protect
+        (progn
+          (should-not (eq obarray old))
+          (should (> (length obarray) (length old)))
+          (should (= (funcall count obarray) (+ before n)))
+          (should (= (funcall count old) (+ before n)))
+          (dolist (sym symbols)
+            (should (eq (intern-soft (symbol-name sym)) sym))
+            (should (eq (intern-soft sym old) sym))
+            (should (eq (intern (symbol-name sym) old) sym)))
+          (let ((keyword (intern (concat ":" (car names)) old)))
+            (should (eq (symbol-value keyword) keyword)))
+          (should (member (car names)
+                          (all-completions (car names) old))))
+      (dolist (sym symbols)
+        (unintern sym obarray))
+      (unintern (concat ":" (car names)) obarray))
+    (should (= (funcall count obarray) before))
+    (should-not (intern-soft (car names))))
+  ;; Other obarrays keep their size.
+  (let ((ob (make-vector 1 0)))
+    (dotimes (i 100)
+      (intern (number-to-string i) ob))
+    (should (= (length ob) 1))
+    (should (eq (intern-soft "42" ob) (intern "42" ob)))
+    (should-not (intern-soft "42"))))
+
+(ert-deftest core-elisp-tests-obarray-intern-while-mapping ()
+  "Interning while mapping over the initial obarray visits every symbol."
+  (let* ((before (let ((n 0))
+                   (mapatoms (lambda (_) (setq n (1+ n))))
+                   n))
+         (n (1+ (length obarray)))
+         (i 0)
+         (seen 0)
+         symbols)
+    (unwind-protect
+        (progn
+          ;; Intern enough symbols during the walk to make it grow.
+          (mapatoms (lambda (_)
+                      (setq seen (1+ seen))
+                      (dotimes (_ 4)
+                        (when (< i n)
+                          (push (intern (format "core-elisp-tests-map-%d" i))
+                                symbols)
+                          (setq i (1+ i))))))
+          (should (= i n))
+          (should (>= seen before))
+          ;; It grows at the next intern after the walk.
+          (push (intern "core-elisp-tests-map") symbols)
+          (should (= (length (all-completions "core-elisp-tests-map" obarray))
+                     (1+ n)))
+          (setq seen 0 i 0)
+          (all-completions "" obarray
+                           (lambda (_)
+                             (setq seen (1+ seen))
+                             (dotimes (_ 4)
+                               (when (< i n)
+                                 (push (intern
+                                        (format "core-elisp-tests-c-%d" i))
+                                       symbols)
+                                 (setq i (1+ i))))))
+          (should (>= seen (+ before n 1))))
+      (dolist (sym symbols)
+        (unintern sym obarray)))))
+
 (provide 'core-elisp-tests)
 ;;; core-elisp-tests.el ends here
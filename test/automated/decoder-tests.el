@@ -206,6 +206,109 @@
 				   'raw-text-mac 'decoder-tests-lf-to-lflf)))
     (decoder-tests-remove-files)))
 
+;; Return a unibyte string of long ASCII runs separated by bytes
+;; chosen at random among BYTES.
+(defun decoder-tests-runs (bytes)
+  (let ((result nil))
+    (dotimes (i 200)
+      (push (make-string (random 50) ?a) result)
+      (push (unibyte-string (aref bytes (random (length bytes)))) result))
+    (apply 'concat result)))
+
+;; The optimized decoder skips ASCII text a word at a time, so check
+;; that it still finds the bytes it must look at wherever they are.
+(ert-deftest ert-test-decoder-long-runs ()
+  (unwind-protect
+      (let ((file (decoder-tests-filename 'runs 'raw-text)))
+	(or (file-directory-p decoder-tests-workdir)
+	    (mkdir decoder-tests-workdir t))
+	(dolist (bytes (list [?\n ?\t ?\s] [?\r ?\n] [?\r] [?\e ?\n]
+			     [?\n 0] [?\n #xC3 #xA9] [?\n #xE9]))
+	  (dotimes (i 5)
+	    (let ((coding-system-for-write 'no-conversion))
+	      (write-region (decoder-tests-runs bytes) nil file))
+	    (dolist (coding '(undecided utf-8 latin-1 raw-text))
+	      (let ((coding-system-for-read coding))
+		(should (equal (with-temp-buffer
+				 (let ((disable-ascii-optimization nil))
+				   (insert-file-contents file))
+				 (buffer-string))
+			       (with-temp-buffer
+				 (let ((disable-ascii-optimization t))
+				   (insert-file-contents file))
+				 (buffer-string)))))))))
+    (decoder-tests-remove-files)))
+
+;; UTF-8 text with a few invalid bytes is still decoded in place, so
+;; check that it decodes as the general decoder does.
+(ert-deftest ert-test-decoder-invalid-utf-8 ()
+  (unwind-protect
+      (let ((file (decoder-tests-filename 'invalid 'utf-8)))
+	(or (file-directory-p decoder-tests-workdir)
+	    (mkdir decoder-tests-workdir t))
+	(dolist (bytes (list [?\n #xC3 #xA9 #xFF]
+			     [?\r ?\n #xE4 #xB8 #xAD #x80]
+			     [?\n #xC0 #xAF #xED #xA0 #x80 #xF4 #x90 #x80]
+			     [?\n #xF0 #x9F #x98 #x80 #xF8 #x88 #xEF #xBB #xBF]))
+	  (dotimes (i 5)
+	    (let ((coding-system-for-write 'no-conversion))
+	      (write-region (decoder-tests-runs bytes) nil file))
+	    (dolist (coding '(undecided utf-8 utf-8-with-signature))
+	      (let ((coding-system-for-read coding))
+		(should (equal (with-temp-buffer
+				 (let ((disable-ascii-optimization nil))
+				   (insert-file-contents file))
+				 (list (buffer-string) last-coding-system-used))
+			       (with-temp-buffer
+				 (let ((disable-ascii-optimization t))
+				   (insert-file-contents file))
+				 (list (buffer-string)
+				       last-coding-system-used)))))))))
+    (decoder-tests-remove-files)))
+
+;; Reading a file, which decodes in place when it can, and decoding a
+;; string must agree about CRs that are not followed by LF.
+(ert-deftest ert-test-decoder-bare-cr ()
+  (unwind-protect
+      (let ((file (decoder-tests-filename 'bare-cr 'utf-8)))
+	(or (file-directory-p decoder-tests-workdir)
+	    (mkdir decoder-tests-workdir t))
+	(dolist (bytes '("a\rb\r\nc" "a\r\377b\r\nc" "\303\r\251\r\n\377"))
+	  (let ((coding-system-for-write 'no-conversion))
+	    (write-region bytes nil file))
+	  (dolist (coding '(utf-8-dos utf-8 undecided))
+	    (should (equal (with-temp-buffer
+			     (let ((coding-system-for-read coding))
+			       (insert-file-contents file))
+			     (buffer-string))
+			   (decode-coding-string bytes coding))))))
+    (decoder-tests-remove-files)))
+
+;; Large texts are checked in pieces by several threads; the pieces
+;; must not split characters or CR LF sequences.
+(ert-deftest ert-test-decoder-threads ()
+  (unwind-protect
+      (let ((file (decoder-tests-filename 'threads 'raw-text))
+	    (piece (concat (make-string 1000 ?a) "\r\n"
+			   (make-string 1000 ?\xe9) "\r\n")))
+	(or (file-directory-p decoder-tests-workdir)
+	    (mkdir decoder-tests-workdir t))
+	(with-temp-file file
+	  (set-buffer-file-coding-system 'utf-8-dos)
+	  (dotimes (i 3000)
+	    (insert (substring piece (% i 7)))))
+	(dolist (coding '(undecided utf-8 latin-1 raw-text))
+	  (let ((coding-system-for-read coding)
+		(results nil))
+	    (dolist (threads '(1 2))
+	      (with-temp-buffer
+		(let ((decoding-threads threads))
+		  (insert-file-contents file))
+		(push (list (buffer-string) buffer-file-coding-system)
+		      results)))
+	    (should (equal (nth 0 results) (nth 1 results))))))
+    (decoder-tests-remove-files)))
+
 
 ;;; Check the coding system `prefer-utf-8'.
 
@@ -216,6 +216,25 @@ Save the result in `file-notify--test-results', for later analysis."
     "Check file creation/removal notifications for remote files.")
   ) ;; file-notify--test-local-enabled
 
+(ert-deftest file-notify-test02a-batch ()
+  "Check that each event of a batch reaches its callback."
+  (let (events)
+    ;; The error is signaled as for a single event, once the other
+    ;; callbacks have run.
+    (should (equal
+	     (should-error
+	      (file-notify-handle-event
+	       `(file-notify
+		 (((1 (modify close-write) "f" 0)
+		   ,(lambda (ev) (push ev events)))
+		  ((1 (create) "g" 0) ,(lambda (_ev) (error "Failing callback")))
+		  ((2 (delete) "h" 0) ,(lambda (ev) (push ev events)))))))
+	     '(error "Failing callback")))
+    (should (equal (nreverse events)
+		   '((1 (modify close-write) "f" 0) (2 (delete) "h" 0))))
+    (should-error (file-notify-handle-event '(file-notify))
+		  :type 'file-notify-error)))
+
 ;; autorevert runs only in interactive mode.
 (defvar auto-revert-remote-files)
 (setq auto-revert-remote-files t)
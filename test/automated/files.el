@@ -146,6 +146,157 @@ form.")
 	      (should (file-test--do-local-variables-test str subtest))))))
     (ad-disable-advice 'hack-local-variables-confirm 'around 'files-test)))
 
+(ert-deftest files-test-directory-files-recursively ()
+  "Test listing a directory tree with `directory-files-recursively'."
+  (let ((dir (file-name-as-directory (make-temp-file "files-test" t))))
+    (unwind-protect
+	(progn
+	  (make-directory (concat dir "a/b") t)
+	  (make-directory (concat dir "c"))
+	  (dolist (file '("x.el" "a/y.el" "a/b/z.txt" "c/w.el"))
+	    (write-region file nil (concat dir file) nil 'silent))
+	  (make-symbolic-link (concat dir "a") (concat dir "link"))
+	  (let ((files (lambda (&rest args)
+			 (sort (mapcar (lambda (file)
+					 (substring file (length dir)))
+				       (apply #'directory-files-recursively
+					      dir args))
+			       #'string<))))
+	    ;; Symbolic links to directories are not followed.
+	    (should (equal (funcall files)
+			   '("a/b/z.txt" "a/y.el" "c/w.el" "link" "x.el")))
+	    (should (equal (funcall files "\\.el\\'")
+			   '("a/y.el" "c/w.el" "x.el")))
+	    (should (equal (funcall files "\\`[ab]" t)
+			   '("a" "a/b"))))
+	  (should (equal (directory-files-recursively
+			  (concat dir "a/b") nil nil t 'string)
+			 (list (cons (concat dir "a/b/z.txt")
+				     (file-attributes (concat dir "a/b/z.txt")
+						      'string)))))
+	  (should (equal (sort (directory-files-recursively
+				(concat dir "a") nil t '(size type))
+			       (lambda (a b) (string< (car a) (car b))))
+			 (list (list (concat dir "a/b")
+				     (nth 7 (file-attributes (concat dir "a/b")))
+				     t)
+			       (list (concat dir "a/b/z.txt") 9 nil)
+			       (list (concat dir "a/y.el") 6 nil))))
+	  (should (equal (directory-files-recursively dir "link" nil '(type))
+			 (list (list (concat dir "link") (concat dir "a")))))
+	  (should-error (directory-files-recursively dir nil nil '(colour)))
+	  (should-error (directory-files-recursively (concat dir "none"))))
+      (delete-directory dir t))))
+
+(ert-deftest files-test-file-attribute-cache ()
+  "Test that the cache of file attributes is used and kept up to date."
+  (let ((dir (file-name-as-directory (make-temp-file "files-test" t)))
+	(file-attribute-cache t)
+	(file-attribute-cache-ttl 10))
+    (unwind-protect
+	(let ((file (concat dir "f")))
+	  (clear-file-attribute-cache)
+	  (should-not (file-exists-p file))
+	  (should-not (file-exists-p file))
+	  (should (= (car (file-attribute-cache-statistics)) 1))
+	  (write-region "abc" nil file nil 'silent)
+	  (should (file-regular-p file))
+	  (should (= (nth 7 (file-attributes file)) 3))
+	  (set-file-modes file #o600)
+	  (should (= (file-modes file) #o600))
+	  (rename-file file (concat dir "g"))
+	  (should-not (file-exists-p file))
+	  (should (file-exists-p (concat dir "g")))
+	  (make-symbolic-link "g" file)
+	  (should (equal (file-symlink-p file) "g"))
+	  (should (equal (car (file-attributes file)) "g"))
+	  (should (= (nth 7 (file-attributes file)) 1))
+	  (should (file-regular-p file))
+	  (delete-file (concat dir "g"))
+	  (should-not (file-exists-p file))
+	  (should (file-symlink-p file))
+	  (make-directory (concat dir "g"))
+	  (should (file-directory-p file))
+	  ;; Names that are not absolute or have "." components are not
+	  ;; cached.
+	  (let ((default-directory dir))
+	    (should (file-directory-p "./g/..")))
+	  (clear-file-attribute-cache)
+	  (should (equal (file-attribute-cache-statistics) '(0 0 0 0))))
+      (delete-directory dir t)
+      (clear-file-attribute-cache))))
+
+(ert-deftest files-test-file-attribute-cache-tree ()
+  "Test that the files under a directory Emacs renames are forgotten."
+  (let ((dir (file-name-as-directory (make-temp-file "files-test" t)))
+	(file-attribute-cache t)
+	(file-attribute-cache-ttl 30))
+    (unwind-protect
+	(let ((file (concat dir "link/x/f")))
+	  (clear-file-attribute-cache)
+	  (make-directory (concat dir "a/x") t)
+	  (make-directory (concat dir "b"))
+	  (write-region "abc" nil (concat dir "a/x/f") nil 'silent)
+	  (make-symbolic-link "a" (concat dir "link"))
+	  ;; The directories under the link cannot be watched, so only
+	  ;; their files are cached.
+	  (should (file-exists-p file))
+	  (rename-file (concat dir "link") (concat dir "old"))
+	  (make-symbolic-link "b" (concat dir "link"))
+	  (should-not (file-exists-p file))
+	  (should (file-exists-p (concat dir "old/x/f"))))
+      (delete-directory dir t)
+      (clear-file-attribute-cache))))
+
+(ert-deftest files-test-file-attribute-cache-changes ()
+  "Test that the cache notices changes made by other programs."
+  :expected-result (if (executable-find "sh") :passed :failed)
+  (let* ((dir (file-name-as-directory (make-temp-file "files-test" t)))
+	 (file (concat dir "a/f"))
+	 (link (concat dir "link/f"))
+	 (file-attribute-cache t)
+	 (shell (lambda (command)
+		  (let ((default-directory dir))
+		    (call-process "sh" nil nil nil "-c" command)))))
+    (unwind-protect
+	(progn
+	  (clear-file-attribute-cache)
+	  (make-directory (concat dir "a"))
+	  (make-symbolic-link "a" (concat dir "link"))
+	  ;; Without a time to live, only the files that can be watched
+	  ;; are cached, and changes to them are seen at once.
+	  (let ((file-attribute-cache-ttl nil))
+	    (should-not (file-exists-p file))
+	    (funcall shell "printf abc >a/f")
+	    (should (= (nth 7 (file-attributes file)) 3))
+	    (funcall shell "printf abcdef >a/f")
+	    (should (= (nth 7 (file-attributes file)) 6))
+	    (funcall shell "mv a b && mkdir a")
+	    (should-not (file-exists-p file))
+	    (should (file-exists-p (concat dir "b/f")))
+	    (funcall shell "rm -r a && mv b a")
+	    (should (file-exists-p link))
+	    (funcall shell "rm a/f")
+	    (should-not (file-exists-p file))
+	    (should-not (file-exists-p link)))
+	  ;; Files under symbolic links to directories cannot be watched;
+	  ;; what is known about them is kept for the time to live.
+	  (let ((file-attribute-cache-ttl 30))
+	    (should-not (file-exists-p link))
+	    (funcall shell "printf abc >a/f")
+	    (should (file-exists-p file))
+	    (should-not (file-exists-p link)))
+	  (let ((file-attribute-cache-ttl 0.2))
+	    (clear-file-attribute-cache)
+	    (should (file-exists-p link))
+	    (funcall shell "rm a/f")
+	    (let ((end (+ (float-time) 5)))
+	      (while (and (file-exists-p link) (< (float-time) end))
+		(sleep-for 0.05)))
+	    (should-not (file-exists-p link))))
+      (delete-directory dir t)
+      (clear-file-attribute-cache))))
+
 ;; Stop the above "Local Var..." confusing Emacs.
 
 
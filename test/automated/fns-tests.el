@@ -0,0 +1,59 @@
+;;; fns-tests.el --- tests for src/fns.c
+
+;; Copyright (C) 2013 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; This program is free software: you can redistribute it and/or
+;; modify it under the terms of the GNU General Public License as
+;; published by the Free Software Foundation, either version 3 of the
+;; License, or (at your option) any later version.
+;;
+;; This program is distributed in the hope that it will be useful, but
+;; WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+;; General Public License for more details.
+;;
+;; You should have received a copy of the GNU General Public License
+;; along with this program.  If not, see `http://www.gnu.org/licenses/'.
+
+;;; Commentary:
+
+;;; Code:
+
+(require 'cl-lib)
+
+(defun fns-tests--random-multibyte-string (n)
+  "Return a multibyte string of N random characters of mixed widths."
+  (let ((chars [?a ?z ?é ?ß ?λ ?ж ?中 ?文 #x1F600 #x3FFF80]))
+    (apply #'string
+	   (cl-loop repeat n collect (aref chars (random (length chars)))))))
+
+(ert-deftest fns-tests-string-char-byte-cache ()
+  "Alternate accesses between several long multibyte strings.
+This exercises the char/byte position cache used by `aref' and
+`substring', checking every result against a list of the characters."
+  (let* ((strings (cl-loop repeat 10
+			   collect (fns-tests--random-multibyte-string
+				    (+ 1000 (random 3000)))))
+	 (chars (mapcar (lambda (s) (append s nil)) strings)))
+    (dotimes (_ 3000)
+      (let* ((k (random (length strings)))
+	     (s (nth k strings))
+	     (i (random (length s))))
+	(should (eq (aref s i) (nth i (nth k chars))))
+	(should (equal (substring s i (min (length s) (+ i 5)))
+		       (apply #'string
+			      (cl-subseq (nth k chars) i
+					 (min (length s) (+ i 5))))))))))
+
+(ert-deftest fns-tests-string-char-byte-cache-aset ()
+  "Changing the byte length of a cached string must not confuse `aref'."
+  (let ((s (fns-tests--random-multibyte-string 2000)))
+    (should (aref s 1500))
+    (dotimes (i 2000)
+      (aset s i (if (cl-oddp i) ?中 ?a)))
+    (dotimes (i 2000)
+      (should (eq (aref s i) (if (cl-oddp i) ?中 ?a))))))
+
+;;; fns-tests.el ends here
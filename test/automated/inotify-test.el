@@ -58,6 +58,49 @@
 	      (should (> events 0)))
 	  (inotify-rm-watch wd)
 	  (delete-file temp-file)))))
+
+  (ert-deftest inotify-coalesce-events ()
+    "Test that changes to the same file are merged into one event."
+    :expected-result (if (executable-find "sh") :passed :failed)
+    (let* ((dir (make-temp-file "inotify-coalesce" t))
+	   (file (expand-file-name "f" dir))
+	   (inotify-coalesce-delay 0.5)
+	   (stats (lambda (n) (nth n (inotify-event-statistics))))
+	   (events nil)
+	   (aspects (lambda (name)
+		      (apply #'append
+			     (mapcar (lambda (ev)
+				       (and (equal (nth 2 ev) name) (nth 1 ev)))
+				     events))))
+	   raw delivered wd)
+      (write-region "" nil file)
+      (setq wd (inotify-add-watch dir '(create modify close-write)
+				  (lambda (ev) (push ev events))))
+      (unwind-protect
+	  (progn
+	    (setq raw (funcall stats 0)
+		  delivered (funcall stats 1))
+	    (let ((default-directory (file-name-as-directory dir)))
+	      (call-process
+	       "sh" nil nil nil "-c"
+	       "i=0; while [ $i -lt 100 ]; do echo $i >>f; i=$((i+1)); done; :>g"))
+	    ;; `sit-for' does not read input in batch mode, so wait with
+	    ;; `read-event', which handles the file events it reads.
+	    (let ((end (+ (float-time) 5)))
+	      (while (and (not (funcall aspects "g"))
+			  (< (float-time) end))
+		(read-event nil nil 0.05)))
+	    ;; Each append is a modify and a close-write event, which
+	    ;; the kernel does not merge.
+	    (should (>= (- (funcall stats 0) raw) 200))
+	    ;; The changes to f are one event, the creation of g another,
+	    ;; unless they were read in separate batches.
+	    (should (< (- (funcall stats 1) delivered) 10))
+	    (should (< (length events) 10))
+	    (should (memq 'modify (funcall aspects "f")))
+	    (should (memq 'close-write (funcall aspects "f"))))
+	(inotify-rm-watch wd)
+	(delete-directory dir t))))
 )
 
 (provide 'inotify-tests)
@@ -0,0 +1,82 @@
+;;; marker-tests.el --- tests for src/marker.c
+
+;; Copyright (C) 2013 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; This program is free software: you can redistribute it and/or
+;; modify it under the terms of the GNU General Public License as
+;; published by the Free Software Foundation, either version 3 of the
+;; License, or (at your option) any later version.
+;;
+;; This program is distributed in the hope that it will be useful, but
+;; WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+;; General Public License for more details.
+;;
+;; You should have received a copy of the GNU General Public License
+;; along with this program.  If not, see `http://www.gnu.org/licenses/'.
+
+;;; Commentary:
+
+;;; Code:
+
+(defun marker-tests--random-text (n)
+  "Return a string of N random characters of mixed byte lengths."
+  (let ((chars [?a ?\n ?é ?λ ?中 #x1F600]))
+    (apply #'string
+	   (mapcar (lambda (_) (aref chars (random (length chars))))
+		   (make-list n nil)))))
+
+(defun marker-tests--check-positions (positions)
+  "Check `position-bytes' and `byte-to-position' at POSITIONS.
+Compute the expected values from a copy of the whole text, since
+`buffer-substring' itself converts positions."
+  (let ((text (buffer-substring-no-properties (point-min) (point-max))))
+    (dolist (pos positions)
+      (let ((byte (1+ (string-bytes (substring text 0 (1- pos))))))
+	(should (= (position-bytes pos) byte))
+	(should (= (byte-to-position byte) pos))))))
+
+(ert-deftest marker-tests-charpos-cache-edits ()
+  "Position conversions stay correct across edits far from point.
+Conversions far from any known position are remembered, so this
+interleaves them with random insertions, deletions and replacements."
+  (with-temp-buffer
+    (insert (marker-tests--random-text 20000))
+    (dotimes (_ 300)
+      (let ((pos (1+ (random (buffer-size)))))
+	(pcase (random 3)
+	  (0 (goto-char pos)
+	     (insert (marker-tests--random-text (random 50))))
+	  (1 (delete-region pos (min (point-max) (+ pos (random 100)))))
+	  (2 (goto-char pos)
+	     (when (re-search-forward "[éλ]" nil t)
+	       (replace-match "x"))))
+	(goto-char (point-min))
+	(marker-tests--check-positions
+	 (list (1+ (random (buffer-size))) (1+ (random (buffer-size)))
+	       (point-max)))))))
+
+(ert-deftest marker-tests-charpos-cache-transpose ()
+  "Position conversions stay correct after `transpose-regions'.
+It moves text without adjusting markers one by one, with or without
+LEAVE-MARKERS."
+  (dolist (leave-markers '(nil t))
+    (with-temp-buffer
+      (insert (make-string 3000 ?é) (make-string 2000 ?a)
+	      (make-string 3000 ?中))
+      (goto-char (point-min))
+      ;; Remember a few positions far from point.
+      (marker-tests--check-positions '(2500 4000 6000 7500))
+      (transpose-regions 1 3001 5001 8001 leave-markers)
+      (goto-char (point-min))
+      (marker-tests--check-positions (list 2500 4000 6000 7500 (point-max)))
+      (transpose-regions 1 (+ 1 (random 4000)) 4001 (+ 4001 (random 4000))
+			 leave-markers)
+      (goto-char (point-min))
+      (marker-tests--check-positions
+       (list (1+ (random (buffer-size))) (1+ (random (buffer-size)))
+	     (point-max))))))
+
+;;; marker-tests.el ends here
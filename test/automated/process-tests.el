@@ -0,0 +1,298 @@
+;;; process-tests.el --- tests for reading output from processes
+
+;; Copyright (C) 2013 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Code:
+
+(require 'ert)
+
+(defun process-tests--output (coding &rest args)
+  "Run ARGS as a process with CODING and return its buffer text."
+  (with-temp-buffer
+    (let* ((process-connection-type nil)
+	   (proc (apply #'start-process "test" (current-buffer) args)))
+      (set-process-coding-system proc coding coding)
+      (set-process-sentinel proc #'ignore)
+      (while (process-live-p proc)
+	(accept-process-output proc 1))
+      (while (accept-process-output proc 0 100))
+      (buffer-string))))
+
+(ert-deftest process-tests-output-decoding ()
+  "Check that process output is decoded the same however it is read."
+  :expected-result (if (executable-find "sh") :passed :failed)
+  (let ((file (make-temp-file "process-tests"))
+	(text (apply #'concat
+		     (make-list 3000 "a café\r\nand a \"thé\"\n\344\n"))))
+    (unwind-protect
+	(progn
+	  (let ((coding-system-for-write 'no-conversion))
+	    (write-region (encode-coding-string text 'utf-8-unix) nil file))
+	  (dolist (coding '(utf-8 utf-8-unix utf-8-dos raw-text latin-1))
+	    (should (equal (process-tests--output coding "cat" file)
+			   (with-temp-buffer
+			     (let ((coding-system-for-read coding))
+			       (insert-file-contents file))
+			     (buffer-string))))))
+      (delete-file file))
+    ;; Characters and CR LF pairs cut in two by the reads.
+    (should (equal (process-tests--output
+		    'utf-8 "sh" "-c"
+		    "printf 'caf\\303'; sleep 1; printf '\\251\\r'; sleep 1; printf '\\n'")
+		   "café\n"))))
+
+(ert-deftest process-tests-output-markers ()
+  "Check where the default filter puts the output and the markers."
+  :expected-result (if (executable-find "sh") :passed :failed)
+  (with-temp-buffer
+    (insert "before\nafter\n")
+    (let* ((process-connection-type nil)
+	   (proc (start-process "test" (current-buffer)
+				"sh" "-c" "printf 'out\\n'"))
+	   (changes nil)
+	   (marker (copy-marker 8))
+	   (end-marker (copy-marker 14)))
+      (set-process-coding-system proc 'utf-8 'utf-8)
+      (set-process-sentinel proc #'ignore)
+      (set-marker (process-mark proc) 8)
+      (goto-char 3)
+      (add-hook 'after-change-functions
+		(lambda (beg end len) (push (list beg end len) changes))
+		nil t)
+      (while (process-live-p proc)
+	(accept-process-output proc 1))
+      (while (accept-process-output proc 0 100))
+      (should (equal (buffer-string) "before\nout\nafter\n"))
+      (should (= (point) 3))
+      (should (= (process-mark proc) 12))
+      (should (= marker 12))
+      (should (= end-marker 18))
+      (should (equal changes '((8 12 0)))))))
+
+(ert-deftest process-tests-wait-for-one ()
+  "Check that output waits while Emacs waits for another process only."
+  :expected-result (if (executable-find "sh") :passed :failed)
+  (let* ((process-connection-type nil)
+	 (output nil)
+	 (idle (start-process "idle" nil "cat"))
+	 (talker (start-process "talker" nil "sh" "-c"
+				"printf hello; sleep 1; printf ' again'")))
+    (set-process-sentinel idle #'ignore)
+    (set-process-sentinel talker #'ignore)
+    (set-process-filter talker (lambda (_proc string)
+				 (push string output)))
+    (unwind-protect
+	(progn
+	  (accept-process-output idle 0.5 nil t)
+	  (should-not output)
+	  (while (process-live-p talker)
+	    (accept-process-output talker 1))
+	  (while (accept-process-output talker 0 100))
+	  (should (equal (apply #'concat (nreverse output)) "hello again"))
+	  ;; Once the talker is gone, waiting for the idle process must
+	  ;; not return at once because of it.
+	  (let ((start (float-time)))
+	    (accept-process-output idle 0.3)
+	    (should (>= (- (float-time) start) 0.25))))
+      (delete-process idle))))
+
+(ert-deftest process-tests-send-string-callback ()
+  "Check that input sent with a callback is queued and sent in order."
+  :expected-result (if (executable-find "cat") :passed :failed)
+  (let* ((process-connection-type nil)
+	 (output nil)
+	 (sent nil)
+	 (big (make-string (* 1024 1024) ?a))
+	 (proc (start-process "test" nil "cat"))
+	 queued)
+    (set-process-sentinel proc #'ignore)
+    (set-process-filter proc (lambda (_proc string)
+			       (push string output)))
+    (unwind-protect
+	(progn
+	  ;; A pipe cannot take all of BIG at once, so some of it stays
+	  ;; queued for the next time Emacs waits.
+	  (setq queued (process-send-string
+			proc big (lambda (p) (push (cons 'big p) sent))))
+	  (should (> queued 0))
+	  (should-not sent)
+	  (process-send-string proc "b" (lambda (_) (push 'b sent)))
+	  (should (= (process-send-queue-size proc) (1+ queued)))
+	  ;; Sending without a callback waits for what is queued.
+	  (process-send-string proc "c")
+	  (should (= (process-send-queue-size proc) 0))
+	  (should (equal sent (list 'b (cons 'big proc))))
+	  (process-send-string proc "d" (lambda (_) (push 'd sent)))
+	  (process-send-eof proc)
+	  (should (eq (car sent) 'd))
+	  (while (process-live-p proc)
+	    (accept-process-output proc 1))
+	  (while (accept-process-output proc 0 100))
+	  (should (equal (apply #'concat (nreverse output))
+			 (concat big "bcd"))))
+      (delete-process proc))))
+
+(ert-deftest process-tests-send-region-callback ()
+  "Check that queued input is written out while Emacs waits."
+  :expected-result (if (executable-find "cat") :passed :failed)
+  (with-temp-buffer
+    (insert (make-string (* 512 1024) ?x))
+    (let* ((process-connection-type nil)
+	   (received 0)
+	   (done nil)
+	   (proc (start-process "test" nil "cat")))
+      (set-process-sentinel proc #'ignore)
+      (set-process-filter proc (lambda (_proc string)
+				 (setq received (+ received (length string)))))
+      (unwind-protect
+	  (progn
+	    (process-send-region proc (point-min) (point-max)
+				 (lambda (_) (setq done t)))
+	    (while (< received (buffer-size))
+	      (should (accept-process-output proc 5)))
+	    (should done)
+	    (should (= (process-send-queue-size proc) 0))
+	    (should (= received (buffer-size))))
+	(delete-process proc)))))
+
+(ert-deftest process-tests-send-callback-just-this-one ()
+  "Check that queued input is written out while waiting for one process."
+  :expected-result (if (executable-find "sh") :passed :failed)
+  (let* ((process-connection-type nil)
+	 (size (* 1024 1024))
+	 (output "")
+	 (done nil)
+	 (proc (start-process
+		"test" nil "sh" "-c"
+		(format "sleep 1; head -c %d >/dev/null; echo done" size))))
+    (set-process-sentinel proc #'ignore)
+    (set-process-filter proc (lambda (_proc string)
+			       (setq output (concat output string))))
+    (unwind-protect
+	(progn
+	  ;; The process starts reading late, so the pipe fills up, and
+	  ;; it answers only once it has read all its input, so waiting
+	  ;; for its output must keep sending the input.
+	  (should (> (process-send-string proc (make-string size ?a)
+					  (lambda (_) (setq done t)))
+		     0))
+	  (while (not (string-match "done" output))
+	    (should (accept-process-output proc 5 nil t)))
+	  (should done)
+	  (should (= (process-send-queue-size proc) 0)))
+      (delete-process proc))))
+
+;; Big enough for call-process to read it in several pieces.
+(defun process-tests--text ()
+  "Return text with non-ASCII characters and CR LF pairs."
+  (apply #'concat (make-list 60000 "a café\r\nand a \"thé\"\n\344\n")))
+
+(ert-deftest process-tests-call-process-decoding ()
+  "Check that `call-process' decodes its output like `insert-file-contents'."
+  :expected-result (if (executable-find "cat") :passed :failed)
+  (let ((file (make-temp-file "process-tests")))
+    (unwind-protect
+	(progn
+	  (let ((coding-system-for-write 'no-conversion))
+	    (write-region (encode-coding-string (process-tests--text) 'utf-8)
+			  nil file nil 'silent))
+	  (dolist (multibyte '(t nil))
+	    (dolist (coding '(utf-8 utf-8-unix utf-8-dos raw-text latin-1
+				    undecided))
+	      (let ((expected
+		     (with-temp-buffer
+		       (set-buffer-multibyte multibyte)
+		       (let ((coding-system-for-read coding))
+			 (insert-file-contents file))
+		       (buffer-string))))
+		(with-temp-buffer
+		  (set-buffer-multibyte multibyte)
+		  (insert "before\nafter\n")
+		  (goto-char 8)
+		  (let ((marker (copy-marker 8))
+			(coding-system-for-read coding))
+		    (should (eq (call-process "cat" file t) 0))
+		    (should (equal (buffer-substring 8 (point)) expected))
+		    (should (equal (buffer-substring (point) (point-max))
+				   "after\n"))
+		    (should (= marker 8))))))))
+      (delete-file file))))
+
+(ert-deftest process-tests-call-process-filter ()
+  "Check that `call-process' can give its output to a function."
+  :expected-result (if (executable-find "cat") :passed :failed)
+  (let ((file (make-temp-file "process-tests"))
+	(text (process-tests--text))
+	(coding-system-for-read 'utf-8)
+	(pieces nil))
+    (unwind-protect
+	(with-temp-buffer
+	  (let ((coding-system-for-write 'no-conversion))
+	    (write-region (encode-coding-string text 'utf-8) nil file
+			  nil 'silent))
+	  (should (eq (call-process "cat" file
+				    `((:filter ,(lambda (s) (push s pieces)))
+				      nil))
+		      0))
+	  (should (> (length pieces) 1))
+	  (should (equal (apply #'concat (nreverse pieces))
+			 (decode-coding-string
+			  (encode-coding-string text 'utf-8) 'utf-8)))
+	  (should (= (buffer-size) 0)))
+      (delete-file file))))
+
+;; Run the same subprocesses with and without posix_spawn.
+(ert-deftest process-tests-posix-spawn ()
+  "Check that subprocesses are set up the same however they are started."
+  :expected-result (if (executable-find "sh") :passed :failed)
+  (let* ((dir (file-name-as-directory (make-temp-file "process-tests" t)))
+	 (input (expand-file-name "input" dir))
+	 (default-directory dir)
+	 (process-environment (cons "PROCESS_TESTS=spawned"
+				    process-environment))
+	 (script "cat; echo \"$PROCESS_TESTS\"; pwd; echo err >&2; exit 3")
+	 results)
+    (unwind-protect
+	(progn
+	  (write-region "in\n" nil input nil 'silent)
+	  (dolist (process-use-posix-spawn '(nil t))
+	    (push
+	     (list
+	      (with-temp-buffer
+		(list (call-process "sh" input t nil "-c" script)
+		      (buffer-string)))
+	      (with-temp-buffer
+		(let* ((process-connection-type nil)
+		       (proc (start-process "test" (current-buffer)
+					    "sh" "-c" script)))
+		  (set-process-sentinel proc #'ignore)
+		  (process-send-string proc "in\n")
+		  (process-send-eof proc)
+		  (while (process-live-p proc)
+		    (accept-process-output proc 1))
+		  (while (accept-process-output proc 0 100))
+		  (list (process-exit-status proc) (buffer-string)))))
+	     results))
+	  (should (equal (car results) (cadr results)))
+	  (let ((expected (list 3 (format "in\nspawned\n%s\nerr\n"
+					  (directory-file-name
+					   (file-truename dir))))))
+	    (should (equal (car results) (list expected expected)))))
+      (delete-directory dir t))))
+
+;;; process-tests.el ends here
@@ -0,0 +1,87 @@
+;;; region-cache-tests.el --- tests for region caches made from Lisp
+
+;; Copyright (C) 2013 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Code:
+
+(require 'ert)
+
+(ert-deftest region-cache-tests-put-get ()
+  (with-temp-buffer
+    (insert (make-string 100 ?x))
+    (should-not (region-cache-get 'test 10))
+    (region-cache-put 'test 10 20 t)
+    (region-cache-put 'test 30 40 7)
+    (should-not (region-cache-get 'test 9))
+    (should (eq (region-cache-get 'test 10) 1))
+    (should (eq (region-cache-get 'test 19) 1))
+    (should-not (region-cache-get 'test 20))
+    (should (eq (region-cache-get 'test 35) 7))
+    (should-not (region-cache-get 'other 35))
+    (should-not (region-cache-get 'test (point-max)))
+    (should (= (region-cache-next-change 'test 1) 10))
+    (should (= (region-cache-next-change 'test 10) 20))
+    (should (= (region-cache-next-change 'test 20) 30))
+    (should (= (region-cache-next-change 'test 40) (point-max)))
+    (should (= (region-cache-next-change 'test 20 25) 25))
+    (should (= (region-cache-previous-change 'test 35) 30))
+    (should (= (region-cache-previous-change 'test 30) 20))
+    (should (= (region-cache-previous-change 'test 9) (point-min)))
+    (should (= (region-cache-previous-change 'test 9 5) 5))
+    ;; Merging and forgetting.
+    (region-cache-put 'test 20 30 1)
+    (should (= (region-cache-next-change 'test 10) 30))
+    (region-cache-put 'test 15 35 nil)
+    (should (eq (region-cache-get 'test 14) 1))
+    (should-not (region-cache-get 'test 15))
+    (should (eq (region-cache-get 'test 35) 7))
+    (region-cache-forget 'test)
+    (should-not (region-cache-get 'test 10))
+    (should-error (region-cache-put 'test 1 10 0))
+    (should-error (region-cache-get 'test 200))))
+
+(ert-deftest region-cache-tests-edits ()
+  "Test that changes in the text forget what was recorded about it."
+  (with-temp-buffer
+    (insert (make-string 100 ?x))
+    (region-cache-put 'test 1 101 t)
+    (goto-char 50)
+    (insert "yyyy")
+    (should (eq (region-cache-get 'test 10) 1))
+    (should (eq (region-cache-get 'test 60) 1))
+    (should (= (region-cache-next-change 'test 10) 50))
+    (should-not (region-cache-get 'test 50))
+    (should (= (region-cache-next-change 'test 50) 54))
+    (delete-region 10 20)
+    (should (eq (region-cache-get 'test 10) 1))
+    (should (= (region-cache-next-change 'test 10) 40))
+    (should (= (region-cache-next-change 'test 40) 44))
+    (should (eq (region-cache-get 'test 90) 1))
+    ;; Indirect buffers share the caches of their base buffer.
+    (let ((base (current-buffer))
+          (indirect (make-indirect-buffer (current-buffer) " *indirect*")))
+      (unwind-protect
+          (with-current-buffer indirect
+            (should (eq (region-cache-get 'test 90) 1))
+            (goto-char 90)
+            (insert "z")
+            (with-current-buffer base
+              (should-not (region-cache-get 'test 90))))
+        (kill-buffer indirect)))))
+
+;;; region-cache-tests.el ends here
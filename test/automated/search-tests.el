@@ -0,0 +1,92 @@
+;;; search-tests.el --- tests for src/search.c
+
+;; Copyright (C) 2013 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; This program is free software: you can redistribute it and/or
+;; modify it under the terms of the GNU General Public License as
+;; published by the Free Software Foundation, either version 3 of the
+;; License, or (at your option) any later version.
+;;
+;; This program is distributed in the hope that it will be useful, but
+;; WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+;; General Public License for more details.
+;;
+;; You should have received a copy of the GNU General Public License
+;; along with this program.  If not, see `http://www.gnu.org/licenses/'.
+
+;;; Commentary:
+
+;;; Code:
+
+(defun search-tests--random-lines (n)
+  "Return a string of N lines of random length and contents."
+  (let ((chars [?a ?b ?\s ?é ?中]))
+    (mapconcat (lambda (_)
+		 (apply #'string
+			(mapcar (lambda (_) (aref chars (random (length chars))))
+				(make-list (random 100) nil))))
+	       (make-list n nil) "\n")))
+
+(defun search-tests--line-motion (buffer pos n)
+  "Return point and value of `forward-line' N from POS in BUFFER."
+  (with-current-buffer buffer
+    (goto-char pos)
+    (let ((value (forward-line n)))
+      (list (point) value))))
+
+(ert-deftest search-tests-line-index ()
+  "Line counting with `cache-long-scans' survives random edits.
+The same edits are made to a buffer that does not use the caches,
+and line motion over many lines must give the same results in both.
+Motions stay far enough from the buffer ends to use the line index."
+  (let ((text (search-tests--random-lines 8000))
+	(indexed (generate-new-buffer " *indexed*"))
+	(plain (generate-new-buffer " *plain*")))
+    (unwind-protect
+	(progn
+	  (dolist (b (list indexed plain))
+	    (with-current-buffer b
+	      (insert text)
+	      (setq cache-long-scans (eq b indexed))))
+	  (dotimes (_ 300)
+	    (let* ((size (with-current-buffer plain (buffer-size)))
+		   (beg (1+ (random (1+ size))))
+		   (end (min (1+ size) (+ beg (random 3000))))
+		   (op (random 5))
+		   (insertion (search-tests--random-lines (1+ (random 20)))))
+	      (dolist (b (list indexed plain))
+		(with-current-buffer b
+		  (save-excursion
+		    (pcase op
+		      (0 (goto-char beg) (insert insertion))
+		      (1 (delete-region beg end))
+		      (2 (subst-char-in-region beg end ?\n ?x))
+		      (3 (subst-char-in-region beg end ?a ?\n))
+		      (4 (upcase-region beg end))))))
+	      (dotimes (_ 3)
+		(let* ((size (with-current-buffer plain (buffer-size)))
+		       (pos (+ 70000 (random (- size 140000))))
+		       (n (* (if (zerop (random 2)) 1 -1)
+			     (+ 1000 (random 5000)))))
+		  (should (equal (search-tests--line-motion indexed pos n)
+				 (search-tests--line-motion plain pos n)))
+		  (should (= (with-current-buffer indexed
+			       (count-lines (point-min) pos))
+			     (with-current-buffer plain
+			       (count-lines (point-min) pos))))))))
+	  ;; Narrowing limits the scans, but not the index.
+	  (dolist (b (list indexed plain))
+	    (with-current-buffer b
+	      (narrow-to-region 50000 (- (point-max) 50000))))
+	  (dotimes (_ 20)
+	    (let ((pos (+ 120000 (random 100000)))
+		  (n (* (if (zerop (random 2)) 1 -1) (+ 1000 (random 5000)))))
+	      (should (equal (search-tests--line-motion indexed pos n)
+			     (search-tests--line-motion plain pos n))))))
+      (kill-buffer indexed)
+      (kill-buffer plain))))
+
+;;; search-tests.el ends here
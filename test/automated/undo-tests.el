@@ -226,6 +226,60 @@
             (should-not (buffer-modified-p))))
       (delete-file tempfile))))
 
+;; Packed undo records must give the same `buffer-undo-list'.
+(defun undo-test-edits ()
+  "Change the current buffer in various ways and return its undo list."
+  (buffer-enable-undo)
+  (insert "Hello world")
+  (undo-boundary)
+  (goto-char 3)
+  (insert "xyz")
+  (insert "abc")
+  (delete-char 2)
+  (delete-char -1)
+  (put-text-property 1 4 'face 'bold)
+  (goto-char 2)
+  (delete-char 2)
+  (goto-char (point-max))
+  (insert "\u00e9t\u00e9")
+  (delete-char -2)
+  (undo-boundary)
+  (goto-char (point-min))
+  (while (search-forward "l" nil t)
+    (replace-match "LL" t t))
+  (upcase-region (point-min) (point-max))
+  buffer-undo-list)
+
+(ert-deftest undo-test-packed-records ()
+  "Test undo with `undo-packed-records'."
+  (let ((list (with-temp-buffer (undo-test-edits))))
+    (let ((undo-packed-records t))
+      (should (equal (with-temp-buffer (undo-test-edits)) list))
+      (with-temp-buffer
+        (undo-test-edits)
+        (primitive-undo 10 buffer-undo-list)
+        (should (string-equal (buffer-string) ""))))))
+
+(ert-deftest undo-test-packed-records-gc ()
+  "Test truncating an undo list with packed records."
+  (let ((lists
+         (mapcar (lambda (packed)
+                   (let ((undo-packed-records packed))
+                     (with-temp-buffer
+                       (buffer-enable-undo)
+                       (insert "abc")
+                       (undo-boundary)
+                       (dotimes (_ 1000)
+                         (insert "x")
+                         (goto-char (point-min)))
+                       (let ((undo-limit 100)
+                             (undo-strong-limit 150))
+                         (garbage-collect))
+                       buffer-undo-list)))
+                 '(nil t))))
+    (should (= (length (car lists)) 1000))
+    (should (equal (car lists) (cadr lists)))))
+
 (defun undo-test-all (&optional interactive)
   "Run all tests for \\[undo]."
   (interactive "p")
@@ -0,0 +1,133 @@
+;;; bytecode-bench.el --- benchmark the byte-code interpreter  -*- lexical-binding: t -*-
+
+;; Copyright (C) 2013 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Commentary:
+
+;; Time byte-compiled functions that exercise the byte-code
+;; interpreter: function calls, list operations, string building and
+;; access to dynamic variables.  Each benchmark is compiled when this
+;; file is loaded, so run it from the source file with
+;;
+;;   emacs -Q --batch -l test/benchmarks/bytecode-bench.el
+;;
+;; and compare the times between builds.
+
+;;; Code:
+
+(require 'benchmark)
+
+(defvar bytecode-bench-repeat 5
+  "Number of times to run each benchmark.")
+
+(defvar bytecode-bench--counter 0
+  "Dynamic variable used by `bytecode-bench-dynamic'.")
+
+(defun bytecode-bench--fib (n)
+  (if (< n 2)
+      n
+    (+ (bytecode-bench--fib (- n 1)) (bytecode-bench--fib (- n 2)))))
+
+(defun bytecode-bench-fib ()
+  "Compute a Fibonacci number the slow way."
+  (bytecode-bench--fib 27))
+
+(defun bytecode-bench--add (a b)
+  (+ a b))
+
+(defun bytecode-bench-calls ()
+  "Call a small function and a few primitives in a loop."
+  (let ((sum 0)
+        (i 0))
+    (while (< i 1000000)
+      (setq sum (bytecode-bench--add sum (logand i 7)))
+      (setq i (1+ i)))
+    sum))
+
+(defun bytecode-bench-lists ()
+  "Build lists, then walk, map, filter and sort them."
+  (let (result)
+    (dotimes (_ 20)
+      (let ((list nil)
+            (alist nil))
+        (dotimes (i 5000)
+          (push i list))
+        (dotimes (i 100)
+          (push (cons i (* i i)) alist))
+        (setq list (nreverse list))
+        (setq result
+              (list (length (delq nil (mapcar (lambda (x)
+                                                (and (zerop (% x 3)) x))
+                                              list)))
+                    (let ((sum 0))
+                      (dolist (x list)
+                        (setq sum (+ sum (or (cdr (assq (% x 100) alist))
+                                             0))))
+                      sum)
+                    (car (sort (copy-sequence list) #'>))
+                    (length (append list (reverse list)))))))
+    result))
+
+(defun bytecode-bench-strings ()
+  "Build strings with `concat', `format' and a buffer."
+  (let (result)
+    (dotimes (_ 10)
+      (let ((s ""))
+        (dotimes (i 1000)
+          (setq s (concat s (number-to-string (% i 10)))))
+        (setq result
+              (list (length s)
+                    (length (mapconcat (lambda (i) (format "%d:%s" i i))
+                                       (number-sequence 1 5000) ","))
+                    (with-temp-buffer
+                      (dotimes (i 10000)
+                        (insert "line " (number-to-string i) "\n"))
+                      (buffer-size))))))
+    result))
+
+(defun bytecode-bench-dynamic ()
+  "Read and set a dynamic variable in a loop."
+  (setq bytecode-bench--counter 0)
+  (let ((i 0))
+    (while (< i 1000000)
+      (setq bytecode-bench--counter (+ bytecode-bench--counter i))
+      (setq i (1+ i))))
+  bytecode-bench--counter)
+
+(defvar bytecode-bench-functions
+  '(bytecode-bench-fib bytecode-bench-calls bytecode-bench-lists
+    bytecode-bench-strings bytecode-bench-dynamic)
+  "Benchmarks to run.")
+
+(defun bytecode-bench-run ()
+  "Compile and run the byte-code benchmarks and print the results."
+  (dolist (function '(bytecode-bench--fib bytecode-bench--add))
+    (byte-compile function))
+  (dolist (function bytecode-bench-functions)
+    (byte-compile function)
+    (funcall function)
+    (garbage-collect)
+    (message "%-25s %8.3f s"
+             function
+             (benchmark-elapse
+               (dotimes (_ bytecode-bench-repeat)
+                 (funcall function))))))
+
+(bytecode-bench-run)
+
+;;; bytecode-bench.el ends here
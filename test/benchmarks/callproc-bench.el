@@ -0,0 +1,79 @@
+;;; callproc-bench.el --- benchmark reading call-process output  -*- lexical-binding: t -*-
+
+;; Copyright (C) 2013 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Commentary:
+
+;; Write `callproc-bench-megabytes' of log-like text to a file, then
+;; time `call-process' inserting it from `cat' into a buffer with
+;; several coding systems, and giving it to a function.  Run it with
+;;
+;;   emacs -Q --batch -l test/benchmarks/callproc-bench.el
+
+;;; Code:
+
+(require 'benchmark)
+
+(defvar callproc-bench-megabytes 100
+  "Size of the output to read, in megabytes.")
+
+(defun callproc-bench--write (file)
+  "Write the text to read into FILE."
+  (with-temp-buffer
+    (let ((i 0))
+      (while (< (buffer-size) (* callproc-bench-megabytes 1024 1024))
+	(insert (format "commit %040x\nAuthor: Jöran Ørsted <jo@example.org>\n\n    Fix the frobnicator (bug#%d)\n\n"
+			i i))
+	(setq i (1+ i))))
+    (let ((coding-system-for-write 'utf-8-unix))
+      (write-region nil nil file nil 'silent))))
+
+(defun callproc-bench-run ()
+  "Run the call-process output benchmarks and print the results."
+  (let ((file (make-temp-file "callproc-bench")))
+    (unwind-protect
+	(progn
+	  (callproc-bench--write file)
+	  (dolist (coding '(utf-8-unix utf-8 raw-text latin-1))
+	    (with-temp-buffer
+	      (let ((coding-system-for-read coding))
+		(garbage-collect)
+		(message "%-10s into a buffer %8.3f s"
+			 coding
+			 (benchmark-elapse
+			   (call-process "cat" file t))))))
+	  (when (condition-case nil
+		    (call-process "true" nil '((:filter ignore) nil))
+		  (error nil))
+	    (let ((coding-system-for-read 'utf-8-unix)
+		  (chars 0))
+	      (garbage-collect)
+	      (message "%-10s to a function %8.3f s for %d characters"
+		       'utf-8-unix
+		       (benchmark-elapse
+			 (call-process "cat" file
+				       `((:filter ,(lambda (s)
+						     (setq chars
+							   (+ chars (length s)))))
+					 nil)))
+		       chars))))
+      (delete-file file))))
+
+(callproc-bench-run)
+
+;;; callproc-bench.el ends here
@@ -0,0 +1,76 @@
+;;; character-bench.el --- benchmark multibyte text scanning  -*- lexical-binding: t -*-
+
+;; Copyright (C) 2013 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Commentary:
+
+;; Measure the throughput, in megabytes per second, of the primitives
+;; that count and convert multibyte text (`multibyte_chars_in_text',
+;; `str_as_multibyte', `str_to_multibyte' and friends in character.c)
+;; on ASCII, Latin, CJK and mixed text.  Run it with
+;;
+;;   emacs -Q --batch -l test/benchmarks/character-bench.el
+
+;;; Code:
+
+(require 'benchmark)
+
+(defvar character-bench-size (* 4 1024 1024)
+  "Approximate number of characters of each sample text.")
+
+(defvar character-bench-repeat 10
+  "Number of times each operation is timed.")
+
+(defun character-bench--text (chars)
+  "Return a text of `character-bench-size' characters from CHARS."
+  (let ((line (apply #'string
+		     (mapcar (lambda (_) (aref chars (random (length chars))))
+			     (make-list 79 nil)))))
+    (mapconcat #'identity
+	       (make-list (/ character-bench-size 80) line) "\n")))
+
+(defun character-bench--report (what text seconds)
+  (message "%-28s %10.1f MB/s" what
+	   (/ (* character-bench-repeat (string-bytes text))
+	      (* 1024.0 1024.0 (max seconds 1e-6)))))
+
+(defun character-bench-run ()
+  "Run the benchmarks and print the results."
+  (random "character-bench")
+  (dolist (sample `(("ASCII" . [?a ?b ?c ?\s ?, ?.])
+		    ("Latin" . [?a ?e ?\s ?é ?à ?ç ?ü])
+		    ("CJK" . [?中 ?文 ?字 ?日 ?本])
+		    ("mixed" . [?a ?\s ?é ?λ ?中 #x1F600])))
+    (let* ((text (character-bench--text (cdr sample)))
+	   (bytes (string-as-unibyte text))
+	   (n character-bench-repeat))
+      (message "%s:" (car sample))
+      (character-bench--report
+       "  format (copy and count)" text
+       (benchmark-elapse (dotimes (_ n) (format "%s" text))))
+      (character-bench--report
+       "  string-as-multibyte" bytes
+       (benchmark-elapse (dotimes (_ n) (string-as-multibyte bytes))))
+      (character-bench--report
+       "  string-to-multibyte" bytes
+       (benchmark-elapse (dotimes (_ n) (string-to-multibyte bytes))))
+      (garbage-collect))))
+
+(character-bench-run)
+
+;;; character-bench.el ends here
@@ -0,0 +1,69 @@
+;;; decode-bench.el --- benchmark decoding of large files  -*- lexical-binding: t -*-
+
+;; Copyright (C) 2013 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Commentary:
+
+;; Report the throughput, in megabytes per second, of
+;; `insert-file-contents' on a large file with non-ASCII text, for
+;; several coding systems and values of `decoding-threads'.  Run it
+;; with
+;;
+;;   emacs -Q --batch -l test/benchmarks/decode-bench.el
+
+;;; Code:
+
+(require 'benchmark)
+
+(defvar decode-bench-size (* 256 1024 1024)
+  "Approximate size in bytes of the generated file.")
+
+(defvar decode-bench-threads '(1 2 4 8)
+  "Values of `decoding-threads' to try.")
+
+(defun decode-bench-run ()
+  "Run the decoding benchmarks and print the results."
+  (let ((file (make-temp-file "decode-bench"))
+	(line "0000042 INFO  requête servie en 17 ms, à 12:00\n"))
+    (unwind-protect
+	(progn
+	  (with-temp-buffer
+	    (dotimes (_ 4096)
+	      (insert line))
+	    (let ((coding-system-for-write 'utf-8-unix))
+	      (write-region nil nil file nil 0)
+	      (dotimes (_ (1- (/ decode-bench-size (buffer-size))))
+		(write-region nil nil file t 0))))
+	  (message "File of %d bytes" (nth 7 (file-attributes file)))
+	  (dolist (coding '(undecided utf-8-unix latin-1-unix raw-text-unix))
+	    (dolist (threads decode-bench-threads)
+	      (let ((seconds
+		     (benchmark-elapse
+		       (with-temp-buffer
+			 (let ((coding-system-for-read coding)
+			       (decoding-threads threads))
+			   (insert-file-contents file))))))
+		(message "%-16s %2d threads %8.1f MB/s" coding threads
+			 (/ (nth 7 (file-attributes file))
+			    (* 1024.0 1024.0 seconds))))
+	      (garbage-collect))))
+      (delete-file file))))
+
+(decode-bench-run)
+
+;;; decode-bench.el ends here
@@ -0,0 +1,96 @@
+;;; dired-bench.el --- benchmark listing directory trees  -*- lexical-binding: t -*-
+
+;; Copyright (C) 2013 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Commentary:
+
+;; Generate a tree of `dired-bench-files' files and time listing it,
+;; with its attributes, from Lisp with `directory-files' and
+;; `directory-files-and-attributes', then with
+;; `directory-files-recursively'.  Run it with
+;;
+;;   emacs -Q --batch -l test/benchmarks/dired-bench.el
+
+;;; Code:
+
+(require 'benchmark)
+
+(defvar dired-bench-files 100000
+  "Number of files in the generated tree.")
+
+(defvar dired-bench-files-per-directory 1000
+  "Number of files in each directory of the generated tree.")
+
+(defun dired-bench--make-tree (dir)
+  "Fill DIR with the files to list."
+  (dotimes (i (/ dired-bench-files dired-bench-files-per-directory))
+    (let ((subdir (expand-file-name (format "d%03d/sub" i) dir)))
+      (make-directory subdir t)
+      (dotimes (j dired-bench-files-per-directory)
+	(write-region "" nil (expand-file-name (format "f%04d.c" j) subdir)
+		      nil 'silent)))))
+
+(defun dired-bench--lisp-walk (dir)
+  "List DIR and its subdirectories with `directory-files'."
+  (let (files)
+    (dolist (file (directory-files dir t "\\`[^.]" t))
+      (if (file-directory-p file)
+	  (setq files (nconc (dired-bench--lisp-walk file) files))
+	(push (cons file (file-attributes file 'string)) files)))
+    files))
+
+(defun dired-bench--lisp-walk-attributes (dir)
+  "List DIR and its subdirectories with `directory-files-and-attributes'."
+  (let (files)
+    (dolist (file (directory-files-and-attributes dir t "\\`[^.]" t 'string))
+      (if (eq (nth 1 file) t)
+	  (setq files (nconc (dired-bench--lisp-walk-attributes (car file))
+			     files))
+	(push file files)))
+    files))
+
+(defun dired-bench-run ()
+  "Run the directory listing benchmarks and print the results."
+  (let ((dir (make-temp-file "dired-bench" t)))
+    (unwind-protect
+	(progn
+	  (dired-bench--make-tree dir)
+	  (dolist (test
+		   `(("directory-files, file-attributes"
+		      ,(lambda () (dired-bench--lisp-walk dir)))
+		     ("directory-files-and-attributes"
+		      ,(lambda () (dired-bench--lisp-walk-attributes dir)))
+		     ("directory-files-recursively, names"
+		      ,(lambda () (directory-files-recursively dir)))
+		     ("directory-files-recursively, size"
+		      ,(lambda () (directory-files-recursively
+				   dir nil nil '(size))))
+		     ("directory-files-recursively, all"
+		      ,(lambda () (directory-files-recursively
+				   dir nil nil t 'string)))))
+	    (garbage-collect)
+	    (let (files)
+	      (message "%-36s %8.3f s for %d files" (car test)
+		       (benchmark-elapse
+			 (setq files (funcall (cadr test))))
+		       (length files)))))
+      (delete-directory dir t))))
+
+(dired-bench-run)
+
+;;; dired-bench.el ends here
@@ -0,0 +1,88 @@
+;;; edit-bench.el --- benchmark making many replacements in a buffer  -*- lexical-binding: t -*-
+
+;; Copyright (C) 2013 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Commentary:
+
+;; Time replacing a word in every line of a buffer that has markers
+;; all over it and an `after-change-functions' hook, once with a
+;; `replace-match' loop and once with a single call to
+;; `replace-regions'.  Run it with
+;;
+;;   emacs -Q --batch -l test/benchmarks/edit-bench.el
+
+;;; Code:
+
+(require 'benchmark)
+
+(defvar edit-bench-lines 100000
+  "Number of lines of the buffer.")
+
+(defvar edit-bench-markers 2000
+  "Number of markers in the buffer.")
+
+(defvar edit-bench-hook-calls 0)
+
+(defun edit-bench--after-change (_beg _end _len)
+  (setq edit-bench-hook-calls (1+ edit-bench-hook-calls)))
+
+(defun edit-bench--buffer ()
+  "Fill the current buffer and put markers in it."
+  (dotimes (_ edit-bench-lines)
+    (insert "0000042 INFO  request served in 17 ms\n"))
+  (let ((step (/ (point-max) edit-bench-markers)))
+    (dotimes (i edit-bench-markers)
+      (copy-marker (1+ (* i step)))))
+  (add-hook 'after-change-functions #'edit-bench--after-change nil t))
+
+(defun edit-bench--time (what function)
+  "Call FUNCTION and report how long it took, under the name WHAT."
+  (setq edit-bench-hook-calls 0)
+  (let ((seconds (benchmark-elapse (funcall function))))
+    (message "%-24s %7.3f s, %6d hook calls" what seconds
+	     edit-bench-hook-calls)))
+
+(defun edit-bench-run ()
+  "Run the editing benchmarks and print the results."
+  (let (expected edits)
+    (with-temp-buffer
+      (edit-bench--buffer)
+      (edit-bench--time
+       "replace-match loop"
+       (lambda ()
+	 (goto-char (point-min))
+	 (while (search-forward "INFO" nil t)
+	   (replace-match "DEBUG" t t))))
+      (setq expected (buffer-string)))
+    (with-temp-buffer
+      (edit-bench--buffer)
+      (edit-bench--time
+       "collecting the edits"
+       (lambda ()
+	 (goto-char (point-min))
+	 (while (search-forward "INFO" nil t)
+	   (push (list (match-beginning 0) (match-end 0) "DEBUG") edits))))
+      (edit-bench--time
+       "replace-regions"
+       (lambda () (replace-regions edits)))
+      (unless (equal (buffer-string) expected)
+	(error "The results differ")))))
+
+(edit-bench-run)
+
+;;; edit-bench.el ends here
@@ -0,0 +1,105 @@
+;;; fast-load-bench.el --- benchmark loading fast-load files  -*- lexical-binding: t -*-
+
+;; Copyright (C) 2013 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Commentary:
+
+;; Copy the compiled files of `fast-load-bench-libraries' to a
+;; temporary directory, write their fast-load files, then compare the
+;; time taken and the objects allocated by loading them from the .elc
+;; files and from the fast-load files.  Run it with
+;;
+;;   emacs -Q --batch -l test/benchmarks/fast-load-bench.el
+
+;;; Code:
+
+(require 'benchmark)
+(require 'bytecomp)
+
+(defvar fast-load-bench-libraries
+  '("org" "gnus-sum" "message" "cc-engine" "calendar")
+  "Libraries to load.")
+
+(defvar fast-load-bench-repeat 10
+  "Number of times to load each library.")
+
+(defun fast-load-bench--copy (dir)
+  "Copy the compiled files of `fast-load-bench-libraries' to DIR.
+Write their fast-load files too, and return the copies."
+  (let (files)
+    (dolist (library fast-load-bench-libraries)
+      (let ((file (locate-library (concat library ".elc") t)))
+	(if (not file)
+	    (message "%s.elc not found, skipped" library)
+	  (let ((copy (expand-file-name (file-name-nondirectory file) dir)))
+	    (copy-file file copy nil t)
+	    (byte-compile-write-fast-load-file copy)
+	    (push copy files)))))
+    (nreverse files)))
+
+(defun fast-load-bench--load (files fast)
+  "Load FILES `fast-load-bench-repeat' times.
+Use their fast-load files if FAST is non-nil.  Return the seconds
+taken and the differences of `memory-use-counts' as a list."
+  (let ((load-use-fast-load-files fast)
+	before time)
+    (garbage-collect)
+    (setq before (memory-use-counts))
+    (setq time (benchmark-elapse
+		 (dotimes (_ fast-load-bench-repeat)
+		   (dolist (file files)
+		     (load file nil t t)))))
+    (let ((after (memory-use-counts))
+	  counts)
+      (while after
+	(push (- (pop after) (pop before)) counts))
+      (cons time (nreverse counts)))))
+
+(defun fast-load-bench-run ()
+  "Run the fast-load benchmarks and print the results."
+  (let ((dir (make-temp-file "fast-load-bench" t)))
+    (unwind-protect
+	(let* ((files (fast-load-bench--copy dir))
+	       (size (lambda (suffix)
+		       (/ (apply #'+ (mapcar (lambda (file)
+					       (nth 7 (file-attributes
+						       (concat (substring file 0 -1)
+							       suffix))))
+					     files))
+			  1024))))
+	  ;; Load everything once first, for the libraries they require.
+	  (dolist (file files)
+	    (load file nil t t))
+	  (message "%d files, %d KB of .elc, %d KB of .elb, loaded %d times"
+		   (length files) (funcall size "c") (funcall size "b")
+		   fast-load-bench-repeat)
+	  (message "%-5s %8s %10s %10s %10s %10s"
+		   "" "seconds" "conses" "vectors" "strings" "string bytes")
+	  (dolist (fast '(nil t))
+	    (let ((result (fast-load-bench--load files fast)))
+	      ;; `memory-use-counts' returns CONSES FLOATS VECTOR-CELLS
+	      ;; SYMBOLS STRING-CHARS MISCS INTERVALS STRINGS.
+	      (message "%-5s %8.3f %10d %10d %10d %10d"
+		       (if fast ".elb" ".elc")
+		       (car result) (nth 1 result) (nth 3 result)
+		       (nth 8 result) (nth 5 result)))))
+      (delete-directory dir t))))
+
+(fast-load-bench-run)
+
+;;; fast-load-bench.el ends here
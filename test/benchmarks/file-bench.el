@@ -0,0 +1,85 @@
+;;; file-bench.el --- benchmark visiting large files  -*- lexical-binding: t -*-
+
+;; Copyright (C) 2013 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Commentary:
+
+;; Generate large log files, ASCII and UTF-8, and time reading them
+;; with `insert-file-contents' with and without automatic detection of
+;; the coding system, and visiting them with `find-file' up to the end
+;; of the first redisplay.  In batch mode there is no redisplay, so
+;; for that figure run it interactively:
+;;
+;;   emacs -Q --batch -l test/benchmarks/file-bench.el
+;;   emacs -Q -l test/benchmarks/file-bench.el
+;;
+;; Set `file-bench-size' to 1 GB or more to look at huge files.
+
+;;; Code:
+
+(require 'benchmark)
+
+(defvar file-bench-size (* 256 1024 1024)
+  "Approximate size in bytes of the generated files.")
+
+(defun file-bench--generate (file line)
+  "Write to FILE copies of LINE up to `file-bench-size' bytes."
+  (let ((coding-system-for-write 'utf-8-unix)
+	(count (/ file-bench-size (string-bytes line))))
+    (with-temp-buffer
+      (dotimes (_ (min count 4096))
+	(insert line))
+      (write-region nil nil file nil 0)
+      (dotimes (_ (1- (/ count 4096)))
+	(write-region nil nil file t 0)))))
+
+(defun file-bench--report (what file seconds)
+  (message "%-40s %7.3f s %8.1f MB/s" what seconds
+	   (/ (nth 7 (file-attributes file)) (* 1024.0 1024.0 seconds))))
+
+(defun file-bench-run ()
+  "Run the file visiting benchmarks and print the results."
+  (dolist (sample '(("ASCII" . "0000042 INFO  request served in 17 ms\n")
+		    ("UTF-8" . "0000042 INFO  requête servie en 17 ms\n")))
+    (let ((file (make-temp-file "file-bench")))
+      (unwind-protect
+	  (progn
+	    (file-bench--generate file (cdr sample))
+	    (message "%s, %d bytes:" (car sample) (nth 7 (file-attributes file)))
+	    (dolist (coding '(undecided utf-8-unix))
+	      (file-bench--report
+	       (format "  insert-file-contents, %s" coding) file
+	       (benchmark-elapse
+		 (with-temp-buffer
+		   (let ((coding-system-for-read coding))
+		     (insert-file-contents file)))))
+	      (garbage-collect))
+	    (let ((large-file-warning-threshold nil)
+		  buffer)
+	      (file-bench--report
+	       "  find-file and first redisplay" file
+	       (benchmark-elapse
+		 (setq buffer (find-file file))
+		 (redisplay t)))
+	      (kill-buffer buffer)
+	      (garbage-collect)))
+	(delete-file file)))))
+
+(file-bench-run)
+
+;;; file-bench.el ends here
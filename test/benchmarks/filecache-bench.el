@@ -0,0 +1,79 @@
+;;; filecache-bench.el --- benchmark the cache of file attributes  -*- lexical-binding: t -*-
+
+;; Copyright (C) 2013 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Commentary:
+
+;; Generate a tree of `filecache-bench-files' files, then ask for the
+;; attributes of each of them, and whether files next to them exist,
+;; `filecache-bench-rounds' times, with and without
+;; `file-attribute-cache'.  Run it with
+;;
+;;   emacs -Q --batch -l test/benchmarks/filecache-bench.el
+
+;;; Code:
+
+(require 'benchmark)
+
+(defvar filecache-bench-files 2000
+  "Number of files in the generated tree.")
+
+(defvar filecache-bench-rounds 20
+  "Number of times to look at each file.")
+
+(defun filecache-bench--make-tree (dir)
+  "Fill DIR with the files to look at, and return their names."
+  (let (files)
+    (dotimes (i filecache-bench-files)
+      (let ((file (expand-file-name (format "d%02d/sub/f%04d.el" (% i 20) i)
+				    dir)))
+	(make-directory (file-name-directory file) t)
+	(write-region "" nil file nil 'silent)
+	(push file files)))
+    files))
+
+(defun filecache-bench--look (files)
+  "Look at FILES the way `find-file' and version control do."
+  (dotimes (_ filecache-bench-rounds)
+    (dolist (file files)
+      (file-attributes file)
+      (file-exists-p (concat file "c"))
+      (file-directory-p (directory-file-name
+			 (file-name-directory file))))))
+
+(defun filecache-bench-run ()
+  "Run the file attribute cache benchmarks and print the results."
+  (let* ((dir (make-temp-file "filecache-bench" t))
+	 (files (filecache-bench--make-tree dir)))
+    (unwind-protect
+	(dolist (cache '(nil t))
+	  (let ((file-attribute-cache cache))
+	    (clear-file-attribute-cache)
+	    (garbage-collect)
+	    (let ((time (benchmark-elapse (filecache-bench--look files))))
+	      (message "%-8s %8.3f s, %6.2f us per call, statistics %S"
+		       (if cache "cached" "uncached") time
+		       (/ (* 1e6 time) (* 3 filecache-bench-rounds
+					  filecache-bench-files))
+		       (file-attribute-cache-statistics)))))
+      (delete-directory dir t)
+      (clear-file-attribute-cache))))
+
+(filecache-bench-run)
+
+;;; filecache-bench.el ends here
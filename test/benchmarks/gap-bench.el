@@ -0,0 +1,85 @@
+;;; gap-bench.el --- benchmark edits in large buffers  -*- lexical-binding: t -*-
+
+;; Copyright (C) 2013 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Commentary:
+
+;; Time series of edits that make the buffer gap move or grow in a
+;; large buffer: a search and replace that makes the text longer, and
+;; insertions that alternate between a few places of the buffer.  Also
+;; time filling a buffer chunk by chunk, as process output does, and
+;; show the resulting `buffer-gap-statistics'.  Run it with
+;;
+;;   emacs -Q --batch -l test/benchmarks/gap-bench.el
+
+;;; Code:
+
+(require 'benchmark)
+
+(defvar gap-bench-size (* 128 1024 1024)
+  "Approximate size in bytes of the buffer.")
+
+(defvar gap-bench-edits 2000
+  "Number of edits of each kind.")
+
+(defun gap-bench--report (what seconds)
+  (message "%-50s %8.3f s" what seconds))
+
+(defun gap-bench--fill ()
+  "Fill the current buffer with `gap-bench-size' bytes of log lines."
+  (let ((line "0000042 INFO  request served in 17 ms\n"))
+    (dotimes (_ (/ gap-bench-size (length line)))
+      (insert line))))
+
+(defun gap-bench-run ()
+  "Run the buffer gap benchmarks and print the results."
+  (with-temp-buffer
+    (buffer-disable-undo)
+    (let ((chunk (make-string 4096 ?x)))
+      (gap-bench--report
+       "insert 4 KB chunks up to 64 MB"
+       (benchmark-elapse
+	 (dotimes (_ (/ (* 64 1024 1024) (length chunk)))
+	   (insert chunk)))))
+    (message "  gap moves, bytes moved, reallocations: %S"
+	     (buffer-gap-statistics)))
+  (with-temp-buffer
+    (buffer-disable-undo)
+    (gap-bench--fill)
+    (message "Buffer of %d bytes" (buffer-size))
+    (goto-char (point-min))
+    (gap-bench--report
+     (format "replace x %d, growing the text" gap-bench-edits)
+     (benchmark-elapse
+       (dotimes (_ gap-bench-edits)
+	 (search-forward "INFO")
+	 (replace-match "INFORMATION" t t))))
+    (dolist (places '(2 8))
+      (garbage-collect)
+      (gap-bench--report
+       (format "insert x %d, alternating between %d places"
+	       gap-bench-edits places)
+       (let ((step (/ (buffer-size) places)))
+	 (benchmark-elapse
+	   (dotimes (i gap-bench-edits)
+	     (goto-char (1+ (* (% i places) step)))
+	     (insert "x"))))))))
+
+(gap-bench-run)
+
+;;; gap-bench.el ends here
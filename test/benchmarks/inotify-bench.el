@@ -0,0 +1,88 @@
+;;; inotify-bench.el --- benchmark handling storms of file events  -*- lexical-binding: t -*-
+
+;; Copyright (C) 2013 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Commentary:
+
+;; Watch a directory, append to its files `inotify-bench-writes' times
+;; from a shell, as a build or a checkout would, and time how long
+;; Emacs takes to pass the events to the callback, with and without
+;; merging them.  Emacs only reads file events while it waits for
+;; input, so this does not work in batch mode; run it with
+;;
+;;   emacs -Q -nw -l test/benchmarks/inotify-bench.el 2>results
+;;
+;; and read the results from the error output once Emacs exits.
+
+;;; Code:
+
+(defvar inotify-bench-files 10
+  "Number of files to write to.")
+
+(defvar inotify-bench-writes 2000
+  "Number of times to append to each file.")
+
+(defun inotify-bench--print (format-string &rest args)
+  "Print FORMAT-STRING with ARGS to the error output."
+  (princ (concat (apply #'format format-string args) "\n")
+	 #'external-debugging-output))
+
+(defun inotify-bench--run (delays dir)
+  "Run the benchmark in DIR for each of DELAYS, then exit."
+  (if (null delays)
+      (progn
+	(delete-directory dir t)
+	(kill-emacs 0))
+    (let* ((inotify-coalesce-delay (car delays))
+	   (calls 0)
+	   (stats (inotify-event-statistics))
+	   (wd (inotify-add-watch dir '(create modify close-write)
+				  (lambda (_event) (setq calls (1+ calls)))))
+	   (start (float-time))
+	   (proc (start-process
+		  "writer" nil "sh" "-c"
+		  (format "cd %s; i=0; while [ $i -lt %d ]; do
+			     for f in $(seq %d); do echo $i >>$f; done
+			     i=$((i+1)); done"
+			  (shell-quote-argument dir) inotify-bench-writes
+			  inotify-bench-files)))
+	   last)
+      (set-process-sentinel proc #'ignore)
+      ;; Handle events until the writer is done and none have come
+      ;; for 0.2 seconds.
+      (while (or (process-live-p proc) (not (eql last calls)))
+	(setq last calls)
+	(sit-for 0.2 'nodisplay))
+      (let ((now (inotify-event-statistics)))
+	(inotify-bench--print
+	 "delay %-5s %6d events read, %6d delivered in %6d input events, %.3f s"
+	 (car delays)
+	 (- (nth 0 now) (nth 0 stats)) (- (nth 1 now) (nth 1 stats))
+	 (- (nth 2 now) (nth 2 stats))
+	 (- (float-time) start 0.2)))
+      (inotify-rm-watch wd)
+      (run-with-timer 0.1 nil #'inotify-bench--run (cdr delays) dir))))
+
+(defun inotify-bench-run ()
+  "Run the file event benchmarks, print the results and exit."
+  (inotify-bench--run (list 0 inotify-coalesce-delay)
+		      (make-temp-file "inotify-bench" t)))
+
+(run-with-timer 0.5 nil #'inotify-bench-run)
+
+;;; inotify-bench.el ends here
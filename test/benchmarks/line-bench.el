@@ -0,0 +1,73 @@
+;;; line-bench.el --- benchmark line counting  -*- lexical-binding: t -*-
+
+;; Copyright (C) 2013 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Commentary:
+
+;; Time `line-number-at-pos' and `forward-line' at random places of a
+;; large log-like buffer, with `cache-long-scans' off and on, and with
+;; edits between the queries.  Run it with
+;;
+;;   emacs -Q --batch -l test/benchmarks/line-bench.el
+
+;;; Code:
+
+(require 'benchmark)
+
+(defvar line-bench-lines 1000000
+  "Number of lines in the buffer.")
+
+(defvar line-bench-queries 200
+  "Number of queries of each kind.")
+
+(defun line-bench--report (what seconds)
+  (message "%-50s %8.3f s" what seconds))
+
+(defun line-bench--queries (n)
+  "Run N `line-number-at-pos' and `forward-line' queries."
+  (let ((size (buffer-size)))
+    (dotimes (_ n)
+      (line-number-at-pos (1+ (random size)))
+      (goto-char (1+ (random size)))
+      (forward-line (- (random 200000) 100000)))))
+
+(defun line-bench-run ()
+  "Run the line counting benchmarks and print the results."
+  (with-temp-buffer
+    (random "line-bench")
+    (dotimes (i line-bench-lines)
+      (insert (format "%07d INFO  request served in %d ms\n" i (random 1000))))
+    (message "Buffer of %d lines, %d bytes" line-bench-lines
+	     (position-bytes (point-max)))
+    (dolist (cache '(nil t))
+      (setq cache-long-scans cache)
+      (line-bench--report
+       (format "queries x %d, cache-long-scans %s" line-bench-queries cache)
+       (car (benchmark-run 1 (line-bench--queries line-bench-queries))))
+      (line-bench--report
+       (format "edit + queries x %d, cache-long-scans %s"
+	       line-bench-queries cache)
+       (car (benchmark-run 1
+	      (dotimes (_ line-bench-queries)
+		(goto-char (1+ (random (buffer-size))))
+		(insert "inserted line\n")
+		(line-bench--queries 1))))))))
+
+(line-bench-run)
+
+;;; line-bench.el ends here
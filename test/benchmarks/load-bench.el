@@ -0,0 +1,77 @@
+;;; load-bench.el --- benchmark loading compiled files  -*- lexical-binding: t -*-
+
+;; Copyright (C) 2013 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Commentary:
+
+;; Time loading `load-bench-libraries', large compiled files, the way
+;; a startup file does, then time only reading them.  Each file is
+;; loaded `load-bench-repeat' times, so the first load, which also
+;; pulls in other libraries, weighs little.  Run it with
+;;
+;;   emacs -Q --batch -l test/benchmarks/load-bench.el
+
+;;; Code:
+
+(require 'benchmark)
+
+(defvar load-bench-libraries
+  '("org" "gnus-sum" "message" "cc-engine" "calendar")
+  "Libraries to load.")
+
+(defvar load-bench-repeat 10
+  "Number of times to load each library.")
+
+(defun load-bench--files ()
+  "Return the compiled files of `load-bench-libraries' that exist."
+  (let (files)
+    (dolist (library load-bench-libraries)
+      (let ((file (locate-library (concat library ".elc") t)))
+	(if file
+	    (push file files)
+	  (message "%s.elc not found, skipped" library))))
+    (nreverse files)))
+
+(defun load-bench--time (files)
+  "Load FILES `load-bench-repeat' times and return the seconds taken."
+  (garbage-collect)
+  (benchmark-elapse
+    (dotimes (_ load-bench-repeat)
+      (dolist (file files)
+	(load file nil t t)))))
+
+(defun load-bench-run ()
+  "Run the loading benchmarks and print the results."
+  (let* ((files (load-bench--files))
+	 (bytes (apply #'+ (mapcar (lambda (file)
+				     (nth 7 (file-attributes file)))
+				   files))))
+    ;; Load everything once first, for the libraries they require.
+    (dolist (file files)
+      (load file nil t t))
+    (message "load %d files, %d KB, %d times: %8.3f s"
+	     (length files) (/ bytes 1024) load-bench-repeat
+	     (load-bench--time files))
+    (let ((load-read-function (lambda (stream) (read stream) nil)))
+      (message "read %d files, %d KB, %d times: %8.3f s"
+	       (length files) (/ bytes 1024) load-bench-repeat
+	       (load-bench--time files)))))
+
+(load-bench-run)
+
+;;; load-bench.el ends here
@@ -0,0 +1,95 @@
+;;; obarray-bench.el --- benchmark interning and reading symbols  -*- lexical-binding: t -*-
+
+;; Copyright (C) 2013 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Commentary:
+
+;; Intern `obarray-bench-count' new symbols in the initial obarray,
+;; then time looking them up with `intern-soft' and `intern', reading
+;; them, mapping over the obarray and completing over it.  Run it with
+;;
+;;   emacs -Q --batch -l test/benchmarks/obarray-bench.el
+
+;;; Code:
+
+(require 'benchmark)
+
+(defvar obarray-bench-count 100000
+  "Number of symbols to intern.")
+
+(defvar obarray-bench-repeat 10
+  "Number of times to repeat each measurement.")
+
+(defun obarray-bench--time (name function)
+  "Print the time taken by `obarray-bench-repeat' calls of FUNCTION.
+NAME describes the measurement."
+  (garbage-collect)
+  (message "%-22s %8.3f s"
+           name
+           (benchmark-elapse
+             (dotimes (_ obarray-bench-repeat)
+               (funcall function)))))
+
+(defun obarray-bench-run ()
+  "Run the obarray benchmarks and print the results."
+  (let* ((names (mapcar (lambda (i) (format "obarray-bench-symbol-%d" i))
+                        (number-sequence 1 obarray-bench-count)))
+         (text (mapconcat #'identity names " "))
+         symbols)
+    (garbage-collect)
+    (message "%-22s %8.3f s"
+             (format "intern %d new" obarray-bench-count)
+             (benchmark-elapse
+               (setq symbols (mapcar #'intern names))))
+    (message "%d symbols, %d buckets"
+             (let ((n 0))
+               (mapatoms (lambda (_) (setq n (1+ n))))
+               n)
+             (length obarray))
+    (obarray-bench--time "intern-soft"
+                         (lambda ()
+                           (dolist (name names)
+                             (intern-soft name))))
+    (obarray-bench--time "intern-soft missing"
+                         (lambda ()
+                           (dolist (name names)
+                             (intern-soft (concat name "x")))))
+    (obarray-bench--time "intern existing"
+                         (lambda ()
+                           (dolist (name names)
+                             (intern name))))
+    (obarray-bench--time "read"
+                         (lambda ()
+                           (with-temp-buffer
+                             (insert text)
+                             (goto-char (point-min))
+                             (condition-case nil
+                                 (while t
+                                   (read (current-buffer)))
+                               (end-of-file nil)))))
+    (obarray-bench--time "mapatoms"
+                         (lambda ()
+                           (mapatoms #'ignore)))
+    (obarray-bench--time "all-completions"
+                         (lambda ()
+                           (all-completions "obarray-bench-symbol-1" obarray)))
+    (length symbols)))
+
+(obarray-bench-run)
+
+;;; obarray-bench.el ends here
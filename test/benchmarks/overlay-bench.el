@@ -0,0 +1,107 @@
+;;; overlay-bench.el --- benchmark overlay lookups  -*- lexical-binding: t -*-
+
+;; Copyright (C) 2013 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Commentary:
+
+;; Time `overlays-at', `overlays-in' and `next-overlay-change' in a
+;; buffer with 10^5 overlays, with and without edits between the
+;; queries, and the insertions and deletions themselves.  Run it with
+;;
+;;   emacs -Q --batch -l test/benchmarks/overlay-bench.el
+
+;;; Code:
+
+(require 'benchmark)
+
+(defvar overlay-bench-count 100000
+  "Number of overlays to create.")
+
+(defvar overlay-bench-queries 10000
+  "Number of queries of each kind.")
+
+(defun overlay-bench--report (what seconds)
+  (message "%-40s %8.3f s" what seconds))
+
+(defun overlay-bench-run ()
+  "Run the overlay benchmarks and print the results."
+  (with-temp-buffer
+    (insert (make-string (* 10 overlay-bench-count) ?x))
+    (random "overlay-bench")
+    ;; Create the overlays from the end of the buffer backward, with
+    ;; the overlay center at the beginning, which keeps `make-overlay'
+    ;; itself cheap.
+    (overlay-recenter (point-min))
+    (overlay-bench--report
+     (format "make-overlay x %d" overlay-bench-count)
+     (car (benchmark-run 1
+	    (let ((beg (point-max)))
+	      (dotimes (_ overlay-bench-count)
+		(setq beg (max 1 (- beg (random 20))))
+		(make-overlay beg (min (point-max) (+ beg (random 200)))))))))
+    (let ((size (buffer-size))
+	  (n overlay-bench-queries))
+      (overlay-bench--report
+       (format "overlays-at x %d" n)
+       (car (benchmark-run 1
+	      (dotimes (_ n)
+		(overlays-at (1+ (random size)))))))
+      (overlay-bench--report
+       (format "overlays-in (100 chars) x %d" n)
+       (car (benchmark-run 1
+	      (dotimes (_ n)
+		(let ((beg (1+ (random size))))
+		  (overlays-in beg (min (point-max) (+ beg 100))))))))
+      (overlay-bench--report
+       (format "next-overlay-change x %d" n)
+       (car (benchmark-run 1
+	      (dotimes (_ n)
+		(next-overlay-change (1+ (random size)))))))
+      ;; Each edit still goes through the overlay lists and the
+      ;; markers of the buffer, so it takes time linear in the number
+      ;; of overlays, whether the index is used or not.
+      (overlay-bench--report
+       (format "insert x %d" (/ n 10))
+       (car (benchmark-run 1
+	      (dotimes (_ (/ n 10))
+		(goto-char (1+ (random size)))
+		(insert "y")))))
+      (overlay-bench--report
+       (format "delete-char x %d" (/ n 10))
+       (car (benchmark-run 1
+	      (dotimes (_ (/ n 10))
+		(goto-char (1+ (random size)))
+		(delete-char 1)))))
+      (overlay-bench--report
+       (format "insert + overlays-at x %d" (/ n 10))
+       (car (benchmark-run 1
+	      (dotimes (_ (/ n 10))
+		(goto-char (1+ (random size)))
+		(insert "y")
+		(overlays-at (point))))))
+      (overlay-bench--report
+       (format "delete-char + overlays-at x %d" (/ n 10))
+       (car (benchmark-run 1
+	      (dotimes (_ (/ n 10))
+		(goto-char (1+ (random size)))
+		(delete-char 1)
+		(overlays-at (point)))))))))
+
+(overlay-bench-run)
+
+;;; overlay-bench.el ends here
@@ -0,0 +1,85 @@
+;;; process-bench.el --- benchmark reading output from a process  -*- lexical-binding: t -*-
+
+;; Copyright (C) 2013 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Commentary:
+
+;; Time `cat' writing a large file into a process buffer, through a
+;; pipe and through a pty, with a few coding systems, and with a
+;; filter that inserts the output itself.  Run it with
+;;
+;;   emacs -Q --batch -l test/benchmarks/process-bench.el
+
+;;; Code:
+
+(require 'benchmark)
+
+(defvar process-bench-megabytes 64
+  "Size of the file to read, in megabytes.")
+
+(defun process-bench--make-file (file)
+  "Write `process-bench-megabytes' of mostly ASCII text to FILE."
+  (with-temp-buffer
+    (dotimes (i 1024)
+      (insert (format "%06d le café est prêt, request served in 17 ms\n" i)))
+    (let ((chunk (buffer-string)))
+      (dotimes (_ (1- (/ (* process-bench-megabytes 1024 1024)
+			 (string-bytes chunk))))
+	(insert chunk)))
+    (let ((coding-system-for-write 'utf-8-unix))
+      (write-region nil nil file nil 'silent))))
+
+(defun process-bench--filter (proc string)
+  (with-current-buffer (process-buffer proc)
+    (goto-char (point-max))
+    (insert string)))
+
+(defun process-bench--read (file coding connection-type filter)
+  "Read FILE through `cat' and return the megabytes per second."
+  (with-temp-buffer
+    (let* ((process-connection-type connection-type)
+	   (proc (start-process "cat" (current-buffer) "cat" file))
+	   (size (nth 7 (file-attributes file))))
+      (set-process-coding-system proc coding coding)
+      (when filter
+	(set-process-filter proc #'process-bench--filter))
+      (set-process-sentinel proc #'ignore)
+      (/ (/ size 1048576.0)
+	 (benchmark-elapse
+	   (while (process-live-p proc)
+	     (accept-process-output proc 1))
+	   (while (accept-process-output proc 0 100)))))))
+
+(defun process-bench-run ()
+  "Run the process output benchmarks and print the results."
+  (let ((file (make-temp-file "process-bench")))
+    (unwind-protect
+	(progn
+	  (process-bench--make-file file)
+	  (dolist (connection-type '(nil t))
+	    (dolist (coding '(utf-8-unix utf-8 raw-text latin-1))
+	      (message "%-4s %-10s %8.1f MB/s"
+		       (if connection-type "pty" "pipe") coding
+		       (process-bench--read file coding connection-type nil))))
+	  (message "%-4s %-10s %8.1f MB/s with a filter" "pipe" 'utf-8
+		   (process-bench--read file 'utf-8 nil t)))
+      (delete-file file))))
+
+(process-bench-run)
+
+;;; process-bench.el ends here
@@ -0,0 +1,87 @@
+;;; send-bench.el --- benchmark sending input to a process  -*- lexical-binding: t -*-
+
+;; Copyright (C) 2013 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Commentary:
+
+;; Send a large string, then many small ones, to a process that
+;; throws its input away, with and without a callback.  For the large
+;; string, time both how long `process-send-string' takes to return
+;; and how long the process takes to read all of it.  Run it with
+;;
+;;   emacs -Q --batch -l test/benchmarks/send-bench.el
+
+;;; Code:
+
+(require 'benchmark)
+
+(defvar send-bench-megabytes 64
+  "Size of the large string, in megabytes.")
+
+(defvar send-bench-small-strings 100000
+  "Number of small strings to send.")
+
+(defun send-bench--start ()
+  "Start a process that reads its input and throws it away."
+  (let* ((process-connection-type nil)
+	 (proc (start-process "sink" nil "sh" "-c" "cat >/dev/null")))
+    (set-process-sentinel proc #'ignore)
+    proc))
+
+(defun send-bench--send (strings callback)
+  "Send STRINGS to a new process, with a callback if CALLBACK.
+Return the seconds taken by the sending calls and the total seconds
+taken until the process had all of STRINGS."
+  (let* ((proc (send-bench--start))
+	 (left (length strings))
+	 (done (lambda (_proc) (setq left (1- left))))
+	 (start (float-time))
+	 returned)
+    (unwind-protect
+	(progn
+	  (dolist (string strings)
+	    (if callback
+		(process-send-string proc string done)
+	      (process-send-string proc string)))
+	  (setq returned (- (float-time) start))
+	  (while (and callback (> left 0))
+	    (accept-process-output proc 0.001))
+	  (list returned (- (float-time) start)))
+      (delete-process proc))))
+
+(defun send-bench-run ()
+  "Run the process input benchmarks and print the results."
+  (let ((big (list (make-string (* send-bench-megabytes 1024 1024) ?a)))
+	(small (make-list send-bench-small-strings
+			  "a line of input to a REPL\n")))
+    (dolist (callback '(nil t))
+      (let ((times (send-bench--send big callback)))
+	(message "%d MB %-16s returned after %8.4f s, sent in %8.4f s"
+		 send-bench-megabytes
+		 (if callback "with a callback" "without")
+		 (nth 0 times) (nth 1 times))))
+    (dolist (callback '(nil t))
+      (let ((times (send-bench--send small callback)))
+	(message "%d strings %-16s %8.1f us per string"
+		 send-bench-small-strings
+		 (if callback "with a callback" "without")
+		 (/ (* 1e6 (nth 1 times)) send-bench-small-strings))))))
+
+(send-bench-run)
+
+;;; send-bench.el ends here
@@ -0,0 +1,79 @@
+;;; spawn-bench.el --- benchmark starting subprocesses  -*- lexical-binding: t -*-
+
+;; Copyright (C) 2013 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Commentary:
+
+;; Run `true' many times with `call-process', and start it many times
+;; with `start-process', with and without `process-use-posix-spawn',
+;; first in a fresh Emacs, then after growing its heap by
+;; `spawn-bench-heap-megabytes'.  Run it with
+;;
+;;   emacs -Q --batch -l test/benchmarks/spawn-bench.el
+
+;;; Code:
+
+(require 'benchmark)
+
+(defvar spawn-bench-count 2000
+  "Number of processes to start for each measurement.")
+
+(defvar spawn-bench-heap-megabytes 1024
+  "Megabytes to add to the heap for the second round of measurements.")
+
+(defun spawn-bench--call ()
+  "Run `true' synchronously."
+  (call-process "true"))
+
+(defun spawn-bench--start ()
+  "Start `true' asynchronously and wait for it to exit."
+  (let* ((process-connection-type nil)
+	 (proc (start-process "true" nil "true")))
+    (set-process-sentinel proc #'ignore)
+    (while (process-live-p proc)
+      (accept-process-output proc 1))))
+
+(defun spawn-bench--round (heap)
+  "Time starting processes, printing HEAP to describe the heap size."
+  (dolist (posix-spawn '(nil t))
+    (let ((process-use-posix-spawn posix-spawn))
+      (dolist (test `(("call-process" ,#'spawn-bench--call)
+		      ("start-process" ,#'spawn-bench--start)))
+	(garbage-collect)
+	(let ((time (benchmark-elapse
+		      (dotimes (_ spawn-bench-count)
+			(funcall (cadr test))))))
+	  (message "%-8s %-13s %-11s %8.1f us, %6.0f processes/s"
+		   heap (car test)
+		   (if posix-spawn "posix_spawn" "vfork")
+		   (/ (* 1e6 time) spawn-bench-count)
+		   (/ spawn-bench-count time)))))))
+
+(defun spawn-bench-run ()
+  "Run the process spawning benchmarks and print the results."
+  (spawn-bench--round "small")
+  (let* ((word-size (if (> most-positive-fixnum (expt 2 32)) 8 4))
+	 (heap (make-vector (/ (* spawn-bench-heap-megabytes 1024 1024)
+			       word-size)
+			    0)))
+    (spawn-bench--round (format "+%d MB" spawn-bench-heap-megabytes))
+    (length heap)))
+
+(spawn-bench-run)
+
+;;; spawn-bench.el ends here
@@ -0,0 +1,69 @@
+;;; undo-bench.el --- benchmark recording changes for undo  -*- lexical-binding: t -*-
+
+;; Copyright (C) 2013 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Commentary:
+
+;; Time a search and replace over a whole buffer, as one command, with
+;; `undo-packed-records' nil and t, and show how much of that time was
+;; spent in garbage collection.  Then time undoing it.  Run it with
+;;
+;;   emacs -Q --batch -l test/benchmarks/undo-bench.el
+
+;;; Code:
+
+(require 'benchmark)
+
+(defvar undo-bench-lines 400000
+  "Number of lines of the buffer.")
+
+(defun undo-bench--time (what function)
+  "Call FUNCTION and report how long it took, under the name WHAT."
+  (let* ((gcs gcs-done)
+	 (gc-time gc-elapsed)
+	 (seconds (benchmark-elapse (funcall function))))
+    (message "%-28s %7.3f s, %3d GCs in %7.3f s" what seconds
+	     (- gcs-done gcs) (- gc-elapsed gc-time))))
+
+(defun undo-bench-run ()
+  "Run the undo benchmarks and print the results."
+  (dolist (packed '(nil t))
+    (let ((undo-packed-records packed))
+      (message "undo-packed-records %s:" packed)
+      (with-temp-buffer
+	(buffer-enable-undo)
+	(dotimes (_ undo-bench-lines)
+	  (insert "0000042 INFO  request served in 17 ms\n"))
+	(setq buffer-undo-list nil)
+	(garbage-collect)
+	(undo-bench--time
+	 "  replace in every line"
+	 (lambda ()
+	   (goto-char (point-min))
+	   (while (search-forward "INFO" nil t)
+	     (replace-match "DEBUG" t t))
+	   (undo-boundary)))
+	(undo-bench--time
+	 "  undo it"
+	 ;; Skip the boundary at the front.
+	 (lambda () (primitive-undo 1 (cdr buffer-undo-list)))))
+      (garbage-collect))))
+
+(undo-bench-run)
+
+;;; undo-bench.el ends here
@@ -0,0 +1,84 @@
+;;; wakeup-bench.el --- benchmark waking up for process output  -*- lexical-binding: t -*-
+
+;; Copyright (C) 2013 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Commentary:
+
+;; Send a byte over a local socket and time how long Emacs takes to
+;; wake up and hand it to the filter, first with no other connections,
+;; then with `wakeup-bench-idle-sockets' sockets open that never say
+;; anything.  Run it with
+;;
+;;   emacs -Q --batch -l test/benchmarks/wakeup-bench.el
+
+;;; Code:
+
+(require 'benchmark)
+
+(defvar wakeup-bench-idle-sockets 1000
+  "Number of idle sockets to open, counting both ends of a connection.")
+
+(defvar wakeup-bench-rounds 20000
+  "Number of bytes to send one after the other.")
+
+(defun wakeup-bench--connect (socket accepted)
+  "Connect to SOCKET and wait for the server to accept.
+ACCEPTED is a cons whose car lists the accepted connections.
+Return the two ends of the connection."
+  (let ((n (length (car accepted)))
+	(client (make-network-process :name "client" :family 'local
+				      :service socket :sentinel #'ignore)))
+    (while (= (length (car accepted)) n)
+      (accept-process-output nil 0.01))
+    (list client (car (car accepted)))))
+
+(defun wakeup-bench--latency (idle-sockets)
+  "Return the microseconds taken per byte with IDLE-SOCKETS open."
+  (let* ((socket (make-temp-name
+		  (expand-file-name "wakeup-bench" temporary-file-directory)))
+	 (accepted (list nil))
+	 (server (make-network-process
+		  :name "server" :family 'local :service socket
+		  :server t :sentinel #'ignore :filter #'ignore
+		  :log (lambda (_server client _message)
+			 (push client (car accepted)))))
+	 (busy (wakeup-bench--connect socket accepted))
+	 (idle nil))
+    (unwind-protect
+	(progn
+	  (dotimes (_ (/ idle-sockets 2))
+	    (setq idle (nconc (wakeup-bench--connect socket accepted) idle)))
+	  (/ (* 1e6 (benchmark-elapse
+		      (dotimes (_ wakeup-bench-rounds)
+			(process-send-string (car busy) "x")
+			(accept-process-output (cadr busy) 1))))
+	     wakeup-bench-rounds))
+      (mapc #'delete-process busy)
+      (mapc #'delete-process idle)
+      (delete-process server)
+      (delete-file socket))))
+
+(defun wakeup-bench-run ()
+  "Run the wakeup benchmarks and print the results."
+  (dolist (idle-sockets (list 0 wakeup-bench-idle-sockets))
+    (message "%5d idle sockets %8.1f us per wakeup"
+	     idle-sockets (wakeup-bench--latency idle-sockets))))
+
+(wakeup-bench-run)
+
+;;; wakeup-bench.el ends here